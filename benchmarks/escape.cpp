@@ -0,0 +1,219 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/webstreambuf.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <random>
+#include <string>
+
+// Pushes user content like text through WebStreambuf with HTML and URL
+// encoding. The way it used to be done, with a std::map lookup for every
+// character, is replicated here for comparison. The text is written both in
+// small pieces and as one single multi-megabyte chunk.
+
+const unsigned int seed = 2026;
+const size_t volume = 16*1024*1024;
+const size_t bufferSize = 8192;
+const size_t chunkSize = 4096;
+
+//! Drops everything written to it
+template<class charT>
+class Sink: public Fastcgipp::WebStreambuf<charT>
+{
+public:
+    size_t written;
+
+    Sink():
+        written(0)
+    {
+        this->setp(m_buffer, m_buffer+bufferSize);
+    }
+
+private:
+    charT m_buffer[bufferSize];
+
+    bool emptyBuffer()
+    {
+        written += this->pptr()-this->pbase();
+        this->setp(m_buffer, m_buffer+bufferSize);
+        return true;
+    }
+};
+
+//! The way WebStreambuf used to escape
+template<class charT>
+size_t mapped(
+        const std::basic_string<charT>& text,
+        Fastcgipp::Encoding encoding)
+{
+    static const std::map<charT, const std::basic_string<charT>> html
+    {
+        {'"', std::basic_string<charT>{'&','q','u','o','t',';'}},
+        {'>', std::basic_string<charT>{'&','g','t',';'}},
+        {'<', std::basic_string<charT>{'&','l','t',';'}},
+        {'&', std::basic_string<charT>{'&','a','m','p',';'}},
+        {0x27, std::basic_string<charT>{'&','a','p','o','s',';'}}
+    };
+    static const std::map<charT, const std::basic_string<charT>> url = []()
+    {
+        static const char hex[] = "0123456789ABCDEF";
+        std::map<charT, const std::basic_string<charT>> map;
+        for(const char c: std::string("!][#?/,$+=&@:;)('*<>\" %"))
+            map.emplace(c, std::basic_string<charT>{
+                    '%',
+                    charT(hex[c>>4]),
+                    charT(hex[c&0x0f])});
+        return map;
+    }();
+
+    const auto& map = encoding == Fastcgipp::Encoding::HTML ? html : url;
+    charT buffer[bufferSize];
+    charT* position = buffer;
+    size_t written = 0;
+
+    for(const charT c: text)
+    {
+        const auto mapping = map.find(c);
+        if(mapping == map.cend())
+        {
+            if(position == buffer+bufferSize)
+            {
+                written += position-buffer;
+                position = buffer;
+            }
+            *position++ = c;
+        }
+        else
+        {
+            if(buffer+bufferSize-position < ptrdiff_t(mapping->second.size()))
+            {
+                written += position-buffer;
+                position = buffer;
+            }
+            position = std::copy(
+                    mapping->second.cbegin(),
+                    mapping->second.cend(),
+                    position);
+        }
+    }
+
+    return written + (position-buffer);
+}
+
+//! The way WebStreambuf does it now
+template<class charT>
+size_t tabled(
+        const std::basic_string<charT>& text,
+        Fastcgipp::Encoding encoding)
+{
+    Sink<charT> sink;
+    std::basic_ostream<charT> out(&sink);
+    out << encoding;
+    for(size_t i=0; i<text.size(); i += chunkSize)
+        out.write(text.data()+i, std::min(chunkSize, text.size()-i));
+    out.flush();
+    return sink.written;
+}
+
+//! The way WebStreambuf does it now with everything in one write
+template<class charT>
+size_t whole(
+        const std::basic_string<charT>& text,
+        Fastcgipp::Encoding encoding)
+{
+    Sink<charT> sink;
+    std::basic_ostream<charT> out(&sink);
+    out << encoding;
+    out.write(text.data(), text.size());
+    out.flush();
+    return sink.written;
+}
+
+template<class charT>
+std::basic_string<charT> makeText(unsigned symbolOdds)
+{
+    static const std::string symbols("\"><&'!#?/,$+=@:;()* %");
+    std::mt19937 rd(seed);
+    std::uniform_int_distribution<unsigned> oddsDist(1, symbolOdds);
+    std::uniform_int_distribution<unsigned> symbolDist(0, symbols.size()-1);
+    std::uniform_int_distribution<unsigned> letterDist('a', 'z');
+
+    std::basic_string<charT> text;
+    text.reserve(volume/sizeof(charT));
+    while(text.size() < volume/sizeof(charT))
+        text.push_back(oddsDist(rd) == 1
+                ? charT(symbols[symbolDist(rd)])
+                : charT(letterDist(rd)));
+    return text;
+}
+
+template<class Function, class charT>
+double run(
+        Function function,
+        const std::basic_string<charT>& text,
+        Fastcgipp::Encoding encoding,
+        size_t& written)
+{
+    const auto start = std::chrono::steady_clock::now();
+    written = function(text, encoding);
+    const std::chrono::duration<double> elapsed
+        = std::chrono::steady_clock::now() - start;
+
+    return text.size()*sizeof(charT)/elapsed.count()/1024/1024;
+}
+
+template<class charT>
+void compare(const char* name)
+{
+    using Fastcgipp::Encoding;
+
+    for(const unsigned symbolOdds: {1000U, 20U})
+    {
+        const std::basic_string<charT> text = makeText<charT>(symbolOdds);
+        for(const Encoding encoding: {Encoding::HTML, Encoding::URL})
+        {
+            size_t oldWritten;
+            size_t newWritten;
+            size_t wholeWritten;
+            const double old = run(mapped<charT>, text, encoding, oldWritten);
+            const double now = run(tabled<charT>, text, encoding, newWritten);
+            const double single = run(
+                    whole<charT>,
+                    text,
+                    encoding,
+                    wholeWritten);
+            if(oldWritten != newWritten || oldWritten != wholeWritten)
+                FAIL_LOG("Escaped output sizes differ: " << oldWritten \
+                        << " vs " << newWritten << " vs " << wholeWritten)
+
+            std::cout << std::setw(8) << name
+                << std::setw(6) << (encoding==Encoding::HTML ? "HTML" : "URL")
+                << std::setw(8) << ("1/" + std::to_string(symbolOdds))
+                << std::setw(14) << std::fixed << std::setprecision(0) << old
+                << std::setw(14) << now
+                << std::setw(14) << single
+                << std::setw(10) << std::setprecision(2) << now/old << '\n';
+        }
+    }
+}
+
+int main()
+{
+    std::cout << "WebStreambuf escaping: " << volume/1024/1024
+        << "MB of text per run\n";
+    std::cout << std::setw(8) << "chars"
+        << std::setw(6) << "enc"
+        << std::setw(8) << "symbols"
+        << std::setw(14) << "map MB/s"
+        << std::setw(14) << "table MB/s"
+        << std::setw(14) << "whole MB/s"
+        << std::setw(10) << "speedup" << '\n';
+
+    compare<char>("char");
+    compare<wchar_t>("wchar_t");
+
+    return 0;
+}
@@ -0,0 +1,380 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/block.hpp"
+#include "fastcgi++/config.hpp"
+#include "fastcgi++/fcgistreambuf.hpp"
+#include "fastcgi++/http.hpp"
+#include "fastcgi++/protocol.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Microbenchmarks of the code every request goes through. Each one is run in
+// batches long enough to be timed reliably and the best batch is kept. The
+// results are written as JSON to the file named by the first argument or to
+// standard output so they can be kept and compared across releases.
+
+const unsigned int seed = 2026;
+const unsigned samples = 5;
+const std::chrono::milliseconds batchTime(50);
+const size_t textSize = 64*1024;
+const size_t bufferSize = 8192;
+
+const unsigned char params[] =
+#include "../tests/multipartParam.hpp"
+
+const unsigned char post[] =
+#include "../tests/multipartPost.hpp"
+
+const char query[] =
+    "getVar=testing&secondGetVar=tested&utf8GetVarTest=%D0%BF%D1%80%D0%BE"
+    "%D0%B2%D0%B5%D1%80%D0%BA%D0%B0&enctype=multipart&q=fastcgi%2B%2B+"
+    "benchmarks&page=2&sort=date&order=desc&filter%5Bauthor%5D=eddie+carle"
+    "&filter%5Byear%5D=2026&session=QOIx7ABZ5Sc2dNCk3TRhJq&empty=&flag";
+
+//! Keeps the compiler from optimizing away what we measure
+volatile size_t checksum;
+
+//! A single benchmark result
+struct Result
+{
+    std::string name;
+    unsigned long long iterations;
+    double nanoseconds;
+    size_t bytes;
+};
+
+std::vector<Result> results;
+
+//! Time a function and record the best batch
+/*!
+ * @param[in] name Name of the benchmark
+ * @param[in] bytes Amount of bytes processed by a single call
+ * @param[in] function What to measure. Should return something to checksum.
+ */
+template<class Function>
+void measure(const char* name, size_t bytes, Function function)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // Find out how many calls fill up a batch
+    unsigned long long iterations = 1;
+    while(true)
+    {
+        const auto start = Clock::now();
+        for(unsigned long long i=0; i<iterations; ++i)
+            checksum += function();
+        if(Clock::now()-start >= batchTime)
+            break;
+        iterations *= 2;
+    }
+
+    double best = 0;
+    for(unsigned sample=0; sample<samples; ++sample)
+    {
+        const auto start = Clock::now();
+        for(unsigned long long i=0; i<iterations; ++i)
+            checksum += function();
+        const std::chrono::duration<double, std::nano> elapsed
+            = Clock::now() - start;
+        const double nanoseconds = elapsed.count()/iterations;
+        if(sample == 0 || nanoseconds < best)
+            best = nanoseconds;
+    }
+
+    results.push_back(Result{name, iterations, best, bytes});
+}
+
+//! Drops everything written to it
+template<class charT>
+class Sink: public Fastcgipp::WebStreambuf<charT>
+{
+public:
+    size_t written;
+
+    Sink():
+        written(0)
+    {
+        this->setp(m_buffer, m_buffer+bufferSize);
+    }
+
+private:
+    charT m_buffer[bufferSize];
+
+    bool emptyBuffer()
+    {
+        written += this->pptr()-this->pbase();
+        this->setp(m_buffer, m_buffer+bufferSize);
+        return true;
+    }
+};
+
+//! Words separated by spaces with the odd symbol and non ASCII letter
+template<class charT>
+std::basic_string<charT> makeText()
+{
+    static const std::string symbols("\"><&'!#?/,$+=@:;()* %");
+    std::mt19937 rd(seed);
+    std::uniform_int_distribution<unsigned> oddsDist(1, 32);
+    std::uniform_int_distribution<unsigned> symbolDist(0, symbols.size()-1);
+    std::uniform_int_distribution<unsigned> letterDist('a', 'z');
+    std::uniform_int_distribution<unsigned> wordDist(1, 12);
+
+    std::basic_string<charT> text;
+    while(text.size() < textSize)
+    {
+        for(unsigned letters=wordDist(rd); letters>0; --letters)
+        {
+            const unsigned odds = oddsDist(rd);
+            if(odds == 1)
+                text.push_back(symbols[symbolDist(rd)]);
+            else if(odds == 2 && sizeof(charT) > 1)
+                text.push_back(charT(0x430+letterDist(rd)-'a'));
+            else
+                text.push_back(letterDist(rd));
+        }
+        text.push_back(' ');
+    }
+    text.resize(textSize);
+    return text;
+}
+
+template<class charT>
+void environment(const char* name)
+{
+    const char* const data = reinterpret_cast<const char*>(params);
+    measure(name, sizeof(params), [data] ()
+    {
+        Fastcgipp::Http::Environment<charT> environment;
+        environment.fill(data, data+sizeof(params));
+        return environment.gets.size();
+    });
+}
+
+template<class charT>
+void urlEncoded(const char* name)
+{
+    measure(name, sizeof(query)-1, [] ()
+    {
+        Fastcgipp::Http::Fields<charT> fields;
+        Fastcgipp::Http::decodeUrlEncoded(
+                query,
+                query+sizeof(query)-1,
+                fields);
+        return fields.size();
+    });
+}
+
+template<class charT>
+void streambuf(const char* name)
+{
+    const std::basic_string<charT> text = makeText<charT>();
+    size_t sent = 0;
+    Fastcgipp::FcgiStreambuf<charT> buffer;
+    buffer.configure(
+            Fastcgipp::Protocol::RequestId(1, Fastcgipp::Socket()),
+            Fastcgipp::Protocol::RecordType::OUT,
+            [&sent] (const Fastcgipp::Socket&, Fastcgipp::Block&& record)
+            {
+                sent += record.size();
+            });
+    std::basic_ostream<charT> out(&buffer);
+
+    measure(name, text.size()*sizeof(charT), [&] ()
+    {
+        for(size_t i=0; i<text.size(); i += 256)
+            out.write(text.data()+i, std::min(size_t(256), text.size()-i));
+        out.flush();
+        return sent;
+    });
+}
+
+template<class charT>
+void webstreambuf(const char* name, Fastcgipp::Encoding encoding)
+{
+    const std::basic_string<charT> text = makeText<charT>();
+    Sink<charT> sink;
+    std::basic_ostream<charT> out(&sink);
+    out << encoding;
+
+    measure(name, text.size()*sizeof(charT), [&] ()
+    {
+        for(size_t i=0; i<text.size(); i += 256)
+            out.write(text.data()+i, std::min(size_t(256), text.size()-i));
+        out.flush();
+        return sink.written;
+    });
+}
+
+//! Escape a string for JSON output
+std::string escape(const std::string& string)
+{
+    std::string escaped;
+    for(const char c: string)
+    {
+        if(c == '"' || c == '\\')
+            escaped.push_back('\\');
+        escaped.push_back(c);
+    }
+    return escaped;
+}
+
+void report(std::ostream& out)
+{
+    out << "{\n"
+        << "  \"library\": \"fastcgi++\",\n"
+        << "  \"version\": \"" << FASTCGIPP_VERSION << "\",\n"
+        << "  \"compiler\": \"" << escape(__VERSION__) << "\",\n"
+#ifdef __OPTIMIZE__
+        << "  \"optimized\": true,\n"
+#else
+        << "  \"optimized\": false,\n"
+#endif
+        << "  \"samples\": " << samples << ",\n"
+        << "  \"results\": [";
+
+    for(auto result=results.cbegin(); result!=results.cend(); ++result)
+    {
+        if(result != results.cbegin())
+            out << ',';
+        out << "\n    {\"name\": \"" << result->name << '"'
+            << ", \"iterations\": " << result->iterations
+            << std::fixed << std::setprecision(1)
+            << ", \"nsPerOp\": " << result->nanoseconds
+            << ", \"bytesPerOp\": " << result->bytes
+            << ", \"mbPerSecond\": "
+            << result->bytes*1000.0/result->nanoseconds << '}';
+    }
+
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+    // Protocol::processParamHeader()
+    {
+        const char* const data = reinterpret_cast<const char*>(params);
+        measure("processParamHeader", sizeof(params), [data] ()
+        {
+            const char* position = data;
+            const char* const end = data+sizeof(params);
+            const char* name;
+            const char* value;
+            const char* valueEnd;
+            size_t count = 0;
+            while(position < end)
+            {
+                if(!Fastcgipp::Protocol::processParamHeader(
+                            position,
+                            end,
+                            name,
+                            value,
+                            valueEnd))
+                    FAIL_LOG("Unable to process parameter header")
+                count += value-name;
+                position = valueEnd;
+            }
+            return count;
+        });
+    }
+
+    // Http::Environment::fill()
+    environment<char>("Environment::fill<char>");
+    environment<wchar_t>("Environment::fill<wchar_t>");
+
+    // Http::decodeUrlEncoded()
+    urlEncoded<char>("decodeUrlEncoded<char>");
+    urlEncoded<wchar_t>("decodeUrlEncoded<wchar_t>");
+
+    // Http::Environment::parsePostsMultipart() through parsePostBuffer().
+    // Each environment needs it's parameters so fill() is timed as well.
+    {
+        const char* const data = reinterpret_cast<const char*>(params);
+        const char* const body = reinterpret_cast<const char*>(post);
+        measure("parsePostsMultipart", sizeof(post), [data, body] ()
+        {
+            Fastcgipp::Http::Environment<char> environment;
+            environment.fill(data, data+sizeof(params));
+            environment.fillPostBuffer(body, body+sizeof(post));
+            if(!environment.parsePostBuffer())
+                FAIL_LOG("Unable to parse multipart POST data")
+            return environment.posts.size();
+        });
+    }
+
+    // FcgiStreambuf flushing into records
+    streambuf<char>("FcgiStreambuf<char>");
+    streambuf<wchar_t>("FcgiStreambuf<wchar_t>");
+
+    // WebStreambuf encoding
+    webstreambuf<char>("WebStreambuf<char>::HTML", Fastcgipp::Encoding::HTML);
+    webstreambuf<char>("WebStreambuf<char>::URL", Fastcgipp::Encoding::URL);
+    webstreambuf<wchar_t>(
+            "WebStreambuf<wchar_t>::HTML",
+            Fastcgipp::Encoding::HTML);
+
+    // Block churn with a mix of record sizes. Records are kept around for a
+    // while before being freed like they are in a send queue.
+    {
+        const size_t sizes[] = {
+            Fastcgipp::Protocol::getRecordSize(0),
+            Fastcgipp::Protocol::getRecordSize(bufferSize),
+            Fastcgipp::Protocol::getRecordSize(0xffff),
+            Fastcgipp::Protocol::getRecordSize(200)};
+        std::vector<Fastcgipp::Block> queue(64);
+        size_t position = 0;
+        measure("Block", 0, [&] ()
+        {
+            Fastcgipp::Block& block = queue[position++ % queue.size()];
+            block = Fastcgipp::Block(sizes[position % 4]);
+            *block.begin() = 1;
+            return block.size();
+        });
+    }
+
+    // Base64
+    {
+        std::mt19937 rd(seed);
+        std::uniform_int_distribution<int> byteDist(0, 255);
+        std::vector<char> binary(48*1024);
+        for(auto& byte: binary)
+            byte = byteDist(rd);
+        std::vector<char> encoded((binary.size()+2)/3*4);
+        std::vector<char> decoded(binary.size());
+
+        measure("base64Encode", binary.size(), [&] ()
+        {
+            return Fastcgipp::Http::base64Encode(
+                    binary.data(),
+                    binary.data()+binary.size(),
+                    encoded.data()) - encoded.data();
+        });
+        measure("base64Decode", encoded.size(), [&] ()
+        {
+            return Fastcgipp::Http::base64Decode(
+                    encoded.data(),
+                    encoded.data()+encoded.size(),
+                    decoded.data()) - decoded.data();
+        });
+        if(decoded != binary)
+            FAIL_LOG("Base64 decoded data doesn't match")
+    }
+
+    if(argc > 1)
+    {
+        std::ofstream file(argv[1]);
+        if(!file)
+            FAIL_LOG("Unable to open " << argv[1])
+        report(file);
+    }
+    else
+        report(std::cout);
+
+    return 0;
+}
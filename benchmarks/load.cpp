@@ -0,0 +1,560 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/protocol.hpp"
+#include "fastcgi++/sockets.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Generates load against a FastCGI application by speaking FastCGI to it
+// directly over a unix socket. Every connection gets it's own thread that
+// keeps a number of multiplexed requests in flight and writes new ones in
+// batches as earlier ones complete. The latency of a request is measured
+// from when it is written until it's END_REQUEST record is received.
+//
+// Run it against an application already listening on a socket
+//
+//     load_benchmark -c 4 -m 8 /tmp/app.sock
+//
+// or have it spawn one of the examples with the socket as it's standard input
+//
+//     load_benchmark -s ./helloworld.fcgi -c 4 -m 8 /tmp/app.sock
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options
+{
+    //! Path to the unix socket
+    const char* path = nullptr;
+
+    //! Application to spawn
+    const char* spawn = nullptr;
+
+    //! Amount of connections
+    unsigned connections = 1;
+
+    //! Request IDs multiplexed over each connection
+    unsigned ids = 1;
+
+    //! Amount of requests written back to back
+    unsigned depth = 1;
+
+    //! Total amount of requests
+    unsigned long long requests = 10000;
+
+    //! Close the connection after every request
+    bool kill = false;
+
+    //! Minimum amount of parameter bytes
+    size_t params = 0;
+
+    //! Amount of bytes of POST data
+    size_t in = 0;
+} options;
+
+//! What a single connection thread measured
+struct Results
+{
+    std::vector<double> latencies;
+    unsigned long long errors = 0;
+    unsigned long long bytes = 0;
+};
+
+std::atomic_llong unclaimed;
+
+void usage(const char* program)
+{
+    std::cout << "Usage: " << program << " [options] socket\n\n"
+        << "  -s program  Spawn this FastCGI application on the socket\n"
+        << "  -c count    Connections (" << options.connections << ")\n"
+        << "  -m count    Request IDs multiplexed per connection ("
+        << options.ids << ")\n"
+        << "  -d count    Requests written back to back ("
+        << options.depth << ")\n"
+        << "  -n count    Total requests (" << options.requests << ")\n"
+        << "  -k          Close the connection after every request\n"
+        << "  -p bytes    Minimum size of the parameters\n"
+        << "  -i bytes    Size of the POST data (" << options.in << ")\n";
+    std::exit(1);
+}
+
+//! Append a FastCGI record, split up if it's too big for one
+void appendRecord(
+        std::string& stream,
+        Fastcgipp::Protocol::RecordType type,
+        const std::string& content)
+{
+    size_t position = 0;
+    do
+    {
+        const size_t size = std::min(content.size()-position, size_t(0xffff));
+        const size_t recordSize = Fastcgipp::Protocol::getRecordSize(size);
+
+        Fastcgipp::Protocol::Header header;
+        header.version = Fastcgipp::Protocol::version;
+        header.type = type;
+        header.fcgiId = 0;
+        header.contentLength = size;
+        header.paddingLength = recordSize-size-sizeof(header);
+        header.reserved = 0;
+
+        stream.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.append(content, position, size);
+        stream.append(header.paddingLength, 0);
+        position += size;
+    } while(position < content.size());
+}
+
+//! Append a name value pair to parameter record content
+void appendParam(
+        std::string& content,
+        const std::string& name,
+        const std::string& value)
+{
+    for(const size_t length: {name.size(), value.size()})
+    {
+        if(length < 0x80)
+            content.push_back(length);
+        else
+        {
+            content.push_back(0x80 | length>>24);
+            content.push_back(length>>16);
+            content.push_back(length>>8);
+            content.push_back(length);
+        }
+    }
+    content += name;
+    content += value;
+}
+
+//! Build a complete request with an fcgiId of zero
+std::string makeRequest()
+{
+    std::string request;
+
+    Fastcgipp::Protocol::BeginRequest begin;
+    std::memset(&begin, 0, sizeof(begin));
+    begin.role = Fastcgipp::Protocol::Role::RESPONDER;
+    if(!options.kill)
+        begin.flags = Fastcgipp::Protocol::BeginRequest::keepConnBit;
+    appendRecord(
+            request,
+            Fastcgipp::Protocol::RecordType::BEGIN_REQUEST,
+            std::string(reinterpret_cast<const char*>(&begin), sizeof(begin)));
+
+    std::vector<std::string> params;
+    const auto param = [&params] (
+            const std::string& name,
+            const std::string& value)
+    {
+        params.emplace_back();
+        appendParam(params.back(), name, value);
+    };
+    param("GATEWAY_INTERFACE", "CGI/1.1");
+    param("SERVER_PROTOCOL", "HTTP/1.1");
+    param("REQUEST_METHOD", options.in ? "POST" : "GET");
+    param("SCRIPT_NAME", "/load.fcgi");
+    param("REQUEST_URI", "/load.fcgi?name=value&other=thing");
+    param("QUERY_STRING", "name=value&other=thing");
+    param("DOCUMENT_ROOT", "/var/www/localhost/htdocs");
+    param("HTTP_HOST", "localhost");
+    param("HTTP_USER_AGENT", "fastcgi++ load generator");
+    param("HTTP_ACCEPT", "text/html,*/*;q=0.8");
+    param("HTTP_ACCEPT_LANGUAGE", "en-CA,en;q=0.5");
+    param("HTTP_COOKIE", "session=QOIx7ABZ5Sc2dNCk3TRhJq");
+    param("SERVER_ADDR", "127.0.0.1");
+    param("SERVER_PORT", "80");
+    param("REMOTE_ADDR", "127.0.0.1");
+    param("REMOTE_PORT", "49003");
+    if(options.in)
+    {
+        param("CONTENT_TYPE", "application/x-www-form-urlencoded");
+        param("CONTENT_LENGTH", std::to_string(options.in));
+    }
+
+    // Pad out the parameters with some extra headers
+    size_t size = 0;
+    for(const auto& pair: params)
+        size += pair.size();
+    for(unsigned padding=0; size < options.params; ++padding)
+    {
+        const size_t length = std::min(options.params-size, size_t(0x4000));
+        param(
+                "HTTP_X_PADDING_" + std::to_string(padding),
+                std::string(length, 'x'));
+        size += params.back().size();
+    }
+
+    // A name value pair can't span records
+    std::string content;
+    for(const auto& pair: params)
+    {
+        if(content.size()+pair.size() > 0xffff)
+        {
+            appendRecord(
+                    request,
+                    Fastcgipp::Protocol::RecordType::PARAMS,
+                    content);
+            content.clear();
+        }
+        content += pair;
+    }
+    appendRecord(request, Fastcgipp::Protocol::RecordType::PARAMS, content);
+    appendRecord(request, Fastcgipp::Protocol::RecordType::PARAMS, "");
+
+    if(options.in)
+    {
+        std::string in("data=");
+        in.resize(std::max(options.in, in.size()), 'x');
+        in.resize(options.in);
+        appendRecord(request, Fastcgipp::Protocol::RecordType::IN, in);
+    }
+    appendRecord(request, Fastcgipp::Protocol::RecordType::IN, "");
+
+    return request;
+}
+
+//! Set the fcgiId of every record in a request
+void setId(std::string& request, Fastcgipp::Protocol::FcgiId id)
+{
+    size_t position = 0;
+    while(position < request.size())
+    {
+        auto& header = *reinterpret_cast<Fastcgipp::Protocol::Header*>(
+                &request[position]);
+        header.fcgiId = id;
+        position += sizeof(header) + header.contentLength
+            + header.paddingLength;
+    }
+}
+
+//! Write all of it or fail
+bool writeAll(const Fastcgipp::Socket& socket, const std::string& data)
+{
+    size_t position = 0;
+    while(position < data.size())
+    {
+        const ssize_t written = socket.write(
+                data.data()+position,
+                data.size()-position);
+        if(written < 0)
+            return false;
+        position += written;
+    }
+    return true;
+}
+
+//! Runs a single connection
+class Connection
+{
+public:
+    Connection(const std::string& request, Results& results):
+        m_results(results),
+        m_requests(options.ids+1, request),
+        m_started(options.ids+1)
+    {
+        for(unsigned id=1; id<=options.ids; ++id)
+        {
+            setId(m_requests[id], id);
+            m_free.push_back(id);
+        }
+        m_buffer.reserve(0x20000);
+    }
+
+    void run()
+    {
+        while(true)
+        {
+            // Claim and write requests if there are enough free IDs
+            if(m_free.size() >= options.depth
+                    || m_free.size() == options.ids)
+            {
+                std::string batch;
+                const auto now = Clock::now();
+                while(!m_free.empty() && --unclaimed >= 0)
+                {
+                    const unsigned id = m_free.back();
+                    m_free.pop_back();
+                    batch += m_requests[id];
+                    m_started[id] = now;
+                }
+
+                if(batch.empty() && m_free.size() == options.ids)
+                {
+                    m_socket.close();
+                    return;
+                }
+
+                if(!batch.empty())
+                {
+                    if(!m_socket.valid())
+                    {
+                        m_socket = m_group.connect(options.path);
+                        if(!m_socket.valid())
+                            FAIL_LOG("Unable to connect to " << options.path)
+                    }
+                    if(!writeAll(m_socket, batch))
+                    {
+                        lost();
+                        continue;
+                    }
+                }
+            }
+
+            if(!receive())
+                lost();
+        }
+    }
+
+private:
+    Results& m_results;
+    Fastcgipp::SocketGroup m_group;
+    Fastcgipp::Socket m_socket;
+
+    //! Complete requests indexed by their FastCGI ID
+    std::vector<std::string> m_requests;
+
+    //! When requests were written indexed by their FastCGI ID
+    std::vector<Clock::time_point> m_started;
+
+    //! FastCGI IDs that aren't in flight
+    std::vector<unsigned> m_free;
+
+    //! Received data that isn't a complete record yet
+    std::vector<char> m_buffer;
+
+    //! Read from the socket and deal with any complete records
+    /*!
+     * @return False if the connection was lost.
+     */
+    bool receive()
+    {
+        const size_t size = m_buffer.size();
+        m_buffer.resize(size + 0x10000);
+        // The socket is blocking so nothing read means it's been closed
+        const ssize_t read = m_socket.read(m_buffer.data()+size, 0x10000);
+        m_buffer.resize(size + std::max(read, ssize_t(0)));
+        if(read <= 0)
+            return false;
+
+        size_t position = 0;
+        while(m_buffer.size()-position >= sizeof(Fastcgipp::Protocol::Header))
+        {
+            const auto& header
+                = *reinterpret_cast<const Fastcgipp::Protocol::Header*>(
+                        m_buffer.data()+position);
+            const size_t recordSize = sizeof(header) + header.contentLength
+                + header.paddingLength;
+            if(m_buffer.size()-position < recordSize)
+                break;
+
+            const Fastcgipp::Protocol::FcgiId id = header.fcgiId;
+            if(header.type == Fastcgipp::Protocol::RecordType::OUT)
+                m_results.bytes += header.contentLength;
+            else if(header.type
+                    == Fastcgipp::Protocol::RecordType::END_REQUEST)
+            {
+                const auto& end
+                    = *reinterpret_cast<const Fastcgipp::Protocol::EndRequest*>(
+                            m_buffer.data()+position+sizeof(header));
+                if(id == 0 || id > options.ids)
+                    FAIL_LOG("END_REQUEST for unknown id " << id)
+                const std::chrono::duration<double, std::micro> latency
+                    = Clock::now() - m_started[id];
+                m_results.latencies.push_back(latency.count());
+                if(end.protocolStatus
+                        != Fastcgipp::Protocol::ProtocolStatus::REQUEST_COMPLETE
+                        || end.appStatus != 0)
+                    ++m_results.errors;
+                m_free.push_back(id);
+                if(options.kill)
+                {
+                    m_socket.close();
+                    m_socket = Fastcgipp::Socket();
+                }
+            }
+            position += recordSize;
+        }
+
+        m_buffer.erase(m_buffer.begin(), m_buffer.begin()+position);
+        return true;
+    }
+
+    //! Everything in flight on a lost connection is an error
+    void lost()
+    {
+        if(!options.kill || m_free.size() != options.ids)
+        {
+            m_results.errors += options.ids-m_free.size();
+            for(unsigned id=1; id<=options.ids; ++id)
+                if(std::find(m_free.cbegin(), m_free.cend(), id)
+                        == m_free.cend())
+                    m_free.push_back(id);
+        }
+        m_socket.close();
+        m_socket = Fastcgipp::Socket();
+        m_buffer.clear();
+    }
+};
+
+//! Spawn an application with a listening socket as it's standard input
+pid_t spawn()
+{
+    const int listen = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, options.path, sizeof(address.sun_path)-1);
+    unlink(options.path);
+    if(listen == -1
+            || bind(
+                listen,
+                reinterpret_cast<sockaddr*>(&address),
+                sizeof(address)) == -1
+            || ::listen(listen, 128) == -1)
+        FAIL_LOG("Unable to listen on " << options.path << ": " \
+                << std::strerror(errno))
+
+    const pid_t child = fork();
+    if(child == 0)
+    {
+        dup2(listen, 0);
+        execl(options.spawn, options.spawn, static_cast<char*>(nullptr));
+        std::_Exit(1);
+    }
+    if(child == -1)
+        FAIL_LOG("Unable to fork: " << std::strerror(errno))
+    close(listen);
+    return child;
+}
+
+double percentile(const std::vector<double>& sorted, double fraction)
+{
+    if(sorted.empty())
+        return 0;
+    const size_t index = std::min(
+            sorted.size()-1,
+            size_t(std::ceil(fraction*sorted.size()))-1);
+    return sorted[index];
+}
+
+int main(int argc, char* argv[])
+{
+    int option;
+    while((option = getopt(argc, argv, "s:c:m:d:n:kp:i:")) != -1)
+    {
+        switch(option)
+        {
+            case 's':
+                options.spawn = optarg;
+                break;
+            case 'c':
+                options.connections = std::strtoul(optarg, nullptr, 10);
+                break;
+            case 'm':
+                options.ids = std::strtoul(optarg, nullptr, 10);
+                break;
+            case 'd':
+                options.depth = std::strtoul(optarg, nullptr, 10);
+                break;
+            case 'n':
+                options.requests = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 'k':
+                options.kill = true;
+                break;
+            case 'p':
+                options.params = std::strtoul(optarg, nullptr, 10);
+                break;
+            case 'i':
+                options.in = std::strtoul(optarg, nullptr, 10);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if(optind != argc-1
+            || options.connections == 0
+            || options.ids == 0
+            || options.ids > 0xffff
+            || options.depth == 0)
+        usage(argv[0]);
+    options.path = argv[optind];
+
+    // A connection that is closed after every request can't multiplex
+    if(options.kill)
+        options.ids = 1;
+    options.depth = std::min(options.depth, options.ids);
+
+    pid_t child = 0;
+    if(options.spawn)
+        child = spawn();
+
+    const std::string request = makeRequest();
+    unclaimed = options.requests;
+    std::vector<Results> results(options.connections);
+    std::vector<std::thread> threads;
+
+    const auto start = Clock::now();
+    for(auto& result: results)
+        threads.emplace_back([&request, &result] ()
+        {
+            Connection connection(request, result);
+            connection.run();
+        });
+    for(auto& thread: threads)
+        thread.join();
+    const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    if(child)
+    {
+        kill(child, SIGTERM);
+        waitpid(child, nullptr, 0);
+        unlink(options.path);
+    }
+
+    std::vector<double> latencies;
+    Results total;
+    for(const auto& result: results)
+    {
+        latencies.insert(
+                latencies.end(),
+                result.latencies.cbegin(),
+                result.latencies.cend());
+        total.errors += result.errors;
+        total.bytes += result.bytes;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << "FastCGI load: " << options.connections << " connections, "
+        << options.ids << " IDs each, batches of " << options.depth << ", "
+        << (options.kill ? "closed" : "kept alive") << ", "
+        << request.size() << " byte requests\n"
+        << std::fixed << std::setprecision(1)
+        << "  requests     " << latencies.size() << " in "
+        << elapsed.count() << "s\n"
+        << "  errors       " << total.errors << '\n'
+        << "  requests/s   " << latencies.size()/elapsed.count() << '\n'
+        << "  output MB/s  " << total.bytes/elapsed.count()/1000000 << '\n'
+        << "  p50          " << percentile(latencies, 0.5) << "us\n"
+        << "  p99          " << percentile(latencies, 0.99) << "us\n"
+        << "  p999         " << percentile(latencies, 0.999) << "us\n"
+        << "  max          "
+        << (latencies.empty() ? 0 : latencies.back()) << "us\n";
+
+    return total.errors ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+#include "fastcgi++/multipart.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+
+// Scans multipart/form-data POST data for parts. The fixture from the unit
+// tests is used as is and then with it's file replaced by a larger random one
+// since that is where the boundary search matters.
+
+const unsigned int seed = 2026;
+const size_t volume = 64*1024*1024;
+const size_t recordSize = 0xffff;
+
+const unsigned char fixture[] =
+#include "../tests/multipartPost.hpp"
+
+//! Boundary from the first line of the fixture
+std::string boundary;
+
+//! The way Environment::parsePostsMultipart() used to do it
+size_t byteByByte(const char* const start, const char* const end)
+{
+    static const std::string cBody("\r\n\r\n");
+    const std::string delimiter("--"+boundary);
+    size_t parts = 0;
+    bool body = false;
+
+    for(auto byte = start; byte < end; ++byte)
+    {
+        const size_t bytesLeft = size_t(end-byte);
+        if(!body)
+        {
+            if(
+                    bytesLeft >= cBody.size() &&
+                    std::equal(cBody.begin(), cBody.end(), byte))
+            {
+                byte += cBody.size()-1;
+                body = true;
+            }
+        }
+        else if(
+                bytesLeft >= delimiter.size() &&
+                std::equal(delimiter.begin(), delimiter.end(), byte))
+        {
+            ++parts;
+            body = false;
+        }
+    }
+
+    return parts;
+}
+
+//! The way Environment does it now, fed in record sized chunks
+size_t streamed(const char* start, const char* const end)
+{
+    size_t parts = 0;
+    Fastcgipp::Http::MultipartParser parser(
+            boundary.data(),
+            boundary.data()+boundary.size(),
+            [] (const Fastcgipp::Http::MultipartParser::Part&)
+            {
+                return true;
+            },
+            [] (const char* start, const char* end)
+            {
+                return true;
+            },
+            [&parts] ()
+            {
+                ++parts;
+                return true;
+            });
+
+    while(start != end)
+    {
+        const char* const chunkEnd
+            = start + std::min(recordSize, size_t(end-start));
+        if(!parser.parse(start, chunkEnd))
+            FAIL_LOG("Multipart data didn't parse")
+        start = chunkEnd;
+    }
+
+    return parts;
+}
+
+template<class Function>
+double run(Function function, const std::vector<char>& data, size_t& parts)
+{
+    const size_t repeats = std::max(volume/data.size(), size_t(1));
+    const auto start = std::chrono::steady_clock::now();
+    for(size_t i=0; i<repeats; ++i)
+        parts = function(data.data(), data.data()+data.size());
+    const std::chrono::duration<double> elapsed
+        = std::chrono::steady_clock::now() - start;
+
+    return repeats*data.size()/elapsed.count()/1024/1024;
+}
+
+int main()
+{
+    const std::vector<char> small(fixture, fixture+sizeof(fixture));
+    boundary.assign(
+            small.cbegin()+2,
+            std::find(small.cbegin(), small.cend(), '\r'));
+
+    // Swap the image out for 16MB of random bytes
+    std::vector<char> large;
+    {
+        static const std::string fileStart("image/png\r\n\r\n");
+        const auto file = std::search(
+                small.cbegin(),
+                small.cend(),
+                fileStart.cbegin(),
+                fileStart.cend()) + fileStart.size();
+        const std::string fileEnd("\r\n--"+boundary);
+        const auto after = std::search(
+                file,
+                small.cend(),
+                fileEnd.cbegin(),
+                fileEnd.cend());
+
+        std::mt19937 rd(seed);
+        std::uniform_int_distribution<int> byteDist(0, 255);
+        large.assign(small.cbegin(), file);
+        for(size_t i=0; i<16*1024*1024; ++i)
+            large.push_back(char(byteDist(rd)));
+        large.insert(large.end(), after, small.cend());
+    }
+
+    std::cout << "Multipart boundary search: " << volume/1024/1024
+        << "MB through each parser\n";
+    std::cout << std::setw(10) << "data"
+        << std::setw(16) << "byte MB/s"
+        << std::setw(16) << "streamed MB/s"
+        << std::setw(10) << "speedup" << '\n';
+
+    for(const auto& data: {small, large})
+    {
+        size_t oldParts;
+        size_t newParts;
+        const double old = run(byteByByte, data, oldParts);
+        const double now = run(streamed, data, newParts);
+        if(oldParts != newParts)
+            FAIL_LOG("Parsers disagree on the amount of parts: " << oldParts \
+                    << " vs " << newParts)
+
+        std::cout << std::setw(9) << data.size()/1024 << 'K'
+            << std::setw(16) << std::fixed << std::setprecision(0) << old
+            << std::setw(16) << now
+            << std::setw(10) << std::setprecision(2) << now/old
+            << '\n';
+    }
+
+    return 0;
+}
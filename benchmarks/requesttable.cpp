@@ -0,0 +1,177 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/requesttable.hpp"
+#include "fastcgi++/sockets.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+// Simulates the request bookkeeping of Manager_base. Every operation is a
+// record being pushed to a request followed by a handler thread looking the
+// same request up. Every so often a request completes and a new one takes its
+// place.
+
+const unsigned int seed = 2026;
+const unsigned int connections = 64;
+const unsigned int requestsPerConnection = 16;
+const unsigned int operations = 200000;
+const unsigned int lifecycleOdds = 32;
+
+typedef std::unique_ptr<std::atomic_ullong> Value;
+
+std::vector<Fastcgipp::Protocol::RequestId> ids;
+
+//! The way Manager_base used to do it
+struct Global
+{
+    Fastcgipp::Protocol::Requests<Value> requests;
+    std::shared_timed_mutex mutex;
+
+    Global()
+    {
+        for(const auto& id: ids)
+            requests[id].reset(new std::atomic_ullong(0));
+    }
+
+    void operate(const Fastcgipp::Protocol::RequestId& id, bool lifecycle)
+    {
+        {
+            std::unique_lock<std::shared_timed_mutex> lock(mutex);
+            auto request = requests.find(id);
+            ++*request->second;
+        }
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(mutex);
+            auto request = requests.find(id);
+            ++*request->second;
+        }
+        if(lifecycle)
+        {
+            std::unique_lock<std::shared_timed_mutex> lock(mutex);
+            requests.erase(id);
+            requests[id].reset(new std::atomic_ullong(0));
+        }
+    }
+};
+
+//! The way Manager_base does it now
+struct Sharded
+{
+    Fastcgipp::RequestTable<Value> requests;
+
+    Sharded()
+    {
+        for(const auto& id: ids)
+            requests.shard(id.m_socket).emplace(id)->second.reset(
+                    new std::atomic_ullong(0));
+    }
+
+    void operate(const Fastcgipp::Protocol::RequestId& id, bool lifecycle)
+    {
+        auto& shard = requests.shard(id.m_socket);
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+            auto request = shard.find(id);
+            ++*request->second;
+        }
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+            auto request = shard.find(id);
+            ++*request->second;
+        }
+        if(lifecycle)
+        {
+            std::unique_lock<std::shared_timed_mutex> lock(shard.mutex);
+            shard.erase(shard.find(id));
+            shard.emplace(id)->second.reset(new std::atomic_ullong(0));
+        }
+    }
+};
+
+template<class Table>
+double run(unsigned threadCount)
+{
+    Table table;
+    std::vector<std::thread> threads;
+    std::atomic_uint ready(0);
+    std::atomic_bool go(false);
+
+    for(unsigned i=0; i<threadCount; ++i)
+        threads.emplace_back([&table, &ready, &go, i] ()
+        {
+            std::mt19937 rd(seed+i);
+            std::uniform_int_distribution<size_t> idDist(0, ids.size()-1);
+            std::uniform_int_distribution<unsigned> lifeDist(
+                    1,
+                    lifecycleOdds);
+            ++ready;
+            while(!go)
+                std::this_thread::yield();
+            for(unsigned op=0; op<operations; ++op)
+                table.operate(ids[idDist(rd)], lifeDist(rd) == 1);
+        });
+
+    while(ready != threadCount)
+        std::this_thread::yield();
+    const auto start = std::chrono::steady_clock::now();
+    go = true;
+    for(auto& thread: threads)
+        thread.join();
+    const std::chrono::duration<double> elapsed
+        = std::chrono::steady_clock::now() - start;
+
+    return threadCount*operations/elapsed.count();
+}
+
+int main()
+{
+    const std::string path = "/tmp/fastcgipp-requesttable-"
+        + std::to_string(getpid());
+    Fastcgipp::SocketGroup group;
+    if(!group.listen(path.c_str()))
+        FAIL_LOG("Unable to listen on " << path.c_str())
+
+    std::vector<Fastcgipp::Socket> sockets;
+    for(unsigned i=0; i<connections; ++i)
+    {
+        sockets.push_back(group.connect(path.c_str()));
+        if(!sockets.back().valid())
+            FAIL_LOG("Unable to connect to " << path.c_str())
+        for(unsigned id=1; id<=requestsPerConnection; ++id)
+            ids.emplace_back(id, sockets.back());
+    }
+
+    std::cout << "Request table contention: " << connections
+        << " connections, " << requestsPerConnection
+        << " requests each, " << operations << " operations per thread\n";
+    std::cout << std::setw(8) << "threads"
+        << std::setw(16) << "global ops/s"
+        << std::setw(16) << "sharded ops/s"
+        << std::setw(10) << "speedup" << '\n';
+
+    const unsigned maxThreads = std::max(
+            std::thread::hardware_concurrency(),
+            4U);
+    for(unsigned threads=1; threads<=maxThreads; threads*=2)
+    {
+        const double global = run<Global>(threads);
+        const double sharded = run<Sharded>(threads);
+        std::cout << std::setw(8) << threads
+            << std::setw(16) << std::fixed << std::setprecision(0) << global
+            << std::setw(16) << sharded
+            << std::setw(10) << std::setprecision(2) << sharded/global
+            << '\n';
+    }
+
+    return 0;
+}
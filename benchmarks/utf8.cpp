@@ -0,0 +1,286 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/utf8.hpp"
+#include "fastcgi++/block.hpp"
+#include "fastcgi++/protocol.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <codecvt>
+#include <iostream>
+#include <iomanip>
+#include <locale>
+#include <random>
+#include <string>
+#include <vector>
+
+// Code converts wide text into UTF-8 FastCGI records a stream buffer's worth
+// at a time like FcgiStreambuf<wchar_t> does when it flushes. The way it used
+// to be done, with a std::codecvt_utf8 constructed on every flush and a record
+// sized for the worst case, is replicated here for comparison.
+//
+// Code also converts UTF-8 parameter values back into wide strings like
+// Http::vecToString() does for every header, cookie, GET and POST value. This
+// is compared against the std::wstring_convert it used to go through.
+
+const unsigned int seed = 2026;
+const size_t volume = 16*1024*1024;
+const size_t bufferSize = 8192;
+const unsigned repeats = 5;
+const size_t valueSize = 48;
+
+//! Checksum of the output so both ways can be compared
+struct Output
+{
+    size_t size;
+    unsigned long long sum;
+
+    Output():
+        size(0),
+        sum(0)
+    {}
+
+    void add(const char* data, size_t size_)
+    {
+        size += size_;
+        for(size_t i=0; i<size_; i+=61)
+            sum = sum*31 + static_cast<unsigned char>(data[i]);
+    }
+
+    bool operator!=(const Output& x) const
+    {
+        return size != x.size || sum != x.sum;
+    }
+};
+
+//! The way FcgiStreambuf used to code convert
+Output codecvt(const std::wstring& text)
+{
+    Output output;
+    for(size_t i=0; i<text.size(); i += bufferSize)
+    {
+        const wchar_t* const from = text.data()+i;
+        const wchar_t* const fromEnd = from+std::min(bufferSize, text.size()-i);
+
+        const std::codecvt_utf8<wchar_t> converter;
+        mbstate_t state = mbstate_t();
+        const wchar_t* fromNext;
+        char* toNext;
+
+        Fastcgipp::Block record;
+        record.reserve(Fastcgipp::Protocol::getRecordSize(
+                    (fromEnd-from)*converter.max_length()));
+        char* const content
+            = record.begin()+sizeof(Fastcgipp::Protocol::Header);
+        if(converter.out(
+                    state,
+                    from,
+                    fromEnd,
+                    fromNext,
+                    content,
+                    record.begin()+record.reserve(),
+                    toNext) != std::codecvt_base::ok)
+            FAIL_LOG("std::codecvt_utf8 failed")
+        output.add(content, toNext-content);
+    }
+    return output;
+}
+
+//! The way FcgiStreambuf does it now
+Output utf8(const std::wstring& text)
+{
+    Output output;
+    for(size_t i=0; i<text.size(); i += bufferSize)
+    {
+        const wchar_t* const from = text.data()+i;
+        const wchar_t* const fromEnd = from+std::min(bufferSize, text.size()-i);
+        const wchar_t* fromNext;
+        char* toNext;
+
+        const size_t length = Fastcgipp::Utf8::length(from, fromEnd);
+        Fastcgipp::Block record;
+        record.reserve(Fastcgipp::Protocol::getRecordSize(length));
+        char* const content
+            = record.begin()+sizeof(Fastcgipp::Protocol::Header);
+        Fastcgipp::Utf8::encode(
+                from,
+                fromEnd,
+                fromNext,
+                content,
+                content+length,
+                toNext);
+        output.add(content, toNext-content);
+    }
+    return output;
+}
+
+//! The way Http::vecToString() used to decode
+Output fromBytes(const std::vector<std::string>& values)
+{
+    Output output;
+    for(const auto& value: values)
+    {
+        std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
+        const std::wstring string = converter.from_bytes(
+                value.data(),
+                value.data()+value.size());
+        output.add(
+                reinterpret_cast<const char*>(string.data()),
+                string.size()*sizeof(wchar_t));
+    }
+    return output;
+}
+
+//! The way Http::vecToString() decodes now
+Output decode(const std::vector<std::string>& values)
+{
+    Output output;
+    for(const auto& value: values)
+    {
+        std::wstring string(value.size(), 0);
+        string.resize(Fastcgipp::Utf8::decode(
+                    value.data(),
+                    value.data()+value.size(),
+                    &string[0]) - string.data());
+        output.add(
+                reinterpret_cast<const char*>(string.data()),
+                string.size()*sizeof(wchar_t));
+    }
+    return output;
+}
+
+//! Split wide text into UTF-8 parameter values
+std::vector<std::string> makeValues(const std::wstring& text)
+{
+    std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
+    std::vector<std::string> values;
+    for(size_t i=0; i<text.size(); i += valueSize)
+        values.push_back(converter.to_bytes(
+                    text.data()+i,
+                    text.data()+std::min(text.size(), i+valueSize)));
+    return values;
+}
+
+//! Words separated by spaces with a percentage of letters from a range
+std::wstring makeText(unsigned otherPercent, wchar_t first, wchar_t last)
+{
+    std::mt19937 rd(seed);
+    std::uniform_int_distribution<unsigned> percentDist(1, 100);
+    std::uniform_int_distribution<unsigned> wordDist(1, 12);
+    std::uniform_int_distribution<unsigned> otherDist(first, last);
+    std::uniform_int_distribution<unsigned> letterDist('a', 'z');
+
+    std::wstring text;
+    text.reserve(volume/sizeof(wchar_t));
+    while(text.size() < volume/sizeof(wchar_t))
+    {
+        for(unsigned letters=wordDist(rd); letters>0; --letters)
+            text.push_back(percentDist(rd) <= otherPercent
+                    ? wchar_t(otherDist(rd))
+                    : wchar_t(letterDist(rd)));
+        text.push_back(' ');
+    }
+    text.resize(volume/sizeof(wchar_t));
+    return text;
+}
+
+//! Amount of wide characters
+size_t count(const std::wstring& text)
+{
+    return text.size();
+}
+
+//! Amount of bytes
+size_t count(const std::vector<std::string>& values)
+{
+    size_t size = 0;
+    for(const auto& value: values)
+        size += value.size();
+    return size;
+}
+
+//! Best rate out of a few runs
+template<class Function, class Input>
+double run(Function function, const Input& text, Output& output)
+{
+    double best = 0;
+    for(unsigned i=0; i<repeats; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        output = function(text);
+        const std::chrono::duration<double> elapsed
+            = std::chrono::steady_clock::now() - start;
+        best = std::max(best, count(text)/elapsed.count()/1000000);
+    }
+    return best;
+}
+
+int main()
+{
+    const struct
+    {
+        const char* name;
+        unsigned otherPercent;
+        wchar_t first;
+        wchar_t last;
+    } texts[] =
+    {
+        {"ascii", 0, 'a', 'z'},
+        {"latin", 5, 0xc0, 0xff},
+        {"cyrillic", 100, 0x410, 0x44f},
+        {"cjk", 100, 0x4e00, 0x9fff}
+    };
+
+    std::cout << "Wide character UTF-8 output: " << volume/1024/1024
+        << "MB of wide text per run, best of " << repeats << '\n';
+    std::cout << std::setw(10) << "text"
+        << std::setw(16) << "codecvt Mch/s"
+        << std::setw(16) << "Utf8 Mch/s"
+        << std::setw(10) << "speedup" << '\n';
+
+    for(const auto& text: texts)
+    {
+        const std::wstring input = makeText(
+                text.otherPercent,
+                text.first,
+                text.last);
+        Output oldOutput;
+        Output newOutput;
+        const double old = run(codecvt, input, oldOutput);
+        const double now = run(utf8, input, newOutput);
+        if(oldOutput != newOutput)
+            FAIL_LOG("Encoded outputs differ with " << text.name)
+
+        std::cout << std::setw(10) << text.name
+            << std::setw(16) << std::fixed << std::setprecision(1) << old
+            << std::setw(16) << now
+            << std::setw(10) << std::setprecision(2) << now/old << '\n';
+    }
+
+    std::cout << "\nUTF-8 parameter input: values of " << valueSize
+        << " characters, best of " << repeats << '\n';
+    std::cout << std::setw(10) << "text"
+        << std::setw(16) << "codecvt MB/s"
+        << std::setw(16) << "Utf8 MB/s"
+        << std::setw(10) << "speedup" << '\n';
+
+    for(const auto& text: texts)
+    {
+        const std::vector<std::string> values = makeValues(makeText(
+                text.otherPercent,
+                text.first,
+                text.last));
+        Output oldOutput;
+        Output newOutput;
+        const double old = run(fromBytes, values, oldOutput);
+        const double now = run(decode, values, newOutput);
+        if(oldOutput != newOutput)
+            FAIL_LOG("Decoded outputs differ with " << text.name)
+
+        std::cout << std::setw(10) << text.name
+            << std::setw(16) << std::fixed << std::setprecision(1) << old
+            << std::setw(16) << now
+            << std::setw(10) << std::setprecision(2) << now/old << '\n';
+    }
+
+    return 0;
+}
@@ -15,6 +15,7 @@ class Gnu: public Fastcgipp::Request<wchar_t>
     //! [Image declaration]
     static const unsigned char gnuPng[];
     static const size_t gnuPngSize = 58587;
+    static const Fastcgipp::SharedResponse gnuPngResponse;
     //! [Image declaration]
     //! [startTime declaration]
     static const std::time_t startTimestamp;
@@ -36,7 +37,7 @@ class Gnu: public Fastcgipp::Request<wchar_t>
                 << std::put_time(&startTime, L"%a, %d %b %Y %H:%M:%S GMT\n");
             out << L"Content-Length: " << gnuPngSize << '\n';
             out << L"Content-Type: image/png\r\n\r\n";
-            dump(gnuPng, gnuPngSize);
+            dump(gnuPngResponse);
         }
     }
     //! [Uncached image]
@@ -168,6 +169,7 @@ const std::vector<std::vector<std::wstring>> Gnu::catalogues
 
 const unsigned char Gnu::gnuPng[] =
 #include "gnu.png.hpp"
+const Fastcgipp::SharedResponse Gnu::gnuPngResponse(gnuPng, gnuPngSize);
 
 const std::time_t Gnu::startTimestamp = std::time(nullptr);
 const std::tm Gnu::startTime = *std::gmtime(&startTimestamp);
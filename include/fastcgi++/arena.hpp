@@ -0,0 +1,270 @@
+/*!
+ * @file       arena.hpp
+ * @brief      Declares the Fastcgipp::Arena and Fastcgipp::ArenaAllocator
+ *             classes
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_ARENA_HPP
+#define FASTCGIPP_ARENA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Monotonic memory arena
+    /*!
+     * Memory is handed out sequentially from chunks taken from the BlockPool.
+     * Individual allocations are never freed. Everything is given back in one
+     * shot by release() or when the arena is destroyed. This makes
+     * allocating a large amount of small, short lived objects that all die
+     * together nearly free.
+     *
+     * Each chunk is twice the size of the previous one up to the size of the
+     * largest BlockPool size class. Allocations too big for a chunk get one
+     * of their own.
+     *
+     * This class is not thread safe.
+     *
+     * @date    October 16, 2026
+     */
+    class Arena
+    {
+    public:
+        //! Allocate memory from the arena
+        /*!
+         * @param [in] size Amount of bytes needed.
+         * @param [in] alignment Required alignment of the memory. Must be a
+         *                       power of two.
+         * @return Pointer to the memory.
+         */
+        void* allocate(size_t size, size_t alignment=alignof(std::max_align_t))
+        {
+            const size_t padding = (alignment - reinterpret_cast<size_t>(
+                        m_position)) & (alignment-1);
+            if(size+padding > static_cast<size_t>(m_end-m_position))
+                return grow(size, alignment);
+            char* const data = m_position+padding;
+            m_position = data+size;
+            return data;
+        }
+
+        //! Give all memory back to the BlockPool
+        /*!
+         * Everything allocated from the arena becomes invalid.
+         */
+        void release();
+
+        //! Total amount of bytes taken from the BlockPool
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        //! Amount of chunks taken from the BlockPool
+        size_t chunks() const
+        {
+            return m_chunks.size();
+        }
+
+        //! Constructor
+        /*!
+         * No memory is taken from the BlockPool until the first allocation.
+         *
+         * @param [in] initialChunk Size of the first chunk in bytes.
+         */
+        Arena(size_t initialChunk=4096):
+            m_position(nullptr),
+            m_end(nullptr),
+            m_size(0),
+            m_nextChunk(initialChunk),
+            m_initialChunk(initialChunk)
+        {}
+
+        ~Arena()
+        {
+            release();
+        }
+
+        Arena(const Arena&) =delete;
+        Arena& operator=(const Arena&) =delete;
+
+    private:
+        //! A chunk taken from the BlockPool
+        struct Chunk
+        {
+            char* data;
+            size_t capacity;
+        };
+
+        //! Every chunk we've taken from the BlockPool
+        std::vector<Chunk> m_chunks;
+
+        //! Next free byte in the current chunk
+        char* m_position;
+
+        //! 1+ the last byte in the current chunk
+        char* m_end;
+
+        //! Total amount of bytes taken from the BlockPool
+        size_t m_size;
+
+        //! Size of the next chunk to take from the BlockPool
+        size_t m_nextChunk;
+
+        //! Size of the first chunk to take from the BlockPool
+        const size_t m_initialChunk;
+
+        //! Take a new chunk from the BlockPool and allocate from it
+        void* grow(size_t size, size_t alignment);
+    };
+
+    //! Standard library compatible allocator that uses an Arena
+    /*!
+     * This follows the same rules as std::pmr::polymorphic_allocator.
+     * Containers using it never propagate the allocator on assignment or
+     * swap and copies of a container don't use the arena. A default
+     * constructed allocator isn't associated with an arena at all and simply
+     * uses the heap.
+     *
+     * @tparam T Type of object to allocate.
+     *
+     * @date    October 16, 2026
+     */
+    template<class T> class ArenaAllocator
+    {
+    public:
+        typedef T value_type;
+        typedef std::false_type propagate_on_container_copy_assignment;
+        typedef std::false_type propagate_on_container_move_assignment;
+        typedef std::false_type propagate_on_container_swap;
+        typedef std::false_type is_always_equal;
+
+        //! Allocate from the heap
+        ArenaAllocator():
+            m_arena(nullptr)
+        {}
+
+        //! Allocate from an arena
+        ArenaAllocator(Arena* arena):
+            m_arena(arena)
+        {}
+
+        template<class U> ArenaAllocator(const ArenaAllocator<U>& x):
+            m_arena(x.arena())
+        {}
+
+        T* allocate(size_t n)
+        {
+            if(m_arena == nullptr)
+                return static_cast<T*>(::operator new(n*sizeof(T)));
+            return static_cast<T*>(m_arena->allocate(n*sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T* data, size_t)
+        {
+            if(m_arena == nullptr)
+                ::operator delete(data);
+        }
+
+        //! Copies of containers go to the heap
+        ArenaAllocator select_on_container_copy_construction() const
+        {
+            return ArenaAllocator();
+        }
+
+        //! The arena we allocate from. Null if the heap.
+        Arena* arena() const
+        {
+            return m_arena;
+        }
+
+    private:
+        Arena* m_arena;
+    };
+
+    template<class T, class U>
+    bool operator==(const ArenaAllocator<T>& x, const ArenaAllocator<U>& y)
+    {
+        return x.arena() == y.arena();
+    }
+
+    template<class T, class U>
+    bool operator!=(const ArenaAllocator<T>& x, const ArenaAllocator<U>& y)
+    {
+        return x.arena() != y.arena();
+    }
+
+    //! Build an allocator associated with an arena if possible
+    /*!
+     * Any allocator that can be constructed from an Arena pointer will be.
+     * Anything else is default constructed.
+     */
+    template<class Allocator>
+    typename std::enable_if<
+        std::is_constructible<Allocator, Arena*>::value,
+        Allocator>::type
+    makeAllocator(Arena& arena)
+    {
+        return Allocator(&arena);
+    }
+
+    //! Build an allocator associated with an arena if possible
+    /*!
+     * Any allocator that can be constructed from an Arena pointer will be.
+     * Anything else is default constructed.
+     */
+    template<class Allocator>
+    typename std::enable_if<
+        !std::is_constructible<Allocator, Arena*>::value,
+        Allocator>::type
+    makeAllocator(Arena&)
+    {
+        return Allocator();
+    }
+
+    //! Is this an allocator the library is compiled with?
+    /*!
+     * Request and Http::Environment are explicitly instantiated in the
+     * library for std::allocator and ArenaAllocator only. Any other allocator
+     * would fail to link so they refuse it up front.
+     *
+     * @tparam charT Character type of the allocator
+     * @tparam Allocator Allocator to check
+     */
+    template<class charT, class Allocator>
+    struct SupportedAllocator: public std::integral_constant<
+        bool,
+        std::is_same<Allocator, std::allocator<charT>>::value
+            || std::is_same<Allocator, ArenaAllocator<charT>>::value>
+    {};
+}
+
+#endif
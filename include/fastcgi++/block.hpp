@@ -33,6 +33,65 @@
 
 namespace Fastcgipp
 {
+    //! Size classed memory pool that backs every Block
+    /*!
+     * Allocations are rounded up to one of a handful of size classes matched
+     * to FastCGI records: a header with up to 64, 256, 1024, 4096, 8192,
+     * 16384, 32768 or 65535 bytes of content plus padding. Anything larger
+     * goes straight to the heap.
+     *
+     * Each thread keeps a small cache of free chunks per size class so that
+     * most allocations and deallocations touch no shared state. When a
+     * thread's cache runs dry it refills from a global depot and when it
+     * overflows it hands chunks back to it. Memory freed in a different
+     * thread than it was allocated in (which is the norm with records) makes
+     * it's way back through the depot.
+     *
+     * All member functions are thread safe.
+     *
+     * @date    October 16, 2026
+     */
+    class BlockPool
+    {
+    public:
+        //! Allocate a chunk of memory
+        /*!
+         * @param [in] size Minimum amount of bytes needed.
+         * @param [out] capacity Actual amount of bytes allocated.
+         * @return Pointer to the chunk.
+         */
+        static char* allocate(size_t size, size_t& capacity);
+
+        //! Return a chunk of memory
+        /*!
+         * @param [in] data Pointer returned from allocate().
+         * @param [in] capacity Capacity returned from allocate().
+         */
+        static void deallocate(char* data, size_t capacity);
+
+        //! Largest allocation that is served from a size class
+        static size_t maxPooled();
+
+        //! Total amount of chunks ever allocated
+        static unsigned long long allocations();
+
+        //! Amount of allocations that had to go to the heap
+        /*!
+         * This is every allocation that couldn't be served from a previously
+         * freed chunk.
+         */
+        static unsigned long long heapAllocations();
+
+        //! Total amount of chunks ever deallocated
+        static unsigned long long deallocations();
+
+        //! Amount of chunks currently allocated
+        static unsigned long long outstanding()
+        {
+            return allocations()-deallocations();
+        }
+    };
+
     //! Data structure to hold a block of raw data
     /*!
      * This is basically a stripped down std::vector. It contains a contiguous
@@ -40,6 +99,15 @@ namespace Fastcgipp
      * how much data is actually allocated while the size tells us how much of
      * the data is relevant. The motivation for this as opposed to a vector is
      * that this lacks element initialization.
+     *
+     * Memory comes from the BlockPool. Since the pool rounds allocations up
+     * to a size class, the underlying allocation may be larger than the
+     * reserve. Growing the reserve within that capacity costs nothing.
+     *
+     * A block can also be a slice of another shared block. In this case it
+     * owns no memory of it's own and simply keeps the shared block alive for
+     * as long as it exists. Should a slice need to grow beyond it's reserve
+     * the data is copied into a fresh allocation of it's own.
      */
     class Block
     {
@@ -51,7 +119,16 @@ namespace Fastcgipp
         size_t m_size;
 
         //! Point to allocated data
-        std::unique_ptr<char[]> m_data;
+        char* m_data;
+
+        //! Actual size of the allocation from the BlockPool
+        size_t m_capacity;
+
+        //! The shared block we are a slice of
+        std::shared_ptr<Block> m_chunk;
+
+        //! Give up our memory whether it's owned or a slice
+        inline void release();
 
     public:
         //! Initialize an empty block
@@ -63,10 +140,27 @@ namespace Fastcgipp
         //! Initialize a block with equal size and reserve from source data
         Block(const char* const data, const size_t size_);
 
+        //! Initialize a block as a slice of a shared block
+        /*!
+         * No data is copied. The size and reserve are equal.
+         *
+         * @param [in] chunk Shared block that the data lives in.
+         * @param [in] data Start of the slice. Must be within the chunk.
+         * @param [in] size_ Size of the slice. Must not go past the end of
+         *                   the chunk.
+         */
+        Block(
+                const std::shared_ptr<Block>& chunk,
+                char* const data,
+                const size_t size_);
+
+        ~Block();
+
         //! Assign a sequence a data to the block
         /*!
          * If the reserve if smaller the requested size then reallocation
-         * occurs. Otherwise the allocation is unchanged.
+         * occurs. Otherwise the allocation is unchanged. A slice always gets
+         * an allocation of it's own so the chunk it came from is left alone.
          */
         void assign(const char* const data, const size_t size_);
 
@@ -85,8 +179,8 @@ namespace Fastcgipp
         //! Set the reserve size
         /*!
          * Unlike std::vector this always obeys your command even if you are
-         * decreasing the reserve size. All data is copied over when a reserve
-         * is changed.
+         * decreasing the reserve size. Data is only copied over if the new
+         * reserve doesn't fit in the current allocation.
          */
         void reserve(size_t x);
 
@@ -102,30 +196,36 @@ namespace Fastcgipp
         //! Pointer to the first element
         char* begin()
         {
-            return m_data.get();
+            return m_data;
         }
 
         //! Constant pointer to the first element
         const char* begin() const
         {
-            return m_data.get();
+            return m_data;
         }
 
         //! Pointer to 1+ the last element
         char* end()
         {
-            return m_data.get()+m_size;
+            return m_data+m_size;
         }
 
         //! Constant pointer to 1+ the last element
         const char* end() const
         {
-            return m_data.get()+m_size;
+            return m_data+m_size;
         }
 
         //! Deallocate memory and set size and reserve to zero
         void clear();
 
+        //! True if this block is a slice of a shared block
+        bool slice() const
+        {
+            return static_cast<bool>(m_chunk);
+        }
+
         Block(const Block&) =delete;
         Block& operator=(const Block&) =delete;
     };
@@ -35,6 +35,7 @@
 
 #include <istream>
 #include <functional>
+#include <memory>
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -45,6 +46,9 @@ namespace Fastcgipp
      * just the same with the added feature of the dump() function but properly
      * flushes into FastCGI records.
      *
+     * The put area is only set up once something is written to it. With
+     * narrow characters it lives directly inside a pooled record Block.
+     *
      * @tparam charT Character type (char or wchar_t)
      * @tparam traits Character traits
      *
@@ -55,16 +59,26 @@ namespace Fastcgipp
     class FcgiStreambuf: public WebStreambuf<charT, traits>
     {
     public:
-        FcgiStreambuf()
-        {
-            this->setp(m_buffer, m_buffer+s_buffSize);
-        }
+        FcgiStreambuf():
+            m_bufferSize(s_buffSize)
+        {}
 
         ~FcgiStreambuf()
         {
-            emptyBuffer();
+            flushBuffer();
         }
 
+        //! Set the size of the stream buffer
+        /*!
+         * Anything in the buffer is flushed first. With narrow characters
+         * the buffer is the content section of the very record it is sent
+         * in so a size of 65535 fills complete FastCGI records. Larger sizes
+         * are clamped to that.
+         *
+         * @param[in] size Size of the buffer in characters
+         */
+        void bufferSize(size_t size);
+
         //! Configure the stream buffer
         /*!
          * Sets FastCGI related member data necessary for operation of the
@@ -109,14 +123,40 @@ namespace Fastcgipp
         void dump(std::basic_istream<char>& stream);
 
     private:
-        //! Code converts, packages and transmits all data in the stream buffer
+        //! Transmit all data in the stream buffer and set up a fresh one
         bool emptyBuffer();
 
-        //! Size of the internal stream buffer
+        //! Code converts, packages and transmits all data in the stream buffer
+        /*!
+         * This doesn't set up a fresh buffer for narrow characters. The put
+         * area is left empty until more data is written. Flushing the stream
+         * calls this alone so it never allocates a buffer.
+         */
+        bool flushBuffer();
+
+        //! Set up the put area if there isn't one
+        void prepareBuffer();
+
+        //! Default size of the stream buffer
         static const int s_buffSize = 8192;
 
-        //! The buffer
-        charT m_buffer[s_buffSize];
+        //! Size of the stream buffer in characters
+        size_t m_bufferSize;
+
+        //! Record that the put area lives in for narrow characters
+        /*!
+         * Room for the header is left up front so that once the buffer is
+         * flushed the header is stamped on and the whole record handed
+         * over without copying.
+         */
+        Block m_record;
+
+        //! The put area for wide characters
+        /*!
+         * Wide characters are code converted straight into records as they
+         * are flushed.
+         */
+        std::unique_ptr<charT[]> m_buffer;
 
         //! ID associated with the request
         Protocol::RequestId m_id;
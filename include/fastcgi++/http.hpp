@@ -28,6 +28,7 @@
 #ifndef FASTCGIPP_HTTP_HPP
 #define FASTCGIPP_HTTP_HPP
 
+#include <algorithm>
 #include <string>
 #include <ostream>
 #include <istream>
@@ -37,9 +38,16 @@
 #include <memory>
 #include <ctime>
 #include <atomic>
+#include <functional>
+#include <limits>
 
 #include "fastcgi++/protocol.hpp"
 #include "fastcgi++/address.hpp"
+#include "fastcgi++/arena.hpp"
+#include "fastcgi++/block.hpp"
+#include "fastcgi++/multipart.hpp"
+#include "fastcgi++/stringview.hpp"
+#include "fastcgi++/utf8.hpp"
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -69,18 +77,51 @@ namespace Fastcgipp
             //! Size of file
             size_t size;
 
-            //! File data
+            //! File data if it is held in memory
+            /*!
+             * This is null if the file was spooled or sent to a FileSink.
+             * Neither happens unless Environment::spoolThreshold or
+             * Environment::fileSinks are set.
+             */
             mutable std::unique_ptr<char[]> data;
 
+            //! File data if it was spooled
+            /*!
+             * Files larger than Environment::spoolThreshold are spooled into
+             * a temporary file as they arrive instead of being held in
+             * memory. This is a read only memory map of that file which goes
+             * away along with the last copy of the pointer.
+             */
+            std::shared_ptr<const char> spooled;
+
+            //! Start of the file data wherever it is
+            /*!
+             * This is null if the file content went to a FileSink that
+             * doesn't provide access to it.
+             */
+            const char* begin() const
+            {
+                return data ? data.get() : spooled.get();
+            }
+
+            //! 1+ the last byte of file data
+            const char* end() const
+            {
+                return begin() ? begin()+size : nullptr;
+            }
+
             //! Move constructor
             File(File&& x):
                 filename(std::move(x.filename)),
                 contentType(std::move(x.contentType)),
                 size(x.size),
-                data(std::move(x.data))
+                data(std::move(x.data)),
+                spooled(std::move(x.spooled))
             {}
 
-            File() {}
+            File():
+                size(0)
+            {}
         };
 
         //! The HTTP request method as an enumeration
@@ -108,57 +149,426 @@ namespace Fastcgipp
             return os << requestMethodLabels[static_cast<int>(requestMethod)];
         }
 
+        //! Handle to an application specific parameter
+        /*!
+         * Get one of these from registerParameter() and use it to fetch the
+         * value of the parameter from an Environment with
+         * Environment::registered().
+         *
+         * @date    October 16, 2026
+         */
+        class RegisteredParameter
+        {
+        public:
+            //! Index of the parameter's slot in an Environment
+            unsigned index() const
+            {
+                return m_index;
+            }
+
+            //! False if registerParameter() refused the name
+            bool valid() const
+            {
+                return m_index != static_cast<unsigned>(-1);
+            }
+
+            explicit RegisteredParameter(unsigned index):
+                m_index(index)
+            {}
+
+        private:
+            unsigned m_index;
+        };
+
+        //! Give an application specific parameter it's own Environment slot
+        /*!
+         * Parameters that Environment doesn't have a member for normally end
+         * up in Environment::others. A registered parameter instead goes
+         * into a slot of it's own which is found with a hash lookup when
+         * filling and a simple index when fetching. This is worth it for
+         * parameters like HTTP_X_REQUEST_ID or HTTP_X_FORWARDED_FOR that
+         * every request looks at.
+         *
+         * Registering the same name twice returns the same handle. Names
+         * that already have their own Environment member are refused and
+         * get an invalid handle that always fetches an empty string. Use the
+         * member instead. This is thread safe but is meant to be called
+         * before the Manager is started. Environments filled before a
+         * parameter is registered won't have it.
+         *
+         * @param [in] name Null terminated FastCGI parameter name
+         * @return Handle to fetch the parameter with. Check
+         *         RegisteredParameter::valid() to see if it was refused.
+         */
+        RegisteredParameter registerParameter(const char* name);
+
+        //! Raw FastCGI parameters that are only decoded when asked for
+        /*!
+         * The PARAMS records themselves are kept alive and indexed so that
+         * every name and value is simply a view into them. Nothing is copied
+         * or converted up front. The GET data and cookies are percent decoded
+         * once, the first time any of them are asked for.
+         *
+         * All values are raw bytes exactly as the web server sent them. This
+         * is normally UTF-8.
+         *
+         * This class is not thread safe.
+         *
+         * @date    October 16, 2026
+         */
+        class Parameters
+        {
+        public:
+            //! A name/value pair
+            typedef std::pair<StringView, StringView> Parameter;
+
+            //! Container of name/value pairs
+            typedef std::vector<Parameter> Container;
+
+            //! Index the parameters in a PARAMS record
+            /*!
+             * @param [in] record The entire record. This is kept alive for as
+             *                    long as we are.
+             * @param [in] data Start of parameter data within the record
+             * @param [in] dataEnd 1+ the last byte of parameter data
+             */
+            void add(Block&& record, const char* data, const char* dataEnd);
+
+            //! Value of a parameter
+            /*!
+             * @return The value or an empty view if there is no such
+             *         parameter.
+             */
+            StringView operator[](const StringView& name) const;
+
+            //! Find a parameter
+            /*!
+             * @return Iterator to the parameter or end() if there is none.
+             */
+            Container::const_iterator find(const StringView& name) const;
+
+            Container::const_iterator begin() const
+            {
+                return m_parameters.cbegin();
+            }
+
+            Container::const_iterator end() const
+            {
+                return m_parameters.cend();
+            }
+
+            //! Amount of parameters
+            size_t size() const
+            {
+                return m_parameters.size();
+            }
+
+            //! Hostname of the server
+            StringView host() const
+            {
+                return (*this)["HTTP_HOST"];
+            }
+
+            //! User agent string
+            StringView userAgent() const
+            {
+                return (*this)["HTTP_USER_AGENT"];
+            }
+
+            //! REQUEST_URI
+            StringView requestUri() const
+            {
+                return (*this)["REQUEST_URI"];
+            }
+
+            //! Filename of script relative to the HTTP root directory
+            StringView scriptName() const
+            {
+                return (*this)["SCRIPT_NAME"];
+            }
+
+            //! Raw url-encoded GET data
+            StringView queryString() const
+            {
+                return (*this)["QUERY_STRING"];
+            }
+
+            //! All percent decoded GET data in the order it was received
+            const Container& gets() const;
+
+            //! First percent decoded GET value with this name
+            /*!
+             * @return The value or an empty view if there is none.
+             */
+            StringView get(const StringView& name) const
+            {
+                return first(gets(), name);
+            }
+
+            //! All percent decoded cookies in the order they were received
+            const Container& cookies() const;
+
+            //! First percent decoded cookie value with this name
+            /*!
+             * @return The value or an empty view if there is none.
+             */
+            StringView cookie(const StringView& name) const
+            {
+                return first(cookies(), name);
+            }
+
+            Parameters():
+                m_getsDecoded(false),
+                m_cookiesDecoded(false)
+            {}
+
+        private:
+            //! The PARAMS records we point into
+            std::vector<Block> m_records;
+
+            //! Every parameter in the order it was received
+            Container m_parameters;
+
+            //! Percent decoded GET data
+            mutable Container m_gets;
+
+            //! True if m_gets has been filled
+            mutable bool m_getsDecoded;
+
+            //! Percent decoded cookies
+            mutable Container m_cookies;
+
+            //! True if m_cookies has been filled
+            mutable bool m_cookiesDecoded;
+
+            //! Buffers the percent decoded data lives in
+            mutable std::vector<std::unique_ptr<char[]>> m_buffers;
+
+            //! Percent decode url-encoded data into views
+            void decode(
+                    const StringView& data,
+                    const char* fieldSeparator,
+                    Container& output) const;
+
+            //! Value of the first pair in a container with this name
+            static StringView first(
+                    const Container& container,
+                    const StringView& name);
+        };
+
+        //! Flat container of url-encoded name/value pairs
+        /*!
+         * This is an alternative to a multimap for decodeUrlEncoded(). All
+         * fields sit in a single vector in the order they were received so
+         * there is no tree node per field. Lookups are linear which suits the
+         * handful of distinct names forms usually have.
+         *
+         * @tparam charT Character type to use for strings
+         * @tparam Allocator Allocator to use for strings and the vector. It
+         *                   is rebound as needed.
+         *
+         * @date    October 16, 2026
+         */
+        template<class charT, class Allocator=std::allocator<charT>>
+        class Fields
+        {
+        public:
+            //! String type of names and values
+            typedef std::basic_string<
+                charT,
+                std::char_traits<charT>,
+                Allocator> String;
+
+            //! A name/value pair
+            typedef std::pair<String, String> value_type;
+
+            //! Allocator of the underlying vector
+            typedef typename std::allocator_traits<Allocator>::template
+                rebind_alloc<value_type> allocator_type;
+
+            typedef typename std::vector<value_type, allocator_type>::iterator
+                iterator;
+            typedef typename std::vector<value_type, allocator_type>::
+                const_iterator const_iterator;
+
+            //! Append a field
+            iterator insert(value_type&& field)
+            {
+                m_fields.push_back(std::move(field));
+                return m_fields.end()-1;
+            }
+
+            //! First field with this name
+            /*!
+             * @return Iterator to the field or end() if there is none.
+             */
+            const_iterator find(const String& name) const
+            {
+                return std::find_if(
+                        m_fields.cbegin(),
+                        m_fields.cend(),
+                        [&name] (const value_type& field)
+                        {
+                            return field.first == name;
+                        });
+            }
+
+            //! Amount of fields with this name
+            size_t count(const String& name) const
+            {
+                return std::count_if(
+                        m_fields.cbegin(),
+                        m_fields.cend(),
+                        [&name] (const value_type& field)
+                        {
+                            return field.first == name;
+                        });
+            }
+
+            iterator begin()
+            {
+                return m_fields.begin();
+            }
+
+            iterator end()
+            {
+                return m_fields.end();
+            }
+
+            const_iterator begin() const
+            {
+                return m_fields.cbegin();
+            }
+
+            const_iterator end() const
+            {
+                return m_fields.cend();
+            }
+
+            //! Amount of fields
+            size_t size() const
+            {
+                return m_fields.size();
+            }
+
+            bool empty() const
+            {
+                return m_fields.empty();
+            }
+
+            void clear()
+            {
+                m_fields.clear();
+            }
+
+            void reserve(size_t size)
+            {
+                m_fields.reserve(size);
+            }
+
+            allocator_type get_allocator() const
+            {
+                return m_fields.get_allocator();
+            }
+
+            Fields(const allocator_type& allocator=allocator_type()):
+                m_fields(allocator)
+            {}
+
+        private:
+            //! The fields in the order they were inserted
+            std::vector<value_type, allocator_type> m_fields;
+        };
+
         //! Data structure of HTTP environment data
         /*!
          * This structure contains all HTTP environment data for each
          * individual request. The data is processed from FastCGI parameter
          * records.
          *
+         * All strings and containers use the allocator passed to the
+         * constructor. With an ArenaAllocator the dozens of small allocations
+         * made while filling the environment all come from a single Arena and
+         * are released in one shot along with it.
+         *
          * @tparam charT Character type to use for strings
+         * @tparam Allocator Allocator to use for strings and containers. It is
+         *                   rebound as needed. The library is only compiled
+         *                   for std::allocator<charT> and
+         *                   ArenaAllocator<charT>.
          *
          * @date    October 13, 2018
          * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
          */
-        template<class charT> struct Environment
+        template<class charT, class Allocator=std::allocator<charT>>
+        struct Environment
         {
+            static_assert(
+                    SupportedAllocator<charT, Allocator>::value,
+                    "Environment only supports std::allocator and"
+                    " ArenaAllocator");
+
+            //! Allocator rebound to another type
+            template<class T> using Rebind = typename std::allocator_traits<
+                Allocator>::template rebind_alloc<T>;
+
+            //! String type of all our string data
+            typedef std::basic_string<
+                charT,
+                std::char_traits<charT>,
+                Rebind<charT>> String;
+
+            //! Narrow string type
+            typedef std::basic_string<
+                char,
+                std::char_traits<char>,
+                Rebind<char>> NarrowString;
+
+            //! Container type for name/value pairs
+            typedef std::multimap<
+                String,
+                String,
+                std::less<String>,
+                Rebind<std::pair<const String, String>>> Multimap;
+
             //! Hostname of the server
-            std::basic_string<charT> host;
+            String host;
 
             //! User agent string
-            std::basic_string<charT> userAgent;
+            String userAgent;
 
             //! Content types the client accepts
-            std::basic_string<charT> acceptContentTypes;
+            String acceptContentTypes;
 
             //! Languages the client accepts
-            std::vector<std::string> acceptLanguages;
+            std::vector<NarrowString, Rebind<NarrowString>> acceptLanguages;
 
             //! Character sets the clients accepts
-            std::basic_string<charT> acceptCharsets;
+            String acceptCharsets;
 	  
             //! Http authorization string
-            std::basic_string<charT> authorization;
+            String authorization;
 	  
             //! Referral URL
-            std::basic_string<charT> referer;
+            String referer;
 
             //! Content type of data sent from client
-            std::basic_string<charT> contentType;
+            String contentType;
 
             //! HTTP root directory
-            std::basic_string<charT> root;
+            String root;
 
             //! Filename of script relative to the HTTP root directory
-            std::basic_string<charT> scriptName;
+            String scriptName;
 
             //! REQUEST_METHOD
             RequestMethod requestMethod;
 
             //! REQUEST_URI
-            std::basic_string<charT> requestUri;
+            String requestUri;
 
             //! Path information
-            std::vector<std::basic_string<charT>> pathInfo;
+            std::vector<String, Rebind<String>> pathInfo;
 
             //! The etag the client assumes this document should have
             unsigned etag;
@@ -186,28 +596,53 @@ namespace Fastcgipp
 
             //! Container with all other enironment variables
             std::map<
-                std::basic_string<charT>,
-                std::basic_string<charT>> others;
+                String,
+                String,
+                std::less<String>,
+                Rebind<std::pair<const String, String>>> others;
 
             //! Container with all url-encoded cookie data
-            std::multimap<
-                std::basic_string<charT>,
-                std::basic_string<charT>> cookies;
+            Multimap cookies;
 
             //! Container with all url-encoded GET data
-            std::multimap<
-                std::basic_string<charT>,
-                std::basic_string<charT>> gets;
+            Multimap gets;
 
             //! Container of non-file POST data
-            std::multimap<
-                std::basic_string<charT>,
-                std::basic_string<charT>> posts;
+            Multimap posts;
 
             //! Container of file POST data
             std::multimap<
-                std::basic_string<charT>,
-                File<charT>> files;
+                String,
+                File<charT>,
+                std::less<String>,
+                Rebind<std::pair<const String, File<charT>>>> files;
+
+            //! Files larger than this are spooled instead of held in memory
+            /*!
+             * See File::spooled. Defaults to the largest size_t so files are
+             * always held in memory in File::data.
+             */
+            size_t spoolThreshold;
+
+            //! Supplies sinks for uploaded files
+            /*!
+             * If set, this is called at the start of every file part of
+             * "multipart/form-data" POST data with the name of the part and
+             * a File containing it's filename and content type. Returning a
+             * FileSink has the file content written into it instead of being
+             * held in memory or spooled. Returning null leaves the file to be
+             * dealt with as usual.
+             */
+            std::function<std::unique_ptr<FileSink>(
+                    const String& name,
+                    const File<charT>& file)> fileSinks;
+
+            //! Raw parameters for a lazy environment
+            /*!
+             * This is only filled if the environment was built with index()
+             * instead of fill().
+             */
+            Parameters parameters;
 
             //! Parses FastCGI parameter data into the data structure
             /*!
@@ -223,6 +658,32 @@ namespace Fastcgipp
                     const char* data,
                     const char* dataEnd);
 
+            //! Keeps a FastCGI parameter record and indexes it
+            /*!
+             * This is the lazy alternative to fill(). The record is kept
+             * alive and it's parameters are made available through
+             * #parameters without being decoded. The only exceptions are
+             * CONTENT_LENGTH, CONTENT_TYPE and REQUEST_METHOD which are still
+             * decoded into their members since POST data can't be processed
+             * without them.
+             *
+             * A record that is a slice of a shared receive chunk is only kept
+             * as is if it's larger than #indexCopyLimit. Smaller ones are
+             * copied into a block of their own so they don't keep the whole
+             * chunk alive.
+             *
+             * @param[in] record The entire record
+             * @param[in] data Start of parameter data within the record
+             * @param[in] dataEnd 1+ the last byte of parameter data
+             */
+            void index(
+                    Block&& record,
+                    const char* data,
+                    const char* dataEnd);
+
+            //! Records up to this size are copied by index()
+            static constexpr size_t indexCopyLimit = 0x4000;
+
             //! Consolidates POST data into a single buffer
             /*!
              * This function will take arbitrarily divided chunks of raw http
@@ -245,6 +706,41 @@ namespace Fastcgipp
              */
             bool parsePostBuffer();
 
+            //! Parses POST data as it arrives
+            /*!
+             * Only "multipart/form-data" can be parsed this way. See
+             * streamable(). The data is parsed into #posts and #files as it
+             * comes in so nothing needs to be consolidated into the post
+             * buffer. Call finishPostStream() once there is no more data.
+             *
+             * @param[in] start Start of post data.
+             * @param[in] end 1+ the last byte of post data
+             * @return False if the data could not be parsed.
+             */
+            bool parsePostStream(
+                    const char* start,
+                    const char* end);
+
+            //! Finish parsing POST data passed to parsePostStream()
+            /*!
+             * @return False if the data could not be parsed or it ended before
+             *         the closing delimiter.
+             */
+            bool finishPostStream();
+
+            //! True if the POST data can be passed to parsePostStream()
+            bool streamable() const;
+
+            //! Amount of bytes of POST data received so far
+            /*!
+             * This counts data passed to both fillPostBuffer() and
+             * parsePostStream().
+             */
+            size_t postSize() const
+            {
+                return m_postSize;
+            }
+
             //! Get the post buffer
             const std::vector<char>& postBuffer() const
             {
@@ -258,19 +754,85 @@ namespace Fastcgipp
                 m_postBuffer.shrink_to_fit();
             }
 
-            Environment():
+            //! Constructor
+            /*!
+             * @param [in] allocator Allocator for all strings and containers
+             */
+            Environment(const Allocator& allocator=Allocator()):
+                host(allocator),
+                userAgent(allocator),
+                acceptContentTypes(allocator),
+                acceptLanguages(allocator),
+                acceptCharsets(allocator),
+                authorization(allocator),
+                referer(allocator),
+                contentType(allocator),
+                root(allocator),
+                scriptName(allocator),
                 requestMethod(RequestMethod::ERROR),
+                requestUri(allocator),
+                pathInfo(allocator),
                 etag(0),
                 keepAlive(0),
                 contentLength(0),
                 serverPort(0),
                 remotePort(0),
-                ifModifiedSince(0)
+                ifModifiedSince(0),
+                others(allocator),
+                cookies(allocator),
+                gets(allocator),
+                posts(allocator),
+                files(allocator),
+                spoolThreshold(std::numeric_limits<size_t>::max()),
+                m_postSize(0),
+                m_partName(allocator),
+                m_partIgnored(false),
+                m_registered(allocator),
+                m_allocator(allocator)
             {}
+
+            //! The allocator used for all strings and containers
+            Allocator get_allocator() const
+            {
+                return m_allocator;
+            }
+
+            //! Value of an application specific parameter
+            /*!
+             * @param [in] parameter Handle from registerParameter()
+             * @return The value or an empty string if the parameter wasn't
+             *         sent.
+             */
+            const String& registered(
+                    const RegisteredParameter& parameter) const
+            {
+                static const String empty;
+                if(parameter.index() < m_registered.size())
+                    return m_registered[parameter.index()];
+                return empty;
+            }
         private:
+            //! Decodes a single known parameter into it's member
+            /*!
+             * @return False if the parameter isn't a known one.
+             */
+            inline bool fill(
+                    const char* name,
+                    const char* value,
+                    const char* end);
+
             //! Parses "multipart/form-data" http post data
             inline void parsePostsMultipart();
 
+            //! Called by m_multipart at the start of every part
+            bool partStart(const MultipartParser::Part& part);
+
+            //! Called by m_multipart with every piece of part content
+            bool partData(const char* start, const char* end);
+
+            //! Called by m_multipart at the end of every part
+            bool partEnd();
+
             //! Parses "application/x-www-form-urlencoded" post data
             inline void parsePostsUrlEncoded();
 
@@ -279,10 +841,44 @@ namespace Fastcgipp
 
             //! Buffer for processing post data
             std::vector<char> m_postBuffer;
+
+            //! Amount of bytes of POST data received so far
+            size_t m_postSize;
+
+            //! Parser for "multipart/form-data" POST data
+            std::unique_ptr<MultipartParser> m_multipart;
+
+            //! Name of the part currently being parsed
+            String m_partName;
+
+            //! File of the part currently being parsed if it is a file
+            std::unique_ptr<File<charT>> m_partFile;
+
+            //! Content of the part currently being parsed
+            /*!
+             * This holds the entire value of regular parts but only up to
+             * #spoolThreshold bytes of file parts.
+             */
+            std::vector<char> m_partData;
+
+            //! Where file content goes once it isn't held in m_partData
+            std::unique_ptr<FileSink> m_partSink;
+
+            //! True if the part currently being parsed is ignored
+            bool m_partIgnored;
+
+            //! Values of application specific parameters
+            std::vector<String, Rebind<String>> m_registered;
+
+            //! The allocator used for all strings and containers
+            const Allocator m_allocator;
         };
 
         //! Convert a char array to a std::wstring
         /*!
+         * The array is decoded as UTF-8. Malformed input is replaced with
+         * Utf8::inputReplacement.
+         *
          * @param[in] start First byte in char array
          * @param[in] end 1+ last byte of the array (no null terminator)
          * @param[out] string Reference to the wstring that should be modified
@@ -306,6 +902,45 @@ namespace Fastcgipp
             string.assign(start, end);
         }
 
+        //! Convert a char array to a wide string with any allocator
+        /*!
+         * @param[in] start First byte in char array
+         * @param[in] end 1+ last byte of the array (no null terminator)
+         * @param[out] string Reference to the string that should be modified
+         */
+        template<class Allocator> void vecToString(
+                const char* start,
+                const char* end,
+                std::basic_string<
+                    wchar_t,
+                    std::char_traits<wchar_t>,
+                    Allocator>& string)
+        {
+            string.resize(end-start);
+            string.resize(Utf8::decode(
+                        start,
+                        end,
+                        &string[0],
+                        Utf8::inputReplacement) - string.data());
+        }
+
+        //! Convert a char string to a string with any allocator
+        /*!
+         * @param[in] start First byte in char string
+         * @param[in] end 1+ last byte of the string (no null terminator)
+         * @param[out] string Reference to the string that should be modified
+         */
+        template<class Allocator> void vecToString(
+                const char* start,
+                const char* end,
+                std::basic_string<
+                    char,
+                    std::char_traits<char>,
+                    Allocator>& string)
+        {
+            string.assign(start, end);
+        }
+
         //! Convert a char string to an integer
         /*!
          * This function is very similar to std::atoi() except that it takes
@@ -343,12 +978,32 @@ namespace Fastcgipp
          * @param[out] output Container to output data into
          * @param[in] fieldSeparator String that signifies field separation
          */
-        template<class charT> void decodeUrlEncoded(
+        template<class charT, class Allocator, class MapAllocator>
+        void decodeUrlEncoded(
                 const char* data,
                 const char* dataEnd,
                 std::multimap<
-                    std::basic_string<charT>,
-                    std::basic_string<charT>>& output,
+                    std::basic_string<charT, std::char_traits<charT>, Allocator>,
+                    std::basic_string<charT, std::char_traits<charT>, Allocator>,
+                    std::less<std::basic_string<
+                        charT,
+                        std::char_traits<charT>,
+                        Allocator>>,
+                    MapAllocator>& output,
+                const char* const fieldSeparator="&");
+
+        //! Decodes a url-encoded string into a flat container
+        /*!
+         * @param[in] data Data to decode
+         * @param[in] dataEnd +1 last byte to decode
+         * @param[out] output Container to append the fields to
+         * @param[in] fieldSeparator String that signifies field separation
+         */
+        template<class charT, class Allocator>
+        void decodeUrlEncoded(
+                const char* data,
+                const char* dataEnd,
+                Fields<charT, Allocator>& output,
                 const char* const fieldSeparator="&");
 
         //! Convert a string with percent escaped byte values to their values
@@ -356,7 +1011,8 @@ namespace Fastcgipp
          * Since converting a percent escaped string to actual values can only
          * make it shorter, it is safe to assume that the return value will
          * always be smaller than size. It is thereby a safe move to make the
-         * destination block of memory the same size as the source.
+         * destination block of memory the same size as the source. The
+         * destination may even be the source itself.
          *
          * @param[in] start Iterator to the first character in the percent
          *                  escaped string
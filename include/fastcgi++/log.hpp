@@ -40,6 +40,14 @@
 namespace Fastcgipp
 {
     //! Contains the Fastcgipp debugging/logging mechanism
+    /*!
+     * Log entries are formatted into a per thread buffer and then written
+     * out to logstream. By default they are written right away with the mutex
+     * held. Call startAsync() to have them queued in lock free per thread
+     * rings instead and written out by a background thread. Should a thread
+     * fill up it's ring, further entries are dropped and counted until there
+     * is room again.
+     */
     namespace Logging
     {
         //! The actual stream we will be logging to.
@@ -68,19 +76,67 @@ namespace Fastcgipp
             DIAG = 5,
         };
 
+        //! Ways to write out log entries
+        enum class Format
+        {
+            //! Syslog style lines of text
+            TEXT,
+
+            //! One JSON object per line
+            /*!
+             * Each object has a time, host, program, level and message
+             * member.
+             */
+            JSON
+        };
+
+        //! How to write out log entries
+        extern Format format;
+
         //! Send a log header to logstream
         void header(Level level);
+
+        //! Start formatting a log entry
+        /*!
+         * @return A stream to format the message into. It belongs to the
+         *         calling thread.
+         */
+        std::wostream& begin();
+
+        //! Send off the log entry formatted since begin()
+        void end(Level level);
+
+        //! Start writing out log entries from a background thread
+        /*!
+         * If we are already logging asynchronously this does nothing.
+         *
+         * @param[in] capacity Amount of entries that fit in each thread's
+         *                     ring. This is rounded up to a power of two.
+         */
+        void startAsync(size_t capacity=1024);
+
+        //! Go back to writing out log entries right away
+        /*!
+         * Everything already queued is written out before this returns.
+         * This happens automatically on exit and on FAIL_LOG().
+         */
+        void stopAsync();
+
+        //! How many log entries were dropped because a ring was full
+        unsigned long long dropped();
     }
 }
 
+//! Format a log entry and send it off
+#define FASTCGIPP_LOG(level, data) {\
+    std::wostream& fastcgippLogMessage = ::Fastcgipp::Logging::begin();\
+    fastcgippLogMessage << data;\
+    ::Fastcgipp::Logging::end(level);}
+
 //! This is for the user to log whatever they want.
 #define INFO_LOG(data) {\
     if(!::Fastcgipp::Logging::suppress)\
-    { \
-        std::lock_guard<std::mutex> lock(::Fastcgipp::Logging::mutex);\
-        ::Fastcgipp::Logging::header(::Fastcgipp::Logging::INFO);\
-        *::Fastcgipp::Logging::logstream << data << std::endl;\
-    }}
+        FASTCGIPP_LOG(::Fastcgipp::Logging::INFO, data)}
 
 //! Log any "errors" that cannot be recovered from and then exit.
 /*!
@@ -91,9 +147,7 @@ namespace Fastcgipp
 #define FAIL_LOG(data) {\
     if(!::Fastcgipp::Logging::suppress)\
     { \
-        std::lock_guard<std::mutex> lock(::Fastcgipp::Logging::mutex);\
-        ::Fastcgipp::Logging::header(::Fastcgipp::Logging::FAIL);\
-        *::Fastcgipp::Logging::logstream << data << std::endl;\
+        FASTCGIPP_LOG(::Fastcgipp::Logging::FAIL, data)\
         std::exit(EXIT_FAILURE);\
     }}
 
@@ -105,11 +159,7 @@ namespace Fastcgipp
  * mechanism to recover from said error.
  */
 #define ERROR_LOG(data) \
-    { \
-        std::lock_guard<std::mutex> lock(::Fastcgipp::Logging::mutex);\
-        ::Fastcgipp::Logging::header(::Fastcgipp::Logging::ERROR);\
-        *::Fastcgipp::Logging::logstream << data << std::endl;\
-    }
+    FASTCGIPP_LOG(::Fastcgipp::Logging::ERROR, data)
 #else
 #define ERROR_LOG(data) {}
 #endif
@@ -123,11 +173,7 @@ namespace Fastcgipp
  */
 #define WARNING_LOG(data) {\
     if(!::Fastcgipp::Logging::suppress)\
-    { \
-        std::lock_guard<std::mutex> lock(::Fastcgipp::Logging::mutex);\
-        ::Fastcgipp::Logging::header(::Fastcgipp::Logging::WARNING);\
-        *::Fastcgipp::Logging::logstream << data << std::endl;\
-    }}
+        FASTCGIPP_LOG(::Fastcgipp::Logging::WARNING, data)}
 #else
 #define WARNING_LOG(data) {}
 #endif
@@ -136,11 +182,7 @@ namespace Fastcgipp
 //! The intention here is for general debug/analysis logging
 #define DEBUG_LOG(data) {\
     if(!::Fastcgipp::Logging::suppress)\
-    { \
-        std::lock_guard<std::mutex> lock(::Fastcgipp::Logging::mutex);\
-        ::Fastcgipp::Logging::header(::Fastcgipp::Logging::DEBUG);\
-        *::Fastcgipp::Logging::logstream << data << std::endl;\
-    }}
+        FASTCGIPP_LOG(::Fastcgipp::Logging::DEBUG, data)}
 #else
 #define DEBUG_LOG(data) {}
 #endif
@@ -149,11 +191,7 @@ namespace Fastcgipp
 //! The intention here is for internal library debug/analysis logging
 #define DIAG_LOG(data) {\
     if(!::Fastcgipp::Logging::suppress)\
-    { \
-        std::lock_guard<std::mutex> lock(::Fastcgipp::Logging::mutex);\
-        ::Fastcgipp::Logging::header(::Fastcgipp::Logging::DIAG);\
-        *::Fastcgipp::Logging::logstream << data << std::endl;\
-    }}
+        FASTCGIPP_LOG(::Fastcgipp::Logging::DIAG, data)}
 #else
 #define DIAG_LOG(data) {}
 #endif
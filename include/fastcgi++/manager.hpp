@@ -35,12 +35,16 @@
 #include <thread>
 #include <mutex>
 #include <shared_mutex>
+#include <condition_variable>
 #include <memory>
 #include <functional>
 
 #include "fastcgi++/protocol.hpp"
 #include "fastcgi++/transceiver.hpp"
 #include "fastcgi++/request.hpp"
+#include "fastcgi++/requesttable.hpp"
+#include "fastcgi++/taskqueue.hpp"
+#include "fastcgi++/metrics.hpp"
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -182,6 +186,19 @@ namespace Fastcgipp
             m_transceiver.reuseAddress(value);
         }
 
+        //! Set the maximum amount of events harvested per OS level poll
+        /*!
+         * Larger values mean fewer system calls when many connections are
+         * active at once. Call this before start().
+         *
+         * @param [in] size Maximum events per OS level poll. Defaults to 1.
+         * @sa Poll::batchSize()
+         */
+        void pollBatchSize(unsigned size)
+        {
+            m_transceiver.pollBatchSize(size);
+        }
+
         //! Call before start to change the number of threads
         /*!
          * If the Manager is already running this will do nothing.
@@ -193,6 +210,63 @@ namespace Fastcgipp
          */
         void resizeThreads(unsigned threads);
 
+        //! Set how overloaded a thread must be before others steal from it
+        /*!
+         * Every request is pinned to the thread that it was first scheduled
+         * on so that it's data stays in that core's cache. An idle thread
+         * will only take work from another thread's queue if it holds more
+         * than this many tasks. The request then becomes pinned to the
+         * idle thread.
+         *
+         * @param[in] threshold Queued tasks a thread may have before it is
+         *                      considered overloaded. Defaults to 2. Zero
+         *                      means idle threads steal any waiting task.
+         */
+        void stealThreshold(unsigned threshold)
+        {
+            m_stealThreshold = threshold;
+        }
+
+        //! Call before start to change the number of transceiver reactors
+        /*!
+         * By default all socket I/O happens in a single thread. Increasing
+         * the amount of reactors spreads connections over that many I/O
+         * threads, each with their own poll set and buffers.
+         *
+         * If the Manager is already running this will do nothing.
+         *
+         * @param[in] reactors Number of I/O threads to use
+         *
+         * @sa Transceiver::resizeReactors()
+         */
+        void resizeReactors(unsigned reactors)
+        {
+            if(m_stop)
+                m_transceiver.resizeReactors(reactors);
+        }
+
+        //! Call before start to have every request traced
+        /*!
+         * Each request gets a Trace of when it went through each of it's
+         * phases. Once the last byte of the request has been written, or it's
+         * connection has died, the trace is passed to the hook. The hook is
+         * called from the transceiver and worker threads so it should be
+         * thread safe and quick. Feeding Trace::elapsed() into a
+         * Metrics::Histogram is a good way to go.
+         *
+         * If the Manager is already running this will do nothing. Pass an
+         * empty function to stop tracing.
+         *
+         * @param[in] hook Function to receive the finished traces
+         */
+        void trace(const Trace::Hook& hook)
+        {
+            if(m_stop)
+                m_traceHook = hook ?
+                    std::make_shared<const Trace::Hook>(hook)
+                    : std::shared_ptr<const Trace::Hook>();
+        }
+
     protected:
         //! Make a request object
         virtual std::unique_ptr<Request_base> makeRequest(
@@ -203,18 +277,44 @@ namespace Fastcgipp
         //! Handles low level communication with the other side
         Transceiver m_transceiver;
 
+        //! Where finished traces go. Null if we aren't tracing.
+        std::shared_ptr<const Trace::Hook> m_traceHook;
+
     private:
-        //! Queue for pending tasks
-        std::queue<Protocol::RequestId> m_tasks;
+        //! Everything needed for a single handler() thread
+        struct Worker
+        {
+            //! Tasks for requests pinned to this thread
+            TaskQueue<Protocol::RequestId> tasks;
 
-        //! Thread safe our tasks
-        std::mutex m_tasksMutex;
+            //! This thread sleeps on this when idle
+            EventCount idle;
 
-        //! An associative container for our requests
-        Protocol::Requests<std::unique_ptr<Request_base>> m_requests;
+            //! The thread itself
+            std::thread thread;
+        };
+
+        //! Our handler() threads
+        std::vector<std::unique_ptr<Worker>> m_workers;
+
+        //! Thread safe resizing m_workers against sampling the queued tasks
+        /*!
+         * The handler() threads don't need this since m_workers is only
+         * resized while they aren't running.
+         */
+        std::mutex m_workersMutex;
+
+        //! Tasks queued beyond this make a worker overloaded
+        std::atomic_uint m_stealThreshold;
 
-        //! Thread safe our requests
-        std::shared_timed_mutex m_requestsMutex;
+        //! Round robin counter for spreading out new work
+        std::atomic_uint m_nextWorker;
+
+        //! An associative container for our requests
+        /*!
+         * This is internally thread safe on a per shard basis.
+         */
+        RequestTable<std::unique_ptr<Request_base>> m_requests;
 
         //! Local messages
         std::queue<std::pair<Message, Socket>> m_messages;
@@ -223,7 +323,43 @@ namespace Fastcgipp
         std::mutex m_messagesMutex;
 
         //! General handling function to have it's own thread
-        void handler();
+        /*!
+         * @param[in] index Index of the worker this is running for.
+         */
+        void handler(unsigned index);
+
+        //! Create a new request if a message is a BEGIN_REQUEST record
+        /*!
+         * The shard must be locked for writing.
+         *
+         * @param[in] shard Shard the request belongs in
+         * @param[in] id ID of the request
+         * @param[in] message The message to check
+         * @return The new request or null if the message isn't a
+         *         BEGIN_REQUEST record.
+         */
+        Request_base* beginRequest(
+                RequestTable<std::unique_ptr<Request_base>>::Shard& shard,
+                const Protocol::RequestId& id,
+                const Message& message);
+
+        //! Queue a task up for a specific worker
+        inline void schedule(const Protocol::RequestId& id, unsigned worker);
+
+        //! Pick a worker for new work
+        inline unsigned leastLoaded();
+
+        //! Take a task from an overloaded worker
+        /*!
+         * @return True if a task was stolen.
+         */
+        inline bool steal(unsigned index, Protocol::RequestId& id);
+
+        //! True if any worker is overloaded
+        inline bool overloaded() const;
+
+        //! Wake all the workers up
+        void wakeAll();
 
         //! Handles management messages
         /*!
@@ -233,51 +369,49 @@ namespace Fastcgipp
         inline void localHandler();
 
         //! True when the manager should be terminating
-        bool m_terminate;
+        std::atomic_bool m_terminate;
 
         //! True when the manager should be stopping
-        bool m_stop;
+        std::atomic_bool m_stop;
 
         //! Thread safe starting and stopping
         std::mutex m_startStopMutex;
 
-        //! Threads our manager is running in
-        std::vector<std::thread> m_threads;
-
-        //! Condition variable to wake handler() threads up
-        std::condition_variable m_wake;
-
         //! General function to handler POSIX signals
         static void signalHandler(int signum);
 
         //! Pointer to the %Manager object
         static Manager_base* instance;
 
-#if FASTCGIPP_LOG_LEVEL > 3
-        //! Debug counter for new requests
-        std::atomic_ullong m_requestCount;
+        //! Counter for new requests
+        Metrics::Counter& m_requestCount;
 
-        //! Debug counter for max requests
-        size_t m_maxRequests;
+        //! Gauge of requests in progress
+        Metrics::Gauge& m_activeRequests;
 
-        //! Debug counter for management records
-        std::atomic_ullong m_managementRecordCount;
+        //! Histogram of request durations in microseconds
+        Metrics::Histogram& m_requestDuration;
 
-        //! Debug counter for bad socket messages
-        std::atomic_ullong m_badSocketMessageCount;
+        //! Counter for management records
+        Metrics::Counter& m_managementRecordCount;
 
-        //! Debug counter for bad socket kills
-        std::atomic_ullong m_badSocketKillCount;
+        //! Counter for bad socket messages
+        Metrics::Counter& m_badSocketMessageCount;
 
-        //! Debug counter for request messages received
-        std::atomic_ullong m_messageCount;
+        //! Counter for bad socket kills
+        Metrics::Counter& m_badSocketKillCount;
 
-        //! Debug counter currently active handler() threads
-        unsigned m_activeThreads;
+        //! Counter for request messages received
+        Metrics::Counter& m_messageCount;
 
-        //! Debug counter max active handler() threads
-        unsigned m_maxActiveThreads;
-#endif
+        //! Gauge of active handler() threads
+        Metrics::Gauge& m_activeThreads;
+
+        //! Counter for tasks stolen from overloaded threads
+        Metrics::Counter& m_stealCount;
+
+        //! Counter for requests handled on a different thread
+        Metrics::Counter& m_migrationCount;
     };
 
     //! General task and protocol management class
@@ -321,11 +455,38 @@ namespace Fastcgipp
             using namespace std::placeholders;
 
             std::unique_ptr<RequestT> request(new RequestT);
+            Request_base& base = *request;
             request->configure(
                     id,
                     role,
                     kill,
-                    std::bind(&Transceiver::send, &m_transceiver, _1, _2, _3),
+                    [this, &base] (
+                        const Socket& socket,
+                        Block&& data,
+                        bool kill)
+                    {
+                        // The END_REQUEST record holds on to the trace
+                        // until it's written
+                        if(base.trace
+                                && base.trace->reached(Trace::Phase::END))
+                            m_transceiver.send(
+                                    socket,
+                                    std::move(data),
+                                    kill,
+                                    base.trace);
+                        else
+                            m_transceiver.send(socket, std::move(data), kill);
+                    },
+                    [this] (
+                        const Socket& socket,
+                        Block&& data,
+                        FileSegment&& file)
+                    {
+                        m_transceiver.send(
+                                socket,
+                                std::move(data),
+                                std::move(file));
+                    },
                     std::bind(&Manager_base::push, this, id, _1));
             return request;
         }
@@ -0,0 +1,419 @@
+/*!
+ * @file       metrics.hpp
+ * @brief      Declares the Fastcgipp::Metrics classes
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_METRICS_HPP
+#define FASTCGIPP_METRICS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    class SocketGroup;
+
+    //! Runtime metrics that are always collected
+    /*!
+     * Metrics are kept in a Registry by name and live as long as it does.
+     * Counters and histograms are split into per thread shards so that
+     * updating them costs a relaxed atomic add on a cache line that no other
+     * thread is likely to be touching. Reading them adds up the shards.
+     *
+     * The library keeps it's own metrics in the process wide registry()
+     * under names starting with "fastcgipp_".
+     */
+    namespace Metrics
+    {
+        //! Amount of shards counters and histograms are split into
+        /*!
+         * This is the hardware concurrency rounded up to a power of two
+         * and capped at 64.
+         */
+        unsigned shards();
+
+        //! Shard belonging to the calling thread
+        unsigned shard();
+
+        //! A value that only ever goes up
+        /*!
+         * @date    October 16, 2026
+         */
+        class Counter
+        {
+        public:
+            //! Add to the counter
+            void add(unsigned long long value=1)
+            {
+                m_cells[shard()].value.fetch_add(
+                        value,
+                        std::memory_order_relaxed);
+            }
+
+            //! Current value of the counter
+            unsigned long long value() const;
+
+            Counter();
+            Counter(const Counter&) =delete;
+
+        private:
+            //! Keeps the shards on separate cache lines
+            struct Cell
+            {
+                std::atomic_ullong value;
+                char padding[64-sizeof(std::atomic_ullong)];
+            };
+
+            //! The shards
+            std::unique_ptr<Cell[]> m_cells;
+        };
+
+        //! A value that goes up and down
+        /*!
+         * Gauges aren't sharded since the high water mark needs to know the
+         * current value. They should be used for things that change at most
+         * a few times per request.
+         *
+         * @date    October 16, 2026
+         */
+        class Gauge
+        {
+        public:
+            //! Add to the gauge
+            void add(long long value=1)
+            {
+                raise(m_value.fetch_add(value, std::memory_order_relaxed)
+                        + value);
+            }
+
+            //! Subtract from the gauge
+            void sub(long long value=1)
+            {
+                m_value.fetch_sub(value, std::memory_order_relaxed);
+            }
+
+            //! Set the gauge
+            void set(long long value)
+            {
+                m_value.store(value, std::memory_order_relaxed);
+                raise(value);
+            }
+
+            //! Current value of the gauge
+            long long value() const
+            {
+                return m_value.load(std::memory_order_relaxed);
+            }
+
+            //! Highest value the gauge has ever had
+            long long max() const
+            {
+                return m_max.load(std::memory_order_relaxed);
+            }
+
+            Gauge():
+                m_value(0),
+                m_max(0)
+            {}
+
+            Gauge(const Gauge&) =delete;
+
+        private:
+            std::atomic_llong m_value;
+            std::atomic_llong m_max;
+
+            //! Update the high water mark
+            void raise(long long value)
+            {
+                long long max = m_max.load(std::memory_order_relaxed);
+                while(value > max && !m_max.compare_exchange_weak(
+                            max,
+                            value,
+                            std::memory_order_relaxed));
+            }
+        };
+
+        //! Distribution of values like latencies
+        /*!
+         * Values are counted in buckets with a fixed relative precision
+         * much like an HDR histogram. Every power of two is split into
+         * 2^precision linear buckets so any percentile is accurate to within
+         * 1/2^precision of the actual value. Values beyond maxValue are
+         * counted as maxValue.
+         *
+         * @date    October 16, 2026
+         */
+        class Histogram
+        {
+        public:
+            //! Bits of precision within each power of two
+            static const unsigned precision = 4;
+
+            //! Largest value that is counted as is
+            static const unsigned long long maxValue = (1ULL<<40)-1;
+
+            //! Amount of buckets
+            static const unsigned buckets = (40-precision+1)<<precision;
+
+            //! Point in time copy of a histogram
+            struct Snapshot
+            {
+                //! Amount of values recorded
+                unsigned long long count;
+
+                //! Sum of all values recorded
+                unsigned long long sum;
+
+                //! Largest value recorded
+                unsigned long long max;
+
+                //! Amount of values in each bucket
+                std::vector<unsigned long long> counts;
+
+                //! Value that a fraction of the recorded values are below
+                /*!
+                 * @param[in] fraction Fraction of values between 0 and 1
+                 * @return The middle of the bucket the percentile lies in
+                 */
+                unsigned long long percentile(double fraction) const;
+
+                //! Mean of all the values recorded
+                double mean() const
+                {
+                    return count ? double(sum)/count : 0;
+                }
+            };
+
+            //! Record a value
+            void record(unsigned long long value);
+
+            //! Take a point in time copy
+            Snapshot snapshot() const;
+
+            //! Bucket a value is counted in
+            static unsigned bucket(unsigned long long value);
+
+            //! Smallest value counted in a bucket
+            static unsigned long long lowest(unsigned bucket);
+
+            Histogram();
+            Histogram(const Histogram&) =delete;
+
+        private:
+            //! A single thread's share of the histogram
+            struct Shard
+            {
+                std::atomic_ullong counts[buckets];
+                std::atomic_ullong sum;
+                std::atomic_ullong max;
+                char padding[64];
+            };
+
+            //! The shards
+            std::unique_ptr<Shard[]> m_shards;
+        };
+
+        //! Named collection of metrics
+        /*!
+         * Metrics are created on first use and live as long as the registry
+         * so references to them stay valid. Asking for an existing name
+         * returns the existing metric. All member functions are thread safe.
+         *
+         * @date    October 16, 2026
+         */
+        class Registry
+        {
+        public:
+            //! Kinds of metrics
+            enum class Kind
+            {
+                COUNTER,
+                GAUGE,
+                HISTOGRAM
+            };
+
+            //! Point in time value of a single metric
+            struct Sample
+            {
+                std::string name;
+                std::string help;
+                Kind kind;
+
+                //! Value of a counter or gauge
+                long long value;
+
+                //! High water mark of a gauge
+                long long max;
+
+                //! Copy of a histogram
+                Histogram::Snapshot histogram;
+            };
+
+            //! Get a counter
+            Counter& counter(const std::string& name, const std::string& help);
+
+            //! Get a gauge
+            Gauge& gauge(const std::string& name, const std::string& help);
+
+            //! Get a histogram
+            Histogram& histogram(
+                    const std::string& name,
+                    const std::string& help);
+
+            //! Add a gauge that is sampled whenever a snapshot is taken
+            /*!
+             * This costs nothing until the registry is actually looked at so
+             * it's the way to go for queue depths and the like. Use remove()
+             * before anything the function uses goes away.
+             */
+            void gauge(
+                    const std::string& name,
+                    const std::string& help,
+                    const std::function<long long()>& sample);
+
+            //! Remove a sampled gauge
+            void remove(const std::string& name);
+
+            //! Point in time values of every metric sorted by name
+            std::vector<Sample> snapshot() const;
+
+            //! Write out every metric in the Prometheus text format
+            /*!
+             * Gauges have their high water mark written as a second gauge
+             * with "_max" appended to the name. Histograms are written as
+             * summaries.
+             */
+            void write(std::ostream& out) const;
+
+        private:
+            //! A single registered metric
+            struct Metric
+            {
+                std::string help;
+                Kind kind;
+                std::unique_ptr<Counter> counter;
+                std::unique_ptr<Gauge> gauge;
+                std::unique_ptr<Histogram> histogram;
+                std::function<long long()> sample;
+            };
+
+            //! The metrics by name
+            std::map<std::string, Metric> m_metrics;
+
+            //! Thread safe the metrics
+            mutable std::mutex m_mutex;
+
+            //! Find or create a metric
+            Metric& get(
+                    const std::string& name,
+                    const std::string& help,
+                    Kind kind);
+        };
+
+        //! The process wide registry
+        Registry& registry();
+
+        //! Serves a registry as text on a socket
+        /*!
+         * Anything written to a connection gets every metric back in the
+         * Prometheus text format followed by the connection being closed. If
+         * what was written looks like an HTTP request the text comes with
+         * an HTTP response header. This means either of these work.
+         *
+         *     echo | nc -U /var/run/app-metrics
+         *     curl --unix-socket /var/run/app-metrics http://localhost/
+         *
+         * The server runs in it's own thread so it works no matter how busy
+         * the Manager is.
+         *
+         * @date    October 16, 2026
+         */
+        class Server
+        {
+        public:
+            //! Serve a registry
+            Server(Registry& registry = Metrics::registry());
+
+            ~Server();
+
+            //! Listen to a named socket
+            /*!
+             * See SocketGroup::listen().
+             */
+            bool listen(
+                    const char* name,
+                    uint32_t permissions = 0xffffffffUL,
+                    const char* owner = nullptr,
+                    const char* group = nullptr);
+
+            //! Listen to a TCP port
+            /*!
+             * See SocketGroup::listen().
+             */
+            bool listen(const char* interface, const char* service);
+
+            //! Start serving in a background thread
+            void start();
+
+            //! Stop serving and wait for the thread to finish
+            void stop();
+
+        private:
+            //! The registry we serve
+            Registry& m_registry;
+
+            //! Where our own connections are counted
+            /*!
+             * This is kept apart so that serving the metrics doesn't show up
+             * in the connection and byte counts it serves.
+             */
+            Registry m_groupRegistry;
+
+            //! Our listen socket and connections
+            std::unique_ptr<SocketGroup> m_group;
+
+            //! Set to have the thread stop
+            std::atomic_bool m_stop;
+
+            //! Serving thread
+            std::thread m_thread;
+
+            //! Serve connections until stopped
+            void handler();
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,300 @@
+/*!
+ * @file       multipart.hpp
+ * @brief      Declares the Fastcgipp::Http::MultipartParser and
+ *             Fastcgipp::Http::FileSink classes
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_MULTIPART_HPP
+#define FASTCGIPP_MULTIPART_HPP
+
+#include <functional>
+#include <memory>
+#include <string>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Defines classes and functions relating to the HTTP protocol
+    namespace Http
+    {
+        //! Somewhere to put the content of an uploaded file
+        /*!
+         * As "multipart/form-data" POST data is parsed the content of every
+         * file part is handed to a sink piece by piece as it arrives. Should
+         * the part be cut short the sink is destroyed without finish() ever
+         * being called.
+         *
+         * @date    October 16, 2026
+         */
+        class FileSink
+        {
+        public:
+            //! Write the next piece of file content
+            /*!
+             * @param [in] data Start of the content
+             * @param [in] size Size of the content in bytes
+             * @return False if the content could not be written. This aborts
+             *         parsing of the POST data.
+             */
+            virtual bool write(const char* data, size_t size) =0;
+
+            //! Called once the entire file has been written
+            /*!
+             * @return False if the file could not be completed. This aborts
+             *         parsing of the POST data.
+             */
+            virtual bool finish()
+            {
+                return true;
+            }
+
+            //! The file content once finished if it can be accessed directly
+            /*!
+             * Whatever is returned here ends up in File::spooled. The default
+             * returns nothing.
+             */
+            virtual std::shared_ptr<const char> contents() const
+            {
+                return std::shared_ptr<const char>();
+            }
+
+            virtual ~FileSink() {}
+        };
+
+        //! Spools a file into an unlinked temporary file
+        /*!
+         * The temporary file is created in the directory named by the TMPDIR
+         * environment variable or /tmp if it isn't set. It is unlinked right
+         * away so nothing is left behind should the process die. Once
+         * finished the file is memory mapped read only and can be accessed
+         * through contents() for as long as any copy of the returned pointer
+         * lives.
+         *
+         * @date    October 16, 2026
+         */
+        class SpoolFile: public FileSink
+        {
+        public:
+            bool write(const char* data, size_t size);
+            bool finish();
+
+            std::shared_ptr<const char> contents() const
+            {
+                return m_contents;
+            }
+
+            //! Amount of bytes written so far
+            size_t size() const
+            {
+                return m_size;
+            }
+
+            SpoolFile();
+            ~SpoolFile();
+            SpoolFile(const SpoolFile&) =delete;
+
+        private:
+            //! File descriptor of the temporary file. Negative if none.
+            int m_file;
+
+            //! Amount of bytes written so far
+            size_t m_size;
+
+            //! Memory map of the finished file
+            std::shared_ptr<const char> m_contents;
+        };
+
+        //! Incremental "multipart/form-data" parser
+        /*!
+         * Data can be fed into this parser in arbitrarily divided chunks as
+         * it arrives. Nothing beyond the part headers and a boundary's worth
+         * of carried over bytes is ever buffered. The content of each part is
+         * passed on as it is found through the data callback, which usually
+         * means in pieces.
+         *
+         * @date    October 16, 2026
+         */
+        class MultipartParser
+        {
+        public:
+            //! Headers of a single part
+            struct Part
+            {
+                //! Raw name from the Content-Disposition header
+                std::string name;
+
+                //! Raw filename from the Content-Disposition header
+                std::string filename;
+
+                //! Raw value of the Content-Type header
+                std::string contentType;
+
+                //! True if the part had a name
+                bool named;
+
+                //! True if the part had a Content-Type header
+                /*!
+                 * This is what distinguishes files from regular values.
+                 */
+                bool file;
+            };
+
+            //! Called with the headers at the start of every part
+            typedef std::function<bool(const Part& part)> PartCallback;
+
+            //! Called with every piece of part content
+            typedef std::function<bool(const char* start, const char* end)>
+                DataCallback;
+
+            //! Called at the end of every part
+            typedef std::function<bool()> EndCallback;
+
+            //! Feed the next chunk of POST data into the parser
+            /*!
+             * @param [in] start Start of the data
+             * @param [in] end 1+ the last byte of the data
+             * @return False if the data is malformed or a callback returned
+             *         false. The parser then ignores any further data.
+             */
+            bool parse(const char* start, const char* end);
+
+            //! True if the closing boundary has been found
+            bool complete() const
+            {
+                return m_state == State::EPILOGUE;
+            }
+
+            //! True if parsing has failed
+            bool failed() const
+            {
+                return m_state == State::FAILED;
+            }
+
+            //! Constructor
+            /*!
+             * All callbacks can return false to abort parsing.
+             *
+             * @param [in] boundary Start of the boundary as given in the
+             *                      Content-Type. Quotes are taken care of.
+             * @param [in] boundaryEnd 1+ the last byte of the boundary
+             * @param [in] part Called with the headers of every part
+             * @param [in] data Called with pieces of part content
+             * @param [in] end Called at the end of every part
+             */
+            MultipartParser(
+                    const char* boundary,
+                    const char* boundaryEnd,
+                    const PartCallback& part,
+                    const DataCallback& data,
+                    const EndCallback& end);
+
+            //! Maximum size of the headers of a single part
+            static const size_t maxHeaderSize = 0x4000;
+
+        private:
+            //! Where we are in the POST data
+            enum class State
+            {
+                PREAMBLE,
+                DELIMITER,
+                HEADERS,
+                BODY,
+                EPILOGUE,
+                FAILED
+            };
+
+            //! Where we are in the POST data
+            State m_state;
+
+            //! CRLF, two dashes and the boundary
+            std::string m_delimiter;
+
+            //! Bytes from the last chunk that may be the start of a delimiter
+            /*!
+             * This starts off as a CRLF since the first boundary need not be
+             * preceded by one.
+             */
+            std::string m_carry;
+
+            //! Headers of the current part as they are received
+            std::string m_headers;
+
+            //! Start of the last line in m_headers
+            size_t m_line;
+
+            //! True if we've seen a dash right after a delimiter
+            bool m_dash;
+
+            //! Headers of the current part
+            Part m_part;
+
+            PartCallback m_partCallback;
+            DataCallback m_dataCallback;
+            EndCallback m_endCallback;
+
+            //! Find a complete delimiter
+            /*!
+             * This is vectorized with SSE2 or AVX2 if the compiler targets
+             * them. Otherwise it falls back to memchr() for the first byte.
+             *
+             * @param [in] start Start of the data to search
+             * @param [in] end 1+ the last byte of the data to search
+             * @return Start of the delimiter or null if there isn't one
+             */
+            const char* find(const char* start, const char* end) const;
+
+            //! Find a delimiter
+            /*!
+             * @param [in] start Start of the data to search
+             * @param [in] end 1+ the last byte of the data to search
+             * @param [out] found True if a complete delimiter was found
+             * @return Start of the delimiter if found. Otherwise the start
+             *         of a partial delimiter at the very end or end if none.
+             */
+            const char* search(
+                    const char* start,
+                    const char* end,
+                    bool& found) const;
+
+            //! Pass on content up to the next delimiter
+            /*!
+             * @param [in,out] start Start of the data. Moved past the
+             *                       delimiter if one is found.
+             * @param [in] end 1+ the last byte of the data
+             * @return True if a delimiter was found and consumed
+             */
+            bool content(const char*& start, const char* end);
+
+            //! Pass on a piece of content if we are in a part
+            bool emit(const char* start, const char* end);
+
+            //! Decode m_headers into m_part
+            void decodeHeaders();
+        };
+    }
+}
+
+#endif
@@ -32,11 +32,15 @@
 #include "fastcgi++/protocol.hpp"
 #include "fastcgi++/fcgistreambuf.hpp"
 #include "fastcgi++/http.hpp"
+#include "fastcgi++/sharedresponse.hpp"
+#include "fastcgi++/trace.hpp"
 
 #include <ostream>
 #include <functional>
 #include <queue>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -59,11 +63,31 @@ namespace Fastcgipp
          */
         virtual std::unique_lock<std::mutex> handler() =0;
 
+        Request_base():
+            affinity(0),
+            created(std::chrono::steady_clock::now())
+        {}
+
         virtual ~Request_base() {}
 
         //! Only one thread is allowed to handle the request at a time
         std::mutex mutex;
 
+        //! Index of the Manager thread this request should be handled by
+        std::atomic_uint affinity;
+
+        //! When the BEGIN_REQUEST record arrived
+        const std::chrono::steady_clock::time_point created;
+
+        //! Phase timestamps if the request is being traced
+        /*!
+         * This is shared with the END_REQUEST record so the last byte
+         * written can be timed.
+         *
+         * @sa Manager_base::trace()
+         */
+        std::shared_ptr<Trace> trace;
+
         //! Send a message to the request
         inline void push(Message&& message)
         {
@@ -71,6 +95,20 @@ namespace Fastcgipp
             m_messages.push(std::move(message));
         }
 
+        //! Take all the messages that haven't been handled
+        /*!
+         * The other side is free to reuse a request ID as soon as it
+         * receives the END_REQUEST record. This means records for a new
+         * request can be pushed to us between completing and being removed.
+         */
+        std::queue<Message> leftovers()
+        {
+            std::lock_guard<std::mutex> lock(m_messagesMutex);
+            std::queue<Message> messages;
+            messages.swap(m_messages);
+            return messages;
+        }
+
     protected:
         //! A queue of message for the request
         std::queue<Message> m_messages;
@@ -92,13 +130,24 @@ namespace Fastcgipp
      * use a 8bit character set pass char as the template argument and use char
      * for everything internally.
      *
+     * Every request owns an Arena that lives and dies with it. Pass an
+     * ArenaAllocator as the second template argument to have the environment
+     * data allocated from it. The default std::allocator simply uses the
+     * heap. The library is only compiled for these two allocators.
+     *
      * @tparam charT Character type for internal processing (wchar_t or char)
+     * @tparam Allocator Allocator for the environment data
+     *                   (std::allocator<charT> or ArenaAllocator<charT>)
      *
      * @date    October 13, 2018
      * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
      */
-    template<class charT> class Request: public Request_base
+    template<class charT, class Allocator=std::allocator<charT>>
+    class Request: public Request_base
     {
+        static_assert(
+                SupportedAllocator<charT, Allocator>::value,
+                "Request only supports std::allocator and ArenaAllocator");
     public:
         //! Initializes what it can. configure() to finish.
         /*!
@@ -110,16 +159,43 @@ namespace Fastcgipp
          *                    limit as large as possible, pass either
          *                    (size_t)-1, std::string::npos or
          *                    std::numeric_limits<size_t>::max().
+         * @param lazyEnvironment Set to true to have the environment built
+         *                        with Http::Environment::index() instead of
+         *                        Http::Environment::fill(). The parameter
+         *                        records are then kept for the life of the
+         *                        request and environment().parameters gives
+         *                        views into them that are only decoded when
+         *                        asked for. Almost none of the other
+         *                        environment members get filled.
+         * @param streamMultipart Set to true to have "multipart/form-data"
+         *                        POST data parsed as it arrives with
+         *                        Http::Environment::parsePostStream() instead
+         *                        of being consolidated into the post buffer
+         *                        first. inProcessor() is then never called
+         *                        for it.
          */
-        Request(const size_t maxPostSize=0):
+        Request(
+                const size_t maxPostSize=0,
+                const bool lazyEnvironment=false,
+                const bool streamMultipart=false):
             out(&m_outStreamBuffer),
             err(&m_errStreamBuffer),
+            m_environment(makeAllocator<Allocator>(m_arena)),
             m_maxPostSize(maxPostSize),
+            m_lazyEnvironment(lazyEnvironment),
+            m_streamMultipart(streamMultipart),
             m_state(Protocol::RecordType::PARAMS),
             m_status(Protocol::ProtocolStatus::REQUEST_COMPLETE)
         {
             out.imbue(std::locale("C"));
             err.imbue(std::locale("C"));
+            m_environment.fileSinks = [this] (
+                    const typename Http::Environment<charT, Allocator>::String&
+                        name,
+                    const Http::File<charT>& file)
+            {
+                return fileSink(name, file);
+            };
         }
 
         //! Configures the request with the data it needs.
@@ -133,6 +209,8 @@ namespace Fastcgipp
          * @param[in] kill Boolean value indicating whether or not the socket
          *                 should be closed upon completion
          * @param[in] send Function for sending data out of the stream buffers
+         * @param[in] sendFile Function for sending a record header followed
+         *                     by a file segment
          * @param[in] callback Callback function capable of passing messages to
          *                     the request
          */
@@ -142,6 +220,8 @@ namespace Fastcgipp
                 bool kill,
                 const std::function<void(const Socket&, Block&&, bool)>
                     send,
+                const std::function<void(const Socket&, Block&&, FileSegment&&)>
+                    sendFile,
                 const std::function<void(Message)> callback);
 
         std::unique_lock<std::mutex> handler();
@@ -150,13 +230,13 @@ namespace Fastcgipp
 
     protected:
         //! Const accessor for the HTTP environment data
-        const Http::Environment<charT>& environment() const
+        const Http::Environment<charT, Allocator>& environment() const
         {
             return m_environment;
         }
 
         //! Accessor for the HTTP environment data
-        Http::Environment<charT>& environment()
+        Http::Environment<charT, Allocator>& environment()
         {
             return m_environment;
         }
@@ -260,6 +340,10 @@ namespace Fastcgipp
          * buffer. Should you return false, the system will try to internally
          * process it.
          *
+         * Note that if the request was constructed with streamMultipart set,
+         * "multipart/form-data" is parsed as it arrives and never makes it
+         * into the post buffer so this function isn't called for it.
+         *
          * @return Return true if you've processed the data.
          */
         virtual bool inProcessor()
@@ -267,6 +351,30 @@ namespace Fastcgipp
             return false;
         }
 
+        //! Pick where an uploaded file goes
+        /*!
+         * Override this function should you wish to take care of the content
+         * of uploaded files yourself. It is called at the start of every file
+         * in "multipart/form-data" post data as it is parsed. Return a sink and
+         * the file content will be written to it piece by piece. The file
+         * still shows up in environment().files but it's content is only
+         * accessible if the sink provides it through FileSink::contents().
+         *
+         * The default returns null which keeps small files in memory and
+         * spools larger ones into temporary files.
+         *
+         * @param[in] name Name of the form field
+         * @param[in] file Filename and content type of the file
+         * @return The sink or null to have the file dealt with as usual
+         */
+        virtual std::unique_ptr<Http::FileSink> fileSink(
+                const typename Http::Environment<charT, Allocator>::String&
+                    name,
+                const Http::File<charT>& file)
+        {
+            return std::unique_ptr<Http::FileSink>();
+        }
+
         //! The message associated with the current handler() call.
         /*!
          * This is only of use to the library user when a non FastCGI (type=0)
@@ -319,6 +427,57 @@ namespace Fastcgipp
             m_outStreamBuffer.dump(stream);
         }
 
+        //! Dumps a pre-framed payload directly into the FastCGI protocol
+        /*!
+         * Like the other dump() functions this bypasses the stream buffer and
+         * any code conversion. The payload was framed into records when the
+         * SharedResponse was built so none of it is copied here. Anything in
+         * the output stream is flushed first.
+         *
+         * @param[in] response Payload to send
+         */
+        void dump(const SharedResponse& response);
+
+        //! Dumps a segment of a file directly into the FastCGI protocol
+        /*!
+         * Like the other dump() functions this bypasses the stream buffer and
+         * any code conversion. The difference is that the data never passes
+         * through userspace buffers. Record headers are queued up and the
+         * file data follows them straight from the file into the socket. This
+         * makes it the way to send large static or cached assets.
+         *
+         * Anything in the output stream is flushed first. Since the file is
+         * read as it is transmitted it's contents shouldn't change until the
+         * request is complete.
+         *
+         * @param[in] segment Segment of a file to send
+         */
+        void dump(FileSegment segment);
+
+        //! Dumps an entire file directly into the FastCGI protocol
+        /*!
+         * Opens the file and sends it with dump(FileSegment). The file is
+         * closed once it has been transmitted.
+         *
+         * @param[in] path Path to the file
+         * @return False if the file couldn't be opened or isn't a regular
+         *         file.
+         */
+        bool dumpFile(const std::string& path);
+
+        //! Set the size of the output stream buffer
+        /*!
+         * The default is 8192 characters. With narrow characters a size of
+         * 65535 means every flush of a full buffer is sent as a single
+         * complete FastCGI record.
+         *
+         * @param[in] size Size of the buffer in characters
+         */
+        void outBufferSize(size_t size)
+        {
+            m_outStreamBuffer.bufferSize(size);
+        }
+
         //! Pick a locale
         /*!
          * Basically this finds the first language in
@@ -347,12 +506,21 @@ namespace Fastcgipp
          */
         std::function<void(Message)> m_callback;
 
+        //! Memory for the environment data if the allocator wants it
+        Arena m_arena;
+
         //! The data structure containing all HTTP environment data
-        Http::Environment<charT> m_environment;
+        Http::Environment<charT, Allocator> m_environment;
 
         //! The maximum amount of post data, in bytes, that can be recieved
         const size_t m_maxPostSize;
 
+        //! Should the environment be built with index() instead of fill()
+        const bool m_lazyEnvironment;
+
+        //! Should multipart POST data be parsed as it arrives
+        const bool m_streamMultipart;
+
         //! The role that the other side expects this request to play
         Protocol::Role m_role;
 
@@ -371,6 +539,9 @@ namespace Fastcgipp
         //! Function to actually send the record
         std::function<void(const Socket&, Block&&, bool kill)> m_send;
 
+        //! Function to actually send a record header and file segment
+        std::function<void(const Socket&, Block&&, FileSegment&&)> m_sendFile;
+
         //! Status to end the request with
         Protocol::ProtocolStatus m_status;
 
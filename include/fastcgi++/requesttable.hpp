@@ -0,0 +1,184 @@
+/*!
+ * @file       requesttable.hpp
+ * @brief      Declares the Fastcgipp::RequestTable class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_REQUESTTABLE_HPP
+#define FASTCGIPP_REQUESTTABLE_HPP
+
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <tuple>
+
+#include "fastcgi++/protocol.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Concurrent associative container that indexes with Protocol::RequestId
+    /*!
+     * The table is split into a fixed amount of shards, each being a
+     * Protocol::Requests container with it's own lock. Which shard a request
+     * lives in is decided by it's socket alone so every request belonging to
+     * a connection can be found with a single Shard::equal_range().
+     *
+     * Threads working on requests from different connections will usually
+     * land in different shards and never contend on the same lock. The total
+     * amount of requests is tracked atomically so size() and empty() don't
+     * need to lock anything.
+     *
+     * @tparam T Type to associate with each RequestId.
+     *
+     * @date    October 16, 2026
+     */
+    template<class T>
+    class RequestTable
+    {
+    public:
+        //! Iterator type within a shard
+        typedef typename Protocol::Requests<T>::iterator iterator;
+
+        //! A single independently locked portion of the table
+        /*!
+         * None of the member functions lock anything. Hold the mutex
+         * (shared or exclusive as appropriate) while calling them.
+         */
+        class Shard
+        {
+        public:
+            //! Thread safe this shard
+            std::shared_timed_mutex mutex;
+
+            //! Find a request in this shard
+            iterator find(const Protocol::RequestId& id)
+            {
+                return m_requests.find(id);
+            }
+
+            //! End iterator of this shard
+            iterator end()
+            {
+                return m_requests.end();
+            }
+
+            //! All requests in this shard associated with a socket
+            std::pair<iterator, iterator> equal_range(const Socket& socket)
+            {
+                return m_requests.equal_range(socket);
+            }
+
+            //! Insert a default constructed value for a request
+            /*!
+             * If a value already exists for the request it is returned as
+             * is.
+             */
+            iterator emplace(const Protocol::RequestId& id)
+            {
+                const auto result = m_requests.emplace(
+                        std::piecewise_construct,
+                        std::forward_as_tuple(id),
+                        std::forward_as_tuple());
+                if(result.second)
+                    ++*m_size;
+                return result.first;
+            }
+
+            //! Erase a request from this shard
+            iterator erase(iterator request)
+            {
+                --*m_size;
+                return m_requests.erase(request);
+            }
+
+        private:
+            friend class RequestTable;
+
+            //! The requests themselves
+            Protocol::Requests<T> m_requests;
+
+            //! Total request count of the table we belong to
+            std::atomic_size_t* m_size;
+        };
+
+        //! Get the shard a socket's requests belong in
+        Shard& shard(const Socket& socket)
+        {
+            // Sockets hash by address so mix the bits before masking
+            const uint64_t hash = static_cast<uint64_t>(socket.hash())
+                * 0x9e3779b97f4a7c15ULL;
+            return m_shards[(hash >> 32) & (m_shardCount-1)];
+        }
+
+        //! Amount of requests in the entire table
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        //! True if there are no requests in the entire table
+        bool empty() const
+        {
+            return m_size == 0;
+        }
+
+        //! Amount of shards in the table
+        unsigned shards() const
+        {
+            return m_shardCount;
+        }
+
+        //! Constructor
+        /*!
+         * @param [in] shards Amount of shards to split the table into. This
+         *                    is rounded up to a power of two.
+         */
+        RequestTable(unsigned shards=64):
+            m_size(0),
+            m_shardCount(1)
+        {
+            while(m_shardCount < shards)
+                m_shardCount <<= 1;
+            m_shards.reset(new Shard[m_shardCount]);
+            for(unsigned i=0; i<m_shardCount; ++i)
+                m_shards[i].m_size = &m_size;
+        }
+
+        RequestTable(const RequestTable&) =delete;
+
+    private:
+        //! Total amount of requests across all shards
+        std::atomic_size_t m_size;
+
+        //! Amount of shards. Always a power of two.
+        unsigned m_shardCount;
+
+        //! The shards themselves
+        std::unique_ptr<Shard[]> m_shards;
+    };
+}
+
+#endif
@@ -0,0 +1,117 @@
+/*!
+ * @file       sharedresponse.hpp
+ * @brief      Declares the Fastcgipp::SharedResponse class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_SHAREDRESPONSE_HPP
+#define FASTCGIPP_SHAREDRESPONSE_HPP
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "fastcgi++/block.hpp"
+#include "fastcgi++/protocol.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! An immutable payload framed into FastCGI records once
+    /*!
+     * Responses that are sent over and over again, like an image or some
+     * cached JSON, can be framed into OUT records ahead of time instead of on
+     * every request. The content of every record lives in a single reference
+     * counted block that is never modified after construction. Requests
+     * transmit slices of it so no payload data is copied.
+     *
+     * All that has to happen per request is copying the prepared record
+     * headers, patching the request ID into them and queuing up a header
+     * and content slice for each record. The cost is proportional to the
+     * amount of records instead of the amount of bytes.
+     *
+     * Copies share the payload so they are cheap and it is safe to transmit
+     * the same SharedResponse from multiple threads at once.
+     *
+     * @date    October 16, 2026
+     */
+    class SharedResponse
+    {
+    public:
+        //! Frame a copy of the payload
+        /*!
+         * @param[in] data Pointer to the first byte of the payload
+         * @param[in] size Size of the payload in bytes
+         */
+        SharedResponse(const char* data, size_t size);
+
+        //! Frame a copy of the payload
+        /*!
+         * @param[in] data Pointer to the first byte of the payload
+         * @param[in] size Size of the payload in bytes
+         */
+        SharedResponse(const unsigned char* data, size_t size):
+            SharedResponse(reinterpret_cast<const char*>(data), size)
+        {}
+
+        //! Size of the payload in bytes
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        //! Amount of FastCGI records the payload is framed into
+        size_t records() const
+        {
+            return m_headers.size();
+        }
+
+        //! Queue up the records for transmission
+        /*!
+         * Every record is passed to the send function as a header block
+         * followed by a slice of the shared content. Neither owns any memory
+         * of it's own. The headers of a single call all share one
+         * allocation.
+         *
+         * @param[in] id ID of the request the records belong to
+         * @param[in] send Function to pass the blocks on to
+         */
+        void send(
+                Protocol::FcgiId id,
+                const std::function<void(Block&&)>& send) const;
+
+    private:
+        //! Prepared record headers with a request ID of zero
+        std::vector<Protocol::Header> m_headers;
+
+        //! Content and padding of every record back to back
+        std::shared_ptr<Block> m_content;
+
+        //! Size of the payload in bytes
+        size_t m_size;
+    };
+}
+
+#endif
@@ -43,9 +43,16 @@
 #include <string>
 
 #include "fastcgi++/config.hpp"
+#include "fastcgi++/metrics.hpp"
 
-#ifdef FASTCGIPP_UNIX
 #include <vector>
+
+#include <sys/uio.h>
+#include <sys/types.h>
+
+#ifdef FASTCGIPP_LINUX
+#include <sys/epoll.h>
+#elif defined FASTCGIPP_UNIX
 #include <poll.h>
 #endif
 
@@ -80,11 +87,29 @@ namespace Fastcgipp
 
     public:
         //! Add a socket identifier to the poll list
-        bool add(const socket_t socket);
+        /*!
+         * @param [in] socket Socket identifier to add
+         * @param [in] exclusive Set to true if the socket is being polled by
+         *                       multiple Poll objects and only one of them
+         *                       should be woken up per event. Only
+         *                       meaningful for listen sockets.
+         */
+        bool add(const socket_t socket, bool exclusive=false);
 
         //! Remove a socket identifier to the poll list
         bool del(const socket_t socket);
 
+        //! Should we also poll a socket for writability?
+        /*!
+         * Sockets are only polled for incoming data by default. Setting this
+         * to true will have poll() also return the socket once it can accept
+         * more outgoing data.
+         *
+         * @param [in] socket Socket identifier already in the poll list
+         * @param [in] status True to poll for writability. False otherwise.
+         */
+        bool writable(const socket_t socket, bool status);
+
         //! Type returned from a poll request
         class Result
         {
@@ -92,6 +117,9 @@ namespace Fastcgipp
             //! Event: there is data to read
             static const unsigned pollIn;
 
+            //! Event: data can be written
+            static const unsigned pollOut;
+
             //! Event: there is an error in the socket
             static const unsigned pollErr;
 
@@ -118,6 +146,13 @@ namespace Fastcgipp
                 m_data(false)
             {}
 
+            //! Only Poll should be able to construct these
+            Result(socket_t socket, unsigned events):
+                m_events(events),
+                m_socket(socket),
+                m_data(true)
+            {}
+
         public:
             //! Get socket id associated with poll event
             socket_t socket() const
@@ -166,8 +201,42 @@ namespace Fastcgipp
             {
                 return m_events == pollIn;
             }
+
+            //! True if the socket can be written to
+            bool out() const
+            {
+                return m_events & pollOut;
+            }
+
+            //! True if and only if the socket can be written to
+            bool onlyOut() const
+            {
+                return m_events == pollOut;
+            }
         };
 
+    private:
+        //! Ring of harvested events waiting to be handed out by poll()
+        std::vector<Result> m_ready;
+
+        //! Position of the next event in m_ready to hand out
+        size_t m_readyPosition;
+
+        //! Maximum amount of events to harvest per OS level poll
+        unsigned m_batchSize;
+
+#ifdef FASTCGIPP_LINUX
+        //! Raw event buffer filled by epoll_wait()
+        std::vector<epoll_event> m_events;
+#endif
+
+        //! Count of OS level polls that returned at least one event
+        std::atomic_ullong m_wakeups;
+
+        //! Count of events harvested from OS level polls
+        std::atomic_ullong m_harvested;
+
+    public:
         //! Initiate poll on group
         /*!
          * @param [in] timeout 0 means don't block at all. -1 means block
@@ -176,12 +245,87 @@ namespace Fastcgipp
          */
         Result poll(int timeout);
 
+        //! Set the maximum amount of events harvested per OS level poll
+        /*!
+         * By default every call to poll() results in a single OS level poll
+         * that returns at most one event. With a batch size larger than one,
+         * up to that many ready events are harvested at once into an internal
+         * ring and subsequent calls to poll() hand them out without touching
+         * the OS until the ring is empty.
+         *
+         * Events belonging to a socket that is removed with del() while still
+         * in the ring are discarded.
+         *
+         * @param [in] size Maximum events per OS level poll. Zero is treated
+         *                  as one.
+         */
+        void batchSize(unsigned size);
+
+        //! Get the maximum amount of events harvested per OS level poll
+        unsigned batchSize() const
+        {
+            return m_batchSize;
+        }
+
+        //! How many OS level polls have returned at least one event
+        unsigned long long wakeups() const
+        {
+            return m_wakeups;
+        }
+
+        //! How many events have been harvested from OS level polls
+        /*!
+         * Divide this by wakeups() to get the average amount of events handled
+         * per OS level poll.
+         */
+        unsigned long long harvested() const
+        {
+            return m_harvested;
+        }
+
         Poll();
         ~Poll();
     };
 
     class SocketGroup;
 
+    //! A range of bytes in a file to be written straight into a socket
+    /*!
+     * The file descriptor is shared between copies so that a segment can be
+     * split up and queued for transmission without worrying about when it
+     * gets closed.
+     *
+     * @date    October 16, 2026
+     */
+    struct FileSegment
+    {
+        //! Shared file descriptor
+        std::shared_ptr<const int> file;
+
+        //! Offset into the file of the first byte to write
+        off_t offset;
+
+        //! Amount of bytes to write
+        size_t size;
+
+        FileSegment():
+            offset(0),
+            size(0)
+        {}
+
+        //! Construct from a file descriptor
+        /*!
+         * @param [in] fd File descriptor. This must be something that can be
+         *                read from at an offset like a regular file or a
+         *                memfd.
+         * @param [in] offset_ Offset into the file of the first byte.
+         * @param [in] size_ Amount of bytes.
+         * @param [in] close Set to true to have the file descriptor closed
+         *                   once the last copy of the segment is gone.
+         */
+        FileSegment(int fd, off_t offset_, size_t size_, bool close=false);
+    };
+
     //! Class for representing an OS level I/O socket.
     /*!
      * It works together with the SocketGroup class to establish all the
@@ -219,6 +363,13 @@ namespace Fastcgipp
              */
             bool m_closing;
 
+            //! Indicates that we are waiting for the socket to be writable
+            /*!
+             * This is set by awaitWritable() and cleared by the SocketGroup
+             * once the poll says the socket can accept more data.
+             */
+            bool m_writeBlocked;
+
             //! SocketGroup object this socket is tied to.
             SocketGroup& m_group;
 
@@ -239,6 +390,7 @@ namespace Fastcgipp
                 m_socket(socket),
                 m_valid(valid),
                 m_closing(false),
+                m_writeBlocked(false),
                 m_group(group)
             {}
 
@@ -316,6 +468,54 @@ namespace Fastcgipp
          */
         ssize_t write(const char* buffer, size_t size) const;
 
+        //! Try and write a set of chunks of data into the socket.
+        /*!
+         * This is a gather version of write() that sends the chunks in order
+         * with a single system call. The semantics of the return value are
+         * the same as write().
+         *
+         * @param [in] chunks Array of chunks to write from.
+         * @param [in] count Amount of chunks in the array.
+         * @param [in] more Set to true if more data is about to follow so
+         *                  the OS can hold off on sending a short packet.
+         * @return Actual number of bytes written from the chunks. A -1 means
+         *         you can't actually write data to the socket anymore.
+         */
+        ssize_t write(
+                const iovec* chunks,
+                size_t count,
+                bool more=false) const;
+
+        //! Try and write a segment of a file into the socket.
+        /*!
+         * The data goes from the file to the socket without passing through
+         * userspace where the OS allows it. The segment is advanced past
+         * whatever was written. The semantics of the return value are the
+         * same as write(). Should the file end before the segment does the
+         * socket is closed since whatever was promised to the other end can
+         * no longer be delivered.
+         *
+         * @param [in,out] segment Segment of a file to write.
+         * @return Actual number of bytes written from the file. A -1 means
+         *         you can't actually write data to the socket anymore.
+         */
+        ssize_t write(FileSegment& segment) const;
+
+        //! Have the SocketGroup poll for writability on this socket
+        /*!
+         * Call this after a write() could not send everything. The socket
+         * will be considered write blocked until the SocketGroup sees that it
+         * can accept more data. At that point SocketGroup::poll() returns
+         * early so that the caller can retry the write.
+         */
+        void awaitWritable() const;
+
+        //! True if we are waiting for the socket to become writable
+        bool writeBlocked() const
+        {
+            return m_data && m_data->m_writeBlocked;
+        }
+
         //! We need this to allow the socket objects to be in sorted containers.
         inline bool operator<(const Socket& x) const noexcept
         {
@@ -328,6 +528,12 @@ namespace Fastcgipp
             return m_data == x.m_data;
         }
 
+        //! Hash value that is equal for equal sockets
+        size_t hash() const noexcept
+        {
+            return std::hash<Data*>()(m_data.get());
+        }
+
         //! Copy constructor
         /*!
          * Any sockets built using the copy constructor will not be marked
@@ -365,6 +571,12 @@ namespace Fastcgipp
         //! Calls close() on the socket if we are destructing the original
         ~Socket();
 
+        //! Returns true if the socket was created by the passed SocketGroup
+        bool memberOf(const SocketGroup& group) const
+        {
+            return m_data && &m_data->m_group == &group;
+        }
+
         //! Returns true if this socket is still open and capable of read/write.
         bool valid() const
         {
@@ -404,7 +616,12 @@ namespace Fastcgipp
     class SocketGroup
     {
     public:
-        SocketGroup();
+        //! Constructor
+        /*!
+         * @param[in] registry The connection and byte counters are kept in
+         *                     this registry.
+         */
+        SocketGroup(Metrics::Registry& registry = Metrics::registry());
 
         ~SocketGroup();
 
@@ -454,6 +671,22 @@ namespace Fastcgipp
                 const char* interface,
                 const char* service);
 
+        //! Also accept connections from the listen sockets of another group
+        /*!
+         * This allows multiple SocketGroup objects, each being polled from
+         * their own thread, to accept connections from the same set of listen
+         * sockets. Whichever group calls accept() first gets the connection.
+         * The listen sockets remain owned by the passed group and it must
+         * outlive this one.
+         *
+         * The listen sockets of both groups are made non-blocking and are
+         * polled such that only one of the groups is woken up per incoming
+         * connection. Call this before either group is polled.
+         *
+         * @param [in] group SocketGroup whose listen sockets should be shared.
+         */
+        void share(SocketGroup& group);
+
         //! Connect to a named socket
         /*!
          * Connect to a named socket. In the Unix world this would be a path.
@@ -494,6 +727,9 @@ namespace Fastcgipp
          *    It will not return anything regarding the dead socket.
          *  - If new data has arrived in a currently active connection it will
          *    return the socket.
+         *  - If a socket waiting in Socket::awaitWritable() can be written to
+         *    it is no longer write blocked and the poll stops blocking. The
+         *    socket is only returned if there is also new data on it.
          *  - If the call has been set to non-blocking and no new data awaits, a
          *    generic invalid socket is returned.
          *
@@ -542,6 +778,36 @@ namespace Fastcgipp
             m_reuse = value;
         }
 
+        //! Set the maximum amount of events harvested per OS level poll
+        /*!
+         * Call this before any polling takes place.
+         *
+         * @param [in] size Maximum events per OS level poll
+         * @sa Poll::batchSize()
+         */
+        void pollBatchSize(unsigned size)
+        {
+            m_poll.batchSize(size);
+        }
+
+        //! Get the maximum amount of events harvested per OS level poll
+        unsigned pollBatchSize() const
+        {
+            return m_poll.batchSize();
+        }
+
+        //! How many OS level polls have returned at least one event
+        unsigned long long pollWakeups() const
+        {
+            return m_poll.wakeups();
+        }
+
+        //! How many events have been harvested from OS level polls
+        unsigned long long pollEvents() const
+        {
+            return m_poll.harvested();
+        }
+
     private:
         //! Our sockets need access to our private data
         friend class Socket;
@@ -549,6 +815,16 @@ namespace Fastcgipp
         //! These are the sockets we listen for connections on
         std::set<socket_t> m_listeners;
 
+        //! These are the listen sockets borrowed from another group
+        /*!
+         * They are also contained in m_listeners but we are not responsible
+         * for closing them.
+         */
+        std::set<socket_t> m_sharedListeners;
+
+        //! Set to true if our listen sockets are polled by other groups too
+        bool m_exclusiveListeners;
+
         //! Our poll object
         Poll m_poll;
 
@@ -579,25 +855,23 @@ namespace Fastcgipp
         //! Filenames to cleanup when we're done
         std::deque<std::string> m_filenames;
 
-#if FASTCGIPP_LOG_LEVEL > 3
-        //! Debug counter for incoming connections
-        std::atomic_ullong m_incomingConnectionCount;
+        //! Counter of incoming connections
+        Metrics::Counter& m_incomingConnectionCount;
 
-        //! Debug counter for outgoing connections
-        std::atomic_ullong m_outgoingConnectionCount;
+        //! Counter of outgoing connections
+        Metrics::Counter& m_outgoingConnectionCount;
 
-        //! Debug counter for locally killed sockets
-        std::atomic_ullong m_connectionKillCount;
+        //! Counter of locally killed sockets
+        Metrics::Counter& m_connectionKillCount;
 
-        //! Debug counter for remotely hung up sockets
-        std::atomic_ullong m_connectionRDHupCount;
+        //! Counter of remotely hung up sockets
+        Metrics::Counter& m_connectionRDHupCount;
 
-        //! Debug counter for bytes sent
-        std::atomic_ullong m_bytesSent;
+        //! Counter of bytes sent
+        Metrics::Counter& m_bytesSent;
 
-        //! Debug counter for bytes received
-        std::atomic_ullong m_bytesReceived;
-#endif
+        //! Counter of bytes received
+        Metrics::Counter& m_bytesReceived;
     };
 }
 
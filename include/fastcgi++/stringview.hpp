@@ -0,0 +1,172 @@
+/*!
+ * @file       stringview.hpp
+ * @brief      Declares the Fastcgipp::StringView class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_STRINGVIEW_HPP
+#define FASTCGIPP_STRINGVIEW_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Non-owning view of a sequence of raw bytes
+    /*!
+     * This is basically a stripped down std::string_view for C++14. It
+     * doesn't own the data it points to so whatever does must outlive it.
+     *
+     * @date    October 16, 2026
+     */
+    class StringView
+    {
+    public:
+        //! An empty view
+        StringView():
+            m_data(nullptr),
+            m_size(0)
+        {}
+
+        //! View a sequence of bytes
+        StringView(const char* data, size_t size):
+            m_data(data),
+            m_size(size)
+        {}
+
+        //! View a sequence of bytes
+        StringView(const char* start, const char* end):
+            m_data(start),
+            m_size(end-start)
+        {}
+
+        //! View a null terminated string (not including the terminator)
+        StringView(const char* string):
+            m_data(string),
+            m_size(std::strlen(string))
+        {}
+
+        //! View a string
+        template<class Allocator>
+        StringView(const std::basic_string<
+                char,
+                std::char_traits<char>,
+                Allocator>& string):
+            m_data(string.data()),
+            m_size(string.size())
+        {}
+
+        //! Pointer to the first byte
+        const char* data() const
+        {
+            return m_data;
+        }
+
+        //! Pointer to the first byte
+        const char* begin() const
+        {
+            return m_data;
+        }
+
+        //! Pointer to 1+ the last byte
+        const char* end() const
+        {
+            return m_data+m_size;
+        }
+
+        //! Amount of bytes in the view
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        //! True if there are no bytes in the view
+        bool empty() const
+        {
+            return m_size == 0;
+        }
+
+        const char& operator[](size_t index) const
+        {
+            return m_data[index];
+        }
+
+        //! Copy the bytes into a std::string
+        std::string str() const
+        {
+            return std::string(m_data, m_size);
+        }
+
+        //! Lexicographically compare with another view
+        /*!
+         * @return Less than zero if we come first, zero if equal and greater
+         *         than zero if we come last.
+         */
+        int compare(const StringView& x) const
+        {
+            const int result = std::char_traits<char>::compare(
+                    m_data,
+                    x.m_data,
+                    std::min(m_size, x.m_size));
+            if(result != 0)
+                return result;
+            if(m_size == x.m_size)
+                return 0;
+            return m_size < x.m_size ? -1 : 1;
+        }
+
+    private:
+        //! First byte in the view
+        const char* m_data;
+
+        //! Amount of bytes in the view
+        size_t m_size;
+    };
+
+    inline bool operator==(const StringView& x, const StringView& y)
+    {
+        return x.size() == y.size() && x.compare(y) == 0;
+    }
+
+    inline bool operator!=(const StringView& x, const StringView& y)
+    {
+        return !(x == y);
+    }
+
+    inline bool operator<(const StringView& x, const StringView& y)
+    {
+        return x.compare(y) < 0;
+    }
+
+    inline std::ostream& operator<<(std::ostream& os, const StringView& view)
+    {
+        return os.write(view.data(), view.size());
+    }
+}
+
+#endif
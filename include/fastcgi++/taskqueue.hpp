@@ -0,0 +1,377 @@
+/*!
+ * @file       taskqueue.hpp
+ * @brief      Declares the Fastcgipp::TaskQueue and Fastcgipp::EventCount
+ *             classes
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_TASKQUEUE_HPP
+#define FASTCGIPP_TASKQUEUE_HPP
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "fastcgi++/config.hpp"
+
+#ifndef FASTCGIPP_LINUX
+#include <condition_variable>
+#endif
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Multiple producer multiple consumer queue
+    /*!
+     * The bulk of the work is done in a fixed size ring of cells each with
+     * it's own sequence number. Producers and consumers claim cells by
+     * advancing their respective positions with a compare and swap so
+     * neither side ever takes a lock while the ring has room.
+     *
+     * Should the ring fill up, further items go into a mutex protected
+     * overflow list instead of blocking the producer. Consumers only look at
+     * the overflow list once the ring is empty. This means items are not
+     * strictly handed out in order once the ring has overflowed.
+     *
+     * @tparam T Type of item to queue. Must be move constructible.
+     *
+     * @date    October 16, 2026
+     */
+    template<class T>
+    class TaskQueue
+    {
+    public:
+        //! Add an item to the queue
+        void push(T&& item)
+        {
+            if(!tryPush(item))
+            {
+                std::lock_guard<std::mutex> lock(m_overflowMutex);
+                m_overflow.push_back(std::move(item));
+                ++m_overflowSize;
+            }
+            ++m_size;
+        }
+
+        //! Add an item to the queue
+        void push(const T& item)
+        {
+            push(T(item));
+        }
+
+        //! Take an item out of the queue
+        /*!
+         * @param [out] item Where to move the item into
+         * @return True if we got an item. False if the queue was empty.
+         */
+        bool pop(T& item)
+        {
+            if(!tryPop(item))
+            {
+                if(m_overflowSize == 0)
+                    return false;
+
+                std::lock_guard<std::mutex> lock(m_overflowMutex);
+                if(m_overflow.empty())
+                    return false;
+                item = std::move(m_overflow.front());
+                m_overflow.pop_front();
+                --m_overflowSize;
+            }
+            --m_size;
+            return true;
+        }
+
+        //! True if there is nothing in the queue
+        /*!
+         * This is sequentially consistent with push() so that it can be
+         * safely used together with EventCount to park consumers.
+         */
+        bool empty() const
+        {
+            return m_size <= 0;
+        }
+
+        //! Approximate amount of items in the queue
+        size_t size() const
+        {
+            const long long size = m_size;
+            return size>0 ? size : 0;
+        }
+
+        //! How many items have ever gone into the overflow list
+        unsigned long long overflows() const
+        {
+            return m_overflows;
+        }
+
+        //! Constructor
+        /*!
+         * @param [in] capacity Amount of items that fit in the ring before we
+         *                      overflow. This is rounded up to a power of
+         *                      two.
+         */
+        TaskQueue(size_t capacity=4096):
+            m_capacity(2),
+            m_enqueuePosition(0),
+            m_dequeuePosition(0),
+            m_size(0),
+            m_overflowSize(0),
+            m_overflows(0)
+        {
+            while(m_capacity < capacity)
+                m_capacity <<= 1;
+            m_cells.reset(new Cell[m_capacity]);
+            for(size_t i=0; i<m_capacity; ++i)
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        ~TaskQueue()
+        {
+            T item;
+            while(tryPop(item));
+        }
+
+        TaskQueue(const TaskQueue&) =delete;
+
+    private:
+        //! A single slot in the ring
+        struct Cell
+        {
+            //! Position this cell is ready for
+            /*!
+             * Equal to the position when empty and ready to be written to.
+             * One more than the position when full and ready to be read
+             * from.
+             */
+            std::atomic_size_t sequence;
+
+            //! Uninitialized storage for the item itself
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type item;
+        };
+
+        //! Try to add an item into the ring
+        bool tryPush(T& item)
+        {
+            size_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+            Cell* cell;
+            while(true)
+            {
+                cell = &m_cells[position & (m_capacity-1)];
+                const size_t sequence
+                    = cell->sequence.load(std::memory_order_acquire);
+                const ptrdiff_t difference
+                    = static_cast<ptrdiff_t>(sequence)
+                    - static_cast<ptrdiff_t>(position);
+                if(difference == 0)
+                {
+                    if(m_enqueuePosition.compare_exchange_weak(
+                                position,
+                                position+1,
+                                std::memory_order_relaxed))
+                        break;
+                }
+                else if(difference < 0)
+                {
+                    ++m_overflows;
+                    return false;
+                }
+                else
+                    position = m_enqueuePosition.load(
+                            std::memory_order_relaxed);
+            }
+
+            new(&cell->item) T(std::move(item));
+            cell->sequence.store(position+1, std::memory_order_release);
+            return true;
+        }
+
+        //! Try to take an item out of the ring
+        bool tryPop(T& item)
+        {
+            size_t position = m_dequeuePosition.load(std::memory_order_relaxed);
+            Cell* cell;
+            while(true)
+            {
+                cell = &m_cells[position & (m_capacity-1)];
+                const size_t sequence
+                    = cell->sequence.load(std::memory_order_acquire);
+                const ptrdiff_t difference
+                    = static_cast<ptrdiff_t>(sequence)
+                    - static_cast<ptrdiff_t>(position+1);
+                if(difference == 0)
+                {
+                    if(m_dequeuePosition.compare_exchange_weak(
+                                position,
+                                position+1,
+                                std::memory_order_relaxed))
+                        break;
+                }
+                else if(difference < 0)
+                    return false;
+                else
+                    position = m_dequeuePosition.load(
+                            std::memory_order_relaxed);
+            }
+
+            T& stored = *reinterpret_cast<T*>(&cell->item);
+            item = std::move(stored);
+            stored.~T();
+            cell->sequence.store(
+                    position+m_capacity,
+                    std::memory_order_release);
+            return true;
+        }
+
+        //! Amount of cells in the ring. Always a power of two.
+        size_t m_capacity;
+
+        //! The ring itself
+        std::unique_ptr<Cell[]> m_cells;
+
+        //! Keep the producer and consumer positions on separate cache lines
+        char m_padding0[64];
+
+        //! Next position to be written to
+        std::atomic_size_t m_enqueuePosition;
+
+        //! Keep the producer and consumer positions on separate cache lines
+        char m_padding1[64];
+
+        //! Next position to be read from
+        std::atomic_size_t m_dequeuePosition;
+
+        //! Keep the positions and the size on separate cache lines
+        char m_padding2[64];
+
+        //! Amount of items in both the ring and the overflow list
+        std::atomic_llong m_size;
+
+        //! Items that didn't fit in the ring
+        std::deque<T> m_overflow;
+
+        //! Thread safe the overflow list
+        std::mutex m_overflowMutex;
+
+        //! Amount of items in the overflow list
+        std::atomic_size_t m_overflowSize;
+
+        //! Counter of items that have ever gone into the overflow list
+        std::atomic_ullong m_overflows;
+    };
+
+    //! Lets consumers sleep until there is something for them to do
+    /*!
+     * A consumer that finds nothing to do calls prepare(), checks for work
+     * one more time and then either calls cancel() or wait(). Producers call
+     * notify() after making work available. If no consumer is waiting
+     * notify() costs a single atomic load and no system call.
+     *
+     * On Linux consumers sleep on a futex. Elsewhere a mutex and condition
+     * variable are used.
+     *
+     * @date    October 16, 2026
+     */
+    class EventCount
+    {
+    public:
+        //! Announce that we are about to wait
+        /*!
+         * @return Key to pass to wait()
+         */
+        int prepare()
+        {
+            ++m_waiters;
+            return m_epoch;
+        }
+
+        //! Changed our mind about waiting after calling prepare()
+        void cancel()
+        {
+            --m_waiters;
+        }
+
+        //! Sleep until notified
+        /*!
+         * Returns immediately if there has been a notify() since the call to
+         * prepare() that returned the key.
+         *
+         * @param [in] key Value returned from prepare()
+         */
+        void wait(int key);
+
+        //! Wake up waiting consumers
+        /*!
+         * @param [in] all Set to true to wake up all waiting consumers instead
+         *                 of only one of them.
+         */
+        void notify(bool all=false)
+        {
+            if(m_waiters != 0)
+                wake(all);
+        }
+
+        //! True if there is a consumer between prepare() and wait()
+        bool waiting() const
+        {
+            return m_waiters != 0;
+        }
+
+        //! How many times a consumer actually went to sleep
+        unsigned long long sleeps() const
+        {
+            return m_sleeps;
+        }
+
+        EventCount();
+
+    private:
+        //! Bumped on every notify() that has waiters
+        std::atomic_int m_epoch;
+
+        //! Amount of consumers between prepare() and cancel()/wait()
+        std::atomic_int m_waiters;
+
+        //! Counter of consumers that went to sleep
+        std::atomic_ullong m_sleeps;
+
+        //! Bump the epoch and wake up consumers
+        void wake(bool all);
+
+#ifndef FASTCGIPP_LINUX
+        //! Thread safe sleeping
+        std::mutex m_mutex;
+
+        //! What we sleep on
+        std::condition_variable m_wake;
+#endif
+    };
+}
+
+#endif
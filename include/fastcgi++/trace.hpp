@@ -0,0 +1,148 @@
+/*!
+ * @file       trace.hpp
+ * @brief      Declares the Fastcgipp::Trace class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_TRACE_HPP
+#define FASTCGIPP_TRACE_HPP
+
+#include <chrono>
+#include <functional>
+#include <memory>
+
+#include "fastcgi++/protocol.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Timestamps of the phases a single request goes through
+    /*!
+     * Tracing is turned on with Manager_base::trace(). Every request then
+     * gets a trace that is shared between the request and it's END_REQUEST
+     * record. Once both are gone, meaning the last byte has been written or
+     * the connection died, the trace is handed to the hook.
+     *
+     * Phases that were never reached have a default constructed time point.
+     * A request that was aborted, for example, never reaches the response
+     * phase.
+     *
+     * @date    October 16, 2026
+     */
+    class Trace
+    {
+    public:
+        //! Clock used for all timestamps
+        typedef std::chrono::steady_clock Clock;
+
+        //! Function that receives finished traces
+        typedef std::function<void(const Trace&)> Hook;
+
+        //! Points in the life of a request
+        enum class Phase: unsigned
+        {
+            BEGIN,    //!< BEGIN_REQUEST record received
+            PARAMS,   //!< Last PARAMS record received
+            IN,       //!< Last IN record received
+            RESPONSE, //!< First call to Request::response()
+            OUT,      //!< First OUT record queued for sending
+            END,      //!< END_REQUEST record queued for sending
+            WRITTEN   //!< Last byte of the END_REQUEST record written
+        };
+
+        //! Amount of phases
+        static const unsigned phases = 7;
+
+        //! Name of a phase
+        static const char* name(Phase phase);
+
+        //! ID of the traced request
+        const Protocol::RequestId id;
+
+        //! Record the time a phase was reached
+        /*!
+         * Only the first time counts.
+         */
+        void mark(Phase phase, Clock::time_point time = Clock::now())
+        {
+            Clock::time_point& point = m_times[static_cast<unsigned>(phase)];
+            if(point == Clock::time_point())
+                point = time;
+        }
+
+        //! True if the phase was reached
+        bool reached(Phase phase) const
+        {
+            return time(phase) != Clock::time_point();
+        }
+
+        //! Time the phase was reached
+        Clock::time_point time(Phase phase) const
+        {
+            return m_times[static_cast<unsigned>(phase)];
+        }
+
+        //! Microseconds between two phases
+        /*!
+         * @return Time between the phases or -1 if either wasn't reached
+         */
+        long long elapsed(Phase from, Phase to) const
+        {
+            if(!reached(from) || !reached(to))
+                return -1;
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                    time(to)-time(from)).count();
+        }
+
+        //! Start a trace
+        /*!
+         * @param[in] id_ ID of the request
+         * @param[in] begin When the BEGIN_REQUEST record was received
+         * @param[in] hook Where to send the trace once it's finished
+         */
+        Trace(
+                const Protocol::RequestId& id_,
+                Clock::time_point begin,
+                const std::shared_ptr<const Hook>& hook);
+
+        //! Hands the trace to the hook
+        /*!
+         * This happens in whatever thread lets go of the trace last.
+         * Usually that's a transceiver thread.
+         */
+        ~Trace();
+
+        Trace(const Trace&) =delete;
+
+    private:
+        //! When each phase was reached
+        Clock::time_point m_times[phases];
+
+        //! Where the trace goes once it's finished
+        const std::shared_ptr<const Hook> m_hook;
+    };
+}
+
+#endif
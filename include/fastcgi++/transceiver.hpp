@@ -39,9 +39,12 @@
 #include <atomic>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 #include <fastcgi++/protocol.hpp>
 #include "fastcgi++/block.hpp"
+#include "fastcgi++/metrics.hpp"
+#include "fastcgi++/trace.hpp"
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -52,44 +55,39 @@ namespace Fastcgipp
      * level sockets and also the creation/destruction of the sockets
      * themselves.
      *
+     * The work is spread across one or more reactors. Each reactor runs in
+     * it's own thread and handles every connection it has accepted. See
+     * resizeReactors().
+     *
      * @date    May 4, 2017
      * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
      */
     class Transceiver
     {
     public:
-        //! General transceiver handler
+        //! Call from any thread to stop the handler() threads
         /*!
-         * This function is called by Manager::handler() to both transmit data
-         * passed to it from requests and relay received data back to them as a
-         * Message. The function will return true if there is nothing at all for
-         * it to do.
-         */
-        void handler();
-
-        //! Call from any thread to stop the handler() thread
-        /*!
-         * Calling this thread will signal the handler() thread to cleanly stop
-         * itself. This means it keeps going until all connections are closed.
-         * No new connections are accepted.
+         * Calling this thread will signal the handler() threads to cleanly
+         * stop themselves. This means they keep going until all connections
+         * are closed. No new connections are accepted.
          *
          * @sa join()
          */
         void stop();
 
-        //! Call from any thread to terminate the handler() thread
+        //! Call from any thread to terminate the handler() threads
         /*!
-         * Calling this thread will signal the handler() thread to immediately
-         * terminate itself. This means it doesn't wait until all connections
-         * are closed.
+         * Calling this thread will signal the handler() threads to immediately
+         * terminate themselves. This means they don't wait until all
+         * connections are closed.
          *
          * @sa join()
          */
         void terminate();
 
-        //! Call from any thread to start the handler() thread
+        //! Call from any thread to start the handler() threads
         /*!
-         * If the thread is already running this will do nothing.
+         * If the threads are already running this will do nothing.
          */
         void start();
 
@@ -102,8 +100,26 @@ namespace Fastcgipp
          * @param[in] data Block of data to send out
          * @param[in] kill True if the socket should be closed once everything
          *                 is sent.
+         * @param[in] trace Trace to mark once the block is written and to hold
+         *                  on to until then.
          */
-        void send(const Socket& socket, Block&& data, bool kill);
+        void send(
+                const Socket& socket,
+                Block&& data,
+                bool kill,
+                const std::shared_ptr<Trace>& trace = std::shared_ptr<Trace>());
+
+        //! Queue up a block of data followed by a file segment for transmission
+        /*!
+         * The file segment is written straight from the file into the socket
+         * without passing through userspace.
+         *
+         * @param[in] socket Socket to write the data out
+         * @param[in] data Block of data to send out before the file segment.
+         *                 Typically a record header.
+         * @param[in] file File segment to send out after the data
+         */
+        void send(const Socket& socket, Block&& data, FileSegment&& file);
 
         //! Constructor
         /*!
@@ -127,7 +143,7 @@ namespace Fastcgipp
          */
         bool listen()
         {
-            return m_sockets.listen();
+            return m_reactors.front()->sockets.listen();
         }
 
         //! Listen to a named socket
@@ -151,7 +167,11 @@ namespace Fastcgipp
                 const char* owner = nullptr,
                 const char* group = nullptr)
         {
-            return m_sockets.listen(name, permissions, owner, group);
+            return m_reactors.front()->sockets.listen(
+                    name,
+                    permissions,
+                    owner,
+                    group);
         }
 
         //! Listen to a TCP port
@@ -170,7 +190,7 @@ namespace Fastcgipp
                 const char* interface,
                 const char* service)
         {
-            return m_sockets.listen(interface, service);
+            return m_reactors.front()->sockets.listen(interface, service);
         }
 
         //! Should we set socket option to reuse address
@@ -180,13 +200,44 @@ namespace Fastcgipp
          */
         void reuseAddress(bool value)
         {
-            m_sockets.reuseAddress(value);
+            m_reactors.front()->sockets.reuseAddress(value);
         }
 
-    private:
-        //! Container associating sockets with their receive buffers
-        std::map<Socket, Block> m_receiveBuffers;
+        //! Set the maximum amount of events harvested per OS level poll
+        /*!
+         * Call this before start().
+         *
+         * @param [in] size Maximum events per OS level poll
+         * @sa Poll::batchSize()
+         */
+        void pollBatchSize(unsigned size);
+
+        //! How many OS level polls have returned at least one event
+        unsigned long long pollWakeups() const;
+
+        //! How many events have been harvested from OS level polls
+        unsigned long long pollEvents() const;
 
+        //! Call before start to change the number of reactors
+        /*!
+         * A reactor is a thread with it's own SocketGroup, receive buffers and
+         * send buffer. All reactors accept connections from the same listen
+         * sockets and a connection is handled for it's entire lifetime by
+         * the reactor that accepted it. By default there is a single reactor.
+         *
+         * If the handler() threads are already running this will do nothing.
+         *
+         * @param[in] reactors Number of reactors. Zero is treated as one.
+         */
+        void resizeReactors(unsigned reactors);
+
+        //! How many reactors do we have
+        unsigned reactors() const
+        {
+            return m_reactors.size();
+        }
+
+    private:
         //! Simple FastCGI record to queue up for transmission
         struct Record
         {
@@ -195,37 +246,128 @@ namespace Fastcgipp
             const char* read;
             const bool kill;
 
+            //! Written out after the data
+            FileSegment file;
+
+            //! Marked once the data is written
+            std::shared_ptr<Trace> trace;
+
+            Record(
+                    const Socket& socket_,
+                    Block&& data_,
+                    bool kill_,
+                    const std::shared_ptr<Trace>& trace_):
+                socket(socket_),
+                data(std::move(data_)),
+                read(data.begin()),
+                kill(kill_),
+                trace(trace_)
+            {}
+
             Record(
                     const Socket& socket_,
                     Block&& data_,
-                    bool kill_):
+                    FileSegment&& file_):
                 socket(socket_),
                 data(std::move(data_)),
                 read(data.begin()),
-                kill(kill_)
+                kill(false),
+                file(std::move(file_))
             {}
         };
 
-        //! %Buffer for transmitting data
-        std::deque<std::unique_ptr<Record>> m_sendBuffer;
+        //! Incoming data for a single connection
+        /*!
+         * As much data as is available is read into a large chunk at once.
+         * Every complete record in it is then passed on as a slice of the
+         * chunk so there is no copying and no allocation per record. The
+         * chunk is let go of whenever there is nothing left in it to pass on.
+         */
+        struct ReceiveBuffer
+        {
+            //! What we read into and slice records out of
+            /*!
+             * This is null while the connection has no partial record.
+             */
+            std::shared_ptr<Block> chunk;
+
+            //! Offset of the first byte that hasn't been passed on yet
+            size_t offset;
 
-        //! Thread safe the send buffer
-        std::mutex m_sendBufferMutex;
+            ReceiveBuffer():
+                offset(0)
+            {}
+        };
+
+        //! Everything needed for a single thread to handle it's connections
+        struct Reactor
+        {
+            //! Listen for connections with this
+            SocketGroup sockets;
+
+            //! Container associating sockets with their receive buffers
+            std::map<Socket, ReceiveBuffer> receiveBuffers;
+
+            //! Records queued up by send() that haven't been sorted yet
+            std::deque<std::unique_ptr<Record>> sendBuffer;
+
+            //! Thread safe the send buffer
+            std::mutex sendBufferMutex;
+
+            //! Outgoing records for each socket in the order they were sent
+            /*!
+             * This is only touched by the reactor's own thread. A socket is
+             * only in here while it has data waiting to go out.
+             */
+            std::map<Socket, std::deque<std::unique_ptr<Record>>> sendQueues;
+
+            //! Thread this reactor is running in
+            std::thread thread;
+        };
+
+        //! Our reactors
+        std::vector<std::unique_ptr<Reactor>> m_reactors;
 
         //! Function to call to pass messages to requests
         const std::function<void(Protocol::RequestId, Message&&)> m_sendMessage;
 
-        //! Listen for connections with this
-        SocketGroup m_sockets;
+        //! General transceiver handler
+        /*!
+         * This function runs in a reactor's thread to both transmit data
+         * passed to it from requests and relay received data back to them as a
+         * Message.
+         */
+        void handler(Reactor& reactor);
+
+        //! Find the reactor that owns a socket
+        inline Reactor& reactor(const Socket& socket);
 
         //! Transmit all buffered data possible
         /*!
-         * @return True if we successfully sent all data that was queued up.
+         * Each socket gets it's own queue so a slow socket never holds up the
+         * output of the others. Sockets that can't take any more data are
+         * skipped until the poll says they are writable again.
+         *
+         * @return True if everything queued up was either sent or is waiting
+         *         for it's socket to become writable.
+         */
+        inline bool transmit(Reactor& reactor);
+
+        //! Send as much of a single socket's queue as possible
+        /*!
+         * Consecutive records are written out with a single gather write.
+         * A gather write stops at a record with a file segment which is then
+         * written on it's own.
+         *
+         * @return True if the queue is now empty and can be discarded.
          */
-        inline bool transmit();
+        inline bool flush(
+                Reactor& reactor,
+                const Socket& socket,
+                std::deque<std::unique_ptr<Record>>& queue);
 
         //! Receive data on the specified socket.
-        inline void receive(Socket& socket);
+        inline void receive(Reactor& reactor, Socket& socket);
 
         //! True when handler() should be terminating
         std::atomic_bool m_terminate;
@@ -233,28 +375,32 @@ namespace Fastcgipp
         //! True when handler() should be stopping
         std::atomic_bool m_stop;
 
-        //! Thread our handler is running in
-        std::thread m_thread;
-
         //! Cleanup a dead socket
-        void cleanupSocket(const Socket& socket);
+        void cleanupSocket(Reactor& reactor, const Socket& socket);
 
-#if FASTCGIPP_LOG_LEVEL > 3
-        //! Debug counter for locally killed sockets
-        std::atomic_ullong m_connectionKillCount;
+        //! Counter for locally killed sockets
+        Metrics::Counter& m_connectionKillCount;
 
-        //! Debug counter for remotely hung up sockets
-        std::atomic_ullong m_connectionRDHupCount;
+        //! Counter for remotely hung up sockets
+        Metrics::Counter& m_connectionRDHupCount;
 
-        //! Debug counter for records sent
-        std::atomic_ullong m_recordsSent;
+        //! Counter for records sent
+        Metrics::Counter& m_recordsSent;
 
-        //! Debug counter for records queued for sending
-        std::atomic_ullong m_recordsQueued;
+        //! Counter for records queued for sending
+        Metrics::Counter& m_recordsQueued;
 
-        //! Debug counter for bytes received
-        std::atomic_ullong m_recordsReceived;
-#endif
+        //! Counter for gather writes
+        Metrics::Counter& m_writes;
+
+        //! Counter for file segment writes
+        Metrics::Counter& m_fileWrites;
+
+        //! Counter for records received
+        Metrics::Counter& m_recordsReceived;
+
+        //! Counter for socket reads
+        Metrics::Counter& m_reads;
     };
 }
 
@@ -0,0 +1,118 @@
+/*!
+ * @file       utf8.hpp
+ * @brief      Declares the Fastcgipp::Utf8 functions
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_UTF8_HPP
+#define FASTCGIPP_UTF8_HPP
+
+#include <cstddef>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! UTF-8 code conversion for wide character requests
+    /*!
+     * These replace std::codecvt_utf8 on the hot paths. Runs of ASCII are
+     * handled a vector at a time and everything else one code point at a
+     * time without any locale machinery. Malformed input never throws.
+     *
+     * Wide characters are taken to be UTF-32.
+     */
+    namespace Utf8
+    {
+        //! Maximum amount of bytes a single code point is encoded into
+        const size_t maxLength = 4;
+
+        //! Code point that invalid input is replaced with
+        const wchar_t replacement = 0xfffd;
+
+        //! Amount of bytes the encoded form of some wide characters takes
+        /*!
+         * @param[in] from First wide character
+         * @param[in] fromEnd 1+ the last wide character
+         * @return Amount of bytes encode() would write
+         */
+        size_t length(const wchar_t* from, const wchar_t* fromEnd);
+
+        //! Encode wide characters into UTF-8
+        /*!
+         * This stops at the first code point that doesn't fit completely in
+         * the output. Surrogates and anything beyond U+10FFFF can't be
+         * represented in UTF-8 so they are encoded as the replacement
+         * character.
+         *
+         * @param[in] from First wide character
+         * @param[in] fromEnd 1+ the last wide character
+         * @param[out] fromNext 1+ the last wide character that was encoded
+         * @param[in] to Where to start writing bytes
+         * @param[in] toEnd 1+ the last byte that can be written
+         * @param[out] toNext 1+ the last byte that was written
+         */
+        void encode(
+                const wchar_t* from,
+                const wchar_t* fromEnd,
+                const wchar_t*& fromNext,
+                char* to,
+                char* toEnd,
+                char*& toNext);
+
+        //! What malformed input is decoded into by default
+        /*!
+         * This is what Http::vecToString() passes to decode() and as such
+         * applies to every wide character header, cookie, GET and POST value.
+         * Set it to zero to have malformed input silently dropped instead of
+         * replaced. It should only be changed before any requests are
+         * processed.
+         */
+        extern wchar_t inputReplacement;
+
+        //! Decode UTF-8 into wide characters
+        /*!
+         * Everything gets decoded. Overlong forms, surrogates, anything
+         * beyond U+10FFFF and truncated sequences are malformed. Every
+         * maximal part of a malformed sequence is decoded into a single
+         * replacement character as recommended by the Unicode standard.
+         *
+         * A byte never decodes into more than one wide character so there
+         * must be room for as many wide characters as there are bytes.
+         *
+         * @param[in] from First byte
+         * @param[in] fromEnd 1+ the last byte
+         * @param[in] to Where to start writing wide characters
+         * @param[in] replacement What to decode malformed input into. Zero
+         *                        means malformed input is dropped.
+         * @return 1+ the last wide character that was written
+         */
+        wchar_t* decode(
+                const char* from,
+                const char* fromEnd,
+                wchar_t* to,
+                wchar_t replacement = Utf8::replacement);
+    }
+}
+
+#endif
@@ -28,7 +28,6 @@
 #ifndef FASTCGIPP_WEBSTREAMBUF_HPP
 #define FASTCGIPP_WEBSTREAMBUF_HPP
 
-#include <map>
 #include <streambuf>
 
 //! Topmost namespace for the fastcgi++ library
@@ -208,12 +207,6 @@ namespace Fastcgipp
         typedef typename std::basic_streambuf<charT, traits>::traits_type traits_type;
         typedef typename std::basic_streambuf<charT, traits>::char_type char_type;
 
-        //! Needed for html encoding of stream data
-        static const std::map<charT, const std::basic_string<charT>> htmlCharacters;
-
-        //! Needed for url encoding of stream data
-        static const std::map<charT, const std::basic_string<charT>> urlCharacters;
-
         //! Derived from std::basic_streambuf<charT, traits>
         std::streamsize xsputn(const char_type *s, std::streamsize n);
 
@@ -226,15 +219,29 @@ namespace Fastcgipp
 
         int sync()
         {
-            return emptyBuffer()?0:-1;
+            return flushBuffer()?0:-1;
         }
 
         int_type overflow(int_type c = traits_type::eof());
 
     protected:
         //! Code converts, packages and deals with all data in the stream buffer
+        /*!
+         * This is called when more room is needed in the put area so it
+         * must leave one behind.
+         */
         virtual bool emptyBuffer() =0;
 
+        //! Deals with all data in the stream buffer
+        /*!
+         * This is called by sync() and, unlike emptyBuffer(), needn't leave a
+         * put area behind. The default just calls emptyBuffer().
+         */
+        virtual bool flushBuffer()
+        {
+            return emptyBuffer();
+        }
+
         WebStreambuf():
             m_encoding(Encoding::NONE)
         {}
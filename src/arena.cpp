@@ -0,0 +1,68 @@
+/*!
+ * @file       arena.cpp
+ * @brief      Defines the Fastcgipp::Arena class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/arena.hpp"
+#include "fastcgi++/block.hpp"
+
+#include <algorithm>
+
+void Fastcgipp::Arena::release()
+{
+    for(const auto& chunk: m_chunks)
+        BlockPool::deallocate(chunk.data, chunk.capacity);
+    m_chunks.clear();
+    m_position = nullptr;
+    m_end = nullptr;
+    m_size = 0;
+    m_nextChunk = m_initialChunk;
+}
+
+void* Fastcgipp::Arena::grow(size_t size, size_t alignment)
+{
+    const size_t needed = size+alignment;
+    Chunk chunk;
+    chunk.data = BlockPool::allocate(
+            std::max(m_nextChunk, needed),
+            chunk.capacity);
+    m_chunks.push_back(chunk);
+    m_size += chunk.capacity;
+
+    char* const data = chunk.data + ((alignment - reinterpret_cast<size_t>(
+                    chunk.data)) & (alignment-1));
+
+    // Only make this the current chunk if it leaves more room than the old
+    // one
+    if(chunk.data+chunk.capacity-(data+size) > m_end-m_position)
+    {
+        m_position = data+size;
+        m_end = chunk.data+chunk.capacity;
+    }
+    m_nextChunk = std::min(m_nextChunk*2, BlockPool::maxPooled());
+
+    return data;
+}
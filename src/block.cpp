@@ -27,61 +27,332 @@
 *******************************************************************************/
 
 #include "fastcgi++/block.hpp"
+#include "fastcgi++/protocol.hpp"
+
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
 
-void Fastcgipp::Block::reserve(size_t x)
+namespace
 {
-    if(x != m_reserve)
+    //! Capacities of each size class
+    /*!
+     * A header, a power of two content length and enough room for padding.
+     * The last one fits the largest possible FastCGI record.
+     */
+    const size_t classCapacities[] =
+    {
+        sizeof(Fastcgipp::Protocol::Header) + 64 + 8,
+        sizeof(Fastcgipp::Protocol::Header) + 256 + 8,
+        sizeof(Fastcgipp::Protocol::Header) + 1024 + 8,
+        sizeof(Fastcgipp::Protocol::Header) + 4096 + 8,
+        sizeof(Fastcgipp::Protocol::Header) + 8192 + 8,
+        sizeof(Fastcgipp::Protocol::Header) + 16384 + 8,
+        sizeof(Fastcgipp::Protocol::Header) + 32768 + 8,
+        sizeof(Fastcgipp::Protocol::Header) + 0xffff + 0xff + 2,
+    };
+
+    const unsigned classCount
+        = sizeof(classCapacities)/sizeof(classCapacities[0]);
+
+    //! Bytes worth of chunks a thread may cache per size class
+    const size_t threadCacheBytes = 256*1024;
+
+    //! Bytes worth of chunks the depot may hold per size class
+    const size_t depotBytes = 4*1024*1024;
+
+    //! Find the size class for an allocation
+    /*!
+     * @return classCount if it's too big for any class
+     */
+    unsigned sizeClass(size_t size)
+    {
+        unsigned i=0;
+        while(i<classCount && classCapacities[i]<size)
+            ++i;
+        return i;
+    }
+
+    //! Max amount of chunks of a class in a thread cache
+    size_t threadCacheLimit(unsigned sizeClass)
+    {
+        return std::max(
+                threadCacheBytes/classCapacities[sizeClass],
+                static_cast<size_t>(4));
+    }
+
+    //! Max amount of chunks of a class in the depot
+    size_t depotLimit(unsigned sizeClass)
+    {
+        return std::max(
+                depotBytes/classCapacities[sizeClass],
+                static_cast<size_t>(16));
+    }
+
+    //! Shared pool of free chunks for all threads
+    struct Depot
+    {
+        std::mutex mutex[classCount];
+        std::vector<char*> chunks[classCount];
+        std::atomic_ullong allocations;
+        std::atomic_ullong heapAllocations;
+        std::atomic_ullong deallocations;
+
+        Depot():
+            allocations(0),
+            heapAllocations(0),
+            deallocations(0)
+        {}
+    };
+
+    //! Never destroyed so that blocks can be freed during static destruction
+    Depot& depot()
+    {
+        static Depot* const depot = new Depot;
+        return *depot;
+    }
+
+    //! Free chunks cached by a single thread
+    struct ThreadCache
     {
-        std::unique_ptr<char[]> data(new char[x]);
-        size_t newSize = std::min(m_size, x);
-        std::copy(
-                m_data.get(),
-                m_data.get()+newSize,
-                data.get());
+        std::vector<char*> chunks[classCount];
+
+        //! Move chunks from the cache to the depot
+        void release(unsigned sizeClass, size_t keep)
+        {
+            auto& chunks = this->chunks[sizeClass];
+            Depot& depot = ::depot();
+            std::lock_guard<std::mutex> lock(depot.mutex[sizeClass]);
+            auto& depotChunks = depot.chunks[sizeClass];
+            const size_t limit = depotLimit(sizeClass);
+            while(chunks.size() > keep)
+            {
+                if(depotChunks.size() < limit)
+                    depotChunks.push_back(chunks.back());
+                else
+                    delete [] chunks.back();
+                chunks.pop_back();
+            }
+        }
+
+        //! Move up to half a cache worth of chunks from the depot
+        void refill(unsigned sizeClass)
+        {
+            auto& chunks = this->chunks[sizeClass];
+            Depot& depot = ::depot();
+            std::lock_guard<std::mutex> lock(depot.mutex[sizeClass]);
+            auto& depotChunks = depot.chunks[sizeClass];
+            size_t count = std::min(
+                    depotChunks.size(),
+                    threadCacheLimit(sizeClass)/2);
+            while(count--)
+            {
+                chunks.push_back(depotChunks.back());
+                depotChunks.pop_back();
+            }
+        }
 
-        m_reserve = x;
-        m_size = newSize;
-        m_data = std::move(data);
+        ~ThreadCache();
+    };
 
+    //! False once this thread's cache has been destroyed
+    thread_local bool threadCacheAlive = true;
+
+    thread_local ThreadCache threadCache;
+
+    ThreadCache::~ThreadCache()
+    {
+        for(unsigned i=0; i<classCount; ++i)
+            release(i, 0);
+        threadCacheAlive = false;
     }
 }
 
+char* Fastcgipp::BlockPool::allocate(size_t size, size_t& capacity)
+{
+    Depot& depot = ::depot();
+    ++depot.allocations;
+
+    const unsigned sizeClass = ::sizeClass(size);
+    if(sizeClass == classCount)
+    {
+        ++depot.heapAllocations;
+        capacity = size;
+        return new char[size];
+    }
+    capacity = classCapacities[sizeClass];
+
+    if(threadCacheAlive)
+    {
+        auto& chunks = threadCache.chunks[sizeClass];
+        if(chunks.empty())
+            threadCache.refill(sizeClass);
+        if(!chunks.empty())
+        {
+            char* const data = chunks.back();
+            chunks.pop_back();
+            return data;
+        }
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(depot.mutex[sizeClass]);
+        auto& chunks = depot.chunks[sizeClass];
+        if(!chunks.empty())
+        {
+            char* const data = chunks.back();
+            chunks.pop_back();
+            return data;
+        }
+    }
+
+    ++depot.heapAllocations;
+    return new char[capacity];
+}
+
+void Fastcgipp::BlockPool::deallocate(char* data, size_t capacity)
+{
+    if(data == nullptr)
+        return;
+
+    Depot& depot = ::depot();
+    ++depot.deallocations;
+
+    const unsigned sizeClass = ::sizeClass(capacity);
+    if(sizeClass == classCount || classCapacities[sizeClass] != capacity)
+    {
+        delete [] data;
+        return;
+    }
+
+    if(threadCacheAlive)
+    {
+        auto& chunks = threadCache.chunks[sizeClass];
+        chunks.push_back(data);
+        const size_t limit = threadCacheLimit(sizeClass);
+        if(chunks.size() > limit)
+            threadCache.release(sizeClass, limit/2);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(depot.mutex[sizeClass]);
+        auto& chunks = depot.chunks[sizeClass];
+        if(chunks.size() < depotLimit(sizeClass))
+            chunks.push_back(data);
+        else
+            delete [] data;
+    }
+}
+
+size_t Fastcgipp::BlockPool::maxPooled()
+{
+    return classCapacities[classCount-1];
+}
+
+unsigned long long Fastcgipp::BlockPool::allocations()
+{
+    return depot().allocations;
+}
+
+unsigned long long Fastcgipp::BlockPool::heapAllocations()
+{
+    return depot().heapAllocations;
+}
+
+unsigned long long Fastcgipp::BlockPool::deallocations()
+{
+    return depot().deallocations;
+}
+
+void Fastcgipp::Block::release()
+{
+    if(m_chunk)
+        m_chunk.reset();
+    else
+        BlockPool::deallocate(m_data, m_capacity);
+}
+
+void Fastcgipp::Block::reserve(size_t x)
+{
+    if(x > m_capacity)
+    {
+        size_t capacity;
+        char* const data = BlockPool::allocate(x, capacity);
+        std::copy(m_data, m_data+std::min(m_size, x), data);
+        release();
+        m_data = data;
+        m_capacity = capacity;
+    }
+    m_reserve = x;
+    m_size = std::min(m_size, x);
+}
+
 Fastcgipp::Block::Block():
     m_reserve(0),
-    m_size(0)
+    m_size(0),
+    m_data(nullptr),
+    m_capacity(0)
 {}
 
 Fastcgipp::Block::Block(const size_t size_):
     m_reserve(size_),
     m_size(size_),
-    m_data(new char[size_])
+    m_data(BlockPool::allocate(size_, m_capacity))
 {}
 
 Fastcgipp::Block::Block(const char* const data, const size_t size_):
     m_reserve(size_),
     m_size(size_),
-    m_data(new char[size_])
+    m_data(BlockPool::allocate(size_, m_capacity))
+{
+    std::copy(data, data+size_, m_data);
+}
+
+Fastcgipp::Block::Block(
+        const std::shared_ptr<Block>& chunk,
+        char* const data,
+        const size_t size_):
+    m_reserve(size_),
+    m_size(size_),
+    m_data(data),
+    m_capacity(size_),
+    m_chunk(chunk)
+{}
+
+Fastcgipp::Block::~Block()
 {
-    std::copy(data, data+size_, m_data.get());
+    release();
 }
 
 Fastcgipp::Block::Block(Block&& x):
     m_reserve(x.m_reserve),
     m_size(x.m_size),
-    m_data(std::move(x.m_data))
+    m_data(x.m_data),
+    m_capacity(x.m_capacity),
+    m_chunk(std::move(x.m_chunk))
 {
     x.m_reserve = 0;
     x.m_size = 0;
+    x.m_data = nullptr;
+    x.m_capacity = 0;
 }
 
 Fastcgipp::Block& Fastcgipp::Block::operator=(Block&& x)
 {
-    m_reserve = x.m_reserve;
-    x.m_reserve = 0;
-    m_size = x.m_size;
-    x.m_size = 0;
-    m_data = std::move(x.m_data);
+    if(this != &x)
+    {
+        release();
+        m_reserve = x.m_reserve;
+        x.m_reserve = 0;
+        m_size = x.m_size;
+        x.m_size = 0;
+        m_data = x.m_data;
+        x.m_data = nullptr;
+        m_capacity = x.m_capacity;
+        x.m_capacity = 0;
+        m_chunk = std::move(x.m_chunk);
+    }
     return *this;
 }
 
@@ -97,18 +368,22 @@ void Fastcgipp::Block::size(size_t x)
 
 void Fastcgipp::Block::clear()
 {
+    release();
     m_reserve = 0;
     m_size = 0;
-    m_data.reset();
+    m_data = nullptr;
+    m_capacity = 0;
 }
 
 void Fastcgipp::Block::assign(const char* const data, const size_t size_)
 {
-    if(size_ > m_reserve)
+    // A slice shares it's memory so it can't be written over
+    if(size_ > m_capacity || m_chunk)
     {
-        m_data.reset(new char[size_]);
-        m_reserve = size_;
+        release();
+        m_data = BlockPool::allocate(size_, m_capacity);
     }
+    m_reserve = std::max(m_reserve, size_);
     m_size = size_;
-    std::copy(data, data+size_, m_data.get());
+    std::copy(data, data+size_, m_data);
 }
@@ -26,52 +26,39 @@
 *******************************************************************************/
 
 #include "fastcgi++/fcgistreambuf.hpp"
-#include "fastcgi++/log.hpp"
+#include "fastcgi++/utf8.hpp"
 
-#include <codecvt>
 #include <algorithm>
 
 namespace Fastcgipp
 {
     template <> bool
-    Fastcgipp::FcgiStreambuf<wchar_t, std::char_traits<wchar_t>>::emptyBuffer()
+    Fastcgipp::FcgiStreambuf<wchar_t, std::char_traits<wchar_t>>::flushBuffer()
     {
-        const std::codecvt_utf8<wchar_t> converter;
-        std::codecvt_base::result result;
+        const size_t maxContentLength = 0xffffU;
         Block record;
-        size_t count;
-        mbstate_t state = mbstate_t();
-        char* toNext;
-        const wchar_t* fromNext;
 
-        while((count = this->pptr() - this->pbase()) != 0)
+        for(const wchar_t* from = this->pbase(); from != this->pptr();)
         {
-            record.reserve(
-                    Protocol::getRecordSize(count*converter.max_length()));
+            // Size the record exactly so nothing is wasted on ASCII
+            const size_t length = std::min(
+                    Utf8::length(from, this->pptr()),
+                    maxContentLength);
+            record.reserve(Protocol::getRecordSize(length));
+
+            char* const content = record.begin()+sizeof(Protocol::Header);
+            char* contentEnd;
+            Utf8::encode(
+                    from,
+                    this->pptr(),
+                    from,
+                    content,
+                    content+length,
+                    contentEnd);
 
             Protocol::Header& header
                 = *reinterpret_cast<Protocol::Header*>(record.begin());
-
-            result = converter.out(
-                    state,
-                    this->pbase(),
-                    this->pptr(),
-                    fromNext,
-                    record.begin()+sizeof(Protocol::Header),
-                    &*record.end(),
-                    toNext);
-
-            if(result == std::codecvt_base::error
-                    || result == std::codecvt_base::noconv)
-            {
-                ERROR_LOG("FcgiStreambuf code conversion failed")
-                pbump(-count);
-                return false;
-            }
-            pbump(-(fromNext - this->pbase()));
-            header.contentLength = std::distance(
-                    record.begin()+sizeof(Protocol::Header),
-                    toNext);
+            header.contentLength = contentEnd-content;
             record.size(Protocol::getRecordSize(header.contentLength));
 
             header.version = Protocol::version;
@@ -83,51 +70,81 @@ namespace Fastcgipp
             send(m_id.m_socket, std::move(record));
         }
 
+        this->setp(this->pbase(), this->epptr());
         return true;
     }
 
-    template <>
-    bool Fastcgipp::FcgiStreambuf<char, std::char_traits<char>>::emptyBuffer()
+    template <> void
+    Fastcgipp::FcgiStreambuf<wchar_t, std::char_traits<wchar_t>>::
+    prepareBuffer()
     {
-        Block record;
-        size_t count;
-
-        while((count = this->pptr() - this->pbase()) != 0)
+        if(!m_buffer)
         {
-            record.size(Protocol::getRecordSize(count));
+            m_buffer.reset(new wchar_t[m_bufferSize]);
+            this->setp(m_buffer.get(), m_buffer.get()+m_bufferSize);
+        }
+    }
 
-            Protocol::Header& header
-                = *reinterpret_cast<Protocol::Header*>(record.begin());
-            header.contentLength = std::min(
-                    count,
-                    static_cast<size_t>(0xffffU));
+    template <>
+    bool Fastcgipp::FcgiStreambuf<char, std::char_traits<char>>::flushBuffer()
+    {
+        const size_t count = this->pptr() - this->pbase();
+        if(count == 0)
+            return true;
 
-            std::copy(
-                    this->pbase(),
-                    this->pbase()+header.contentLength,
-                    record.begin()+sizeof(Protocol::Header));
+        Protocol::Header& header
+            = *reinterpret_cast<Protocol::Header*>(m_record.begin());
+        header.contentLength = count;
+        m_record.size(Protocol::getRecordSize(count));
 
-            pbump(-header.contentLength);
+        header.version = Protocol::version;
+        header.type = m_type;
+        header.fcgiId = m_id.m_id;
+        header.paddingLength =
+            m_record.size()-header.contentLength-sizeof(Protocol::Header);
 
-            header.version = Protocol::version;
-            header.type = m_type;
-            header.fcgiId = m_id.m_id;
-            header.paddingLength =
-                record.size()-header.contentLength-sizeof(Protocol::Header);
+        this->setp(nullptr, nullptr);
+        send(m_id.m_socket, std::move(m_record));
+        return true;
+    }
 
-            send(m_id.m_socket, std::move(record));
+    template <> void
+    Fastcgipp::FcgiStreambuf<char, std::char_traits<char>>::prepareBuffer()
+    {
+        if(this->pbase() == nullptr)
+        {
+            m_record.reserve(Protocol::getRecordSize(m_bufferSize));
+            char* const start = m_record.begin()+sizeof(Protocol::Header);
+            this->setp(start, start+m_bufferSize);
         }
-
-        return true;
     }
 }
 
+template <class charT, class traits>
+bool Fastcgipp::FcgiStreambuf<charT, traits>::emptyBuffer()
+{
+    if(!flushBuffer())
+        return false;
+    prepareBuffer();
+    return true;
+}
+
+template <class charT, class traits>
+void Fastcgipp::FcgiStreambuf<charT, traits>::bufferSize(size_t size)
+{
+    flushBuffer();
+    m_bufferSize = std::max(std::min(size, size_t(0xffffU)), size_t(1));
+    this->setp(nullptr, nullptr);
+    m_record.clear();
+    m_buffer.reset();
+}
+
 template <class charT, class traits>
 void Fastcgipp::FcgiStreambuf<charT, traits>::dump(
         const char* data,
         size_t size)
 {
-    emptyBuffer();
+    flushBuffer();
     Block record;
 
     while(size != 0)
@@ -161,7 +178,7 @@ void Fastcgipp::FcgiStreambuf<charT, traits>::dump(
         std::basic_istream<char>& stream)
 {
     const size_t maxContentLength = 0xffffU;
-    emptyBuffer();
+    flushBuffer();
     Block record;
 
     while(true)
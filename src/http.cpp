@@ -25,31 +25,407 @@
 * along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
 *******************************************************************************/
 
-#include <locale>
-#include <codecvt>
+#include <algorithm>
+#include <cstring>
 #include <utility>
 #include <sstream>
 #include <iomanip>
 #include <random>
+#include <cstdint>
+#include <mutex>
 
 #include "fastcgi++/log.hpp"
 #include "fastcgi++/http.hpp"
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
-void Fastcgipp::Http::vecToString(
-        const char* start,
-        const char* end,
-        std::wstring& string)
+namespace
 {
-    std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
-    try
+    //! Parameters that have their own member in Http::Environment
+    enum class KnownParameter: unsigned char
+    {
+        NONE,
+        HTTP_HOST,
+        PATH_INFO,
+        HTTP_ACCEPT,
+        HTTP_COOKIE,
+        SERVER_ADDR,
+        REMOTE_ADDR,
+        SERVER_PORT,
+        REMOTE_PORT,
+        SCRIPT_NAME,
+        REQUEST_URI,
+        HTTP_REFERER,
+        CONTENT_TYPE,
+        QUERY_STRING,
+        DOCUMENT_ROOT,
+        REQUEST_METHOD,
+        CONTENT_LENGTH,
+        HTTP_USER_AGENT,
+        HTTP_KEEP_ALIVE,
+        HTTP_IF_NONE_MATCH,
+        HTTP_AUTHORIZATION,
+        HTTP_ACCEPT_CHARSET,
+        HTTP_ACCEPT_LANGUAGE,
+        HTTP_IF_MODIFIED_SINCE
+    };
+
+    struct KnownName
+    {
+        const char* name;
+        size_t size;
+        KnownParameter parameter;
+    };
+
+    constexpr KnownName knownNames[] =
+    {
+        {"HTTP_HOST", 9, KnownParameter::HTTP_HOST},
+        {"PATH_INFO", 9, KnownParameter::PATH_INFO},
+        {"HTTP_ACCEPT", 11, KnownParameter::HTTP_ACCEPT},
+        {"HTTP_COOKIE", 11, KnownParameter::HTTP_COOKIE},
+        {"SERVER_ADDR", 11, KnownParameter::SERVER_ADDR},
+        {"REMOTE_ADDR", 11, KnownParameter::REMOTE_ADDR},
+        {"SERVER_PORT", 11, KnownParameter::SERVER_PORT},
+        {"REMOTE_PORT", 11, KnownParameter::REMOTE_PORT},
+        {"SCRIPT_NAME", 11, KnownParameter::SCRIPT_NAME},
+        {"REQUEST_URI", 11, KnownParameter::REQUEST_URI},
+        {"HTTP_REFERER", 12, KnownParameter::HTTP_REFERER},
+        {"CONTENT_TYPE", 12, KnownParameter::CONTENT_TYPE},
+        {"QUERY_STRING", 12, KnownParameter::QUERY_STRING},
+        {"DOCUMENT_ROOT", 13, KnownParameter::DOCUMENT_ROOT},
+        {"REQUEST_METHOD", 14, KnownParameter::REQUEST_METHOD},
+        {"CONTENT_LENGTH", 14, KnownParameter::CONTENT_LENGTH},
+        {"HTTP_USER_AGENT", 15, KnownParameter::HTTP_USER_AGENT},
+        {"HTTP_KEEP_ALIVE", 15, KnownParameter::HTTP_KEEP_ALIVE},
+        {"HTTP_IF_NONE_MATCH", 18, KnownParameter::HTTP_IF_NONE_MATCH},
+        {"HTTP_AUTHORIZATION", 18, KnownParameter::HTTP_AUTHORIZATION},
+        {"HTTP_ACCEPT_CHARSET", 19, KnownParameter::HTTP_ACCEPT_CHARSET},
+        {"HTTP_ACCEPT_LANGUAGE", 20, KnownParameter::HTTP_ACCEPT_LANGUAGE},
+        {"HTTP_IF_MODIFIED_SINCE", 22, KnownParameter::HTTP_IF_MODIFIED_SINCE}
+    };
+
+    constexpr size_t knownCount = sizeof(knownNames)/sizeof(knownNames[0]);
+
+    //! Amount of slots in the perfect hash table. Must be a power of two.
+    constexpr size_t knownSlots = 64;
+
+    //! Seeded FNV-1a hash of a parameter name
+    constexpr uint32_t hashName(
+            const char* name,
+            size_t size,
+            uint32_t seed)
+    {
+        uint32_t hash = 2166136261u ^ seed;
+        for(size_t i=0; i<size; ++i)
+        {
+            hash ^= static_cast<unsigned char>(name[i]);
+            hash *= 16777619u;
+        }
+
+        // The low bits of FNV-1a are weak so mix everything into them
+        hash ^= hash >> 16;
+        hash *= 0x85ebca6bu;
+        hash ^= hash >> 13;
+        return hash;
+    }
+
+    //! True if no two known names land in the same slot with this seed
+    constexpr bool perfect(uint32_t seed)
+    {
+        bool used[knownSlots] = {};
+        for(size_t i=0; i<knownCount; ++i)
+        {
+            const size_t slot = hashName(
+                    knownNames[i].name,
+                    knownNames[i].size,
+                    seed) & (knownSlots-1);
+            if(used[slot])
+                return false;
+            used[slot] = true;
+        }
+        return true;
+    }
+
+    //! Find the first seed that gives us a perfect hash
+    constexpr uint32_t findSeed()
+    {
+        uint32_t seed = 0;
+        while(!perfect(seed))
+            ++seed;
+        return seed;
+    }
+
+    //! Seed for the perfect hash of known names
+    constexpr uint32_t knownSeed = findSeed();
+
+    //! Perfect hash table of known names
+    struct KnownTable
     {
-        string = converter.from_bytes(&*start, &*end);
+        //! Index+1 in knownNames of the name in each slot. Zero if empty.
+        unsigned char slots[knownSlots];
+    };
+
+    constexpr KnownTable makeKnownTable()
+    {
+        KnownTable table = {};
+        for(size_t i=0; i<knownCount; ++i)
+            table.slots[hashName(
+                    knownNames[i].name,
+                    knownNames[i].size,
+                    knownSeed) & (knownSlots-1)] = i+1;
+        return table;
     }
-    catch(const std::range_error& e)
+
+    constexpr KnownTable knownTable = makeKnownTable();
+
+    //! Identify a parameter name that has it's own Environment member
+    KnownParameter knownParameter(const char* name, const char* nameEnd)
     {
-        WARNING_LOG("Error in code conversion from utf8")
+        const size_t size = nameEnd-name;
+        const unsigned char slot = knownTable.slots[
+            hashName(name, size, knownSeed) & (knownSlots-1)];
+        if(slot == 0)
+            return KnownParameter::NONE;
+        const KnownName& known = knownNames[slot-1];
+        if(known.size != size || !std::equal(name, nameEnd, known.name))
+            return KnownParameter::NONE;
+        return known.parameter;
     }
+
+    //! Parameter names registered by the application
+    /*!
+     * This is never modified once published. Registering a new name
+     * publishes a new copy and the old one is kept around forever since
+     * other threads may still be looking at it.
+     */
+    struct Registry
+    {
+        //! Every registered name in the order they were registered
+        std::vector<std::string> names;
+
+        //! Open addressing hash table of index+1 into names. Zero if empty.
+        std::vector<unsigned> slots;
+    };
+
+    //! The currently published registry
+    std::atomic<const Registry*> registry(nullptr);
+
+    //! Index of a name that isn't registered
+    const unsigned unregistered = static_cast<unsigned>(-1);
+
+    //! Find the index of a registered parameter name
+    unsigned registeredParameter(const char* name, const char* nameEnd)
+    {
+        const Registry* const current = registry.load(
+                std::memory_order_acquire);
+        if(current == nullptr)
+            return unregistered;
+
+        const size_t mask = current->slots.size()-1;
+        for(
+                size_t slot = hashName(name, nameEnd-name, knownSeed) & mask;
+                current->slots[slot] != 0;
+                slot = (slot+1) & mask)
+        {
+            const std::string& registered
+                = current->names[current->slots[slot]-1];
+            if(registered.size() == size_t(nameEnd-name)
+                    && std::equal(name, nameEnd, registered.begin()))
+                return current->slots[slot]-1;
+        }
+        return unregistered;
+    }
+
+    //! Find the first '%' or '+' in url-encoded data
+    /*!
+     * Vectorized with SSE2 or AVX2 if the compiler targets them.
+     *
+     * @return Position of the escape or end if there is none.
+     */
+    inline const char* findEscape(const char* start, const char* const end)
+    {
+#if defined(__AVX2__)
+        const __m256i percents = _mm256_set1_epi8('%');
+        const __m256i pluses = _mm256_set1_epi8('+');
+        for(; end-start >= 32; start += 32)
+        {
+            const __m256i bytes = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(start));
+            const unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(
+                        _mm256_cmpeq_epi8(bytes, percents),
+                        _mm256_cmpeq_epi8(bytes, pluses)));
+            if(mask)
+                return start+__builtin_ctz(mask);
+        }
+#elif defined(__SSE2__)
+        const __m128i percents = _mm_set1_epi8('%');
+        const __m128i pluses = _mm_set1_epi8('+');
+        for(; end-start >= 16; start += 16)
+        {
+            const __m128i bytes = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(start));
+            const unsigned mask = _mm_movemask_epi8(_mm_or_si128(
+                        _mm_cmpeq_epi8(bytes, percents),
+                        _mm_cmpeq_epi8(bytes, pluses)));
+            if(mask)
+                return start+__builtin_ctz(mask);
+        }
+#endif
+        while(start != end && *start != '%' && *start != '+')
+            ++start;
+        return start;
+    }
+
+    //! Value of a hexadecimal digit or zero if it isn't one
+    inline char hexValue(const char digit)
+    {
+        if((digit|0x20) >= 'a' && (digit|0x20) <= 'f')
+            return (digit|0x20)-0x57;
+        else if(digit >= '0' && digit <= '9')
+            return digit&0x0f;
+        return 0;
+    }
+
+    //! Find a field separator in url-encoded data
+    /*!
+     * @return Start of the separator or end if there is none.
+     */
+    inline const char* findSeparator(
+            const char* start,
+            const char* const end,
+            const char* const separator,
+            const size_t separatorSize)
+    {
+        while(start != end)
+        {
+            start = static_cast<const char*>(
+                    std::memchr(start, *separator, end-start));
+            if(start == nullptr)
+                return end;
+            if(size_t(end-start) >= separatorSize
+                    && std::memcmp(start, separator, separatorSize) == 0)
+                return start;
+            ++start;
+        }
+        return end;
+    }
+
+    //! Decode url-encoded data into any container of string pairs
+    template<class Output>
+    void decodeUrlEncodedInto(
+            const char* data,
+            const char* const dataEnd,
+            Output& output,
+            const char* const fieldSeparator)
+    {
+        typedef typename Output::value_type::second_type String;
+        const typename String::allocator_type allocator(
+                output.get_allocator());
+
+        std::unique_ptr<char[]> buffer(new char[dataEnd-data]);
+        const size_t fieldSeparatorSize = std::strlen(fieldSeparator);
+
+        while(data != dataEnd)
+        {
+            const char* const equals = static_cast<const char*>(
+                    std::memchr(data, '=', dataEnd-data));
+            if(equals == nullptr)
+                break;
+
+            String name(allocator);
+            Fastcgipp::Http::vecToString(
+                    buffer.get(),
+                    Fastcgipp::Http::percentEscapedToRealBytes(
+                        data,
+                        equals,
+                        buffer.get()),
+                    name);
+
+            const char* const valueEnd = findSeparator(
+                    equals+1,
+                    dataEnd,
+                    fieldSeparator,
+                    fieldSeparatorSize);
+            String value(allocator);
+            Fastcgipp::Http::vecToString(
+                    buffer.get(),
+                    Fastcgipp::Http::percentEscapedToRealBytes(
+                        equals+1,
+                        valueEnd,
+                        buffer.get()),
+                    value);
+
+            output.insert(std::make_pair(std::move(name), std::move(value)));
+
+            if(valueEnd == dataEnd)
+                break;
+            data = valueEnd+fieldSeparatorSize;
+        }
+    }
+}
+
+Fastcgipp::Http::RegisteredParameter Fastcgipp::Http::registerParameter(
+        const char* name)
+{
+    static std::mutex mutex;
+    static std::vector<std::unique_ptr<const Registry>> registries;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const char* const nameEnd = name+std::strlen(name);
+    if(knownParameter(name, nameEnd) != KnownParameter::NONE)
+    {
+        WARNING_LOG("Refusing to register " << name \
+                << " since it has it's own Environment member")
+        return RegisteredParameter(unregistered);
+    }
+
+    unsigned index = registeredParameter(name, nameEnd);
+    if(index != unregistered)
+        return RegisteredParameter(index);
+
+    std::unique_ptr<Registry> next(new Registry);
+    if(!registries.empty())
+        next->names = registries.back()->names;
+    index = next->names.size();
+    next->names.emplace_back(name, nameEnd);
+
+    // Keep the table at most half full
+    size_t size = 2;
+    while(size < next->names.size()*2)
+        size <<= 1;
+    next->slots.resize(size, 0);
+    for(unsigned i=0; i<next->names.size(); ++i)
+    {
+        const std::string& registered = next->names[i];
+        size_t slot = hashName(
+                registered.data(),
+                registered.size(),
+                knownSeed) & (size-1);
+        while(next->slots[slot] != 0)
+            slot = (slot+1) & (size-1);
+        next->slots[slot] = i+1;
+    }
+
+    registries.emplace_back(std::move(next));
+    registry.store(registries.back().get(), std::memory_order_release);
+    return RegisteredParameter(index);
+}
+
+
+void Fastcgipp::Http::vecToString(
+        const char* start,
+        const char* end,
+        std::wstring& string)
+{
+    string.resize(end-start);
+    string.resize(Utf8::decode(
+                start,
+                end,
+                &string[0],
+                Utf8::inputReplacement) - string.data());
 }
 
 template int Fastcgipp::Http::atoi<char>(const char* start, const char* end);
@@ -114,55 +490,38 @@ float Fastcgipp::Http::atof(const charT* start, const charT* end)
 
 char* Fastcgipp::Http::percentEscapedToRealBytes(
         const char* start,
-        const char* end,
+        const char* const end,
         char* destination)
 {
-    enum State
-    {
-        NORMAL,
-        DECODINGFIRST,
-        DECODINGSECOND,
-    } state = NORMAL;
-
     while(start != end)
     {
-        if(state == NORMAL)
-        {
-            if(*start=='%')
-            {
-                *destination=0;
-                state = DECODINGFIRST;
-            }
-            else if(*start=='+')
-                *destination++=' ';
-            else
-                *destination++=*start;
-        }
-        else if(state == DECODINGFIRST)
-        {
-            if((*start|0x20) >= 'a' && (*start|0x20) <= 'f')
-                *destination = ((*start|0x20)-0x57)<<4;
-            else if(*start >= '0' && *start <= '9')
-                *destination = (*start&0x0f)<<4;
+        // Copy everything up to the next escape in one go
+        const char* const escape = findEscape(start, end);
+        std::memmove(destination, start, escape-start);
+        destination += escape-start;
+        start = escape;
 
-            state = DECODINGSECOND;
+        if(start == end)
+            break;
+        if(*start == '+')
+        {
+            *destination++ = ' ';
+            ++start;
         }
-        else if(state == DECODINGSECOND)
+        else
         {
-            if((*start|0x20) >= 'a' && (*start|0x20) <= 'f')
-                *destination |= (*start|0x20)-0x57;
-            else if(*start >= '0' && *start <= '9')
-                *destination |= *start&0x0f;
-
-            ++destination;
-            state = NORMAL;
+            // An escape cut short by the end is dropped
+            if(end-start < 3)
+                break;
+            *destination++ = hexValue(start[1])<<4 | hexValue(start[2]);
+            start += 3;
         }
-        ++start;
     }
     return destination;
 }
 
-template<class charT> void Fastcgipp::Http::Environment<charT>::fill(
+void Fastcgipp::Http::Parameters::add(
+        Block&& record,
         const char* data,
         const char* const dataEnd)
 {
@@ -177,264 +536,430 @@ template<class charT> void Fastcgipp::Http::Environment<charT>::fill(
             value,
             end))
     {
-        bool processed=true;
+        m_parameters.emplace_back(
+                StringView(name, value),
+                StringView(value, end));
+        data = end;
+    }
+    m_records.push_back(std::move(record));
+}
 
-        switch(value-name)
-        {
-        case 9:
-            if(std::equal(name, value, "HTTP_HOST"))
-                vecToString(value, end, host);
-            else if(std::equal(name, value, "PATH_INFO"))
+Fastcgipp::Http::Parameters::Container::const_iterator
+Fastcgipp::Http::Parameters::find(const StringView& name) const
+{
+    return std::find_if(
+            m_parameters.cbegin(),
+            m_parameters.cend(),
+            [&name] (const Parameter& parameter)
             {
-                const size_t bufferSize = end-value;
-                std::unique_ptr<char[]> buffer(new char[bufferSize]);
-                int size=-1;
-                for(
-                        auto source=value;
-                        source<=end;
-                        ++source, ++size)
-                {
-                    if(*source == '/' || source == end)
-                    {
-                        if(size > 0)
-                        {
-                            const auto bufferEnd = percentEscapedToRealBytes(
-                                    source-size,
-                                    source,
-                                    buffer.get());
-                            pathInfo.push_back(std::basic_string<charT>());
-                            vecToString(
-                                    buffer.get(),
-                                    bufferEnd,
-                                    pathInfo.back());
-                        }
-                        size=-1;
-                    }
-                }
-            }
+                return parameter.first == name;
+            });
+}
+
+Fastcgipp::StringView Fastcgipp::Http::Parameters::operator[](
+        const StringView& name) const
+{
+    const auto parameter = find(name);
+    if(parameter == m_parameters.cend())
+        return StringView();
+    return parameter->second;
+}
+
+const Fastcgipp::Http::Parameters::Container&
+Fastcgipp::Http::Parameters::gets() const
+{
+    if(!m_getsDecoded)
+    {
+        decode(queryString(), "&", m_gets);
+        m_getsDecoded = true;
+    }
+    return m_gets;
+}
+
+const Fastcgipp::Http::Parameters::Container&
+Fastcgipp::Http::Parameters::cookies() const
+{
+    if(!m_cookiesDecoded)
+    {
+        decode((*this)["HTTP_COOKIE"], "; ", m_cookies);
+        m_cookiesDecoded = true;
+    }
+    return m_cookies;
+}
+
+void Fastcgipp::Http::Parameters::decode(
+        const StringView& data,
+        const char* const fieldSeparator,
+        Container& output) const
+{
+    if(data.empty())
+        return;
+
+    m_buffers.emplace_back(new char[data.size()]);
+    char* destination = m_buffers.back().get();
+
+    const size_t fieldSeparatorSize = std::strlen(fieldSeparator);
+    const char* fieldStart = data.begin();
+
+    while(fieldStart < data.end())
+    {
+        const char* fieldEnd = findSeparator(
+                fieldStart,
+                data.end(),
+                fieldSeparator,
+                fieldSeparatorSize);
+        const char* const equals = std::find(fieldStart, fieldEnd, '=');
+        if(equals != fieldEnd)
+        {
+            char* const nameStart = destination;
+            destination = percentEscapedToRealBytes(
+                    fieldStart,
+                    equals,
+                    destination);
+            char* const valueStart = destination;
+            destination = percentEscapedToRealBytes(
+                    equals+1,
+                    fieldEnd,
+                    destination);
+            output.emplace_back(
+                    StringView(nameStart, valueStart),
+                    StringView(valueStart, destination));
+        }
+        fieldStart = fieldEnd+fieldSeparatorSize;
+    }
+}
+
+Fastcgipp::StringView Fastcgipp::Http::Parameters::first(
+        const Container& container,
+        const StringView& name)
+{
+    for(const auto& parameter: container)
+        if(parameter.first == name)
+            return parameter.second;
+    return StringView();
+}
+
+template<class charT, class Allocator>
+void Fastcgipp::Http::Environment<charT, Allocator>::fill(
+        const char* data,
+        const char* const dataEnd)
+{
+    const char* name;
+    const char* value;
+    const char* end;
+
+    while(Protocol::processParamHeader(
+            data,
+            dataEnd,
+            name,
+            value,
+            end))
+    {
+        if(!fill(name, value, end))
+        {
+            String nameString(m_allocator);
+            String valueString(m_allocator);
+            vecToString(name, value, nameString);
+            vecToString(value, end, valueString);
+            const auto other = others.find(nameString);
+            if(other == others.end())
+                others.emplace(std::move(nameString), std::move(valueString));
             else
-                processed=false;
+                other->second = std::move(valueString);
+        }
+        data = end;
+    }
+}
+
+template<class charT, class Allocator>
+void Fastcgipp::Http::Environment<charT, Allocator>::index(
+        Block&& record,
+        const char* data,
+        const char* dataEnd)
+{
+    // A small slice would pin an entire receive chunk for the life of the
+    // request so it's cheaper to copy it out
+    if(record.slice() && record.size() <= indexCopyLimit)
+    {
+        Block owned(record.begin(), record.size());
+        data = owned.begin() + (data-record.begin());
+        dataEnd = owned.begin() + (dataEnd-record.begin());
+        record = std::move(owned);
+    }
+
+    const size_t first = parameters.size();
+    parameters.add(std::move(record), data, dataEnd);
+
+    for(
+            auto parameter = parameters.begin()+first;
+            parameter != parameters.end();
+            ++parameter)
+    {
+        const StringView& name = parameter->first;
+        switch(knownParameter(name.begin(), name.end()))
+        {
+        case KnownParameter::CONTENT_LENGTH:
+        case KnownParameter::CONTENT_TYPE:
+        case KnownParameter::REQUEST_METHOD:
+            fill(
+                    name.begin(),
+                    parameter->second.begin(),
+                    parameter->second.end());
             break;
-        case 11:
-            if(std::equal(name, value, "HTTP_ACCEPT"))
-                vecToString(value, end, acceptContentTypes);
-            else if(std::equal(name, value, "HTTP_COOKIE"))
-                decodeUrlEncoded(value, end, cookies, "; ");
-            else if(std::equal(name, value, "SERVER_ADDR"))
-                serverAddress.assign(&*value, &*end);
-            else if(std::equal(name, value, "REMOTE_ADDR"))
-                remoteAddress.assign(&*value, &*end);
-            else if(std::equal(name, value, "SERVER_PORT"))
-                serverPort=atoi(&*value, &*end);
-            else if(std::equal(name, value, "REMOTE_PORT"))
-                remotePort=atoi(&*value, &*end);
-            else if(std::equal(name, value, "SCRIPT_NAME"))
-                vecToString(value, end, scriptName);
-            else if(std::equal(name, value, "REQUEST_URI"))
-                vecToString(value, end, requestUri);
-            else
-                processed=false;
+        default:
             break;
-        case 12:
-            if(std::equal(name, value, "HTTP_REFERER"))
-                vecToString(value, end, referer);
-            else if(std::equal(name, value, "CONTENT_TYPE"))
+        }
+    }
+}
+
+template<class charT, class Allocator>
+bool Fastcgipp::Http::Environment<charT, Allocator>::fill(
+        const char* const name,
+        const char* const value,
+        const char* const end)
+{
+    switch(knownParameter(name, value))
+    {
+    case KnownParameter::HTTP_HOST:
+        vecToString(value, end, host);
+        break;
+    case KnownParameter::PATH_INFO:
+    {
+        const size_t bufferSize = end-value;
+        std::unique_ptr<char[]> buffer(new char[bufferSize]);
+        int size=-1;
+        for(
+                auto source=value;
+                source<=end;
+                ++source, ++size)
+        {
+            if(*source == '/' || source == end)
             {
-                const auto semicolon = std::find(value, end, ';');
-                vecToString(
-                        value,
-                        semicolon,
-                        contentType);
-                if(semicolon != end)
+                if(size > 0)
                 {
-                    const auto equals = std::find(semicolon, end, '=');
-                    if(equals != end)
-                        boundary.assign(
-                                equals+1,
-                                end);
+                    const auto bufferEnd = percentEscapedToRealBytes(
+                            source-size,
+                            source,
+                            buffer.get());
+                    pathInfo.emplace_back(m_allocator);
+                    vecToString(
+                            buffer.get(),
+                            bufferEnd,
+                            pathInfo.back());
                 }
+                size=-1;
             }
-            else if(std::equal(name, value, "QUERY_STRING"))
-                decodeUrlEncoded(value, end, gets);
-            else
-                processed=false;
-            break;
-        case 13:
-            if(std::equal(name, value, "DOCUMENT_ROOT"))
-                vecToString(value, end, root);
-            else
-                processed=false;
+        }
+        break;
+    }
+    case KnownParameter::HTTP_ACCEPT:
+        vecToString(value, end, acceptContentTypes);
+        break;
+    case KnownParameter::HTTP_COOKIE:
+        decodeUrlEncoded(value, end, cookies, "; ");
+        break;
+    case KnownParameter::SERVER_ADDR:
+        serverAddress.assign(&*value, &*end);
+        break;
+    case KnownParameter::REMOTE_ADDR:
+        remoteAddress.assign(&*value, &*end);
+        break;
+    case KnownParameter::SERVER_PORT:
+        serverPort=atoi(&*value, &*end);
+        break;
+    case KnownParameter::REMOTE_PORT:
+        remotePort=atoi(&*value, &*end);
+        break;
+    case KnownParameter::SCRIPT_NAME:
+        vecToString(value, end, scriptName);
+        break;
+    case KnownParameter::REQUEST_URI:
+        vecToString(value, end, requestUri);
+        break;
+    case KnownParameter::HTTP_REFERER:
+        vecToString(value, end, referer);
+        break;
+    case KnownParameter::CONTENT_TYPE:
+    {
+        const auto semicolon = std::find(value, end, ';');
+        vecToString(
+                value,
+                semicolon,
+                contentType);
+        if(semicolon != end)
+        {
+            const auto equals = std::find(semicolon, end, '=');
+            if(equals != end)
+                boundary.assign(
+                        equals+1,
+                        end);
+        }
+        break;
+    }
+    case KnownParameter::QUERY_STRING:
+        decodeUrlEncoded(value, end, gets);
+        break;
+    case KnownParameter::DOCUMENT_ROOT:
+        vecToString(value, end, root);
+        break;
+    case KnownParameter::REQUEST_METHOD:
+    {
+        requestMethod = RequestMethod::ERROR;
+        switch(end-value)
+        {
+        case 3:
+            if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::GET)]))
+                requestMethod = RequestMethod::GET;
+            else if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::PUT)]))
+                requestMethod = RequestMethod::PUT;
             break;
-        case 14:
-            if(std::equal(name, value, "REQUEST_METHOD"))
-            {
-                requestMethod = RequestMethod::ERROR;
-                switch(end-value)
-                {
-                case 3:
-                    if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::GET)]))
-                        requestMethod = RequestMethod::GET;
-                    else if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::PUT)]))
-                        requestMethod = RequestMethod::PUT;
-                    break;
-                case 4:
-                    if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::HEAD)]))
-                        requestMethod = RequestMethod::HEAD;
-                    else if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::POST)]))
-                        requestMethod = RequestMethod::POST;
-                    break;
-                case 5:
-                    if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::TRACE)]))
-                        requestMethod = RequestMethod::TRACE;
-                    break;
-                case 6:
-                    if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::DELETE)]))
-                        requestMethod = RequestMethod::DELETE;
-                    break;
-                case 7:
-                    if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::OPTIONS)]))
-                        requestMethod = RequestMethod::OPTIONS;
-                    else if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::OPTIONS)]))
-                        requestMethod = RequestMethod::CONNECT;
-                    break;
-                }
-            }
-            else if(std::equal(name, value, "CONTENT_LENGTH"))
-                contentLength=atoi(&*value, &*end);
-            else
-                processed=false;
+        case 4:
+            if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::HEAD)]))
+                requestMethod = RequestMethod::HEAD;
+            else if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::POST)]))
+                requestMethod = RequestMethod::POST;
             break;
-        case 15:
-            if(std::equal(name, value, "HTTP_USER_AGENT"))
-                vecToString(value, end, userAgent);
-            else if(std::equal(name, value, "HTTP_KEEP_ALIVE"))
-                keepAlive=atoi(&*value, &*end);
-            else
-                processed=false;
+        case 5:
+            if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::TRACE)]))
+                requestMethod = RequestMethod::TRACE;
             break;
-        case 18:
-            if(std::equal(name, value, "HTTP_IF_NONE_MATCH"))
-                etag=atoi(&*value, &*end);
-            else if(std::equal(name, value, "HTTP_AUTHORIZATION"))
-                vecToString(value, end, authorization);
-            else
-                processed=false;
+        case 6:
+            if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::DELETE)]))
+                requestMethod = RequestMethod::DELETE;
             break;
-        case 19:
-            if(std::equal(name, value, "HTTP_ACCEPT_CHARSET"))
-                vecToString(value, end, acceptCharsets);
-            else
-                processed=false;
+        case 7:
+            if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::OPTIONS)]))
+                requestMethod = RequestMethod::OPTIONS;
+            else if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::CONNECT)]))
+                requestMethod = RequestMethod::CONNECT;
             break;
-        case 20:
-            if(std::equal(name, value, "HTTP_ACCEPT_LANGUAGE"))
-            {
-                const char* groupStart = value;
-                const char* groupEnd;
-                const char* subStart;
-                const char* subEnd;
-                size_t dash;
-                while(groupStart < end)
-                {
-                    acceptLanguages.push_back(std::string());
-                    std::string& language = acceptLanguages.back();
+        }
+        break;
+    }
+    case KnownParameter::CONTENT_LENGTH:
+        contentLength=atoi(&*value, &*end);
+        break;
+    case KnownParameter::HTTP_USER_AGENT:
+        vecToString(value, end, userAgent);
+        break;
+    case KnownParameter::HTTP_KEEP_ALIVE:
+        keepAlive=atoi(&*value, &*end);
+        break;
+    case KnownParameter::HTTP_IF_NONE_MATCH:
+        etag=atoi(&*value, &*end);
+        break;
+    case KnownParameter::HTTP_AUTHORIZATION:
+        vecToString(value, end, authorization);
+        break;
+    case KnownParameter::HTTP_ACCEPT_CHARSET:
+        vecToString(value, end, acceptCharsets);
+        break;
+    case KnownParameter::HTTP_ACCEPT_LANGUAGE:
+    {
+        const char* groupStart = value;
+        const char* groupEnd;
+        const char* subStart;
+        const char* subEnd;
+        size_t dash;
+        while(groupStart < end)
+        {
+            acceptLanguages.emplace_back(m_allocator);
+            NarrowString& language = acceptLanguages.back();
 
-                    groupEnd = std::find(groupStart, end, ',');
+            groupEnd = std::find(groupStart, end, ',');
 
-                    // Setup the locality
-                    subEnd = std::find(groupStart, groupEnd, ';');
-                    subStart = groupStart;
-                    while(subStart != subEnd && *subStart == ' ')
-                        ++subStart;
-                    while(subEnd != subStart && *(subEnd-1) == ' ')
-                        --subEnd;
-                    vecToString(subStart, subEnd, language);
+            // Setup the locality
+            subEnd = std::find(groupStart, groupEnd, ';');
+            subStart = groupStart;
+            while(subStart != subEnd && *subStart == ' ')
+                ++subStart;
+            while(subEnd != subStart && *(subEnd-1) == ' ')
+                --subEnd;
+            vecToString(subStart, subEnd, language);
 
-                    dash = language.find('-');
-                    if(dash != std::string::npos)
-                        language[dash] = '_';
+            dash = language.find('-');
+            if(dash != NarrowString::npos)
+                language[dash] = '_';
 
-                    groupStart = groupEnd+1;
-                }
-            }
-            else
-                processed=false;
-            break;
-        case 22:
-            if(std::equal(name, value, "HTTP_IF_MODIFIED_SINCE"))
-            {
-                std::tm time;
-                std::fill(
-                        reinterpret_cast<char*>(&time),
-                        reinterpret_cast<char*>(&time)+sizeof(time),
-                        0);
-                std::stringstream dateStream;
-                dateStream.write(&*value, end-value);
-                dateStream >> std::get_time(
-                        &time,
-                        "%a, %d %b %Y %H:%M:%S GMT");
-                ifModifiedSince = std::mktime(&time) - timezone;
-            }
-            else
-                processed=false;
-            break;
-        }
-        if(!processed)
-        {
-            std::basic_string<charT> nameString;
-            std::basic_string<charT> valueString;
-            vecToString(name, value, nameString);
-            vecToString(value, end, valueString);
-            others[nameString] = valueString;
+            groupStart = groupEnd+1;
         }
-        data = end;
+        break;
+    }
+    case KnownParameter::HTTP_IF_MODIFIED_SINCE:
+    {
+        std::tm time;
+        std::fill(
+                reinterpret_cast<char*>(&time),
+                reinterpret_cast<char*>(&time)+sizeof(time),
+                0);
+        std::stringstream dateStream;
+        dateStream.write(&*value, end-value);
+        dateStream >> std::get_time(
+                &time,
+                "%a, %d %b %Y %H:%M:%S GMT");
+        ifModifiedSince = std::mktime(&time) - timezone;
+        break;
+    }
+    default:
+    {
+        const unsigned registered = registeredParameter(name, value);
+        if(registered == unregistered)
+            return false;
+        while(m_registered.size() <= registered)
+            m_registered.emplace_back(m_allocator);
+        vecToString(value, end, m_registered[registered]);
+        break;
     }
+    }
+
+    return true;
 }
 
-template<class charT>
-void Fastcgipp::Http::Environment<charT>::fillPostBuffer(
+template<class charT, class Allocator>
+void Fastcgipp::Http::Environment<charT, Allocator>::fillPostBuffer(
         const char* const start,
         const char* const end)
 {
     if(m_postBuffer.empty())
         m_postBuffer.reserve(contentLength);
     m_postBuffer.insert(m_postBuffer.end(), start, end);
+    m_postSize += end-start;
 }
 
-template<class charT>
-bool Fastcgipp::Http::Environment<charT>::parsePostBuffer()
+template<class charT, class Allocator>
+bool Fastcgipp::Http::Environment<charT, Allocator>::parsePostBuffer()
 {
     static const std::string multipartStr("multipart/form-data");
     static const std::string urlEncodedStr("application/x-www-form-urlencoded");
@@ -466,185 +991,187 @@ bool Fastcgipp::Http::Environment<charT>::parsePostBuffer()
     return parsed;
 }
 
-template<class charT>
-void Fastcgipp::Http::Environment<charT>::parsePostsMultipart()
+template<class charT, class Allocator>
+bool Fastcgipp::Http::Environment<charT, Allocator>::streamable() const
 {
-    static const std::string cName("name=\"");
-    static const std::string cFilename("filename=\"");
-    static const std::string cContentType("Content-Type: ");
-    static const std::string cBody("\r\n\r\n");
-
-    const char* const postBufferStart = m_postBuffer.data();
-    const char* const postBufferEnd = m_postBuffer.data() + m_postBuffer.size();
-
-    auto nameStart(postBufferEnd);
-    auto nameEnd(postBufferEnd);
-    auto filenameStart(postBufferEnd);
-    auto filenameEnd(postBufferEnd);
-    auto contentTypeStart(postBufferEnd);
-    auto contentTypeEnd(postBufferEnd);
-    auto bodyStart(postBufferEnd);
-    auto bodyEnd(postBufferEnd);
-
-    enum State
-    {
-        HEADER,
-        NAME,
-        FILENAME,
-        CONTENT_TYPE,
-        BODY
-    } state=HEADER;
+    static const std::string multipartStr("multipart/form-data");
 
-    for(auto byte = postBufferStart; byte < postBufferEnd; ++byte)
-    {
-        switch(state)
-        {
-            case HEADER:
-            {
-                const size_t bytesLeft = size_t(postBufferEnd-byte);
+    return !boundary.empty() && std::equal(
+            multipartStr.cbegin(),
+            multipartStr.cend(),
+            contentType.cbegin(),
+            contentType.cend());
+}
 
-                if(
-                        nameEnd == postBufferEnd &&
-                        bytesLeft >= cName.size() &&
-                        std::equal(cName.begin(), cName.end(), byte))
+template<class charT, class Allocator>
+bool Fastcgipp::Http::Environment<charT, Allocator>::parsePostStream(
+        const char* const start,
+        const char* const end)
+{
+    m_postSize += end-start;
+
+    if(!m_multipart)
+        m_multipart.reset(new MultipartParser(
+                boundary.data(),
+                boundary.data()+boundary.size(),
+                [this] (const MultipartParser::Part& part)
                 {
-                    byte += cName.size()-1;
-                    nameStart = byte+1;
-                    state = NAME;
-                }
-                else if(
-                        filenameEnd == postBufferEnd &&
-                        bytesLeft >= cFilename.size() &&
-                        std::equal(cFilename.begin(), cFilename.end(), byte))
+                    return partStart(part);
+                },
+                [this] (const char* start, const char* end)
                 {
-                    byte += cFilename.size()-1;
-                    filenameStart = byte+1;
-                    state = FILENAME;
-                }
-                else if(
-                        contentTypeEnd == postBufferEnd &&
-                        bytesLeft >= cContentType.size() &&
-                        std::equal(cContentType.begin(), cContentType.end(), byte))
+                    return partData(start, end);
+                },
+                [this] ()
                 {
-                    byte += cContentType.size()-1;
-                    contentTypeStart = byte+1;
-                    state = CONTENT_TYPE;
-                }
-                else if(
-                        bodyEnd == postBufferEnd &&
-                        bytesLeft >= cBody.size() &&
-                        std::equal(cBody.begin(), cBody.end(), byte))
-                {
-                    byte += cBody.size()-1;
-                    bodyStart = byte+1;
-                    state = BODY;
-                }
+                    return partEnd();
+                }));
 
-                break;
-            }
+    return m_multipart->parse(start, end);
+}
 
-            case NAME:
-            {
-                if(*byte == '"')
-                {
-                    nameEnd=byte;
-                    state=HEADER;
-                }
-                break;
-            }
+template<class charT, class Allocator>
+bool Fastcgipp::Http::Environment<charT, Allocator>::finishPostStream()
+{
+    if(!m_multipart)
+        return true;
 
-            case FILENAME:
-            {
-                if(*byte == '"')
-                {
-                    filenameEnd=byte;
-                    state=HEADER;
-                }
-                break;
-            }
+    // Data that ends before the closing delimiter is as bad as malformed data
+    const bool failed = m_multipart->failed() || !m_multipart->complete();
+    m_multipart.reset();
+    m_partSink.reset();
+    m_partFile.reset();
+    m_partData.clear();
+    m_partData.shrink_to_fit();
 
-            case CONTENT_TYPE:
-            {
-                if(*byte == '\r' || *byte == '\n')
-                {
-                    contentTypeEnd = byte--;
-                    state=HEADER;
-                }
-                break;
-            }
+    return !failed;
+}
 
-            case BODY:
-            {
-                const size_t bytesLeft = size_t(postBufferEnd-byte);
+template<class charT, class Allocator>
+void Fastcgipp::Http::Environment<charT, Allocator>::parsePostsMultipart()
+{
+    // Undo the count since parsePostStream() adds it again
+    m_postSize -= m_postBuffer.size();
+    parsePostStream(
+            m_postBuffer.data(),
+            m_postBuffer.data()+m_postBuffer.size());
+    if(!finishPostStream())
+        WARNING_LOG("Unable to parse multipart/form-data POST data")
+}
 
-                if(
-                        bytesLeft >= boundary.size() &&
-                        std::equal(boundary.begin(), boundary.end(), byte))
-                {
-                    bodyEnd = byte-2;
-                    if(bodyEnd<bodyStart)
-                        bodyEnd = bodyStart;
-                    else if(
-                            bodyEnd-bodyStart>=2
-                            && *(bodyEnd-1)=='\n'
-                            && *(bodyEnd-2)=='\r')
-                        bodyEnd -= 2;
-
-                    if(nameEnd != postBufferEnd)
-                    {
-                        std::basic_string<charT> name;
-                        vecToString(nameStart, nameEnd, name);
-
-                        if(contentTypeEnd != postBufferEnd)
-                        {
-                            File<charT> file;
-                            vecToString(
-                                    contentTypeStart,
-                                    contentTypeEnd,
-                                    file.contentType);
-                            if(filenameEnd != postBufferEnd)
-                                vecToString(
-                                        filenameStart,
-                                        filenameEnd,
-                                        file.filename);
-
-                            file.size = bodyEnd-bodyStart;
-                            file.data.reset(new char[file.size]);
-                            std::copy(bodyStart, bodyEnd, file.data.get());
-
-                            files.insert(std::make_pair(
-                                        std::move(name),
-                                        std::move(file)));
-                        }
-                        else
-                        {
-                            std::basic_string<charT> value;
-                            vecToString(bodyStart, bodyEnd, value);
-                            posts.insert(std::make_pair(
-                                        std::move(name),
-                                        std::move(value)));
-                        }
-                    }
-
-                    state=HEADER;
-                    nameStart = postBufferEnd;
-                    nameEnd = postBufferEnd;
-                    filenameStart = postBufferEnd;
-                    filenameEnd = postBufferEnd;
-                    contentTypeStart = postBufferEnd;
-                    contentTypeEnd = postBufferEnd;
-                    bodyStart = postBufferEnd;
-                    bodyEnd = postBufferEnd;
-                }
+template<class charT, class Allocator>
+bool Fastcgipp::Http::Environment<charT, Allocator>::partStart(
+        const MultipartParser::Part& part)
+{
+    m_partData.clear();
+    m_partSink.reset();
+    m_partFile.reset();
 
-                break;
-            }
+    m_partIgnored = !part.named;
+    if(m_partIgnored)
+        return true;
+
+    vecToString(
+            part.name.data(),
+            part.name.data()+part.name.size(),
+            m_partName);
+
+    if(part.file)
+    {
+        m_partFile.reset(new File<charT>);
+        vecToString(
+                part.contentType.data(),
+                part.contentType.data()+part.contentType.size(),
+                m_partFile->contentType);
+        vecToString(
+                part.filename.data(),
+                part.filename.data()+part.filename.size(),
+                m_partFile->filename);
+
+        if(fileSinks)
+            m_partSink = fileSinks(m_partName, *m_partFile);
+    }
+
+    return true;
+}
+
+template<class charT, class Allocator>
+bool Fastcgipp::Http::Environment<charT, Allocator>::partData(
+        const char* const start,
+        const char* const end)
+{
+    if(m_partIgnored)
+        return true;
+
+    if(m_partFile)
+    {
+        const size_t size = end-start;
+        m_partFile->size += size;
+
+        if(!m_partSink && m_partData.size()+size > spoolThreshold)
+        {
+            m_partSink.reset(new SpoolFile);
+            if(!m_partSink->write(m_partData.data(), m_partData.size()))
+                return false;
+            m_partData.clear();
+            m_partData.shrink_to_fit();
         }
+
+        if(m_partSink)
+            return m_partSink->write(start, size);
     }
+
+    m_partData.insert(m_partData.end(), start, end);
+    return true;
 }
 
-template<class charT>
-void Fastcgipp::Http::Environment<charT>::parsePostsUrlEncoded()
+template<class charT, class Allocator>
+bool Fastcgipp::Http::Environment<charT, Allocator>::partEnd()
+{
+    if(m_partIgnored)
+        return true;
+
+    if(m_partFile)
+    {
+        if(m_partSink)
+        {
+            if(!m_partSink->finish())
+                return false;
+            m_partFile->spooled = m_partSink->contents();
+            m_partSink.reset();
+        }
+        else
+        {
+            m_partFile->data.reset(new char[m_partFile->size]);
+            std::copy(
+                    m_partData.cbegin(),
+                    m_partData.cend(),
+                    m_partFile->data.get());
+        }
+
+        files.insert(std::make_pair(
+                    std::move(m_partName),
+                    std::move(*m_partFile)));
+        m_partFile.reset();
+    }
+    else
+    {
+        String value(m_allocator);
+        vecToString(
+                m_partData.data(),
+                m_partData.data()+m_partData.size(),
+                value);
+        posts.insert(std::make_pair(
+                    std::move(m_partName),
+                    std::move(value)));
+    }
+
+    m_partData.clear();
+    return true;
+}
+
+template<class charT, class Allocator>
+void Fastcgipp::Http::Environment<charT, Allocator>::parsePostsUrlEncoded()
 {
     decodeUrlEncoded(
             m_postBuffer.data(),
@@ -654,6 +1181,12 @@ void Fastcgipp::Http::Environment<charT>::parsePostsUrlEncoded()
 
 template struct Fastcgipp::Http::Environment<char>;
 template struct Fastcgipp::Http::Environment<wchar_t>;
+template struct Fastcgipp::Http::Environment<
+    char,
+    Fastcgipp::ArenaAllocator<char>>;
+template struct Fastcgipp::Http::Environment<
+    wchar_t,
+    Fastcgipp::ArenaAllocator<wchar_t>>;
 
 Fastcgipp::Http::SessionId::SessionId()
 {
@@ -682,73 +1215,71 @@ template<class charT> Fastcgipp::Http::SessionId::SessionId(
 const size_t Fastcgipp::Http::SessionId::stringLength;
 const size_t Fastcgipp::Http::SessionId::size;
 
-template void Fastcgipp::Http::decodeUrlEncoded<char>(
+template void Fastcgipp::Http::decodeUrlEncoded(
         const char* data,
         const char* const dataEnd,
-        std::multimap<
-            std::basic_string<char>,
-            std::basic_string<char>>& output,
+        Environment<char>::Multimap& output,
         const char* const fieldSeparator);
-template void Fastcgipp::Http::decodeUrlEncoded<wchar_t>(
+template void Fastcgipp::Http::decodeUrlEncoded(
         const char* data,
         const char* const dataEnd,
-        std::multimap<
-            std::basic_string<wchar_t>,
-            std::basic_string<wchar_t>>& output,
+        Environment<wchar_t>::Multimap& output,
         const char* const fieldSeparator);
-template<class charT> void Fastcgipp::Http::decodeUrlEncoded(
+template void Fastcgipp::Http::decodeUrlEncoded(
+        const char* data,
+        const char* const dataEnd,
+        Environment<char, ArenaAllocator<char>>::Multimap& output,
+        const char* const fieldSeparator);
+template void Fastcgipp::Http::decodeUrlEncoded(
+        const char* data,
+        const char* const dataEnd,
+        Environment<wchar_t, ArenaAllocator<wchar_t>>::Multimap& output,
+        const char* const fieldSeparator);
+template void Fastcgipp::Http::decodeUrlEncoded(
+        const char* data,
+        const char* const dataEnd,
+        Fields<char>& output,
+        const char* const fieldSeparator);
+template void Fastcgipp::Http::decodeUrlEncoded(
+        const char* data,
+        const char* const dataEnd,
+        Fields<wchar_t>& output,
+        const char* const fieldSeparator);
+template void Fastcgipp::Http::decodeUrlEncoded(
+        const char* data,
+        const char* const dataEnd,
+        Fields<char, ArenaAllocator<char>>& output,
+        const char* const fieldSeparator);
+template void Fastcgipp::Http::decodeUrlEncoded(
+        const char* data,
+        const char* const dataEnd,
+        Fields<wchar_t, ArenaAllocator<wchar_t>>& output,
+        const char* const fieldSeparator);
+template<class charT, class Allocator, class MapAllocator>
+void Fastcgipp::Http::decodeUrlEncoded(
         const char* data,
         const char* const dataEnd,
         std::multimap<
-            std::basic_string<charT>,
-            std::basic_string<charT>>& output,
+            std::basic_string<charT, std::char_traits<charT>, Allocator>,
+            std::basic_string<charT, std::char_traits<charT>, Allocator>,
+            std::less<std::basic_string<
+                charT,
+                std::char_traits<charT>,
+                Allocator>>,
+            MapAllocator>& output,
         const char* const fieldSeparator)
 {
-    std::unique_ptr<char[]> buffer(new char[dataEnd-data]);
-    std::basic_string<charT> name;
-    std::basic_string<charT> value;
-
-    const size_t fieldSeparatorSize = std::strlen(fieldSeparator);
-    const char* const fieldSeparatorEnd = fieldSeparator+fieldSeparatorSize;
-
-    const char* nameStart = data;
-    const char* nameEnd = dataEnd;
-    const char* valueStart = nullptr;
-    const char* valueEnd;
+    decodeUrlEncodedInto(data, dataEnd, output, fieldSeparator);
+}
 
-    while(data <= dataEnd)
-    {
-        if(nameEnd != dataEnd)
-        {
-            if(data == dataEnd || (data+fieldSeparatorSize<=dataEnd
-                        && std::equal(fieldSeparator, fieldSeparatorEnd, data)))
-            {
-                valueEnd=percentEscapedToRealBytes(
-                        valueStart,
-                        data,
-                        buffer.get());
-                vecToString(buffer.get(), valueEnd, value);
-                output.insert(std::make_pair(
-                            std::move(name),
-                            std::move(value)));
-
-                nameStart = data+fieldSeparatorSize;
-                data += fieldSeparatorSize;
-                nameEnd = dataEnd;
-                continue;
-            }
-        }
-        else if(data!=dataEnd && *data=='=')
-        {
-            nameEnd = percentEscapedToRealBytes(
-                    nameStart,
-                    data,
-                    buffer.get());
-            vecToString(buffer.get(), nameEnd, name);
-            valueStart=data+1;
-        }
-        ++data;
-    }
+template<class charT, class Allocator>
+void Fastcgipp::Http::decodeUrlEncoded(
+        const char* data,
+        const char* const dataEnd,
+        Fields<charT, Allocator>& output,
+        const char* const fieldSeparator)
+{
+    decodeUrlEncodedInto(data, dataEnd, output, fieldSeparator);
 }
 
 extern const std::array<const char, 64> Fastcgipp::Http::base64Characters =
@@ -28,6 +28,8 @@
 
 #include "fastcgi++/log.hpp"
 
+#include "fastcgi++/taskqueue.hpp"
+
 #include <iomanip>
 #include <iostream>
 #include <ctime>
@@ -35,6 +37,10 @@
 #include <cstring>
 #include <array>
 #include <sstream>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
 
 #include <unistd.h>
 #include <limits.h>
@@ -95,19 +101,453 @@ namespace Fastcgipp
             L"[debug]: ",
             L"[diagnostic]: "
         }};
+
+        std::array<const wchar_t*, 6> levelNames
+        {{
+            L"info",
+            L"fail",
+            L"error",
+            L"warning",
+            L"debug",
+            L"diagnostic"
+        }};
+
+        //! Appends everything written to it to a string
+        class MessageBuffer: public std::wstreambuf
+        {
+        public:
+            std::wstring message;
+
+        private:
+            int_type overflow(int_type c)
+            {
+                if(!traits_type::eq_int_type(c, traits_type::eof()))
+                    message.push_back(traits_type::to_char_type(c));
+                return traits_type::not_eof(c);
+            }
+
+            std::streamsize xsputn(const wchar_t* s, std::streamsize n)
+            {
+                message.append(s, n);
+                return n;
+            }
+        };
+
+        //! A thread's log entry in the making
+        struct Draft
+        {
+            MessageBuffer buffer;
+            std::wostream stream;
+
+            Draft():
+                stream(&buffer)
+            {}
+        };
+
+        Draft& draft()
+        {
+            thread_local Draft draft;
+            return draft;
+        }
+
+        //! A formatted log entry
+        struct Entry
+        {
+            Level level;
+            std::time_t time;
+            std::wstring message;
+        };
+
+        //! Log entries from a single thread on their way to the logstream
+        /*!
+         * Only the owning thread pushes and only the background thread pops
+         * so the positions are all the synchronization we need.
+         */
+        struct Ring
+        {
+            std::unique_ptr<Entry[]> entries;
+            const size_t mask;
+            char padding0[64];
+            std::atomic_size_t head;
+            char padding1[64];
+            std::atomic_size_t tail;
+            std::atomic_bool orphaned;
+
+            Ring(size_t capacity):
+                entries(new Entry[capacity]),
+                mask(capacity-1),
+                head(0),
+                tail(0),
+                orphaned(false)
+            {}
+
+            bool empty() const
+            {
+                return head.load(std::memory_order_acquire)
+                    == tail.load(std::memory_order_acquire);
+            }
+        };
+
+        //! Marks a thread's ring as orphaned once the thread is gone
+        struct RingOwner
+        {
+            std::shared_ptr<Ring> ring;
+
+            ~RingOwner()
+            {
+                if(ring)
+                    ring->orphaned = true;
+            }
+        };
+
+        //! Everything needed for logging asynchronously
+        struct Backend
+        {
+            //! True while we are logging asynchronously
+            std::atomic_bool running;
+
+            //! Every thread's ring
+            std::vector<std::shared_ptr<Ring>> rings;
+
+            //! Thread safe the ring list and starting/stopping
+            std::mutex mutex;
+
+            //! Capacity of newly made rings
+            size_t capacity;
+
+            //! Bumped whenever the rings are replaced
+            std::atomic_uint generation;
+
+            //! Where the background thread sleeps
+            EventCount idle;
+
+            //! Set to have the background thread stop
+            std::atomic_bool stop;
+
+            //! The background thread
+            std::thread thread;
+
+            //! Counter of dropped entries
+            std::atomic_ullong dropped;
+
+            //! Dropped entries we have already reported
+            unsigned long long reported;
+
+            Backend():
+                running(false),
+                capacity(1024),
+                generation(0),
+                stop(false),
+                dropped(0),
+                reported(0)
+            {}
+        };
+
+        //! Never destroyed so logging still works from static destructors
+        Backend& backend()
+        {
+            static Backend* const backend = new Backend;
+            return *backend;
+        }
+
+        //! Writes out whatever is left in the rings on exit
+        struct Stopper
+        {
+            ~Stopper()
+            {
+                stopAsync();
+            }
+        } stopper;
+
+        //! The calling thread's ring
+        Ring& ring()
+        {
+            thread_local RingOwner owner;
+            thread_local unsigned generation = 0;
+            Backend& backend = Logging::backend();
+            if(!owner.ring || generation != backend.generation)
+            {
+                std::lock_guard<std::mutex> lock(backend.mutex);
+                owner.ring = std::make_shared<Ring>(backend.capacity);
+                generation = backend.generation;
+                backend.rings.push_back(owner.ring);
+            }
+            return *owner.ring;
+        }
+
+        //! Cached formatted timestamps. Thread safe with Logging::mutex.
+        struct Timestamp
+        {
+            std::time_t time;
+            std::wstring text;
+            std::wstring json;
+        };
+
+        const Timestamp& timestamp(std::time_t time)
+        {
+            static Timestamp cache{-1, std::wstring(), std::wstring()};
+            if(time != cache.time)
+            {
+                wchar_t buffer[64];
+                std::tm local;
+                localtime_r(&time, &local);
+                cache.time = time;
+                cache.text.assign(
+                        buffer,
+                        std::wcsftime(
+                            buffer,
+                            64,
+                            L"%b %d %H:%M:%S ",
+                            &local));
+                cache.json.assign(
+                        buffer,
+                        std::wcsftime(
+                            buffer,
+                            64,
+                            L"%Y-%m-%dT%H:%M:%S%z",
+                            &local));
+            }
+            return cache;
+        }
+
+        //! Write a string escaped for JSON
+        void escape(std::wostream& out, const std::wstring& string)
+        {
+            for(const wchar_t c: string)
+            {
+                switch(c)
+                {
+                    case L'"':
+                        out << L"\\\"";
+                        break;
+                    case L'\\':
+                        out << L"\\\\";
+                        break;
+                    case L'\n':
+                        out << L"\\n";
+                        break;
+                    case L'\t':
+                        out << L"\\t";
+                        break;
+                    case L'\r':
+                        out << L"\\r";
+                        break;
+                    default:
+                        if(c < 0x20)
+                        {
+                            const wchar_t* const hex = L"0123456789abcdef";
+                            out << L"\\u00" << hex[c>>4] << hex[c&0xf];
+                        }
+                        else
+                            out.put(c);
+                }
+            }
+        }
+
+        //! Write out a log entry. Thread safe with Logging::mutex.
+        void write(Level level, std::time_t time, const std::wstring& message)
+        {
+            const Timestamp& stamp = timestamp(time);
+            if(format == Format::JSON)
+            {
+                *logstream << L"{\"time\":\"" << stamp.json
+                    << L"\",\"host\":\"";
+                escape(*logstream, hostname);
+                *logstream << L"\",\"program\":\"";
+                escape(*logstream, program);
+                *logstream << L"\",\"level\":\"" << levelNames[level]
+                    << L"\",\"message\":\"";
+                escape(*logstream, message);
+                *logstream << L"\"}\n";
+            }
+            else
+                *logstream << stamp.text << hostname << L' ' << program
+                    << L' ' << levels[level] << message << L'\n';
+        }
+
+        //! Write out everything in the rings
+        /*!
+         * @return True if anything was written
+         */
+        bool drain(Backend& backend)
+        {
+            bool written = false;
+            std::lock_guard<std::mutex> ringsLock(backend.mutex);
+            std::lock_guard<std::mutex> lock(Logging::mutex);
+
+            // Pairs with the fence in end() so that an entry pushed as we are
+            // stopping is either seen here or written out by end() itself
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            for(auto ring=backend.rings.begin(); ring!=backend.rings.end();)
+            {
+                Ring& entries = **ring;
+                size_t head = entries.head.load(std::memory_order_relaxed);
+                const size_t tail
+                    = entries.tail.load(std::memory_order_acquire);
+                for(; head != tail; ++head)
+                {
+                    Entry& entry = entries.entries[head & entries.mask];
+                    write(entry.level, entry.time, entry.message);
+                    entry.message.clear();
+                    entries.head.store(head+1, std::memory_order_release);
+                    written = true;
+                }
+
+                if(entries.orphaned && entries.empty())
+                    ring = backend.rings.erase(ring);
+                else
+                    ++ring;
+            }
+
+            const unsigned long long dropped = backend.dropped;
+            if(dropped != backend.reported)
+            {
+                std::wostringstream message;
+                message << dropped-backend.reported
+                    << L" log entries were dropped";
+                write(WARNING, std::time(nullptr), message.str());
+                backend.reported = dropped;
+                written = true;
+            }
+
+            if(written)
+                logstream->flush();
+            return written;
+        }
+
+        //! Background thread writing out the rings
+        void drainer(Backend& backend)
+        {
+            while(true)
+            {
+                if(drain(backend))
+                    continue;
+
+                const int key = backend.idle.prepare();
+                bool empty = true;
+                {
+                    std::lock_guard<std::mutex> lock(backend.mutex);
+                    for(const auto& ring: backend.rings)
+                        if(!ring->empty())
+                            empty = false;
+                }
+                if(!empty || backend.stop)
+                {
+                    backend.idle.cancel();
+                    if(backend.stop)
+                        break;
+                    continue;
+                }
+                backend.idle.wait(key);
+            }
+            drain(backend);
+        }
     }
 }
 
 std::wostream* Fastcgipp::Logging::logstream(&std::wcerr);
 std::mutex Fastcgipp::Logging::mutex;
 bool Fastcgipp::Logging::suppress(false);
+Fastcgipp::Logging::Format Fastcgipp::Logging::format(
+        Fastcgipp::Logging::Format::TEXT);
 std::wstring Fastcgipp::Logging::hostname(Fastcgipp::Logging::getHostname());
 std::wstring Fastcgipp::Logging::program(Fastcgipp::Logging::getProgram());
 
 void Fastcgipp::Logging::header(Level level)
 {
-    const std::time_t now = std::time(nullptr);
     *logstream
-        << std::put_time(std::localtime(&now), L"%b %d %H:%M:%S ")
+        << timestamp(std::time(nullptr)).text
         << hostname << ' ' << program << ' ' << levels[level];
 }
+
+std::wostream& Fastcgipp::Logging::begin()
+{
+    Draft& draft = Logging::draft();
+    draft.buffer.message.clear();
+    draft.stream.clear();
+    draft.stream.flags(std::ios_base::dec | std::ios_base::skipws);
+    draft.stream.precision(6);
+    draft.stream.width(0);
+    draft.stream.fill(L' ');
+    return draft.stream;
+}
+
+void Fastcgipp::Logging::end(Level level)
+{
+    std::wstring& text = draft().buffer.message;
+    Backend& backend = Logging::backend();
+
+    if(backend.running)
+    {
+        if(level == FAIL)
+            stopAsync();
+        else
+        {
+            Ring& ring = Logging::ring();
+            const size_t tail = ring.tail.load(std::memory_order_relaxed);
+            if(tail - ring.head.load(std::memory_order_acquire) > ring.mask)
+                ++backend.dropped;
+            else
+            {
+                Entry& entry = ring.entries[tail & ring.mask];
+                entry.level = level;
+                entry.time = std::time(nullptr);
+                entry.message.swap(text);
+                ring.tail.store(tail+1, std::memory_order_release);
+
+                // If stopAsync() got in since we checked, the background
+                // thread may have done it's final drain already
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(backend.running)
+                    backend.idle.notify();
+                else
+                    drain(backend);
+            }
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    write(level, std::time(nullptr), text);
+    logstream->flush();
+}
+
+void Fastcgipp::Logging::startAsync(size_t capacity)
+{
+    Backend& backend = Logging::backend();
+    std::lock_guard<std::mutex> lock(backend.mutex);
+    if(backend.thread.joinable())
+        return;
+
+    backend.capacity = 2;
+    while(backend.capacity < capacity)
+        backend.capacity <<= 1;
+    backend.rings.clear();
+    ++backend.generation;
+    backend.stop = false;
+    backend.thread = std::thread(drainer, std::ref(backend));
+    backend.running = true;
+}
+
+void Fastcgipp::Logging::stopAsync()
+{
+    Backend& backend = Logging::backend();
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(backend.mutex);
+        if(!backend.thread.joinable()
+                || backend.thread.get_id() == std::this_thread::get_id())
+            return;
+        backend.running = false;
+        backend.stop = true;
+        thread.swap(backend.thread);
+    }
+    backend.idle.notify(true);
+    thread.join();
+}
+
+unsigned long long Fastcgipp::Logging::dropped()
+{
+    return backend().dropped;
+}
@@ -37,62 +37,104 @@ Fastcgipp::Manager_base::Manager_base(unsigned threads):
                 this,
                 std::placeholders::_1,
                 std::placeholders::_2)),
+    m_stealThreshold(2),
+    m_nextWorker(0),
     m_terminate(true),
     m_stop(true),
-    m_threads(threads)
-#if FASTCGIPP_LOG_LEVEL > 3
-    ,m_requestCount(0),
-    m_maxRequests(0),
-    m_managementRecordCount(0),
-    m_badSocketMessageCount(0),
-    m_badSocketKillCount(0),
-    m_messageCount(0),
-    m_activeThreads(threads),
-    m_maxActiveThreads(0)
-#endif
+    m_requestCount(Metrics::registry().counter(
+                "fastcgipp_requests_total",
+                "Requests started")),
+    m_activeRequests(Metrics::registry().gauge(
+                "fastcgipp_requests_active",
+                "Requests in progress")),
+    m_requestDuration(Metrics::registry().histogram(
+                "fastcgipp_request_duration_microseconds",
+                "Time from BEGIN_REQUEST until the request is complete")),
+    m_managementRecordCount(Metrics::registry().counter(
+                "fastcgipp_management_records_total",
+                "Management records received")),
+    m_badSocketMessageCount(Metrics::registry().counter(
+                "fastcgipp_bad_socket_messages_total",
+                "Notifications of connections going away")),
+    m_badSocketKillCount(Metrics::registry().counter(
+                "fastcgipp_bad_socket_kills_total",
+                "Requests killed because their connection went away")),
+    m_messageCount(Metrics::registry().counter(
+                "fastcgipp_request_messages_total",
+                "Messages received for requests")),
+    m_activeThreads(Metrics::registry().gauge(
+                "fastcgipp_threads_active",
+                "Worker threads that aren't sleeping")),
+    m_stealCount(Metrics::registry().counter(
+                "fastcgipp_tasks_stolen_total",
+                "Tasks stolen from overloaded worker threads")),
+    m_migrationCount(Metrics::registry().counter(
+                "fastcgipp_request_migrations_total",
+                "Requests handled on a different worker thread"))
 {
     if(instance != nullptr)
         FAIL_LOG("You're not allowed to have multiple manager instances")
     instance = this;
+    resizeThreads(threads);
+    Metrics::registry().gauge(
+            "fastcgipp_tasks_queued",
+            "Tasks waiting for a worker thread",
+            [this] ()
+            {
+                std::lock_guard<std::mutex> lock(m_workersMutex);
+                long long tasks = 0;
+                for(const auto& worker: m_workers)
+                    tasks += worker->tasks.size();
+                return tasks;
+            });
     DIAG_LOG("Manager_base::Manager_base(): Initialized")
 }
 
+void Fastcgipp::Manager_base::wakeAll()
+{
+    for(auto& worker: m_workers)
+        worker->idle.notify(true);
+}
+
 void Fastcgipp::Manager_base::terminate()
 {
-    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
     m_terminate=true;
     m_transceiver.terminate();
-    m_wake.notify_all();
+    wakeAll();
 }
 
 void Fastcgipp::Manager_base::stop()
 {
-    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
     m_stop=true;
     m_transceiver.stop();
-    m_wake.notify_all();
+    wakeAll();
 }
 
 void Fastcgipp::Manager_base::start()
 {
-    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
     DIAG_LOG("Starting fastcgi++ manager")
     m_stop=false;
     m_terminate=false;
     m_transceiver.start();
-    for(auto& thread: m_threads)
-        if(!thread.joinable())
+    for(unsigned index=0; index<m_workers.size(); ++index)
+        if(!m_workers[index]->thread.joinable())
         {
-            std::thread newThread(&Fastcgipp::Manager_base::handler, this);
-            thread.swap(newThread);
+            std::thread newThread(
+                    &Fastcgipp::Manager_base::handler,
+                    this,
+                    index);
+            m_workers[index]->thread.swap(newThread);
         }
 }
 
 void Fastcgipp::Manager_base::join()
 {
-    for(auto& thread: m_threads)
-        if(thread.joinable())
-            thread.join();
+    for(auto& worker: m_workers)
+        if(worker->thread.joinable())
+            worker->thread.join();
     m_transceiver.join();
 }
 
@@ -159,16 +201,19 @@ void Fastcgipp::Manager_base::localHandler()
         {
             case Protocol::RecordType::GET_VALUES:
             {
+                const char* data = message.data.begin()+sizeof(header);
                 const char* name;
                 const char* value;
                 const char* end;
 
-                while(Protocol::processParamHeader(
-                        message.data.begin()+sizeof(header),
+                for(;
+                    Protocol::processParamHeader(
+                        data,
                         message.data.end(),
                         name,
                         value,
-                        end))
+                        end);
+                    data = end)
                 {
                     switch(value-name)
                     {
@@ -251,101 +296,197 @@ void Fastcgipp::Manager_base::localHandler()
         ERROR_LOG("Got a non-FastCGI record destined for the manager")
 }
 
-void Fastcgipp::Manager_base::handler()
+void Fastcgipp::Manager_base::handler(const unsigned index)
 {
-    std::unique_lock<std::shared_timed_mutex> requestsWriteLock(
-            m_requestsMutex,
-            std::defer_lock);
-    std::unique_lock<std::mutex> tasksLock(m_tasksMutex);
-    std::shared_lock<std::shared_timed_mutex> requestsReadLock(m_requestsMutex);
+    // How many times we look for a task before going to sleep
+    const unsigned spins = 64;
+
+    Worker& worker = *m_workers[index];
+    Protocol::RequestId id;
+    unsigned spin = 0;
 
     while(!m_terminate && !(m_stop && m_requests.empty()))
     {
-        requestsReadLock.unlock();
-        while(!m_tasks.empty())
+        if(!worker.tasks.pop(id) && !steal(index, id))
         {
-            auto id = m_tasks.front();
-            m_tasks.pop();
-            tasksLock.unlock();
+            if(++spin < spins)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            spin = 0;
 
-            if(id.m_id == 0)
-                localHandler();
-            else
+            const int key = worker.idle.prepare();
+            if(!worker.tasks.empty()
+                    || overloaded()
+                    || m_terminate
+                    || (m_stop && m_requests.empty()))
+            {
+                worker.idle.cancel();
+                continue;
+            }
+            // Every sub() gets it's add() back, stopping or not, or the
+            // gauge drifts below zero when we sleep more than once
+            m_activeThreads.sub();
+            worker.idle.wait(key);
+            m_activeThreads.add();
+            continue;
+        }
+        spin = 0;
+
+        if(id.m_id == 0)
+            localHandler();
+        else
+        {
+            auto& shard = m_requests.shard(id.m_socket);
+            std::shared_lock<std::shared_timed_mutex> shardReadLock(
+                    shard.mutex);
+            auto request = shard.find(id);
+            if(request != shard.end())
             {
-                requestsReadLock.lock();
-                auto request = m_requests.find(id);
-                if(request != m_requests.end())
+                std::unique_lock<std::mutex> requestLock(
+                        request->second->mutex,
+                        std::try_to_lock);
+                shardReadLock.unlock();
+
+                if(requestLock)
                 {
-                    std::unique_lock<std::mutex> requestLock(
-                            request->second->mutex,
-                            std::try_to_lock);
-                    requestsReadLock.unlock();
+                    // Follow up work should come to us from now on
+                    if(request->second->affinity != index)
+                    {
+                        request->second->affinity = index;
+                        m_migrationCount.add();
+                    }
 
-                    if(requestLock)
+                    auto lock = request->second->handler();
+                    if(!lock || !id.m_socket.valid())
                     {
-                        auto lock = request->second->handler();
-                        if(!lock || !id.m_socket.valid())
-                        {
-#if FASTCGIPP_LOG_LEVEL > 3
-                            if(!id.m_socket.valid())
-                                ++m_badSocketKillCount;
-#endif
-                            if(lock)
-                                lock.unlock();
-                            requestsWriteLock.lock();
-                            requestLock.unlock();
-                            m_requests.erase(request);
-                            requestsWriteLock.unlock();
-                        }
-                        else
+                        if(!id.m_socket.valid())
+                            m_badSocketKillCount.add();
+                        if(lock)
+                            lock.unlock();
+                        Request_base* next = nullptr;
                         {
+                            std::lock_guard<std::shared_timed_mutex>
+                                shardWriteLock(shard.mutex);
                             requestLock.unlock();
-                            lock.unlock();
+                            auto leftovers = request->second->leftovers();
+                            m_requestDuration.record(
+                                    std::chrono::duration_cast<
+                                        std::chrono::microseconds>(
+                                        std::chrono::steady_clock::now()
+                                        - request->second->created).count());
+                            shard.erase(request);
+                            m_activeRequests.sub();
+
+                            // Anything from after the END_REQUEST record
+                            // belongs to a new request with the same ID
+                            while(!leftovers.empty() && !next)
+                            {
+                                next = beginRequest(
+                                        shard,
+                                        id,
+                                        leftovers.front());
+                                leftovers.pop();
+                            }
+                            for(; !leftovers.empty(); leftovers.pop())
+                                next->push(std::move(leftovers.front()));
+                            if(next)
+                                schedule(id, next->affinity);
                         }
+
+                        // Let everyone know if that was the last one
+                        if(m_stop && m_requests.empty())
+                            wakeAll();
+                    }
+                    else
+                    {
+                        requestLock.unlock();
+                        lock.unlock();
                     }
                 }
-                else
-                    requestsReadLock.unlock();
             }
-            tasksLock.lock();
+            else
+                shardReadLock.unlock();
         }
+    }
+}
 
-        requestsReadLock.lock();
-        if(m_terminate || (m_stop && m_requests.empty()))
-            break;
-        requestsReadLock.unlock();
-#if FASTCGIPP_LOG_LEVEL > 3
-        --m_activeThreads;
-#endif
-        m_wake.wait(tasksLock);
-#if FASTCGIPP_LOG_LEVEL > 3
-        if(!m_stop && !m_terminate)
+void Fastcgipp::Manager_base::schedule(
+        const Protocol::RequestId& id,
+        unsigned index)
+{
+    Worker& worker = *m_workers[index];
+    worker.tasks.push(id);
+    worker.idle.notify();
+
+    // If the worker is falling behind get an idle one to help out
+    if(worker.tasks.size() > m_stealThreshold)
+        for(auto& other: m_workers)
+            if(other.get() != &worker && other->idle.waiting())
+            {
+                other->idle.notify();
+                break;
+            }
+}
+
+unsigned Fastcgipp::Manager_base::leastLoaded()
+{
+    const unsigned start = m_nextWorker++ % m_workers.size();
+    unsigned best = start;
+    size_t bestSize = m_workers[start]->tasks.size();
+    for(unsigned i=1; i<m_workers.size() && bestSize>0; ++i)
+    {
+        const unsigned index = (start+i) % m_workers.size();
+        const size_t size = m_workers[index]->tasks.size();
+        if(size < bestSize)
         {
-            ++m_activeThreads;
-            m_maxActiveThreads = std::max(m_activeThreads, m_maxActiveThreads);
+            best = index;
+            bestSize = size;
+        }
+    }
+    return best;
+}
+
+bool Fastcgipp::Manager_base::steal(unsigned index, Protocol::RequestId& id)
+{
+    for(unsigned i=1; i<m_workers.size(); ++i)
+    {
+        Worker& victim = *m_workers[(index+i) % m_workers.size()];
+        if(victim.tasks.size() > m_stealThreshold && victim.tasks.pop(id))
+        {
+            m_stealCount.add();
+            return true;
         }
-#endif
-        requestsReadLock.lock();
     }
+    return false;
+}
+
+bool Fastcgipp::Manager_base::overloaded() const
+{
+    for(const auto& worker: m_workers)
+        if(worker->tasks.size() > m_stealThreshold)
+            return true;
+    return false;
 }
 
 void Fastcgipp::Manager_base::push(Protocol::RequestId id, Message&& message)
 {
     if(id.m_id == 0)
     {
-#if FASTCGIPP_LOG_LEVEL > 3
-        ++m_managementRecordCount;
-#endif
-        std::lock_guard<std::mutex> lock(m_messagesMutex);
-        m_messages.push(std::make_pair(std::move(message), id.m_socket));
+        m_managementRecordCount.add();
+        {
+            std::lock_guard<std::mutex> lock(m_messagesMutex);
+            m_messages.push(std::make_pair(std::move(message), id.m_socket));
+        }
+        schedule(id, leastLoaded());
     }
     else if(id.m_id == Protocol::badFcgiId)
     {
-#if FASTCGIPP_LOG_LEVEL > 3
-        ++m_badSocketMessageCount;
-#endif
-        std::lock_guard<std::shared_timed_mutex> lock(m_requestsMutex);
-        const auto range = m_requests.equal_range(id.m_socket);
+        m_badSocketMessageCount.add();
+        auto& shard = m_requests.shard(id.m_socket);
+        std::lock_guard<std::shared_timed_mutex> lock(shard.mutex);
+        const auto range = shard.equal_range(id.m_socket);
         auto request = range.first;
         while(request != range.second)
         {
@@ -355,10 +496,9 @@ void Fastcgipp::Manager_base::push(Protocol::RequestId id, Message&& message)
             if(lock)
             {
                 lock.unlock();
-                request = m_requests.erase(request);
-#if FASTCGIPP_LOG_LEVEL > 3
-                ++m_badSocketKillCount;
-#endif
+                request = shard.erase(request);
+                m_activeRequests.sub();
+                m_badSocketKillCount.add();
             }
             else
                 ++request;
@@ -367,61 +507,84 @@ void Fastcgipp::Manager_base::push(Protocol::RequestId id, Message&& message)
     }
     else
     {
-#if FASTCGIPP_LOG_LEVEL > 3
-        ++m_messageCount;
-#endif
-        std::unique_lock<std::shared_timed_mutex> lock(m_requestsMutex);
-        auto request = m_requests.find(id);
-        if(request == m_requests.end())
+        m_messageCount.add();
+        auto& shard = m_requests.shard(id.m_socket);
+
+        // The common case is a record for an existing request
         {
-            if(message.type == 0)
+            std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+            const auto request = shard.find(id);
+            if(request != shard.end())
             {
-                const Protocol::Header& header=
-                    *reinterpret_cast<Protocol::Header*>(message.data.begin());
-                if(header.type == Protocol::RecordType::BEGIN_REQUEST)
-                {
-                    const Protocol::BeginRequest& body
-                        = *reinterpret_cast<Protocol::BeginRequest*>(
-                                message.data.begin()
-                                +sizeof(header));
-
-                    request = m_requests.emplace(
-                            std::piecewise_construct,
-                            std::forward_as_tuple(id),
-                            std::forward_as_tuple()).first;
-
-                    request->second = makeRequest(
-                            id,
-                            body.role,
-                            body.kill());
-                    lock.unlock();
-#if FASTCGIPP_LOG_LEVEL > 3
-                    ++m_requestCount;
-                    m_maxRequests = std::max(m_maxRequests, m_requests.size());
-#endif
-                }
-                else
-                    WARNING_LOG("Got a non BEGIN_REQUEST record for a request"\
-                            " that doesn't exist")
+                request->second->push(std::move(message));
+                const unsigned worker = request->second->affinity;
+                lock.unlock();
+                schedule(id, worker);
+                return;
             }
-            return;
         }
-        else
-            request->second->push(std::move(message));
+
+        std::lock_guard<std::shared_timed_mutex> lock(shard.mutex);
+        if(!beginRequest(shard, id, message))
+            WARNING_LOG("Got a non BEGIN_REQUEST record for a request"\
+                    " that doesn't exist")
     }
-    std::lock_guard<std::mutex> lock(m_tasksMutex);
-    m_tasks.push(id);
-    m_wake.notify_one();
+}
+
+Fastcgipp::Request_base* Fastcgipp::Manager_base::beginRequest(
+        RequestTable<std::unique_ptr<Request_base>>::Shard& shard,
+        const Protocol::RequestId& id,
+        const Message& message)
+{
+    if(message.type != 0)
+        return nullptr;
+
+    const Protocol::Header& header=
+        *reinterpret_cast<const Protocol::Header*>(message.data.begin());
+    if(header.type != Protocol::RecordType::BEGIN_REQUEST)
+        return nullptr;
+
+    const Protocol::BeginRequest& body
+        = *reinterpret_cast<const Protocol::BeginRequest*>(
+                message.data.begin()
+                +sizeof(header));
+
+    auto request = shard.emplace(id);
+    if(!request->second)
+    {
+        request->second = makeRequest(
+                id,
+                body.role,
+                body.kill());
+        request->second->affinity = leastLoaded();
+        if(m_traceHook)
+            request->second->trace = std::make_shared<Trace>(
+                    id,
+                    request->second->created,
+                    m_traceHook);
+        m_requestCount.add();
+        m_activeRequests.add();
+    }
+    return request->second.get();
 }
 
 void Fastcgipp::Manager_base::resizeThreads(unsigned threads)
 {
     if(m_stop)
     {
-        m_threads.resize(threads);
-#if FASTCGIPP_LOG_LEVEL > 3
-        m_activeThreads = threads;
-#endif
+        for(const auto& worker: m_workers)
+            if(worker->thread.joinable())
+                return;
+
+        threads = std::max(threads, 1U);
+        {
+            std::lock_guard<std::mutex> lock(m_workersMutex);
+            m_workers.resize(threads);
+            for(auto& worker: m_workers)
+                if(!worker)
+                    worker.reset(new Worker);
+        }
+        m_activeThreads.set(threads);
     }
 }
 
@@ -429,24 +592,38 @@ Fastcgipp::Manager_base::~Manager_base()
 {
     instance=nullptr;
     terminate();
+    Metrics::registry().remove("fastcgipp_tasks_queued");
     DIAG_LOG("Manager_base::~Manager_base(): New requests ============== " \
-            << m_requestCount)
+            << m_requestCount.value())
     DIAG_LOG("Manager_base::~Manager_base(): Max concurrent requests === " \
-            << m_maxRequests)
+            << m_activeRequests.max())
     DIAG_LOG("Manager_base::~Manager_base(): Management records ======== " \
-            << m_managementRecordCount)
+            << m_managementRecordCount.value())
     DIAG_LOG("Manager_base::~Manager_base(): Bad socket messages ======= " \
-            << m_badSocketMessageCount)
+            << m_badSocketMessageCount.value())
     DIAG_LOG("Manager_base::~Manager_base(): Bad socket request kills == " \
-            << m_badSocketKillCount)
+            << m_badSocketKillCount.value())
     DIAG_LOG("Manager_base::~Manager_base(): Request messages received = " \
-            << m_messageCount)
+            << m_messageCount.value())
     DIAG_LOG("Manager_base::~Manager_base(): Maximum active threads ==== " \
-            << m_maxActiveThreads)
+            << m_activeThreads.max())
     DIAG_LOG("Manager_base::~Manager_base(): Remaining requests ======== " \
             << m_requests.size())
+    DIAG_LOG("Manager_base::~Manager_base(): Tasks stolen ============== " \
+            << m_stealCount.value())
+    DIAG_LOG("Manager_base::~Manager_base(): Request migrations ======== " \
+            << m_migrationCount.value())
+#if FASTCGIPP_LOG_LEVEL > 3
+    size_t tasks = 0;
+    for(const auto& worker: m_workers)
+        tasks += worker->tasks.size();
+#endif
     DIAG_LOG("Manager_base::~Manager_base(): Remaining tasks =========== " \
-            << m_tasks.size())
+            << tasks)
     DIAG_LOG("Manager_base::~Manager_base(): Remaining local messages == " \
             << m_messages.size())
+    DIAG_LOG("Manager_base::~Manager_base(): Block allocations ========= " \
+            << BlockPool::allocations())
+    DIAG_LOG("Manager_base::~Manager_base(): Block heap allocations ==== " \
+            << BlockPool::heapAllocations())
 }
@@ -0,0 +1,445 @@
+/*!
+ * @file       metrics.cpp
+ * @brief      Defines the Fastcgipp::Metrics classes
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+
+#include "fastcgi++/metrics.hpp"
+#include "fastcgi++/sockets.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+    //! Hands out shards to threads in the order they first use one
+    std::atomic_uint nextShard(0);
+}
+
+unsigned Fastcgipp::Metrics::shards()
+{
+    static const unsigned count = []()
+    {
+        const unsigned threads = std::min(
+                std::max(std::thread::hardware_concurrency(), 1U),
+                64U);
+        unsigned count = 1;
+        while(count < threads)
+            count <<= 1;
+        return count;
+    }();
+    return count;
+}
+
+unsigned Fastcgipp::Metrics::shard()
+{
+    thread_local const unsigned index = nextShard++ & (shards()-1);
+    return index;
+}
+
+Fastcgipp::Metrics::Counter::Counter():
+    m_cells(new Cell[shards()])
+{
+    for(unsigned i=0; i<shards(); ++i)
+        m_cells[i].value.store(0, std::memory_order_relaxed);
+}
+
+unsigned long long Fastcgipp::Metrics::Counter::value() const
+{
+    unsigned long long value = 0;
+    for(unsigned i=0; i<shards(); ++i)
+        value += m_cells[i].value.load(std::memory_order_relaxed);
+    return value;
+}
+
+Fastcgipp::Metrics::Histogram::Histogram():
+    m_shards(new Shard[shards()])
+{
+    for(unsigned i=0; i<shards(); ++i)
+    {
+        Shard& shard = m_shards[i];
+        for(auto& count: shard.counts)
+            count.store(0, std::memory_order_relaxed);
+        shard.sum.store(0, std::memory_order_relaxed);
+        shard.max.store(0, std::memory_order_relaxed);
+    }
+}
+
+unsigned Fastcgipp::Metrics::Histogram::bucket(unsigned long long value)
+{
+    const unsigned long long linear = 1ULL<<precision;
+    if(value < linear)
+        return value;
+    if(value > maxValue)
+        value = maxValue;
+
+    unsigned exponent = 63-__builtin_clzll(value);
+    const unsigned shift = exponent-precision;
+    return ((shift+1)<<precision) + ((value>>shift) & (linear-1));
+}
+
+unsigned long long Fastcgipp::Metrics::Histogram::lowest(unsigned bucket)
+{
+    const unsigned long long linear = 1ULL<<precision;
+    if(bucket < linear)
+        return bucket;
+
+    const unsigned shift = (bucket>>precision)-1;
+    return (linear + (bucket & (linear-1))) << shift;
+}
+
+void Fastcgipp::Metrics::Histogram::record(unsigned long long value)
+{
+    Shard& shard = m_shards[Metrics::shard()];
+    shard.counts[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(value, std::memory_order_relaxed);
+
+    // Only the owning thread usually writes to a shard so this rarely loops
+    unsigned long long max = shard.max.load(std::memory_order_relaxed);
+    while(value > max && !shard.max.compare_exchange_weak(
+                max,
+                value,
+                std::memory_order_relaxed));
+}
+
+Fastcgipp::Metrics::Histogram::Snapshot
+Fastcgipp::Metrics::Histogram::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.count = 0;
+    snapshot.sum = 0;
+    snapshot.max = 0;
+    snapshot.counts.resize(buckets, 0);
+
+    for(unsigned i=0; i<shards(); ++i)
+    {
+        const Shard& shard = m_shards[i];
+        for(unsigned j=0; j<buckets; ++j)
+        {
+            const unsigned long long count
+                = shard.counts[j].load(std::memory_order_relaxed);
+            snapshot.counts[j] += count;
+            snapshot.count += count;
+        }
+        snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+        snapshot.max = std::max(
+                snapshot.max,
+                shard.max.load(std::memory_order_relaxed));
+    }
+
+    return snapshot;
+}
+
+unsigned long long Fastcgipp::Metrics::Histogram::Snapshot::percentile(
+        double fraction) const
+{
+    if(count == 0)
+        return 0;
+
+    fraction = std::min(std::max(fraction, 0.0), 1.0);
+    unsigned long long target = fraction*count;
+    if(target == 0)
+        target = 1;
+
+    unsigned long long seen = 0;
+    for(unsigned i=0; i<counts.size(); ++i)
+    {
+        seen += counts[i];
+        if(seen >= target)
+        {
+            const unsigned long long low = lowest(i);
+            const unsigned long long high = i+1<buckets ?
+                lowest(i+1)-1 : maxValue;
+            return std::min(low + (high-low)/2, max);
+        }
+    }
+
+    return max;
+}
+
+Fastcgipp::Metrics::Registry::Metric& Fastcgipp::Metrics::Registry::get(
+        const std::string& name,
+        const std::string& help,
+        Kind kind)
+{
+    Metric& metric = m_metrics[name];
+    if(metric.help.empty())
+    {
+        metric.help = help;
+        metric.kind = kind;
+    }
+    else if(metric.kind != kind)
+        WARNING_LOG("Metric " << name.c_str() \
+                << " was already registered as a different kind")
+    return metric;
+}
+
+Fastcgipp::Metrics::Counter& Fastcgipp::Metrics::Registry::counter(
+        const std::string& name,
+        const std::string& help)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Metric& metric = get(name, help, Kind::COUNTER);
+    if(!metric.counter)
+        metric.counter.reset(new Counter);
+    return *metric.counter;
+}
+
+Fastcgipp::Metrics::Gauge& Fastcgipp::Metrics::Registry::gauge(
+        const std::string& name,
+        const std::string& help)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Metric& metric = get(name, help, Kind::GAUGE);
+    if(!metric.gauge)
+        metric.gauge.reset(new Gauge);
+    return *metric.gauge;
+}
+
+Fastcgipp::Metrics::Histogram& Fastcgipp::Metrics::Registry::histogram(
+        const std::string& name,
+        const std::string& help)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Metric& metric = get(name, help, Kind::HISTOGRAM);
+    if(!metric.histogram)
+        metric.histogram.reset(new Histogram);
+    return *metric.histogram;
+}
+
+void Fastcgipp::Metrics::Registry::gauge(
+        const std::string& name,
+        const std::string& help,
+        const std::function<long long()>& sample)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    get(name, help, Kind::GAUGE).sample = sample;
+}
+
+void Fastcgipp::Metrics::Registry::remove(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto metric = m_metrics.find(name);
+    if(metric != m_metrics.end() && metric->second.sample)
+    {
+        if(metric->second.gauge)
+            metric->second.sample = std::function<long long()>();
+        else
+            m_metrics.erase(metric);
+    }
+}
+
+std::vector<Fastcgipp::Metrics::Registry::Sample>
+Fastcgipp::Metrics::Registry::snapshot() const
+{
+    std::vector<Sample> samples;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    samples.reserve(m_metrics.size());
+
+    for(const auto& metric: m_metrics)
+    {
+        samples.emplace_back();
+        Sample& sample = samples.back();
+        sample.name = metric.first;
+        sample.help = metric.second.help;
+        sample.kind = metric.second.kind;
+        sample.value = 0;
+        sample.max = 0;
+
+        switch(metric.second.kind)
+        {
+            case Kind::COUNTER:
+                sample.value = metric.second.counter->value();
+                sample.max = sample.value;
+                break;
+            case Kind::GAUGE:
+                if(metric.second.sample)
+                {
+                    sample.value = metric.second.sample();
+                    sample.max = sample.value;
+                }
+                else
+                {
+                    sample.value = metric.second.gauge->value();
+                    sample.max = metric.second.gauge->max();
+                }
+                break;
+            case Kind::HISTOGRAM:
+                sample.histogram = metric.second.histogram->snapshot();
+                sample.value = sample.histogram.count;
+                sample.max = sample.histogram.max;
+                break;
+        }
+    }
+
+    return samples;
+}
+
+void Fastcgipp::Metrics::Registry::write(std::ostream& out) const
+{
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+    for(const auto& sample: snapshot())
+    {
+        out << "# HELP " << sample.name << ' ' << sample.help << '\n';
+        switch(sample.kind)
+        {
+            case Kind::COUNTER:
+                out << "# TYPE " << sample.name << " counter\n"
+                    << sample.name << ' ' << sample.value << '\n';
+                break;
+            case Kind::GAUGE:
+                out << "# TYPE " << sample.name << " gauge\n"
+                    << sample.name << ' ' << sample.value << '\n'
+                    << "# TYPE " << sample.name << "_max gauge\n"
+                    << sample.name << "_max " << sample.max << '\n';
+                break;
+            case Kind::HISTOGRAM:
+                out << "# TYPE " << sample.name << " summary\n";
+                for(const double quantile: quantiles)
+                    out << sample.name << "{quantile=\"" << quantile << "\"} "
+                        << sample.histogram.percentile(quantile) << '\n';
+                out << sample.name << "_sum " << sample.histogram.sum << '\n'
+                    << sample.name << "_count " << sample.histogram.count
+                    << '\n';
+                break;
+        }
+    }
+}
+
+Fastcgipp::Metrics::Registry& Fastcgipp::Metrics::registry()
+{
+    static Registry registry;
+    return registry;
+}
+
+Fastcgipp::Metrics::Server::Server(Registry& registry):
+    m_registry(registry),
+    m_group(new SocketGroup(m_groupRegistry)),
+    m_stop(false)
+{}
+
+Fastcgipp::Metrics::Server::~Server()
+{
+    stop();
+}
+
+bool Fastcgipp::Metrics::Server::listen(
+        const char* name,
+        uint32_t permissions,
+        const char* owner,
+        const char* group)
+{
+    return m_group->listen(name, permissions, owner, group);
+}
+
+bool Fastcgipp::Metrics::Server::listen(
+        const char* interface,
+        const char* service)
+{
+    return m_group->listen(interface, service);
+}
+
+void Fastcgipp::Metrics::Server::start()
+{
+    if(!m_thread.joinable())
+    {
+        m_stop = false;
+        m_thread = std::thread(&Fastcgipp::Metrics::Server::handler, this);
+    }
+}
+
+void Fastcgipp::Metrics::Server::stop()
+{
+    if(m_thread.joinable())
+    {
+        m_stop = true;
+        m_group->wake();
+        m_thread.join();
+    }
+}
+
+void Fastcgipp::Metrics::Server::handler()
+{
+    //! Text still to be sent on each connection
+    std::map<Socket, std::string> pending;
+    char buffer[512];
+
+    while(!m_stop)
+    {
+        const Socket socket = m_group->poll(true);
+
+        if(socket.valid() && pending.find(socket) == pending.end())
+        {
+            const ssize_t count = socket.read(buffer, sizeof(buffer));
+            if(count > 0)
+            {
+                std::ostringstream text;
+                m_registry.write(text);
+
+                std::string& response = pending[socket];
+                if(count >= 4 && std::memcmp(buffer, "GET ", 4) == 0)
+                {
+                    const std::string body = text.str();
+                    response = "HTTP/1.0 200 OK\r\n"
+                        "Content-Type: text/plain; version=0.0.4\r\n"
+                        "Content-Length: ";
+                    response += std::to_string(body.size());
+                    response += "\r\n\r\n";
+                    response += body;
+                }
+                else
+                    response = text.str();
+            }
+        }
+
+        for(auto connection = pending.begin(); connection != pending.end();)
+        {
+            std::string& response = connection->second;
+            const ssize_t sent = connection->first.write(
+                    response.data(),
+                    response.size());
+            if(sent >= 0)
+                response.erase(0, sent);
+
+            if(sent < 0 || response.empty())
+            {
+                connection->first.close();
+                connection = pending.erase(connection);
+            }
+            else
+            {
+                connection->first.awaitWritable();
+                ++connection;
+            }
+        }
+    }
+
+    for(const auto& connection: pending)
+        connection.first.close();
+}
@@ -0,0 +1,541 @@
+/*!
+ * @file       multipart.cpp
+ * @brief      Defines the Fastcgipp::Http::MultipartParser and
+ *             Fastcgipp::Http::SpoolFile classes
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/multipart.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+const size_t Fastcgipp::Http::MultipartParser::maxHeaderSize;
+
+Fastcgipp::Http::SpoolFile::SpoolFile():
+    m_file(-1),
+    m_size(0)
+{
+    const char* directory = std::getenv("TMPDIR");
+    if(directory == nullptr || *directory == 0)
+        directory = "/tmp";
+    static const char name[] = "/fastcgipp-XXXXXX";
+
+    std::vector<char> path(directory, directory+std::strlen(directory));
+    path.insert(path.end(), name, name+sizeof(name));
+
+    m_file = mkstemp(path.data());
+    if(m_file < 0)
+    {
+        ERROR_LOG("Unable to create temporary file in " << directory \
+                << ": " << std::strerror(errno))
+        return;
+    }
+    unlink(path.data());
+    fcntl(m_file, F_SETFD, FD_CLOEXEC);
+}
+
+Fastcgipp::Http::SpoolFile::~SpoolFile()
+{
+    if(m_file >= 0)
+        close(m_file);
+}
+
+bool Fastcgipp::Http::SpoolFile::write(const char* data, size_t size)
+{
+    if(m_file < 0)
+        return false;
+
+    while(size)
+    {
+        const ssize_t written = ::write(m_file, data, size);
+        if(written < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            ERROR_LOG("Unable to write to temporary file: " \
+                    << std::strerror(errno))
+            return false;
+        }
+        data += written;
+        size -= written;
+        m_size += written;
+    }
+    return true;
+}
+
+bool Fastcgipp::Http::SpoolFile::finish()
+{
+    if(m_file < 0)
+        return false;
+
+    if(m_size)
+    {
+        void* const map = mmap(
+                nullptr,
+                m_size,
+                PROT_READ,
+                MAP_SHARED,
+                m_file,
+                0);
+        if(map == MAP_FAILED)
+        {
+            ERROR_LOG("Unable to memory map temporary file: " \
+                    << std::strerror(errno))
+            return false;
+        }
+
+        const size_t size = m_size;
+        m_contents.reset(
+                static_cast<const char*>(map),
+                [size] (const char* map)
+                {
+                    munmap(const_cast<char*>(map), size);
+                });
+    }
+
+    close(m_file);
+    m_file = -1;
+    return true;
+}
+
+Fastcgipp::Http::MultipartParser::MultipartParser(
+        const char* boundary,
+        const char* boundaryEnd,
+        const PartCallback& part,
+        const DataCallback& data,
+        const EndCallback& end):
+    m_state(State::PREAMBLE),
+    m_delimiter("\r\n--"),
+    m_carry("\r\n"),
+    m_line(0),
+    m_dash(false),
+    m_partCallback(part),
+    m_dataCallback(data),
+    m_endCallback(end)
+{
+    if(boundaryEnd-boundary >= 2
+            && *boundary == '"'
+            && *(boundaryEnd-1) == '"')
+    {
+        ++boundary;
+        --boundaryEnd;
+    }
+    m_delimiter.append(boundary, boundaryEnd);
+}
+
+const char* Fastcgipp::Http::MultipartParser::find(
+        const char* start,
+        const char* const end) const
+{
+    const size_t size = m_delimiter.size();
+    if(size_t(end-start) < size)
+        return nullptr;
+    const char* const delimiter = m_delimiter.data();
+
+    // Candidates for the start of a delimiter end before this
+    const char* const stop = end-size+1;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    // Only look closer at positions where both the first and last byte of
+    // the delimiter match. The loads of the last bytes stay within end since
+    // candidates stay before stop.
+#if defined(__AVX2__)
+    typedef __m256i Vector;
+    const Vector firsts = _mm256_set1_epi8(delimiter[0]);
+    const Vector lasts = _mm256_set1_epi8(delimiter[size-1]);
+#else
+    typedef __m128i Vector;
+    const Vector firsts = _mm_set1_epi8(delimiter[0]);
+    const Vector lasts = _mm_set1_epi8(delimiter[size-1]);
+#endif
+
+    for(; stop-start >= ptrdiff_t(sizeof(Vector)); start += sizeof(Vector))
+    {
+#if defined(__AVX2__)
+        const Vector first = _mm256_loadu_si256(
+                reinterpret_cast<const Vector*>(start));
+        const Vector last = _mm256_loadu_si256(
+                reinterpret_cast<const Vector*>(start+size-1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(
+                    _mm256_cmpeq_epi8(first, firsts),
+                    _mm256_cmpeq_epi8(last, lasts)));
+#else
+        const Vector first = _mm_loadu_si128(
+                reinterpret_cast<const Vector*>(start));
+        const Vector last = _mm_loadu_si128(
+                reinterpret_cast<const Vector*>(start+size-1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+                    _mm_cmpeq_epi8(first, firsts),
+                    _mm_cmpeq_epi8(last, lasts)));
+#endif
+        while(mask)
+        {
+            const char* const candidate = start+__builtin_ctz(mask);
+            if(std::memcmp(candidate+1, delimiter+1, size-2) == 0)
+                return candidate;
+            mask &= mask-1;
+        }
+    }
+#endif
+
+    while(start != stop)
+    {
+        start = static_cast<const char*>(
+                std::memchr(start, delimiter[0], stop-start));
+        if(start == nullptr)
+            break;
+        if(std::memcmp(start+1, delimiter+1, size-1) == 0)
+            return start;
+        ++start;
+    }
+    return nullptr;
+}
+
+const char* Fastcgipp::Http::MultipartParser::search(
+        const char* const start,
+        const char* const end,
+        bool& found) const
+{
+    const char* position = find(start, end);
+    found = position != nullptr;
+    if(found)
+        return position;
+
+    // Look for the start of a delimiter cut off by the end
+    const size_t size = m_delimiter.size();
+    position = size_t(end-start) < size ? start : end-size+1;
+    while(position != end)
+    {
+        position = static_cast<const char*>(
+                std::memchr(position, m_delimiter[0], end-position));
+        if(position == nullptr)
+            return end;
+        if(std::memcmp(position, m_delimiter.data(), end-position) == 0)
+            return position;
+        ++position;
+    }
+    return end;
+}
+
+bool Fastcgipp::Http::MultipartParser::emit(
+        const char* const start,
+        const char* const end)
+{
+    if(m_state == State::BODY && start != end && !m_dataCallback(start, end))
+    {
+        m_state = State::FAILED;
+        return false;
+    }
+    return true;
+}
+
+bool Fastcgipp::Http::MultipartParser::content(
+        const char*& start,
+        const char* const end)
+{
+    bool found;
+
+    if(!m_carry.empty())
+    {
+        // See if the delimiter straddles the last chunk and this one
+        const size_t carried = m_carry.size();
+        const size_t taken = std::min(size_t(end-start), m_delimiter.size());
+        m_carry.append(start, taken);
+
+        const char* const carry = m_carry.data();
+        const char* const carryEnd = carry+m_carry.size();
+        const char* const position = search(carry, carryEnd, found);
+
+        if(found)
+        {
+            if(!emit(carry, position))
+                return false;
+            start += position+m_delimiter.size()-carry-carried;
+            m_carry.clear();
+            return true;
+        }
+
+        if(taken == size_t(end-start))
+        {
+            if(!emit(carry, position))
+                return false;
+            m_carry.erase(0, position-carry);
+            start = end;
+            return false;
+        }
+
+        // Nothing that starts in the carried bytes can be a delimiter
+        if(!emit(carry, carry+carried))
+            return false;
+        m_carry.clear();
+    }
+
+    const char* const position = search(start, end, found);
+    if(!emit(start, position))
+        return false;
+
+    if(found)
+    {
+        start = position+m_delimiter.size();
+        return true;
+    }
+
+    m_carry.assign(position, end);
+    start = end;
+    return false;
+}
+
+bool Fastcgipp::Http::MultipartParser::parse(
+        const char* start,
+        const char* const end)
+{
+    while(start != end)
+    {
+        switch(m_state)
+        {
+            case State::PREAMBLE:
+            case State::BODY:
+            {
+                const bool body = m_state == State::BODY;
+                if(content(start, end))
+                {
+                    if(body && !m_endCallback())
+                    {
+                        m_state = State::FAILED;
+                        return false;
+                    }
+                    m_state = State::DELIMITER;
+                    m_dash = false;
+                }
+                else if(m_state == State::FAILED)
+                    return false;
+                break;
+            }
+
+            case State::DELIMITER:
+            {
+                const char byte = *start++;
+                if(byte == '-')
+                {
+                    if(m_dash)
+                        m_state = State::EPILOGUE;
+                    m_dash = true;
+                }
+                else if(m_dash)
+                {
+                    m_state = State::FAILED;
+                    return false;
+                }
+                else if(byte == '\n')
+                {
+                    m_state = State::HEADERS;
+                    m_headers.clear();
+                    m_line = 0;
+                }
+                break;
+            }
+
+            case State::HEADERS:
+            {
+                const char* const newline = static_cast<const char*>(
+                        std::memchr(start, '\n', end-start));
+                const char* const stop = newline ? newline+1 : end;
+                m_headers.append(start, stop);
+                start = stop;
+
+                if(m_headers.size() > maxHeaderSize)
+                {
+                    WARNING_LOG("Multipart headers are too large")
+                    m_state = State::FAILED;
+                    return false;
+                }
+
+                if(newline)
+                {
+                    const size_t length = m_headers.size()-m_line;
+                    if(length == 1 || (length == 2 && m_headers[m_line]=='\r'))
+                    {
+                        decodeHeaders();
+                        if(!m_partCallback(m_part))
+                        {
+                            m_state = State::FAILED;
+                            return false;
+                        }
+                        m_state = State::BODY;
+                    }
+                    else
+                        m_line = m_headers.size();
+                }
+                break;
+            }
+
+            case State::EPILOGUE:
+                return true;
+
+            case State::FAILED:
+                return false;
+        }
+    }
+
+    return m_state != State::FAILED;
+}
+
+namespace Fastcgipp
+{
+    namespace Http
+    {
+        //! Case insensitive comparison against a lower case string
+        inline bool headerEquals(
+                const char* start,
+                const char* const end,
+                const char* lower)
+        {
+            for(; start != end; ++start, ++lower)
+                if(
+                        *lower == 0
+                        || std::tolower(static_cast<unsigned char>(*start))
+                            != *lower)
+                    return false;
+            return *lower == 0;
+        }
+
+        //! Strip linear white space off both ends
+        inline void trim(const char*& start, const char*& end)
+        {
+            while(start != end && (*start == ' ' || *start == '\t'))
+                ++start;
+            while(end != start && (
+                        *(end-1) == ' '
+                        || *(end-1) == '\t'
+                        || *(end-1) == '\r'))
+                --end;
+        }
+    }
+}
+
+void Fastcgipp::Http::MultipartParser::decodeHeaders()
+{
+    m_part.name.clear();
+    m_part.filename.clear();
+    m_part.contentType.clear();
+    m_part.named = false;
+    m_part.file = false;
+
+    const char* line = m_headers.data();
+    const char* const headersEnd = line+m_headers.size();
+
+    while(line != headersEnd)
+    {
+        const char* lineEnd = std::find(line, headersEnd, '\n');
+        const char* const next = lineEnd == headersEnd ? lineEnd : lineEnd+1;
+        const char* const colon = std::find(line, lineEnd, ':');
+        if(colon == lineEnd)
+        {
+            line = next;
+            continue;
+        }
+
+        const char* nameStart = line;
+        const char* nameEnd = colon;
+        trim(nameStart, nameEnd);
+        const char* value = colon+1;
+        trim(value, lineEnd);
+
+        if(headerEquals(nameStart, nameEnd, "content-type"))
+        {
+            m_part.contentType.assign(value, lineEnd);
+            m_part.file = true;
+        }
+        else if(headerEquals(nameStart, nameEnd, "content-disposition"))
+        {
+            // Skip the disposition type and go through the parameters
+            value = std::find(value, lineEnd, ';');
+            while(value != lineEnd)
+            {
+                ++value;
+                const char* keyEnd = std::find(value, lineEnd, '=');
+                const char* key = value;
+                const char* const semicolon = std::find(value, lineEnd, ';');
+                if(semicolon < keyEnd)
+                {
+                    value = semicolon;
+                    continue;
+                }
+                trim(key, keyEnd);
+
+                std::string parameter;
+                value = keyEnd == lineEnd ? lineEnd : keyEnd+1;
+                while(value != lineEnd && (*value == ' ' || *value == '\t'))
+                    ++value;
+                if(value != lineEnd && *value == '"')
+                {
+                    for(++value; value != lineEnd && *value != '"'; ++value)
+                    {
+                        if(*value == '\\' && value+1 != lineEnd)
+                            ++value;
+                        parameter.push_back(*value);
+                    }
+                    value = std::find(value, lineEnd, ';');
+                }
+                else
+                {
+                    const char* const parameterEnd = std::find(
+                            value,
+                            lineEnd,
+                            ';');
+                    const char* parameterStart = value;
+                    const char* trimmedEnd = parameterEnd;
+                    trim(parameterStart, trimmedEnd);
+                    parameter.assign(parameterStart, trimmedEnd);
+                    value = parameterEnd;
+                }
+
+                if(headerEquals(key, keyEnd, "name"))
+                {
+                    m_part.name = std::move(parameter);
+                    m_part.named = true;
+                }
+                else if(headerEquals(key, keyEnd, "filename"))
+                    m_part.filename = std::move(parameter);
+            }
+        }
+
+        line = next;
+    }
+}
@@ -29,10 +29,19 @@
 #include "fastcgi++/request.hpp"
 #include "fastcgi++/log.hpp"
 
-template<class charT> void Fastcgipp::Request<charT>::complete()
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+template<class charT, class Allocator>
+void Fastcgipp::Request<charT, Allocator>::complete()
 {
     out.flush();
     err.flush();
+    if(trace)
+        trace->mark(Trace::Phase::END);
 
     Block record(sizeof(Protocol::Header)+sizeof(Protocol::EndRequest));
 
@@ -52,8 +61,8 @@ template<class charT> void Fastcgipp::Request<charT>::complete()
     m_send(m_id.m_socket, std::move(record), m_kill);
 }
 
-template<class charT>
-std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
+template<class charT, class Allocator>
+std::unique_lock<std::mutex> Fastcgipp::Request<charT, Allocator>::handler()
 {
     std::unique_lock<std::mutex> lock(m_messagesMutex);
     while(!m_messages.empty())
@@ -106,11 +115,19 @@ std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
                             complete();
                             goto exit;
                         }
+                        if(trace)
+                            trace->mark(Trace::Phase::PARAMS);
                         m_state = Protocol::RecordType::IN;
                         lock.lock();
                         continue;
                     }
-                    m_environment.fill(body,  bodyEnd);
+                    if(m_lazyEnvironment)
+                        m_environment.index(
+                                std::move(message.data),
+                                body,
+                                bodyEnd);
+                    else
+                        m_environment.fill(body,  bodyEnd);
                     lock.lock();
                     continue;
                 }
@@ -119,7 +136,20 @@ std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
                 {
                     if(header.contentLength==0)
                     {
-                        if(!inProcessor() && !m_environment.parsePostBuffer())
+                        if(m_streamMultipart && m_environment.streamable())
+                        {
+                            if(!m_environment.finishPostStream())
+                            {
+                                WARNING_LOG("Malformed multipart data from "\
+                                        "client")
+                                errorHandler();
+                                complete();
+                                goto exit;
+                            }
+                        }
+                        else if(
+                                !inProcessor()
+                                && !m_environment.parsePostBuffer())
                         {
                             WARNING_LOG("Unknown content type from client")
                             unknownContentErrorHandler();
@@ -128,11 +158,13 @@ std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
                         }
 
                         m_environment.clearPostBuffer();
+                        if(trace)
+                            trace->mark(Trace::Phase::IN);
                         m_state = Protocol::RecordType::OUT;
                         break;
                     }
 
-                    if(m_environment.postBuffer().size()+(bodyEnd-body)
+                    if(m_environment.postSize()+(bodyEnd-body)
                             > environment().contentLength)
                     {
                         bigPostErrorHandler();
@@ -140,7 +172,15 @@ std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
                         goto exit;
                     }
 
-                    m_environment.fillPostBuffer(body, bodyEnd);
+                    if(!m_streamMultipart || !m_environment.streamable())
+                        m_environment.fillPostBuffer(body, bodyEnd);
+                    else if(!m_environment.parsePostStream(body, bodyEnd))
+                    {
+                        WARNING_LOG("Malformed multipart data from client")
+                        errorHandler();
+                        complete();
+                        goto exit;
+                    }
                     inHandler(header.contentLength);
                     lock.lock();
                     continue;
@@ -157,6 +197,8 @@ std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
         }
 
         m_message = std::move(message);
+        if(trace)
+            trace->mark(Trace::Phase::RESPONSE);
         if(response())
         {
             complete();
@@ -168,7 +210,8 @@ exit:
     return lock;
 }
 
-template<class charT> void Fastcgipp::Request<charT>::errorHandler()
+template<class charT, class Allocator>
+void Fastcgipp::Request<charT, Allocator>::errorHandler()
 {
     out << \
 "Status: 500 Internal Server Error\n"\
@@ -184,7 +227,8 @@ template<class charT> void Fastcgipp::Request<charT>::errorHandler()
 "</html>";
 }
 
-template<class charT> void Fastcgipp::Request<charT>::bigPostErrorHandler()
+template<class charT, class Allocator>
+void Fastcgipp::Request<charT, Allocator>::bigPostErrorHandler()
 {
         out << \
 "Status: 413 Request Entity Too Large\n"\
@@ -200,7 +244,8 @@ template<class charT> void Fastcgipp::Request<charT>::bigPostErrorHandler()
 "</html>";
 }
 
-template<class charT> void Fastcgipp::Request<charT>::unknownContentErrorHandler()
+template<class charT, class Allocator>
+void Fastcgipp::Request<charT, Allocator>::unknownContentErrorHandler()
 {
         out << \
 "Status: 415 Unsupported Media Type\n"\
@@ -216,11 +261,14 @@ template<class charT> void Fastcgipp::Request<charT>::unknownContentErrorHandler
 "</html>";
 }
 
-template<class charT> void Fastcgipp::Request<charT>::configure(
+template<class charT, class Allocator>
+void Fastcgipp::Request<charT, Allocator>::configure(
         const Protocol::RequestId& id,
         const Protocol::Role& role,
         bool kill,
         const std::function<void(const Socket&, Block&&, bool)> send,
+        const std::function<void(const Socket&, Block&&, FileSegment&&)>
+            sendFile,
         const std::function<void(Message)> callback)
 {
     using namespace std::placeholders;
@@ -230,23 +278,107 @@ template<class charT> void Fastcgipp::Request<charT>::configure(
     m_role=role;
     m_callback=callback;
     m_send=send;
+    m_sendFile=sendFile;
 
     m_outStreamBuffer.configure(
             id,
             Protocol::RecordType::OUT,
-            std::bind(send, _1, _2, false));
+            [this] (const Socket& socket, Block&& record)
+            {
+                if(trace)
+                    trace->mark(Trace::Phase::OUT);
+                m_send(socket, std::move(record), false);
+            });
     m_errStreamBuffer.configure(
             id,
             Protocol::RecordType::ERR,
             std::bind(send, _1, _2, false));
 }
 
-template<class charT> unsigned Fastcgipp::Request<charT>::pickLocale(
+template<class charT, class Allocator>
+void Fastcgipp::Request<charT, Allocator>::dump(const SharedResponse& response)
+{
+    out.flush();
+    if(trace)
+        trace->mark(Trace::Phase::OUT);
+    response.send(m_id.m_id, [this] (Block&& record)
+    {
+        m_send(m_id.m_socket, std::move(record), false);
+    });
+}
+
+template<class charT, class Allocator>
+void Fastcgipp::Request<charT, Allocator>::dump(FileSegment segment)
+{
+    const size_t maxContentLength = 0xffffU;
+    out.flush();
+    if(trace && segment.size != 0)
+        trace->mark(Trace::Phase::OUT);
+
+    while(segment.size != 0)
+    {
+        const size_t size = std::min(segment.size, maxContentLength);
+
+        Block record(sizeof(Protocol::Header));
+        Protocol::Header& header
+            = *reinterpret_cast<Protocol::Header*>(record.begin());
+        header.version = Protocol::version;
+        header.type = Protocol::RecordType::OUT;
+        header.fcgiId = m_id.m_id;
+        header.contentLength = size;
+        header.paddingLength = 0;
+
+        FileSegment piece(segment);
+        piece.size = size;
+        m_sendFile(m_id.m_socket, std::move(record), std::move(piece));
+
+        segment.offset += size;
+        segment.size -= size;
+    }
+}
+
+template<class charT, class Allocator>
+bool Fastcgipp::Request<charT, Allocator>::dumpFile(const std::string& path)
+{
+    // Non blocking so that opening a FIFO doesn't wait for a writer
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if(fd < 0)
+    {
+        WARNING_LOG("Unable to open " << path.c_str() << ": " \
+                << std::strerror(errno))
+        return false;
+    }
+
+    struct stat status;
+    if(::fstat(fd, &status) != 0)
+    {
+        WARNING_LOG("Unable to stat " << path.c_str() << ": " \
+                << std::strerror(errno))
+        ::close(fd);
+        return false;
+    }
+
+    // Anything else would fail in the transceiver and take the whole
+    // connection down with it
+    if(!S_ISREG(status.st_mode))
+    {
+        WARNING_LOG("Unable to send " << path.c_str() \
+                << ": Not a regular file")
+        ::close(fd);
+        return false;
+    }
+
+    dump(FileSegment(fd, 0, status.st_size, true));
+    return true;
+}
+
+template<class charT, class Allocator>
+unsigned Fastcgipp::Request<charT, Allocator>::pickLocale(
         const std::vector<std::string>& locales)
 {
     unsigned index=0;
 
-    for(const std::string& language: environment().acceptLanguages)
+    for(const auto& language: environment().acceptLanguages)
     {
         if(language.size() <= 5)
         {
@@ -272,7 +404,8 @@ template<class charT> unsigned Fastcgipp::Request<charT>::pickLocale(
     return index;
 }
 
-template<class charT> void Fastcgipp::Request<charT>::setLocale(
+template<class charT, class Allocator>
+void Fastcgipp::Request<charT, Allocator>::setLocale(
         const std::string& locale)
 {
     try
@@ -286,18 +419,13 @@ template<class charT> void Fastcgipp::Request<charT>::setLocale(
     }
 }
 
-namespace Fastcgipp
+template<class charT, class Allocator>
+const char* Fastcgipp::Request<charT, Allocator>::codepage() const
 {
-    template<> const char* Fastcgipp::Request<wchar_t>::codepage() const
-    {
-        return ".UTF-8";
-    }
-
-    template<> const char* Fastcgipp::Request<char>::codepage() const
-    {
-        return "";
-    }
+    return std::is_same<charT, wchar_t>::value ? ".UTF-8" : "";
 }
 
 template class Fastcgipp::Request<char>;
 template class Fastcgipp::Request<wchar_t>;
+template class Fastcgipp::Request<char, Fastcgipp::ArenaAllocator<char>>;
+template class Fastcgipp::Request<wchar_t, Fastcgipp::ArenaAllocator<wchar_t>>;
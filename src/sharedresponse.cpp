@@ -0,0 +1,97 @@
+/*!
+ * @file       sharedresponse.cpp
+ * @brief      Defines the Fastcgipp::SharedResponse class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/sharedresponse.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+Fastcgipp::SharedResponse::SharedResponse(const char* data, size_t size):
+    m_content(std::make_shared<Block>()),
+    m_size(size)
+{
+    const size_t maxContentLength = 0xffffU;
+    const size_t headerSize = sizeof(Protocol::Header);
+
+    const size_t records = (size+maxContentLength-1)/maxContentLength;
+    m_headers.resize(records);
+    m_content->reserve(records*(
+                Protocol::getRecordSize(maxContentLength)-headerSize));
+    m_content->size(0);
+
+    for(auto& header: m_headers)
+    {
+        const size_t contentLength = std::min(size, maxContentLength);
+
+        header.version = Protocol::version;
+        header.type = Protocol::RecordType::OUT;
+        header.fcgiId = 0;
+        header.contentLength = contentLength;
+        header.paddingLength = Protocol::getRecordSize(contentLength)
+            - contentLength
+            - headerSize;
+
+        char* const content = m_content->end();
+        std::memcpy(content, data, contentLength);
+        std::memset(content+contentLength, 0, header.paddingLength);
+        m_content->size(
+                m_content->size()
+                + contentLength
+                + header.paddingLength);
+
+        data += contentLength;
+        size -= contentLength;
+    }
+}
+
+void Fastcgipp::SharedResponse::send(
+        Protocol::FcgiId id,
+        const std::function<void(Block&&)>& send) const
+{
+    if(m_headers.empty())
+        return;
+
+    const size_t headerSize = sizeof(Protocol::Header);
+    const std::shared_ptr<Block> headers(std::make_shared<Block>(
+                m_headers.size()*headerSize));
+    std::memcpy(headers->begin(), m_headers.data(), headers->size());
+
+    char* header = headers->begin();
+    char* content = m_content->begin();
+    for(const auto& prepared: m_headers)
+    {
+        reinterpret_cast<Protocol::Header*>(header)->fcgiId = id;
+        const size_t size = prepared.contentLength+prepared.paddingLength;
+
+        send(Block(headers, header, headerSize));
+        send(Block(m_content, content, size));
+
+        header += headerSize;
+        content += size;
+    }
+}
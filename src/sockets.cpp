@@ -32,11 +32,7 @@
 #include "fastcgi++/sockets.hpp"
 #include "fastcgi++/log.hpp"
 
-#ifdef FASTCGIPP_LINUX
-#include <sys/epoll.h>
-#elif defined FASTCGIPP_UNIX
 #include <algorithm>
-#endif
 
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -50,22 +46,35 @@
 #include <grp.h>
 #include <cstring>
 
+#ifdef FASTCGIPP_LINUX
+#include <sys/sendfile.h>
+#endif
+
 #ifdef FASTCGIPP_LINUX
 const unsigned Fastcgipp::Poll::Result::pollIn = EPOLLIN;
+const unsigned Fastcgipp::Poll::Result::pollOut = EPOLLOUT;
 const unsigned Fastcgipp::Poll::Result::pollErr = EPOLLERR;
 const unsigned Fastcgipp::Poll::Result::pollHup = EPOLLHUP;
 const unsigned Fastcgipp::Poll::Result::pollRdHup = EPOLLRDHUP;
 #elif defined FASTCGIPP_UNIX
 const unsigned Fastcgipp::Poll::Result::pollIn = POLLIN;
+const unsigned Fastcgipp::Poll::Result::pollOut = POLLOUT;
 const unsigned Fastcgipp::Poll::Result::pollErr = POLLERR;
 const unsigned Fastcgipp::Poll::Result::pollHup = POLLHUP;
 const unsigned Fastcgipp::Poll::Result::pollRdHup = POLLRDHUP;
 #endif
 
-Fastcgipp::Poll::Poll()
+Fastcgipp::Poll::Poll():
+#ifdef FASTCGIPP_LINUX
+    m_poll(epoll_create1(0)),
+#endif
+    m_readyPosition(0),
+    m_batchSize(1),
 #ifdef FASTCGIPP_LINUX
-    :m_poll(epoll_create1(0))
+    m_events(1),
 #endif
+    m_wakeups(0),
+    m_harvested(0)
 {}
 
 Fastcgipp::Poll::~Poll()
@@ -75,15 +84,32 @@ Fastcgipp::Poll::~Poll()
 #endif
 }
 
+void Fastcgipp::Poll::batchSize(unsigned size)
+{
+    m_batchSize = std::max(size, 1U);
+#ifdef FASTCGIPP_LINUX
+    m_events.resize(m_batchSize);
+#endif
+}
+
 Fastcgipp::Poll::Result Fastcgipp::Poll::poll(int timeout)
 {
+    // Hand out anything left over from the last harvest first
+    while(m_readyPosition < m_ready.size())
+    {
+        const Result& result = m_ready[m_readyPosition++];
+        if(result)
+            return result;
+    }
+    m_ready.clear();
+    m_readyPosition = 0;
+
     int pollResult;
 #ifdef FASTCGIPP_LINUX
-    epoll_event epollEvent;
     pollResult = epoll_wait(
             m_poll,
-            &epollEvent,
-            1,
+            m_events.data(),
+            m_events.size(),
             timeout);
 #elif defined FASTCGIPP_UNIX
     pollResult = ::poll(
@@ -92,32 +118,36 @@ Fastcgipp::Poll::Result Fastcgipp::Poll::poll(int timeout)
             timeout);
 #endif
 
-    Result result;
-
     if(pollResult<0 && errno != EINTR)
         FAIL_LOG("Error on poll: " << std::strerror(errno))
     else if(pollResult>0)
     {
-        result.m_data = true;
 #ifdef FASTCGIPP_LINUX
-        result.m_socket = epollEvent.data.fd;
-        result.m_events = epollEvent.events;
+        for(int i=0; i<pollResult; ++i)
+        {
+            const socket_t socket = m_events[i].data.fd;
+            const unsigned events = m_events[i].events;
+            m_ready.emplace_back(Result(socket, events));
+        }
 #elif defined FASTCGIPP_UNIX
-        const auto fd = std::find_if(
-                m_poll.begin(),
-                m_poll.end(),
-                [] (const pollfd& x)
-                {
-                    return x.revents != 0;
-                });
-        if(fd == m_poll.end())
+        for(const auto& fd: m_poll)
+        {
+            if(fd.revents != 0)
+            {
+                m_ready.emplace_back(Result(fd.fd, fd.revents));
+                if(m_ready.size() == m_batchSize)
+                    break;
+            }
+        }
+        if(m_ready.empty())
             FAIL_LOG("poll() gave a result >0 but no revents are non-zero")
-        result.m_socket = fd->fd;
-        result.m_events = fd->revents;
 #endif
+        ++m_wakeups;
+        m_harvested += m_ready.size();
+        return m_ready[m_readyPosition++];
     }
 
-    return result;
+    return Result();
 }
 
 Fastcgipp::Socket::Socket(
@@ -152,16 +182,12 @@ ssize_t Fastcgipp::Socket::read(char* buffer, size_t size) const
     }
     if(count == 0 && m_data->m_closing)
     {
-#if FASTCGIPP_LOG_LEVEL > 3
-        ++m_data->m_group.m_connectionRDHupCount;
-#endif
+        m_data->m_group.m_connectionRDHupCount.add();
         close();
         return -1;
     }
 
-#if FASTCGIPP_LOG_LEVEL > 3
-    m_data->m_group.m_bytesReceived += count;
-#endif
+    m_data->m_group.m_bytesReceived.add(count);
 
     return count;
 }
@@ -182,13 +208,127 @@ ssize_t Fastcgipp::Socket::write(const char* buffer, size_t size) const
         return -1;
     }
 
-#if FASTCGIPP_LOG_LEVEL > 3
-    m_data->m_group.m_bytesSent += count;
-#endif
+    m_data->m_group.m_bytesSent.add(count);
 
     return count;
 }
 
+ssize_t Fastcgipp::Socket::write(
+        const iovec* chunks,
+        size_t count,
+        bool more) const
+{
+    if(!valid() || m_data->m_closing)
+        return -1;
+
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = const_cast<iovec*>(chunks);
+    message.msg_iovlen = count;
+
+    int flags = MSG_NOSIGNAL;
+#ifdef MSG_MORE
+    if(more)
+        flags |= MSG_MORE;
+#endif
+
+    const ssize_t sent = ::sendmsg(m_data->m_socket, &message, flags);
+    if(sent<0)
+    {
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        WARNING_LOG("Socket sendmsg() error on fd " \
+                << m_data->m_socket << ": " << strerror(errno))
+        close();
+        return -1;
+    }
+
+    m_data->m_group.m_bytesSent.add(sent);
+
+    return sent;
+}
+
+ssize_t Fastcgipp::Socket::write(FileSegment& segment) const
+{
+    if(!valid() || m_data->m_closing)
+        return -1;
+
+#ifdef FASTCGIPP_LINUX
+    const ssize_t sent = ::sendfile(
+            m_data->m_socket,
+            *segment.file,
+            &segment.offset,
+            segment.size);
+#else
+    // No zero copy so the best we can do is a single pass through a buffer.
+    // Nothing is lost if the socket takes less than we read since the next
+    // call simply reads it again.
+    char buffer[0x10000];
+    ssize_t sent = ::pread(
+            *segment.file,
+            buffer,
+            std::min(segment.size, sizeof(buffer)),
+            segment.offset);
+    if(sent>0)
+    {
+        sent = ::send(m_data->m_socket, buffer, sent, MSG_NOSIGNAL);
+        if(sent>0)
+            segment.offset += sent;
+    }
+#endif
+    if(sent<0)
+    {
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        WARNING_LOG("Socket file write error on fd " \
+                << m_data->m_socket << ": " << strerror(errno))
+        close();
+        return -1;
+    }
+    if(sent == 0 && segment.size != 0)
+    {
+        WARNING_LOG("File ended before the segment did on fd " \
+                << m_data->m_socket)
+        close();
+        return -1;
+    }
+    segment.size -= sent;
+
+    m_data->m_group.m_bytesSent.add(sent);
+
+    return sent;
+}
+
+Fastcgipp::FileSegment::FileSegment(
+        int fd,
+        off_t offset_,
+        size_t size_,
+        bool close):
+    offset(offset_),
+    size(size_)
+{
+    if(close)
+        file.reset(new int(fd), [] (const int* fd)
+        {
+            ::close(*fd);
+            delete fd;
+        });
+    else
+        file = std::make_shared<const int>(fd);
+}
+
+void Fastcgipp::Socket::awaitWritable() const
+{
+    if(valid() && !m_data->m_writeBlocked)
+    {
+        if(m_data->m_group.m_poll.writable(m_data->m_socket, true))
+            m_data->m_writeBlocked = true;
+        else
+            ERROR_LOG("Unable to poll for writability on fd " \
+                    << m_data->m_socket << ": " << std::strerror(errno))
+    }
+}
+
 void Fastcgipp::Socket::close() const
 {
     if(valid())
@@ -198,10 +338,8 @@ void Fastcgipp::Socket::close() const
         ::close(m_data->m_socket);
         m_data->m_valid = false;
         m_data->m_group.m_sockets.erase(m_data->m_socket);
-#if FASTCGIPP_LOG_LEVEL > 3
         if(!m_data->m_closing)
-            ++m_data->m_group.m_connectionKillCount;
-#endif
+            m_data->m_group.m_connectionKillCount.add();
     }
 }
 
@@ -216,19 +354,30 @@ Fastcgipp::Socket::~Socket()
     }
 }
 
-Fastcgipp::SocketGroup::SocketGroup():
+Fastcgipp::SocketGroup::SocketGroup(Metrics::Registry& registry):
+    m_exclusiveListeners(false),
     m_waking(false),
     m_reuse(false),
     m_accept(true),
-    m_refreshListeners(false)
-#if FASTCGIPP_LOG_LEVEL > 3
-    ,m_incomingConnectionCount(0),
-    m_outgoingConnectionCount(0),
-    m_connectionKillCount(0),
-    m_connectionRDHupCount(0),
-    m_bytesSent(0),
-    m_bytesReceived(0)
-#endif
+    m_refreshListeners(false),
+    m_incomingConnectionCount(registry.counter(
+                "fastcgipp_socket_incoming_total",
+                "Connections accepted")),
+    m_outgoingConnectionCount(registry.counter(
+                "fastcgipp_socket_outgoing_total",
+                "Connections made")),
+    m_connectionKillCount(registry.counter(
+                "fastcgipp_socket_kills_total",
+                "Connections closed locally")),
+    m_connectionRDHupCount(registry.counter(
+                "fastcgipp_socket_hangups_total",
+                "Connections closed remotely")),
+    m_bytesSent(registry.counter(
+                "fastcgipp_socket_sent_bytes_total",
+                "Bytes written to sockets")),
+    m_bytesReceived(registry.counter(
+                "fastcgipp_socket_received_bytes_total",
+                "Bytes read from sockets"))
 {
     // Add our wakeup socket into the poll list
     socketpair(AF_UNIX, SOCK_STREAM, 0, m_wakeSockets);
@@ -242,6 +391,8 @@ Fastcgipp::SocketGroup::~SocketGroup()
     close(m_wakeSockets[1]);
     for(const auto& listener: m_listeners)
     {
+        if(m_sharedListeners.find(listener) != m_sharedListeners.end())
+            continue;
         ::shutdown(listener, SHUT_RDWR);
         ::close(listener);
     }
@@ -249,18 +400,23 @@ Fastcgipp::SocketGroup::~SocketGroup()
         std::remove(filename.c_str());
 
     DIAG_LOG("SocketGroup::~SocketGroup(): Incoming sockets ======== " \
-            << m_incomingConnectionCount)
+            << m_incomingConnectionCount.value())
     DIAG_LOG("SocketGroup::~SocketGroup(): Outgoing sockets ======== " \
-            << m_outgoingConnectionCount)
+            << m_outgoingConnectionCount.value())
     DIAG_LOG("SocketGroup::~SocketGroup(): Locally closed sockets == " \
-            << m_connectionKillCount)
+            << m_connectionKillCount.value())
     DIAG_LOG("SocketGroup::~SocketGroup(): Remotely closed sockets = " \
-            << m_connectionRDHupCount)
+            << m_connectionRDHupCount.value())
     DIAG_LOG("SocketGroup::~SocketGroup(): Remaining sockets ======= " \
             << m_sockets.size())
-    DIAG_LOG("SocketGroup::~SocketGroup(): Bytes sent ===== " << m_bytesSent)
+    DIAG_LOG("SocketGroup::~SocketGroup(): Bytes sent ===== " \
+            << m_bytesSent.value())
     DIAG_LOG("SocketGroup::~SocketGroup(): Bytes received = " \
-            << m_bytesReceived)
+            << m_bytesReceived.value())
+    DIAG_LOG("SocketGroup::~SocketGroup(): Poll wakeups ===== " \
+            << m_poll.wakeups())
+    DIAG_LOG("SocketGroup::~SocketGroup(): Poll events ====== " \
+            << m_poll.harvested())
 }
 
 static void set_reuse(int sock)
@@ -445,6 +601,22 @@ bool Fastcgipp::SocketGroup::listen(
     return true;
 }
 
+void Fastcgipp::SocketGroup::share(SocketGroup& group)
+{
+    for(const auto& listener: group.m_listeners)
+    {
+        if(m_listeners.find(listener) != m_listeners.end())
+            continue;
+        fcntl(listener, F_SETFL, fcntl(listener, F_GETFL)|O_NONBLOCK);
+        m_listeners.insert(listener);
+        m_sharedListeners.insert(listener);
+    }
+    m_exclusiveListeners = true;
+    m_refreshListeners = true;
+    group.m_exclusiveListeners = true;
+    group.m_refreshListeners = true;
+}
+
 Fastcgipp::Socket Fastcgipp::SocketGroup::connect(const char* name)
 {
     const auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -470,9 +642,7 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::connect(const char* name)
         return Socket();
     }
 
-#if FASTCGIPP_LOG_LEVEL > 3
-    ++m_outgoingConnectionCount;
-#endif
+    m_outgoingConnectionCount.add();
 
     return m_sockets.emplace(
             fd,
@@ -533,9 +703,7 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::connect(
         return Socket();
     }
 
-#if FASTCGIPP_LOG_LEVEL > 3
-    ++m_outgoingConnectionCount;
-#endif
+    m_outgoingConnectionCount.add();
 
     return m_sockets.emplace(
             fd,
@@ -551,7 +719,7 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
             for(auto& listener: m_listeners)
             {
                 m_poll.del(listener);
-                if(m_accept && !m_poll.add(listener))
+                if(m_accept && !m_poll.add(listener, m_exclusiveListeners))
                     FAIL_LOG("Unable to add listen socket " << listener \
                             << " to the poll list: " << std::strerror(errno))
             }
@@ -607,6 +775,15 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
                     continue;
                 }
 
+                if(result.out())
+                {
+                    socket->second.m_data->m_writeBlocked=false;
+                    m_poll.writable(result.socket(), false);
+                    block=false;
+                    if(result.onlyOut())
+                        continue;
+                }
+
                 if(result.rdHup())
                     socket->second.m_data->m_closing=true;
                 else if(result.hup())
@@ -651,6 +828,11 @@ void Fastcgipp::SocketGroup::createSocket(const socket_t listener)
             listener,
             reinterpret_cast<sockaddr*>(&addr),
             &addrlen);
+    if(socket<0 && (
+                errno == EAGAIN
+                || errno == EWOULDBLOCK
+                || errno == ECONNABORTED))
+        return;
     if(socket<0)
         FAIL_LOG("Unable to accept() with fd " \
                 << listener << ": " \
@@ -672,9 +854,7 @@ void Fastcgipp::SocketGroup::createSocket(const socket_t listener)
         m_sockets.emplace(
                 socket,
                 Socket(socket, *this));
-#if FASTCGIPP_LOG_LEVEL > 3
-        ++m_incomingConnectionCount;
-#endif
+        m_incomingConnectionCount.add();
     }
     else
         close(socket);
@@ -685,11 +865,20 @@ Fastcgipp::Socket::Socket():
     m_original(false)
 {}
 
-bool Fastcgipp::Poll::add(const socket_t socket)
+bool Fastcgipp::Poll::add(const socket_t socket, bool exclusive)
 {
 #ifdef FASTCGIPP_LINUX
     epoll_event event;
     event.data.fd = socket;
+#ifdef EPOLLEXCLUSIVE
+    if(exclusive)
+    {
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        if(epoll_ctl(m_poll, EPOLL_CTL_ADD, socket, &event) != -1)
+            return true;
+        // Older kernels don't know about EPOLLEXCLUSIVE
+    }
+#endif
     event.events = EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP;
     return epoll_ctl(m_poll, EPOLL_CTL_ADD, socket, &event) != -1;
 #elif defined FASTCGIPP_UNIX
@@ -712,6 +901,14 @@ bool Fastcgipp::Poll::add(const socket_t socket)
 
 bool Fastcgipp::Poll::del(const socket_t socket)
 {
+    // Make sure we don't hand out stale events for this socket
+    for(
+            auto result = m_ready.begin()+m_readyPosition;
+            result < m_ready.end();
+            ++result)
+        if(result->m_socket == socket)
+            result->m_data = false;
+
 #ifdef FASTCGIPP_LINUX
     return epoll_ctl(m_poll, EPOLL_CTL_DEL, socket, nullptr) != -1;
 #elif defined FASTCGIPP_UNIX
@@ -730,6 +927,34 @@ bool Fastcgipp::Poll::del(const socket_t socket)
 #endif
 }
 
+bool Fastcgipp::Poll::writable(const socket_t socket, bool status)
+{
+#ifdef FASTCGIPP_LINUX
+    epoll_event event;
+    event.data.fd = socket;
+    event.events = EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP;
+    if(status)
+        event.events |= EPOLLOUT;
+    return epoll_ctl(m_poll, EPOLL_CTL_MOD, socket, &event) != -1;
+#elif defined FASTCGIPP_UNIX
+    const auto fd = std::find_if(
+            m_poll.begin(),
+            m_poll.end(),
+            [&socket] (const pollfd& x)
+            {
+                return x.fd == socket;
+            });
+    if(fd == m_poll.end())
+        return false;
+
+    if(status)
+        fd->events |= POLLOUT;
+    else
+        fd->events &= ~POLLOUT;
+    return true;
+#endif
+}
+
 void Fastcgipp::SocketGroup::accept(bool status)
 {
     if(status != m_accept)
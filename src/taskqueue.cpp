@@ -0,0 +1,88 @@
+/*!
+ * @file       taskqueue.cpp
+ * @brief      Defines the Fastcgipp::EventCount class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/taskqueue.hpp"
+
+#include <climits>
+
+#ifdef FASTCGIPP_LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+Fastcgipp::EventCount::EventCount():
+    m_epoch(0),
+    m_waiters(0),
+    m_sleeps(0)
+{}
+
+void Fastcgipp::EventCount::wait(int key)
+{
+    ++m_sleeps;
+#ifdef FASTCGIPP_LINUX
+    // The kernel checks the epoch against the key atomically for us
+    syscall(
+            SYS_futex,
+            reinterpret_cast<int*>(&m_epoch),
+            FUTEX_WAIT_PRIVATE,
+            key,
+            nullptr,
+            nullptr,
+            0);
+#else
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while(m_epoch == key)
+            m_wake.wait(lock);
+    }
+#endif
+    --m_waiters;
+}
+
+void Fastcgipp::EventCount::wake(bool all)
+{
+#ifdef FASTCGIPP_LINUX
+    ++m_epoch;
+    syscall(
+            SYS_futex,
+            reinterpret_cast<int*>(&m_epoch),
+            FUTEX_WAKE_PRIVATE,
+            all ? INT_MAX : 1,
+            nullptr,
+            nullptr,
+            0);
+#else
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_epoch;
+    if(all)
+        m_wake.notify_all();
+    else
+        m_wake.notify_one();
+#endif
+}
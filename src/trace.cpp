@@ -0,0 +1,70 @@
+/*!
+ * @file       trace.cpp
+ * @brief      Defines the Fastcgipp::Trace class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+
+#include "fastcgi++/trace.hpp"
+#include "fastcgi++/log.hpp"
+
+const char* Fastcgipp::Trace::name(Phase phase)
+{
+    static const char* const names[phases] = {
+        "begin",
+        "params",
+        "in",
+        "response",
+        "out",
+        "end",
+        "written"};
+    return names[static_cast<unsigned>(phase)];
+}
+
+Fastcgipp::Trace::Trace(
+        const Protocol::RequestId& id_,
+        Clock::time_point begin,
+        const std::shared_ptr<const Hook>& hook):
+    id(id_),
+    m_times(),
+    m_hook(hook)
+{
+    m_times[static_cast<unsigned>(Phase::BEGIN)] = begin;
+}
+
+Fastcgipp::Trace::~Trace()
+{
+    if(m_hook && *m_hook)
+    {
+        try
+        {
+            (*m_hook)(*this);
+        }
+        catch(...)
+        {
+            ERROR_LOG("Request trace hook threw an exception")
+        }
+    }
+}
@@ -29,211 +29,444 @@
 #include "fastcgi++/transceiver.hpp"
 
 #include "fastcgi++/log.hpp"
-bool Fastcgipp::Transceiver::transmit()
+
+#include <atomic>
+
+namespace
+{
+    //! Is the receive chunk referenced by nothing but the receive buffer?
+    /*!
+     * The use count is read with a relaxed load. Requests drop their slices
+     * of the chunk from other threads so we need an acquire fence to make sure
+     * they are done with the memory before we write over it.
+     */
+    inline bool unshared(const std::shared_ptr<Fastcgipp::Block>& chunk)
+    {
+        if(chunk.use_count() != 1)
+            return false;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+    }
+}
+
+bool Fastcgipp::Transceiver::transmit(Reactor& reactor)
 {
-    std::unique_ptr<Record> record;
+    // Sort the newly queued records into their sockets' queues
+    {
+        std::deque<std::unique_ptr<Record>> records;
+        {
+            std::lock_guard<std::mutex> lock(reactor.sendBufferMutex);
+            records.swap(reactor.sendBuffer);
+        }
+        for(auto& record: records)
+            reactor.sendQueues[record->socket].push_back(std::move(record));
+    }
 
-    while(!m_sendBuffer.empty())
+    bool flushed = true;
+    for(auto queue = reactor.sendQueues.begin();
+            queue != reactor.sendQueues.end();)
     {
+        if(queue->first.writeBlocked())
+        {
+            ++queue;
+            continue;
+        }
+
+        if(flush(reactor, queue->first, queue->second))
+            queue = reactor.sendQueues.erase(queue);
+        else
         {
-            std::lock_guard<std::mutex> lock(m_sendBufferMutex);
-            record = std::move(m_sendBuffer.front());
-            m_sendBuffer.pop_front();
+            if(!queue->first.writeBlocked())
+                flushed = false;
+            ++queue;
         }
+    }
+
+    return flushed;
+}
+
+bool Fastcgipp::Transceiver::flush(
+        Reactor& reactor,
+        const Socket& socket,
+        std::deque<std::unique_ptr<Record>>& queue)
+{
+    // Gathering more than this many records per system call gains us nothing
+    const size_t maxChunks = 64;
+    iovec chunks[maxChunks];
 
-        const ssize_t sent = record->socket.write(
-                record->read,
-                record->data.end()-record->read);
-        if(sent>=0)
+    while(!queue.empty())
+    {
+        size_t count = 0;
+        size_t gathered = 0;
+        bool file = false;
+        for(const auto& record: queue)
         {
-            record->read += sent;
             if(record->read != record->data.end())
             {
+                chunks[count].iov_base = const_cast<char*>(record->read);
+                chunks[count].iov_len = record->data.end()-record->read;
+                ++count;
+            }
+            ++gathered;
+            file = record->file.size != 0;
+            if(count == maxChunks || record->kill || file)
+                break;
+        }
+
+        ssize_t sent = 0;
+        if(count != 0)
+        {
+            sent = socket.write(chunks, count, file);
+            if(sent<0)
+                return true;
+            m_writes.add();
+        }
+
+        // Only the records we gathered were written. Anything short of all
+        // of them means the socket is full.
+        for(; gathered != 0; --gathered)
+        {
+            Record& record = *queue.front();
+            const size_t remaining = record.data.end()-record.read;
+            if(static_cast<size_t>(sent) < remaining)
+            {
+                record.read += sent;
+                socket.awaitWritable();
+                return false;
+            }
+            sent -= remaining;
+            record.read = record.data.end();
+
+            const bool file = record.file.size != 0;
+            if(file)
+            {
+                if(socket.write(record.file) < 0)
+                    return true;
+                m_fileWrites.add();
+                if(record.file.size != 0)
                 {
-                    std::lock_guard<std::mutex> lock(m_sendBufferMutex);
-                    m_sendBuffer.push_front(std::move(record));
+                    socket.awaitWritable();
+                    return false;
                 }
-                return false;
             }
-#if FASTCGIPP_LOG_LEVEL > 3
-            ++m_recordsSent;
-#endif
-            if(record->kill)
+            m_recordsSent.add();
+            if(record.trace)
+                record.trace->mark(Trace::Phase::WRITTEN);
+            if(record.kill)
             {
-                record->socket.close();
-                m_receiveBuffers.erase(record->socket);
-#if FASTCGIPP_LOG_LEVEL > 3
-                ++m_connectionKillCount;
-#endif
+                socket.close();
+                reactor.receiveBuffers.erase(socket);
+                m_connectionKillCount.add();
+                return true;
             }
+            queue.pop_front();
         }
     }
 
     return true;
 }
 
-void Fastcgipp::Transceiver::handler()
+void Fastcgipp::Transceiver::handler(Reactor& reactor)
 {
     bool flushed=false;
     Socket socket;
 
-    while(!m_terminate && !(m_stop && m_sockets.size()==0))
+    while(!m_terminate && !(m_stop && reactor.sockets.size()==0))
     {
-        socket = m_sockets.poll(flushed);
-        receive(socket);
-        flushed = transmit();
+        socket = reactor.sockets.poll(flushed);
+        receive(reactor, socket);
+        flushed = transmit(reactor);
     }
 }
 
 void Fastcgipp::Transceiver::stop()
 {
     m_stop=true;
-    m_sockets.accept(false);
+    for(auto& reactor: m_reactors)
+        reactor->sockets.accept(false);
 }
 
 void Fastcgipp::Transceiver::terminate()
 {
     m_terminate=true;
-    m_sockets.wake();
+    for(auto& reactor: m_reactors)
+        reactor->sockets.wake();
 }
 
 void Fastcgipp::Transceiver::start()
 {
     m_stop=false;
     m_terminate=false;
-    m_sockets.accept(true);
-    if(!m_thread.joinable())
+    for(auto& reactor: m_reactors)
     {
-        std::thread thread(&Fastcgipp::Transceiver::handler, this);
-        m_thread.swap(thread);
+        if(reactor != m_reactors.front())
+            reactor->sockets.share(m_reactors.front()->sockets);
+        reactor->sockets.accept(true);
     }
+    for(auto& reactor: m_reactors)
+        if(!reactor->thread.joinable())
+        {
+            std::thread thread(
+                    &Fastcgipp::Transceiver::handler,
+                    this,
+                    std::ref(*reactor));
+            reactor->thread.swap(thread);
+        }
 }
 
 void Fastcgipp::Transceiver::join()
 {
-    if(m_thread.joinable())
+    for(auto& reactor: m_reactors)
+        if(reactor->thread.joinable())
+            reactor->thread.join();
+}
+
+void Fastcgipp::Transceiver::resizeReactors(unsigned reactors)
+{
+    for(const auto& reactor: m_reactors)
+        if(reactor->thread.joinable())
+            return;
+
+    const unsigned batchSize = m_reactors.front()->sockets.pollBatchSize();
+    reactors = std::max(reactors, 1U);
+    while(m_reactors.size() > reactors)
+        m_reactors.pop_back();
+    while(m_reactors.size() < reactors)
     {
-        m_thread.join();
+        m_reactors.emplace_back(new Reactor);
+        m_reactors.back()->sockets.pollBatchSize(batchSize);
     }
 }
 
+void Fastcgipp::Transceiver::pollBatchSize(unsigned size)
+{
+    for(auto& reactor: m_reactors)
+        reactor->sockets.pollBatchSize(size);
+}
+
+unsigned long long Fastcgipp::Transceiver::pollWakeups() const
+{
+    unsigned long long wakeups = 0;
+    for(const auto& reactor: m_reactors)
+        wakeups += reactor->sockets.pollWakeups();
+    return wakeups;
+}
+
+unsigned long long Fastcgipp::Transceiver::pollEvents() const
+{
+    unsigned long long events = 0;
+    for(const auto& reactor: m_reactors)
+        events += reactor->sockets.pollEvents();
+    return events;
+}
+
 Fastcgipp::Transceiver::Transceiver(
         const std::function<void(Protocol::RequestId, Message&&)> sendMessage):
-    m_sendMessage(sendMessage)
-#if FASTCGIPP_LOG_LEVEL > 3
-    ,m_connectionKillCount(0),
-    m_connectionRDHupCount(0),
-    m_recordsSent(0),
-    m_recordsQueued(0),
-    m_recordsReceived(0)
-#endif
+    m_sendMessage(sendMessage),
+    m_connectionKillCount(Metrics::registry().counter(
+                "fastcgipp_transceiver_kills_total",
+                "Connections killed after a record asked for it")),
+    m_connectionRDHupCount(Metrics::registry().counter(
+                "fastcgipp_transceiver_hangups_total",
+                "Connections hung up by the other side")),
+    m_recordsSent(Metrics::registry().counter(
+                "fastcgipp_records_sent_total",
+                "Records written to sockets")),
+    m_recordsQueued(Metrics::registry().counter(
+                "fastcgipp_records_queued_total",
+                "Records queued for sending")),
+    m_writes(Metrics::registry().counter(
+                "fastcgipp_gather_writes_total",
+                "Gather writes of queued records")),
+    m_fileWrites(Metrics::registry().counter(
+                "fastcgipp_file_writes_total",
+                "Writes of file segments")),
+    m_recordsReceived(Metrics::registry().counter(
+                "fastcgipp_records_received_total",
+                "Records read from sockets")),
+    m_reads(Metrics::registry().counter(
+                "fastcgipp_socket_reads_total",
+                "Reads from sockets"))
 {
+    m_reactors.emplace_back(new Reactor);
     DIAG_LOG("Transceiver::Transciever(): Initialized")
 }
 
-void Fastcgipp::Transceiver::receive(Socket& socket)
+void Fastcgipp::Transceiver::receive(Reactor& reactor, Socket& socket)
 {
     if(socket.valid())
     {
-        Block& buffer=m_receiveBuffers[socket];
+        // Big enough for the largest possible record
+        const size_t chunkSize = sizeof(Protocol::Header)+0xffff+0xff;
 
-        // Are we receiving a header?
-        if(buffer.size() < sizeof(Protocol::Header))
-        {
-            buffer.reserve(sizeof(Protocol::Header));
+        ReceiveBuffer& buffer=reactor.receiveBuffers[socket];
 
-            const ssize_t read = socket.read(
-                    buffer.begin()+buffer.size(),
-                    buffer.reserve()-buffer.size());
-            if(read<0)
+        if(!buffer.chunk)
+        {
+            buffer.chunk = std::make_shared<Block>();
+            buffer.chunk->reserve(chunkSize);
+        }
+        else if(buffer.chunk->size() == buffer.chunk->reserve())
+        {
+            // We're out of room so move the incomplete record to the start of
+            // a chunk. If nobody else is using the current one we can reuse
+            // it.
+            const Block& old = *buffer.chunk;
+            if(unshared(buffer.chunk))
+            {
+                std::copy(
+                        buffer.chunk->begin()+buffer.offset,
+                        buffer.chunk->end(),
+                        buffer.chunk->begin());
+                buffer.chunk->size(old.size()-buffer.offset);
+            }
+            else
             {
-                cleanupSocket(socket);
-                return;
+                std::shared_ptr<Block> chunk(std::make_shared<Block>());
+                chunk->reserve(chunkSize);
+                chunk->size(old.size()-buffer.offset);
+                std::copy(
+                        old.begin()+buffer.offset,
+                        old.end(),
+                        chunk->begin());
+                buffer.chunk = std::move(chunk);
             }
-            buffer.size(buffer.size() + read);
-            if(buffer.size() < sizeof(Protocol::Header))
-                return;
+            buffer.offset = 0;
         }
 
-        if(buffer.size() == sizeof(Protocol::Header))
-            buffer.reserve(sizeof(Protocol::Header)
-                +reinterpret_cast<Protocol::Header*>(
-                    buffer.begin())->contentLength
-                +reinterpret_cast<Protocol::Header*>(
-                    buffer.begin())->paddingLength);
-
-        Protocol::Header& header
-            = *reinterpret_cast<Protocol::Header*>(buffer.begin());
-
+        Block& chunk = *buffer.chunk;
         const ssize_t read = socket.read(
-                buffer.begin()+buffer.size(),
-                buffer.reserve()-buffer.size());
-
+                chunk.end(),
+                chunk.reserve()-chunk.size());
         if(read<0)
         {
-            cleanupSocket(socket);
+            cleanupSocket(reactor, socket);
             return;
         }
-        buffer.size(buffer.size() + read);
-        if(buffer.size() < buffer.reserve())
-            return;
+        chunk.size(chunk.size() + read);
+        m_reads.add();
 
-        Message message;
-        message.data = std::move(buffer);
+        // Pass on every complete record
+        while(chunk.size()-buffer.offset >= sizeof(Protocol::Header))
+        {
+            char* const record = chunk.begin()+buffer.offset;
+            const Protocol::Header& header
+                = *reinterpret_cast<const Protocol::Header*>(record);
+            const size_t size = sizeof(Protocol::Header)
+                +header.contentLength
+                +header.paddingLength;
+            if(chunk.size()-buffer.offset < size)
+                break;
 
-        m_sendMessage(
-                Protocol::RequestId(header.fcgiId, socket),
-                std::move(message));
-#if FASTCGIPP_LOG_LEVEL > 3
-        ++m_recordsReceived;
-#endif
+            Message message;
+            message.data = Block(buffer.chunk, record, size);
+            buffer.offset += size;
+
+            m_sendMessage(
+                    Protocol::RequestId(header.fcgiId, socket),
+                    std::move(message));
+            m_recordsReceived.add();
+        }
+
+        // Let go of the chunk once everything in it has been passed on so
+        // idle connections don't hold on to one. It goes back to the pool as
+        // soon as the requests are done with their slices and we get a new
+        // one on the next read.
+        if(buffer.offset == chunk.size())
+        {
+            buffer.chunk.reset();
+            buffer.offset = 0;
+        }
     }
 }
 
-void Fastcgipp::Transceiver::cleanupSocket(const Socket& socket)
+void Fastcgipp::Transceiver::cleanupSocket(
+        Reactor& reactor,
+        const Socket& socket)
 {
-    m_receiveBuffers.erase(socket);
+    reactor.receiveBuffers.erase(socket);
+    reactor.sendQueues.erase(socket);
     m_sendMessage(
             Fastcgipp::Protocol::RequestId(Protocol::badFcgiId, socket),
             Message());
     socket.close();
-#if FASTCGIPP_LOG_LEVEL > 3
-    ++m_connectionRDHupCount;
-#endif
+    m_connectionRDHupCount.add();
+}
+
+Fastcgipp::Transceiver::Reactor& Fastcgipp::Transceiver::reactor(
+        const Socket& socket)
+{
+    for(auto& reactor: m_reactors)
+        if(socket.memberOf(reactor->sockets))
+            return *reactor;
+    return *m_reactors.front();
 }
 
 void Fastcgipp::Transceiver::send(
         const Socket& socket,
         Block&& data,
-        bool kill)
+        bool kill,
+        const std::shared_ptr<Trace>& trace)
 {
     std::unique_ptr<Record> record(new Record(
                 socket,
                 std::move(data),
-                kill));
+                kill,
+                trace));
+    Reactor& reactor = this->reactor(socket);
     {
-        std::lock_guard<std::mutex> lock(m_sendBufferMutex);
-        m_sendBuffer.push_back(std::move(record));
+        std::lock_guard<std::mutex> lock(reactor.sendBufferMutex);
+        reactor.sendBuffer.push_back(std::move(record));
     }
-    m_sockets.wake();
-#if FASTCGIPP_LOG_LEVEL > 3
-    ++m_recordsQueued;
-#endif
+    reactor.sockets.wake();
+    m_recordsQueued.add();
+}
+
+void Fastcgipp::Transceiver::send(
+        const Socket& socket,
+        Block&& data,
+        FileSegment&& file)
+{
+    std::unique_ptr<Record> record(new Record(
+                socket,
+                std::move(data),
+                std::move(file)));
+    Reactor& reactor = this->reactor(socket);
+    {
+        std::lock_guard<std::mutex> lock(reactor.sendBufferMutex);
+        reactor.sendBuffer.push_back(std::move(record));
+    }
+    reactor.sockets.wake();
+    m_recordsQueued.add();
 }
 
 Fastcgipp::Transceiver::~Transceiver()
 {
     terminate();
+    join();
     DIAG_LOG("Transceiver::~Transceiver(): Locally closed sockets ==== " \
-            << m_connectionKillCount)
+            << m_connectionKillCount.value())
     DIAG_LOG("Transceiver::~Transceiver(): Remotely closed sockets === " \
-            << m_connectionRDHupCount)
+            << m_connectionRDHupCount.value())
+#if FASTCGIPP_LOG_LEVEL > 3
+    size_t receiveBuffers = 0;
+    for(const auto& reactor: m_reactors)
+        receiveBuffers += reactor->receiveBuffers.size();
+#endif
     DIAG_LOG("Transceiver::~Transceiver(): Remaining receive buffers = " \
-            << m_receiveBuffers.size())
+            << receiveBuffers)
     DIAG_LOG("Transceiver::~Transceiver(): Records queued === " \
-            << m_recordsQueued)
+            << m_recordsQueued.value())
     DIAG_LOG("Transceiver::~Transceiver(): Records sent ===== " \
-            << m_recordsSent)
+            << m_recordsSent.value())
+    DIAG_LOG("Transceiver::~Transceiver(): Gather writes ==== " \
+            << m_writes.value())
+    DIAG_LOG("Transceiver::~Transceiver(): File writes ====== " \
+            << m_fileWrites.value())
     DIAG_LOG("Transceiver::~Transceiver(): Records received = " \
-            << m_recordsReceived)
+            << m_recordsReceived.value())
+    DIAG_LOG("Transceiver::~Transceiver(): Socket reads ===== " \
+            << m_reads.value())
+    DIAG_LOG("Transceiver::~Transceiver(): Reactors ========= " \
+            << m_reactors.size())
 }
@@ -0,0 +1,458 @@
+/*!
+ * @file       utf8.cpp
+ * @brief      Defines the Fastcgipp::Utf8 functions
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 16, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/utf8.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    static_assert(
+            sizeof(wchar_t) == 4,
+            "Wide characters are expected to be UTF-32");
+
+    //! Amount of wide characters checked for ASCII at once
+    const size_t asciiBlock = 16;
+
+    //! Code point a wide character represents once invalid ones are replaced
+    inline uint32_t codePoint(wchar_t character)
+    {
+        const uint32_t point = static_cast<uint32_t>(character);
+        if(point > 0x10ffff || (point >= 0xd800 && point < 0xe000))
+            return Fastcgipp::Utf8::replacement;
+        return point;
+    }
+
+    //! Amount of bytes a valid code point is encoded into
+    inline size_t encodedLength(uint32_t point)
+    {
+        return 1 + (point>0x7f) + (point>0x7ff) + (point>0xffff);
+    }
+
+    //! Encode a valid code point
+    /*!
+     * @return 1+ the last byte written
+     */
+    inline char* put(uint32_t point, char* to)
+    {
+        if(point < 0x80)
+            *to++ = static_cast<char>(point);
+        else if(point < 0x800)
+        {
+            *to++ = static_cast<char>(0xc0 | point>>6);
+            *to++ = static_cast<char>(0x80 | (point & 0x3f));
+        }
+        else if(point < 0x10000)
+        {
+            *to++ = static_cast<char>(0xe0 | point>>12);
+            *to++ = static_cast<char>(0x80 | (point>>6 & 0x3f));
+            *to++ = static_cast<char>(0x80 | (point & 0x3f));
+        }
+        else
+        {
+            *to++ = static_cast<char>(0xf0 | point>>18);
+            *to++ = static_cast<char>(0x80 | (point>>12 & 0x3f));
+            *to++ = static_cast<char>(0x80 | (point>>6 & 0x3f));
+            *to++ = static_cast<char>(0x80 | (point & 0x3f));
+        }
+        return to;
+    }
+
+    //! Copy the ASCII at the start of the next asciiBlock wide characters
+    /*!
+     * All asciiBlock bytes may be written to regardless of how many are
+     * ASCII.
+     *
+     * @return Amount of leading wide characters that were ASCII
+     */
+    inline size_t copyAscii(const wchar_t* from, char* to)
+    {
+#if defined(__SSE2__)
+        const __m128i* const in = reinterpret_cast<const __m128i*>(from);
+        const __m128i mask = _mm_set1_epi32(~0x7f);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i a = _mm_loadu_si128(in);
+        const __m128i b = _mm_loadu_si128(in+1);
+        const __m128i c = _mm_loadu_si128(in+2);
+        const __m128i d = _mm_loadu_si128(in+3);
+
+        const unsigned ascii = _mm_movemask_epi8(_mm_packs_epi16(
+                    _mm_packs_epi32(
+                        _mm_cmpeq_epi32(_mm_and_si128(a, mask), zero),
+                        _mm_cmpeq_epi32(_mm_and_si128(b, mask), zero)),
+                    _mm_packs_epi32(
+                        _mm_cmpeq_epi32(_mm_and_si128(c, mask), zero),
+                        _mm_cmpeq_epi32(_mm_and_si128(d, mask), zero))));
+
+        _mm_storeu_si128(
+                reinterpret_cast<__m128i*>(to),
+                _mm_packus_epi16(
+                    _mm_packs_epi32(a, b),
+                    _mm_packs_epi32(c, d)));
+
+        return ascii == 0xffff ? asciiBlock : __builtin_ctz(~ascii);
+#else
+        size_t count = 0;
+        while(count < asciiBlock && static_cast<uint32_t>(from[count]) < 0x80)
+        {
+            to[count] = static_cast<char>(from[count]);
+            ++count;
+        }
+        return count;
+#endif
+    }
+
+    //! Decode a single UTF-8 sequence that doesn't start with ASCII
+    /*!
+     * Only the maximal part of a malformed sequence is consumed so decoding
+     * can pick up again at the next byte that could start a sequence.
+     *
+     * @param[in,out] from First byte of the sequence. Moved to 1+ the last
+     *                     byte consumed.
+     * @param[in] fromEnd 1+ the last byte
+     * @return The code point or an invalid one if the sequence is malformed
+     */
+    inline uint32_t take(
+            const unsigned char*& from,
+            const unsigned char* fromEnd)
+    {
+        const uint32_t malformed = 0xffffffff;
+        const unsigned char lead = *from++;
+
+        // Amount of continuation bytes and the range the first one must be in
+        // to rule out overlong forms, surrogates and anything past U+10FFFF.
+        unsigned continuations;
+        unsigned char low = 0x80;
+        unsigned char high = 0xbf;
+        uint32_t point;
+        if(lead >= 0xc2 && lead <= 0xdf)
+        {
+            continuations = 1;
+            point = lead & 0x1f;
+        }
+        else if(lead >= 0xe0 && lead <= 0xef)
+        {
+            continuations = 2;
+            point = lead & 0x0f;
+            if(lead == 0xe0)
+                low = 0xa0;
+            else if(lead == 0xed)
+                high = 0x9f;
+        }
+        else if(lead >= 0xf0 && lead <= 0xf4)
+        {
+            continuations = 3;
+            point = lead & 0x07;
+            if(lead == 0xf0)
+                low = 0x90;
+            else if(lead == 0xf4)
+                high = 0x8f;
+        }
+        else
+            return malformed;
+
+        if(from == fromEnd || *from < low || *from > high)
+            return malformed;
+        point = point<<6 | (*from++ & 0x3f);
+
+        while(--continuations)
+        {
+            if(from == fromEnd || (*from & 0xc0) != 0x80)
+                return malformed;
+            point = point<<6 | (*from++ & 0x3f);
+        }
+        return point;
+    }
+
+    //! Widen the ASCII at the start of the next asciiBlock bytes
+    /*!
+     * All asciiBlock wide characters may be written to regardless of how
+     * many bytes are ASCII.
+     *
+     * @return Amount of leading bytes that were ASCII
+     */
+    inline size_t widenAscii(const unsigned char* from, wchar_t* to)
+    {
+#if defined(__SSE2__)
+        const __m128i bytes = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(from));
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+        __m128i* const out = reinterpret_cast<__m128i*>(to);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(low, zero));
+        _mm_storeu_si128(out+1, _mm_unpackhi_epi16(low, zero));
+        _mm_storeu_si128(out+2, _mm_unpacklo_epi16(high, zero));
+        _mm_storeu_si128(out+3, _mm_unpackhi_epi16(high, zero));
+
+        const unsigned other = _mm_movemask_epi8(bytes);
+        return other == 0 ? asciiBlock : __builtin_ctz(other);
+#else
+        size_t count = 0;
+        while(count < asciiBlock && from[count] < 0x80)
+        {
+            to[count] = from[count];
+            ++count;
+        }
+        return count;
+#endif
+    }
+}
+
+#if defined(__SSE2__)
+namespace
+{
+    //! Swap invalid code points for the replacement character
+    inline __m128i validate(__m128i point)
+    {
+        const __m128i invalid = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_cmplt_epi32(point, _mm_setzero_si128()),
+                    _mm_cmpgt_epi32(point, _mm_set1_epi32(0x10ffff))),
+                _mm_cmpeq_epi32(
+                    _mm_srli_epi32(point, 11),
+                    _mm_set1_epi32(0xd800>>11)));
+        return _mm_or_si128(
+                _mm_andnot_si128(invalid, point),
+                _mm_and_si128(
+                    invalid,
+                    _mm_set1_epi32(Fastcgipp::Utf8::replacement)));
+    }
+
+    //! Encode four code points from the basic multilingual plane
+    /*!
+     * The encoding of every code point is built in it's own lane and then
+     * written out four bytes at a time with only the encoded length kept.
+     * This means there are no branches to mispredict when text switches
+     * between ASCII and everything else. Three bytes past the encoded
+     * output may be written to.
+     *
+     * @return 1+ the last byte written
+     */
+    inline char* encodeBmp(__m128i point, char* to)
+    {
+        const __m128i sixBits = _mm_set1_epi32(0x3f);
+        const __m128i continuation = _mm_set1_epi32(0x80);
+        const __m128i x = _mm_or_si128(
+                _mm_and_si128(point, sixBits),
+                continuation);
+        const __m128i y = _mm_or_si128(
+                _mm_and_si128(_mm_srli_epi32(point, 6), sixBits),
+                continuation);
+
+        const __m128i two = _mm_or_si128(
+                _mm_or_si128(_mm_srli_epi32(point, 6), _mm_set1_epi32(0xc0)),
+                _mm_slli_epi32(x, 8));
+        const __m128i three = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_srli_epi32(point, 12),
+                    _mm_set1_epi32(0xe0)),
+                _mm_or_si128(_mm_slli_epi32(y, 8), _mm_slli_epi32(x, 16)));
+
+        const __m128i isTwo = _mm_cmpgt_epi32(point, _mm_set1_epi32(0x7f));
+        const __m128i isThree = _mm_cmpgt_epi32(point, _mm_set1_epi32(0x7ff));
+        const __m128i encoding = _mm_or_si128(
+                _mm_andnot_si128(isTwo, point),
+                _mm_or_si128(
+                    _mm_and_si128(_mm_andnot_si128(isThree, isTwo), two),
+                    _mm_and_si128(isThree, three)));
+        const unsigned twos = _mm_movemask_ps(_mm_castsi128_ps(isTwo));
+        const unsigned threes = _mm_movemask_ps(_mm_castsi128_ps(isThree));
+
+        __m128i remaining = encoding;
+        for(unsigned i=0; i<4; ++i)
+        {
+            const uint32_t bytes = _mm_cvtsi128_si32(remaining);
+            std::memcpy(to, &bytes, 4);
+            to += 1 + (twos>>i & 1) + (threes>>i & 1);
+            remaining = _mm_srli_si128(remaining, 4);
+        }
+        return to;
+    }
+}
+#endif
+
+size_t Fastcgipp::Utf8::length(const wchar_t* from, const wchar_t* fromEnd)
+{
+    size_t length = fromEnd-from;
+
+#if defined(__SSE2__)
+    // Count the extra bytes four code points at a time without branching.
+    // Invalid code points are swapped for the replacement character first.
+    const __m128i* in = reinterpret_cast<const __m128i*>(from);
+    const __m128i* const inEnd = in + (fromEnd-from)/4;
+    while(in != inEnd)
+    {
+        __m128i extra = _mm_setzero_si128();
+        const __m128i* const batchEnd = in + std::min(
+                size_t(0x1000),
+                size_t(inEnd-in));
+        while(in != batchEnd)
+        {
+            const __m128i point = validate(_mm_loadu_si128(in++));
+            extra = _mm_sub_epi32(
+                    extra,
+                    _mm_cmpgt_epi32(point, _mm_set1_epi32(0x7f)));
+            extra = _mm_sub_epi32(
+                    extra,
+                    _mm_cmpgt_epi32(point, _mm_set1_epi32(0x7ff)));
+            extra = _mm_sub_epi32(
+                    extra,
+                    _mm_cmpgt_epi32(point, _mm_set1_epi32(0xffff)));
+        }
+        uint32_t lanes[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), extra);
+        length += size_t(lanes[0])+lanes[1]+lanes[2]+lanes[3];
+    }
+    from = reinterpret_cast<const wchar_t*>(in);
+#endif
+
+    while(from != fromEnd)
+    {
+        length += encodedLength(codePoint(*from++))-1;
+    }
+    return length;
+}
+
+void Fastcgipp::Utf8::encode(
+        const wchar_t* from,
+        const wchar_t* fromEnd,
+        const wchar_t*& fromNext,
+        char* to,
+        char* toEnd,
+        char*& toNext)
+{
+    while(from != fromEnd)
+    {
+        if(size_t(fromEnd-from) >= asciiBlock
+                && size_t(toEnd-to) >= asciiBlock*maxLength)
+        {
+            const size_t ascii = copyAscii(from, to);
+            from += ascii;
+            to += ascii;
+            if(ascii == asciiBlock)
+                continue;
+#if defined(__SSE2__)
+            if(size_t(fromEnd-from) >= asciiBlock)
+            {
+                const __m128i* const in
+                    = reinterpret_cast<const __m128i*>(from);
+                const __m128i a = validate(_mm_loadu_si128(in));
+                const __m128i b = validate(_mm_loadu_si128(in+1));
+                const __m128i c = validate(_mm_loadu_si128(in+2));
+                const __m128i d = validate(_mm_loadu_si128(in+3));
+                const __m128i bmp = _mm_set1_epi32(0xffff);
+                if(_mm_movemask_epi8(_mm_or_si128(
+                            _mm_or_si128(
+                                _mm_cmpgt_epi32(a, bmp),
+                                _mm_cmpgt_epi32(b, bmp)),
+                            _mm_or_si128(
+                                _mm_cmpgt_epi32(c, bmp),
+                                _mm_cmpgt_epi32(d, bmp)))) == 0)
+                {
+                    to = encodeBmp(a, to);
+                    to = encodeBmp(b, to);
+                    to = encodeBmp(c, to);
+                    to = encodeBmp(d, to);
+                    from += asciiBlock;
+                    continue;
+                }
+            }
+#endif
+        }
+
+        // Go one at a time until the next chance at a block
+        const wchar_t* const end = from + std::min(
+                asciiBlock,
+                size_t(fromEnd-from));
+        while(from != end)
+        {
+            const uint32_t point = codePoint(*from);
+            if(size_t(toEnd-to) < encodedLength(point))
+                goto done;
+            to = put(point, to);
+            ++from;
+        }
+    }
+
+done:
+    fromNext = from;
+    toNext = to;
+}
+
+wchar_t Fastcgipp::Utf8::inputReplacement = Fastcgipp::Utf8::replacement;
+
+wchar_t* Fastcgipp::Utf8::decode(
+        const char* from,
+        const char* fromEnd,
+        wchar_t* to,
+        wchar_t replacement)
+{
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(from);
+    const unsigned char* const inEnd
+        = reinterpret_cast<const unsigned char*>(fromEnd);
+
+    while(in != inEnd)
+    {
+        // There is always room for as many wide characters as bytes left
+        if(size_t(inEnd-in) >= asciiBlock)
+        {
+            const size_t ascii = widenAscii(in, to);
+            in += ascii;
+            to += ascii;
+            if(ascii == asciiBlock)
+                continue;
+        }
+
+        // Go one at a time until the next chance at a block
+        const unsigned char* const end = in + std::min(
+                asciiBlock,
+                size_t(inEnd-in));
+        while(in < end)
+        {
+            if(*in < 0x80)
+                *to++ = *in++;
+            else
+            {
+                const uint32_t point = take(in, inEnd);
+                if(point <= 0x10ffff)
+                    *to++ = static_cast<wchar_t>(point);
+                else if(replacement != 0)
+                    *to++ = replacement;
+            }
+        }
+    }
+
+    return to;
+}
@@ -29,6 +29,13 @@
 #include "fastcgi++/log.hpp"
 
 #include <algorithm>
+#include <array>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 template
 std::basic_ostream<wchar_t, std::char_traits<wchar_t>>& Fastcgipp::operator<<(
@@ -57,87 +64,149 @@ std::basic_ostream<charT, traits>& Fastcgipp::operator<<(
     return os;
 }
 
-namespace Fastcgipp
+namespace
 {
-    template <>
-    const std::map<char, const std::basic_string<char>>
-    Fastcgipp::WebStreambuf<char, std::char_traits<char>>::htmlCharacters
+    //! Escape sequence for a single character
+    struct Escape
     {
-        std::make_pair('"', "&quot;"),
-        std::make_pair('>', "&gt;"),
-        std::make_pair('<', "&lt;"),
-        std::make_pair('&', "&amp;"),
-        std::make_pair(0x27, "&apos;")
+        //! The sequence itself. Null if the character is left alone.
+        const char* sequence;
+
+        //! Size of the sequence
+        unsigned char size;
     };
 
-    template <>
-    const std::map<wchar_t, const std::basic_string<wchar_t>>
-    Fastcgipp::WebStreambuf<wchar_t, std::char_traits<wchar_t>>::htmlCharacters
+    //! Escape sequences indexed by character
+    typedef std::array<Escape, 256> EscapeTable;
+
+    EscapeTable makeTable(
+            std::initializer_list<std::pair<unsigned char, const char*>> list)
     {
-        std::make_pair('"', L"&quot;"),
-        std::make_pair('>', L"&gt;"),
-        std::make_pair('<', L"&lt;"),
-        std::make_pair('&', L"&amp;"),
-        std::make_pair(0x27, L"&apos;")
-    };
+        EscapeTable table;
+        table.fill(Escape{nullptr, 0});
+        for(const auto& escape: list)
+            table[escape.first] = Escape{
+                escape.second,
+                static_cast<unsigned char>(std::strlen(escape.second))};
+        return table;
+    }
+
+    const EscapeTable htmlEscapes = makeTable({
+        {'"', "&quot;"},
+        {'>', "&gt;"},
+        {'<', "&lt;"},
+        {'&', "&amp;"},
+        {0x27, "&apos;"}
+    });
+
+    const EscapeTable urlEscapes = makeTable({
+        {'!', "%21"},
+        {']', "%5D"},
+        {'[', "%5B"},
+        {'#', "%23"},
+        {'?', "%3F"},
+        {'/', "%2F"},
+        {',', "%2C"},
+        {'$', "%24"},
+        {'+', "%2B"},
+        {'=', "%3D"},
+        {'&', "%26"},
+        {'@', "%40"},
+        {':', "%3A"},
+        {';', "%3B"},
+        {')', "%29"},
+        {'(', "%28"},
+        {0x27, "%27"},
+        {'*', "%2A"},
+        {'<', "%3C"},
+        {'>', "%3E"},
+        {'"', "%22"},
+        {' ', "%20"},
+        {'%', "%25"}
+    });
 
-    template <>
-    const std::map<char, const std::basic_string<char>>
-    Fastcgipp::WebStreambuf<char, std::char_traits<char>>::urlCharacters
+    //! Escape sequence for a character
+    inline const Escape& escape(const EscapeTable& table, const char c)
     {
-        std::make_pair('!', "%21"),
-        std::make_pair(']', "%5D"),
-        std::make_pair('[', "%5B"),
-        std::make_pair('#', "%23"),
-        std::make_pair('?', "%3F"),
-        std::make_pair('/', "%2F"),
-        std::make_pair(',', "%2C"),
-        std::make_pair('$', "%24"),
-        std::make_pair('+', "%2B"),
-        std::make_pair('=', "%3D"),
-        std::make_pair('&', "%26"),
-        std::make_pair('@', "%40"),
-        std::make_pair(':', "%3A"),
-        std::make_pair(';', "%3B"),
-        std::make_pair(')', "%29"),
-        std::make_pair('(', "%28"),
-        std::make_pair(0x27, "%27"),
-        std::make_pair('*', "%2A"),
-        std::make_pair('<', "%3C"),
-        std::make_pair('>', "%3E"),
-        std::make_pair('"', "%22"),
-        std::make_pair(' ', "%20"),
-        std::make_pair('%', "%25")
-    };
+        return table[static_cast<unsigned char>(c)];
+    }
 
-    template <>
-    const std::map<wchar_t, const std::basic_string<wchar_t>>
-    Fastcgipp::WebStreambuf<wchar_t, std::char_traits<wchar_t>>::urlCharacters
+    //! Escape sequence for a character
+    inline const Escape& escape(const EscapeTable& table, const wchar_t c)
     {
-        std::make_pair('!', L"%21"),
-        std::make_pair(']', L"%5D"),
-        std::make_pair('[', L"%5B"),
-        std::make_pair('#', L"%23"),
-        std::make_pair('?', L"%3F"),
-        std::make_pair('/', L"%2F"),
-        std::make_pair(',', L"%2C"),
-        std::make_pair('$', L"%24"),
-        std::make_pair('+', L"%2B"),
-        std::make_pair('=', L"%3D"),
-        std::make_pair('&', L"%26"),
-        std::make_pair('@', L"%40"),
-        std::make_pair(':', L"%3A"),
-        std::make_pair(';', L"%3B"),
-        std::make_pair(')', L"%29"),
-        std::make_pair('(', L"%28"),
-        std::make_pair(0x27, L"%27"),
-        std::make_pair('*', L"%2A"),
-        std::make_pair('<', L"%3C"),
-        std::make_pair('>', L"%3E"),
-        std::make_pair('"', L"%22"),
-        std::make_pair(' ', L"%20"),
-        std::make_pair('%', L"%25")
-    };
+        static const Escape none{nullptr, 0};
+        return c>=0 && c<256 ? table[c] : none;
+    }
+
+    //! Find the first character that needs escaping
+    template<class charT>
+    inline const charT* findEscape(
+            const EscapeTable& table,
+            const charT* start,
+            const charT* const end)
+    {
+        while(start != end && escape(table, *start).sequence == nullptr)
+            ++start;
+        return start;
+    }
+
+#if defined(__SSE2__)
+    //! Bit mask of the bytes of characters that need HTML escaping
+    inline unsigned htmlMask(const __m128i characters, char)
+    {
+        return _mm_movemask_epi8(_mm_or_si128(
+                    _mm_or_si128(
+                        _mm_or_si128(
+                            _mm_cmpeq_epi8(characters, _mm_set1_epi8('"')),
+                            _mm_cmpeq_epi8(characters, _mm_set1_epi8('>'))),
+                        _mm_or_si128(
+                            _mm_cmpeq_epi8(characters, _mm_set1_epi8('<')),
+                            _mm_cmpeq_epi8(characters, _mm_set1_epi8('&')))),
+                    _mm_cmpeq_epi8(characters, _mm_set1_epi8(0x27))));
+    }
+
+    //! Bit mask of the bytes of characters that need HTML escaping
+    inline unsigned htmlMask(const __m128i characters, wchar_t)
+    {
+        return _mm_movemask_epi8(_mm_or_si128(
+                    _mm_or_si128(
+                        _mm_or_si128(
+                            _mm_cmpeq_epi32(characters, _mm_set1_epi32('"')),
+                            _mm_cmpeq_epi32(characters, _mm_set1_epi32('>'))),
+                        _mm_or_si128(
+                            _mm_cmpeq_epi32(characters, _mm_set1_epi32('<')),
+                            _mm_cmpeq_epi32(characters, _mm_set1_epi32('&')))),
+                    _mm_cmpeq_epi32(characters, _mm_set1_epi32(0x27))));
+    }
+#endif
+
+    //! Find the first character that needs HTML escaping
+    /*!
+     * With SSE2 a whole vector of characters is compared against all five of
+     * them at once.
+     */
+    template<class charT>
+    inline const charT* findHtmlEscape(
+            const charT* start,
+            const charT* const end)
+    {
+#if defined(__SSE2__)
+        if(sizeof(charT) == 1 || sizeof(charT) == 4)
+        {
+            const size_t width = sizeof(__m128i)/sizeof(charT);
+            for(; size_t(end-start) >= width; start += width)
+            {
+                const unsigned mask = htmlMask(
+                        _mm_loadu_si128(
+                            reinterpret_cast<const __m128i*>(start)),
+                        charT());
+                if(mask)
+                    return start + __builtin_ctz(mask)/sizeof(charT);
+            }
+        }
+#endif
+        return findEscape(htmlEscapes, start, end);
+    }
 }
 
 template <class charT, class traits>
@@ -160,39 +229,41 @@ std::streamsize Fastcgipp::WebStreambuf<charT, traits>::xsputn(
         }
         else
         {
-            const std::map<charT, const std::basic_string<charT>>* map;
-            if(m_encoding == Encoding::HTML)
-                map = &htmlCharacters;
-            else
-                map = &urlCharacters;
+            const EscapeTable& table = m_encoding == Encoding::HTML
+                ? htmlEscapes
+                : urlEscapes;
 
             while(s<end)
             {
-                const size_t writeSpace = this->epptr() - this->pptr();
-                const auto mapping = map->find(*s);
-                if(mapping == map->cend())
-                {
-                    if(writeSpace < 1)
-                        break;
-                    *this->pptr() = *s++;
-                    this->pbump(1);
-                }
-                else
-                {
-                    if(writeSpace < mapping->second.size())
-                        break;
-                    std::copy(
-                            mapping->second.cbegin(),
-                            mapping->second.cend(),
-                            this->pptr());
-                    this->pbump(mapping->second.size());
-                    ++s;
-                }
+                // Copy everything up to the next escape in one go. The search
+                // stops where the put area does so no character is scanned
+                // twice.
+                const char_type* const limit = s + std::min(
+                        end-s,
+                        this->epptr()-this->pptr());
+                const char_type* const unsafe = m_encoding == Encoding::HTML
+                    ? findHtmlEscape(s, limit)
+                    : findEscape(table, s, limit);
+                traits_type::copy(this->pptr(), s, unsafe-s);
+                this->pbump(unsafe-s);
+                s = unsafe;
+                if(s == limit)
+                    break;
+
+                const Escape& sequence = escape(table, *s);
+                if(this->epptr()-this->pptr() < sequence.size)
+                    break;
+                std::copy(
+                        sequence.sequence,
+                        sequence.sequence+sequence.size,
+                        this->pptr());
+                this->pbump(sequence.size);
+                ++s;
             }
         }
 
         if(s<end)
-            this->sync();
+            emptyBuffer();
         else
             break;
     }
@@ -0,0 +1,87 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/arena.hpp"
+#include "fastcgi++/block.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+int main()
+{
+    // Allocation and alignment
+    {
+        Fastcgipp::Arena arena(128);
+        if(arena.size() != 0 || arena.chunks() != 0)
+            FAIL_LOG("Arena allocated memory on construction")
+
+        char* const first = static_cast<char*>(arena.allocate(3, 1));
+        char* const second = static_cast<char*>(arena.allocate(3, 1));
+        if(second != first+3)
+            FAIL_LOG("Arena didn't allocate sequentially")
+
+        char* const aligned = static_cast<char*>(arena.allocate(8, 8));
+        if(reinterpret_cast<uintptr_t>(aligned) % 8 != 0)
+            FAIL_LOG("Arena didn't align an allocation")
+
+        const void* const big = arena.allocate(100000, 16);
+        if(big == nullptr || reinterpret_cast<uintptr_t>(big) % 16 != 0)
+            FAIL_LOG("Arena didn't handle an allocation bigger than a chunk")
+
+        char* const third = static_cast<char*>(arena.allocate(3, 1));
+        if(third != aligned+8)
+            FAIL_LOG("Arena abandoned it's chunk for an oversized allocation")
+
+        const auto outstanding = Fastcgipp::BlockPool::outstanding();
+        arena.release();
+        if(arena.size() != 0 || arena.chunks() != 0)
+            FAIL_LOG("Arena isn't empty after release")
+        if(Fastcgipp::BlockPool::outstanding() != outstanding-2)
+            FAIL_LOG("Arena didn't give it's chunks back to the BlockPool")
+    }
+
+    // Standard containers
+    {
+        const auto outstanding = Fastcgipp::BlockPool::outstanding();
+        {
+            Fastcgipp::Arena arena;
+            typedef std::basic_string<
+                char,
+                std::char_traits<char>,
+                Fastcgipp::ArenaAllocator<char>> String;
+            std::map<
+                String,
+                String,
+                std::less<String>,
+                Fastcgipp::ArenaAllocator<std::pair<const String, String>>>
+                    map(&arena);
+
+            for(unsigned i=0; i<1000; ++i)
+                map.emplace(
+                        std::piecewise_construct,
+                        std::forward_as_tuple(
+                            std::to_string(i).c_str(),
+                            &arena),
+                        std::forward_as_tuple(
+                            "a value long enough to need allocation",
+                            &arena));
+            if(map.size() != 1000 || map.find("500") == map.end())
+                FAIL_LOG("ArenaAllocator broke a std::map")
+            if(map.begin()->second.get_allocator().arena() != &arena)
+                FAIL_LOG("ArenaAllocator isn't using the arena")
+
+            const String copy(map.begin()->second);
+            if(copy.get_allocator().arena() != nullptr)
+                FAIL_LOG("ArenaAllocator copied a container into the arena")
+
+            std::vector<int, Fastcgipp::ArenaAllocator<int>> heap;
+            heap.assign(100, 7);
+            if(heap.size() != 100 || heap.back() != 7)
+                FAIL_LOG("Default ArenaAllocator broke a std::vector")
+        }
+        if(Fastcgipp::BlockPool::outstanding() != outstanding)
+            FAIL_LOG("Arena leaked memory")
+    }
+
+    return 0;
+}
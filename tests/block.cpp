@@ -0,0 +1,155 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/block.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+const char text[] = "The quick brown fox jumps over the lazy dog";
+
+int main()
+{
+    // Reserve and size semantics
+    {
+        Fastcgipp::Block block(text, sizeof(text));
+        if(block.size() != sizeof(text) || block.reserve() != sizeof(text))
+            FAIL_LOG("Block has the wrong size on construction")
+        if(std::memcmp(block.begin(), text, sizeof(text)) != 0)
+            FAIL_LOG("Block didn't copy the data on construction")
+
+        block.reserve(10);
+        if(block.size() != 10 || block.reserve() != 10)
+            FAIL_LOG("Block didn't shrink it's reserve")
+        if(std::memcmp(block.begin(), text, 10) != 0)
+            FAIL_LOG("Block lost it's data shrinking the reserve")
+
+        block.reserve(100000);
+        if(block.size() != 10 || block.reserve() != 100000)
+            FAIL_LOG("Block didn't grow it's reserve")
+        if(std::memcmp(block.begin(), text, 10) != 0)
+            FAIL_LOG("Block lost it's data growing the reserve")
+
+        block.size(50);
+        block.assign(text, sizeof(text));
+        if(block.size() != sizeof(text) || block.reserve() != 100000)
+            FAIL_LOG("Block has the wrong size after assign")
+
+        block.clear();
+        if(block.size() != 0 || block.reserve() != 0 || block.begin())
+            FAIL_LOG("Block isn't empty after clear")
+    }
+
+    // Growing within the size class shouldn't reallocate
+    {
+        Fastcgipp::Block block(8);
+        const char* const data = block.begin();
+        std::copy(text, text+8, block.begin());
+        const auto allocations = Fastcgipp::BlockPool::allocations();
+        block.reserve(64);
+        if(block.begin() != data)
+            FAIL_LOG("Block reallocated within it's size class")
+        if(Fastcgipp::BlockPool::allocations() != allocations)
+            FAIL_LOG("BlockPool counted an allocation that didn't happen")
+        if(block.size() != 8 || std::memcmp(block.begin(), text, 8) != 0)
+            FAIL_LOG("Block lost it's data growing within it's size class")
+    }
+
+    // Freed chunks get reused
+    {
+        const char* data;
+        {
+            Fastcgipp::Block block(1000);
+            data = block.begin();
+        }
+        const auto heapAllocations = Fastcgipp::BlockPool::heapAllocations();
+        Fastcgipp::Block block(900);
+        if(block.begin() != data)
+            FAIL_LOG("BlockPool didn't reuse a freed chunk")
+        if(Fastcgipp::BlockPool::heapAllocations() != heapAllocations)
+            FAIL_LOG("BlockPool went to the heap for a cached chunk")
+    }
+
+    // Moving transfers ownership
+    {
+        Fastcgipp::Block source(text, sizeof(text));
+        const char* const data = source.begin();
+        Fastcgipp::Block destination(100);
+        destination = std::move(source);
+        if(destination.begin() != data || destination.size() != sizeof(text))
+            FAIL_LOG("Block didn't take ownership on move assignment")
+        if(source.begin() || source.size() || source.reserve())
+            FAIL_LOG("Block isn't empty after being moved from")
+    }
+
+    // Slices share memory with their chunk
+    {
+        std::shared_ptr<Fastcgipp::Block> chunk(
+                new Fastcgipp::Block(text, sizeof(text)));
+        const auto allocations = Fastcgipp::BlockPool::allocations();
+        Fastcgipp::Block first(chunk, chunk->begin(), 3);
+        Fastcgipp::Block second(chunk, chunk->begin()+4, 5);
+        if(Fastcgipp::BlockPool::allocations() != allocations)
+            FAIL_LOG("Block slice allocated memory")
+        if(!first.slice() || first.begin() != chunk->begin()
+                || first.size() != 3 || first.reserve() != 3)
+            FAIL_LOG("Block slice doesn't point into it's chunk")
+        if(std::memcmp(second.begin(), "quick", 5) != 0)
+            FAIL_LOG("Block slice has the wrong data")
+
+        const char* const data = chunk->begin();
+        chunk.reset();
+        if(first.begin() != data || std::memcmp(first.begin(), "The", 3) != 0)
+            FAIL_LOG("Block slice didn't keep it's chunk alive")
+
+        Fastcgipp::Block moved(std::move(second));
+        if(!moved.slice() || second.slice() || moved.begin() != data+4)
+            FAIL_LOG("Block slice wasn't moved properly")
+
+        moved.reserve(100);
+        if(moved.slice() || moved.size() != 5
+                || std::memcmp(moved.begin(), "quick", 5) != 0)
+            FAIL_LOG("Block slice didn't copy it's data when growing")
+    }
+
+    // Assigning to a slice leaves it's chunk alone
+    {
+        std::shared_ptr<Fastcgipp::Block> chunk(
+                new Fastcgipp::Block(text, sizeof(text)));
+        Fastcgipp::Block slice(chunk, chunk->begin()+4, 5);
+        slice.assign("red", 3);
+        if(slice.slice() || slice.size() != 3
+                || std::memcmp(slice.begin(), "red", 3) != 0)
+            FAIL_LOG("Block slice wasn't assigned properly")
+        if(std::memcmp(chunk->begin(), text, sizeof(text)) != 0)
+            FAIL_LOG("Block slice assignment wrote over it's chunk")
+    }
+
+    // Allocate in one thread and free in another
+    {
+        const auto outstanding = Fastcgipp::BlockPool::outstanding();
+        std::vector<Fastcgipp::Block> blocks;
+        std::thread producer([&blocks] ()
+        {
+            for(unsigned i=0; i<10000; ++i)
+                blocks.emplace_back(text, i%sizeof(text)+1);
+        });
+        producer.join();
+        if(Fastcgipp::BlockPool::outstanding() != outstanding+10000)
+            FAIL_LOG("BlockPool has the wrong amount of outstanding chunks")
+
+        std::thread consumer([&blocks] ()
+        {
+            for(auto& block: blocks)
+                if(std::memcmp(block.begin(), text, block.size()) != 0)
+                    FAIL_LOG("Block data was corrupted crossing threads")
+            blocks.clear();
+        });
+        consumer.join();
+        if(Fastcgipp::BlockPool::outstanding() != outstanding)
+            FAIL_LOG("BlockPool leaked chunks freed in another thread")
+    }
+
+    return 0;
+}
@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <iostream>
 #include <string>
+#include <vector>
 
 unsigned called;
 
@@ -302,6 +303,186 @@ void checker(const Fastcgipp::Socket& socket, Fastcgipp::Block&& record)
     ++called;
 }
 
+//! Collects everything written to a WebStreambuf through a tiny buffer
+template<class charT>
+class Collector: public Fastcgipp::WebStreambuf<charT>
+{
+public:
+    std::basic_string<charT> output;
+
+    Collector()
+    {
+        this->setp(m_buffer, m_buffer+sizeof(m_buffer)/sizeof(charT));
+    }
+
+private:
+    charT m_buffer[13];
+
+    bool emptyBuffer()
+    {
+        output.append(this->pbase(), this->pptr());
+        this->setp(m_buffer, m_buffer+sizeof(m_buffer)/sizeof(charT));
+        return true;
+    }
+};
+
+//! The way escaping is supposed to come out
+template<class charT>
+std::basic_string<charT> escape(
+        const std::basic_string<charT>& input,
+        Fastcgipp::Encoding encoding)
+{
+    static const std::string html("\"><&'");
+    static const std::string url("!][#?/,$+=&@:;)('*<>\" %");
+    static const char hex[] = "0123456789ABCDEF";
+
+    std::basic_string<charT> output;
+    for(const charT c: input)
+    {
+        if(encoding == Fastcgipp::Encoding::HTML
+                && c>=0 && c<128 && html.find(char(c)) != std::string::npos)
+        {
+            std::string entity;
+            switch(c)
+            {
+                case '"': entity = "&quot;"; break;
+                case '>': entity = "&gt;"; break;
+                case '<': entity = "&lt;"; break;
+                case '&': entity = "&amp;"; break;
+                default: entity = "&apos;"; break;
+            }
+            output.append(entity.begin(), entity.end());
+        }
+        else if(encoding == Fastcgipp::Encoding::URL
+                && c>=0 && c<128 && url.find(char(c)) != std::string::npos)
+        {
+            output.push_back('%');
+            output.push_back(hex[c>>4]);
+            output.push_back(hex[c&0x0f]);
+        }
+        else
+            output.push_back(c);
+    }
+    return output;
+}
+
+//! Escape every substring of some symbol heavy text in one go
+template<class charT>
+void testEscaping(const std::basic_string<charT>& text)
+{
+    using Fastcgipp::Encoding;
+
+    for(const Encoding encoding: {Encoding::HTML, Encoding::URL})
+        for(size_t length=1; length<=text.size(); length += 7)
+        {
+            const std::basic_string<charT> input(text, 0, length);
+            Collector<charT> collector;
+            std::basic_ostream<charT> out(&collector);
+            out << encoding << input << Encoding::NONE << input;
+            out.flush();
+
+            if(collector.output != escape(input, encoding)+input)
+                FAIL_LOG("Fastcgipp::WebStreambuf didn't escape properly "\
+                        "with " << sizeof(charT) << " byte characters")
+        }
+}
+
+//! Check that a large buffer fills complete records without losing anything
+template<class charT>
+void testRecordFilling()
+{
+    const size_t total = 200000;
+    std::string received;
+    std::vector<size_t> sizes;
+
+    {
+        Fastcgipp::FcgiStreambuf<charT> streambuf;
+        streambuf.configure(
+                Fastcgipp::Protocol::RequestId(
+                    FCGIID,
+                    Fastcgipp::Socket()),
+                Fastcgipp::Protocol::RecordType::OUT,
+                [&] (const Fastcgipp::Socket&, Fastcgipp::Block&& record)
+                {
+                    if(record.size() % Fastcgipp::Protocol::chunkSize)
+                        FAIL_LOG("Our record is not sized properly");
+                    const Fastcgipp::Protocol::Header& header
+                        = *reinterpret_cast<Fastcgipp::Protocol::Header*>(
+                                record.begin());
+                    if(header.fcgiId != FCGIID
+                            || header.version != Fastcgipp::Protocol::version
+                            || header.type
+                                != Fastcgipp::Protocol::RecordType::OUT)
+                        FAIL_LOG("Our record header isn't right")
+                    if(record.size() != Fastcgipp::Protocol::getRecordSize(
+                                header.contentLength))
+                        FAIL_LOG("Our record padding isn't right")
+                    sizes.push_back(header.contentLength);
+                    received.append(
+                            record.begin()+sizeof(Fastcgipp::Protocol::Header),
+                            header.contentLength);
+                });
+        streambuf.bufferSize(0x100000);
+
+        std::basic_ostream<charT> out(&streambuf);
+        for(size_t i=0; i<total; ++i)
+            out.put(charT('a'+i%26));
+    }
+
+    if(received.size() != total)
+        FAIL_LOG("Fastcgipp::FcgiStreambuf lost data with " << sizeof(charT)\
+                << " byte characters")
+    for(size_t i=0; i<total; ++i)
+        if(received[i] != char('a'+i%26))
+            FAIL_LOG("Fastcgipp::FcgiStreambuf mangled data with "\
+                    << sizeof(charT) << " byte characters")
+    if(sizeof(charT) == 1)
+        for(size_t i=0; i+1<sizes.size(); ++i)
+            if(sizes[i] != 0xffff)
+                FAIL_LOG("Fastcgipp::FcgiStreambuf didn't fill a record")
+}
+
+//! Lets us see whether a put area has been set up
+template<class charT>
+class Peeker: public Fastcgipp::FcgiStreambuf<charT>
+{
+public:
+    bool buffered() const
+    {
+        return this->pbase() != nullptr;
+    }
+};
+
+//! Check that flushing an unused stream doesn't set up a buffer
+template<class charT>
+void testLazyBuffer()
+{
+    size_t records = 0;
+    Peeker<charT> streambuf;
+    streambuf.configure(
+            Fastcgipp::Protocol::RequestId(
+                FCGIID,
+                Fastcgipp::Socket()),
+            Fastcgipp::Protocol::RecordType::OUT,
+            [&records] (const Fastcgipp::Socket&, Fastcgipp::Block&& record)
+            {
+                ++records;
+            });
+
+    std::basic_ostream<charT> out(&streambuf);
+    out.flush();
+    out.flush();
+    if(streambuf.buffered() || records != 0)
+        FAIL_LOG("Fastcgipp::FcgiStreambuf set up a buffer to flush nothing "\
+                "with " << sizeof(charT) << " byte characters")
+
+    out.put(charT('a'));
+    out.flush();
+    if(records != 1)
+        FAIL_LOG("Fastcgipp::FcgiStreambuf didn't flush a record with "\
+                << sizeof(charT) << " byte characters")
+}
+
 int main()
 {
     using Fastcgipp::Encoding;
@@ -386,6 +567,24 @@ int main()
             "trillion mature trees in the world.";
     }
 
+    // Testing escaping across buffer boundaries
+    testEscaping<char>(
+            "A plain run of text long enough for a few vectors, then <tags> & "
+            "\"quotes\" 'here' and there; plus $ymbols @ every: turn (!) "
+            "[ok] #hash ?query /path, 100% * = + \xd0\xb6\xd0\xb8 done.");
+    testEscaping<wchar_t>(
+            L"A plain run of text long enough for a few vectors, then <tags> & "
+            "\"quotes\" 'here' and there; plus $ymbols @ every: turn (!) "
+            "[ok] #hash ?query /path, 100% * = + жи\u2726\U0001F333 done.");
+
+    // Testing large buffers
+    testRecordFilling<char>();
+    testRecordFilling<wchar_t>();
+
+    // Testing flushes of unused streams
+    testLazyBuffer<char>();
+    testLazyBuffer<wchar_t>();
+
     if(called != 5)
         FAIL_LOG("Our checker() was not called as many times as it should have")
     return 0;
@@ -11,6 +11,7 @@
 #include <chrono>
 #include <random>
 #include <cstring>
+#include <memory>
 
 int main()
 {
@@ -484,6 +485,66 @@ int main()
             FAIL_LOG("Fastcgipp::Http::decodeUrlEncoded() #3")
     }
 
+    // Testing Fastcgipp::Http::decodeUrlEncoded() with Fastcgipp::Http::Fields
+    {
+        const char input[] =
+            "zebra=1&apple=%D0%B6%D0%B8&zebra=2+3&empty=&=nameless"
+            "&long=abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwx"
+            "%25yz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789+%2b%2B&trunc=%4";
+
+        const std::vector<std::pair<std::wstring, std::wstring>> properOutput
+        {
+            {L"zebra", L"1"},
+            {L"apple", L"жи"},
+            {L"zebra", L"2 3"},
+            {L"empty", L""},
+            {L"", L"nameless"},
+            {L"long", L"abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqr"
+                "stuvwx%yz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 ++"},
+            {L"trunc", L""}
+        };
+
+        Fastcgipp::Http::Fields<wchar_t> output;
+        Fastcgipp::Http::decodeUrlEncoded(
+                input,
+                input+sizeof(input)-1,
+                output);
+
+        if(
+                output.size() != properOutput.size()
+                || !std::equal(
+                    output.begin(),
+                    output.end(),
+                    properOutput.begin())
+                || output.count(L"zebra") != 2
+                || output.find(L"zebra")->second != L"1"
+                || output.find(L"nothing") != output.end())
+            FAIL_LOG("Fastcgipp::Http::decodeUrlEncoded() with Fields")
+    }
+
+    // Testing Fastcgipp::Http::percentEscapedToRealBytes() in place against
+    // every alignment of an escape
+    {
+        for(size_t position=0; position<70; ++position)
+        {
+            std::string encoded(70, 'a');
+            encoded.replace(position, 1, "%41");
+            encoded[(position+37)%encoded.size()] = '+';
+            std::string proper(encoded);
+            proper.replace(position, 3, "A");
+            std::replace(proper.begin(), proper.end(), '+', ' ');
+
+            const auto end = Fastcgipp::Http::percentEscapedToRealBytes(
+                    &encoded[0],
+                    &encoded[0]+encoded.size(),
+                    &encoded[0]);
+            encoded.resize(end-&encoded[0]);
+            if(encoded != proper)
+                FAIL_LOG("Fastcgipp::Http::percentEscapedToRealBytes() "\
+                        "with an escape at " << position)
+        }
+    }
+
     // Testing Fastcgipp::Http::Environment
     {
         Fastcgipp::Address loopback;
@@ -628,6 +689,131 @@ int main()
             }
         }
 
+        // Doing test with streamed multipart POST
+        {
+            static const unsigned char parms[] =
+#include "multipartParam.hpp"
+            static const unsigned char data[] =
+#include "multipartPost.hpp"
+            static const unsigned char gnu_png[] =
+#include "gnu.png.hpp"
+            static const char* const dataStart =
+                reinterpret_cast<const char*>(data);
+            static const char* const dataEnd =
+                reinterpret_cast<const char*>(data+sizeof(data));
+
+            // A sink that keeps it's own copy
+            struct Sink: public Fastcgipp::Http::FileSink
+            {
+                std::vector<char>& content;
+
+                bool write(const char* data, size_t size)
+                {
+                    content.insert(content.end(), data, data+size);
+                    return true;
+                }
+
+                Sink(std::vector<char>& content_):
+                    content(content_)
+                {}
+            };
+
+            for(int pass=0; pass<3; ++pass)
+            {
+                Fastcgipp::Http::Environment<wchar_t> environment;
+                environment.fill(
+                        reinterpret_cast<const char*>(parms),
+                        reinterpret_cast<const char*>(parms+sizeof(parms)-1));
+
+                if(!environment.streamable())
+                    FAIL_LOG("Fastcgipp::Http::Environment multipart isn't "\
+                            "streamable")
+
+                // Keep it in memory, spool it and send it to a sink
+                std::vector<char> sunk;
+                if(pass == 1)
+                    environment.spoolThreshold = 4096;
+                else if(pass == 2)
+                    environment.fileSinks = [&sunk] (
+                            const std::wstring& name,
+                            const Fastcgipp::Http::File<wchar_t>& file)
+                    {
+                        return std::unique_ptr<Fastcgipp::Http::FileSink>(
+                                new Sink(sunk));
+                    };
+
+                // Feed it in awkward pieces so delimiters get split up
+                size_t chunk = 1;
+                for(const char* start = dataStart; start != dataEnd;)
+                {
+                    const char* const end = start + std::min(
+                            chunk,
+                            size_t(dataEnd-start));
+                    if(!environment.parsePostStream(start, end))
+                        FAIL_LOG("Fastcgipp::Http::Environment streamed "\
+                                "multipart failed to parse")
+                    start = end;
+                    chunk = chunk*7%1021+1;
+                }
+                if(!environment.finishPostStream())
+                    FAIL_LOG("Fastcgipp::Http::Environment streamed "\
+                            "multipart failed to finish")
+
+                if(environment.postSize() != sizeof(data)
+                        || !environment.postBuffer().empty())
+                    FAIL_LOG("Fastcgipp::Http::Environment streamed "\
+                            "multipart was buffered")
+
+                if(properPosts != environment.posts)
+                    FAIL_LOG("Fastcgipp::Http::Environment streamed "\
+                            "multipart posts didn't decode properly")
+
+                if(
+                        environment.files.size() != 1 ||
+                        environment.files.begin()->first != L"aFile" ||
+                        environment.files.begin()->second.filename
+                            != L"gnu.png" ||
+                        environment.files.begin()->second.contentType
+                            != L"image/png" ||
+                        environment.files.begin()->second.size != 58587)
+                    FAIL_LOG("Fastcgipp::Http::Environment streamed "\
+                            "multipart files didn't decode properly")
+
+                const auto& file = environment.files.begin()->second;
+                const char* const fileStart = pass==2
+                    ? sunk.data()
+                    : file.begin();
+                if(
+                        (pass==0 && !file.data) ||
+                        (pass==1 && (file.data || !file.spooled)) ||
+                        (pass==2 && (file.begin() || sunk.size() != file.size))
+                        || !std::equal(
+                            reinterpret_cast<const char*>(gnu_png),
+                            reinterpret_cast<const char*>(gnu_png)
+                                +sizeof(gnu_png),
+                            fileStart))
+                    FAIL_LOG("Fastcgipp::Http::Environment streamed "\
+                            "multipart file content is wrong on pass " \
+                            << pass)
+            }
+
+            // Data that stops short of the closing delimiter
+            {
+                Fastcgipp::Http::Environment<wchar_t> environment;
+                environment.fill(
+                        reinterpret_cast<const char*>(parms),
+                        reinterpret_cast<const char*>(parms+sizeof(parms)-1));
+                if(!environment.parsePostStream(
+                            dataStart,
+                            dataStart+sizeof(data)/2))
+                    FAIL_LOG("Fastcgipp::Http::Environment streamed "\
+                            "multipart failed to parse")
+                if(environment.finishPostStream())
+                    FAIL_LOG("Fastcgipp::Http::Environment streamed "\
+                            "multipart finished without a closing delimiter")
+            }
+        }
+
         // Doing test with urlencoded POST
         {
             Fastcgipp::Http::Environment<wchar_t> environment;
@@ -722,6 +908,165 @@ int main()
                             "posts didn't decode properly")
             }
         }
+
+        // Doing test with urlencoded POST and an arena
+        {
+            Fastcgipp::Arena arena;
+            Fastcgipp::Http::Environment<
+                wchar_t,
+                Fastcgipp::ArenaAllocator<wchar_t>> environment(&arena);
+            {
+                static const unsigned char data[] =
+#include "urlencodedParam.hpp"
+                environment.fill(
+                        reinterpret_cast<const char*>(data),
+                        reinterpret_cast<const char*>(data+sizeof(data)));
+            }
+            {
+                const unsigned char data[] =
+#include "urlencodedPost.hpp"
+                environment.fillPostBuffer(
+                        reinterpret_cast<const char*>(data),
+                        reinterpret_cast<const char*>(data+sizeof(data)));
+                environment.parsePostBuffer();
+            }
+
+            const auto same = [] (
+                    const decltype(environment.gets)& x,
+                    const std::multimap<std::wstring, std::wstring>& y)
+            {
+                return x.size() == y.size() && std::equal(
+                        x.cbegin(),
+                        x.cend(),
+                        y.cbegin(),
+                        [] (
+                            const decltype(*x.cbegin())& a,
+                            const decltype(*y.cbegin())& b)
+                        {
+                            return a.first.size() == b.first.size()
+                                && a.second.size() == b.second.size()
+                                && std::equal(
+                                    a.first.cbegin(),
+                                    a.first.cend(),
+                                    b.first.cbegin())
+                                && std::equal(
+                                    a.second.cbegin(),
+                                    a.second.cend(),
+                                    b.second.cbegin());
+                        });
+            };
+
+            if(
+                    environment.host != L"localhost" ||
+                    environment.scriptName != L"/examples/echo.fcgi" ||
+                    environment.pathInfo.size() != properPath.size() ||
+                    environment.pathInfo.back() != L"test\\ path" ||
+                    environment.acceptLanguages.size()
+                        != properLanguages.size() ||
+                    environment.acceptLanguages.front() != "en_CA" ||
+                    !same(environment.gets, properGets) ||
+                    !same(environment.cookies, properCookies) ||
+                    !same(environment.posts, properPosts))
+                FAIL_LOG("Fastcgipp::Http::Environment with an arena didn't "\
+                        "decode properly")
+
+            if(arena.size() == 0)
+                FAIL_LOG("Fastcgipp::Http::Environment didn't use the arena")
+            if(environment.host.get_allocator().arena() != &arena
+                    || environment.gets.begin()->second.get_allocator().arena()
+                        != &arena)
+                FAIL_LOG("Fastcgipp::Http::Environment data isn't in the "\
+                        "arena")
+        }
+
+        // Doing test with a lazy environment
+        {
+            Fastcgipp::Http::Environment<wchar_t> environment;
+            {
+                static const unsigned char data[] =
+#include "urlencodedParam.hpp"
+                // Slice the record out of a receive sized chunk
+                const auto chunk = std::make_shared<Fastcgipp::Block>(0x10000);
+                std::copy(data, data+sizeof(data), chunk->begin());
+                Fastcgipp::Block record(chunk, chunk->begin(), sizeof(data));
+                const char* const start = record.begin();
+                const char* const end = record.end();
+                environment.index(std::move(record), start, end);
+
+                if(chunk.use_count() != 1)
+                    FAIL_LOG("Fastcgipp::Http::Environment kept a receive "\
+                            "chunk alive for a small record")
+            }
+
+            const auto& parameters = environment.parameters;
+            if(
+                    parameters.host() != "localhost" ||
+                    parameters.scriptName() != "/examples/echo.fcgi" ||
+                    parameters["SERVER_PORT"] != "80" ||
+                    parameters["NOT_A_PARAMETER"] != "" ||
+                    parameters.find("NOT_A_PARAMETER") != parameters.end() ||
+                    parameters.get("getVar") != "testing" ||
+                    parameters.get("utf8GetVarTest") != "проверка" ||
+                    parameters.get("notAGetVar") != "" ||
+                    parameters.gets().size() != properGets.size() ||
+                    parameters.cookie("echoCookie") != "<\"русский\">;" ||
+                    parameters.cookies().size() != properCookies.size())
+                FAIL_LOG("Fastcgipp::Http::Environment lazy parameters "\
+                        "didn't decode properly")
+
+            if(
+                    environment.contentLength != 98 ||
+                    environment.requestMethod
+                        != Fastcgipp::Http::RequestMethod::POST ||
+                    environment.contentType
+                        != L"application/x-www-form-urlencoded" ||
+                    !environment.host.empty() ||
+                    !environment.others.empty())
+                FAIL_LOG("Fastcgipp::Http::Environment lazy environment "\
+                        "decoded the wrong members")
+        }
+
+        // Doing test with registered parameters
+        {
+            const auto uniqueId = Fastcgipp::Http::registerParameter(
+                    "UNIQUE_ID");
+            const auto connection = Fastcgipp::Http::registerParameter(
+                    "HTTP_CONNECTION");
+            const auto missing = Fastcgipp::Http::registerParameter(
+                    "HTTP_X_REQUEST_ID");
+            if(Fastcgipp::Http::registerParameter("UNIQUE_ID").index()
+                    != uniqueId.index())
+                FAIL_LOG("Fastcgipp::Http::registerParameter() gave the same "\
+                        "name two handles")
+            const auto host = Fastcgipp::Http::registerParameter(
+                    "HTTP_HOST");
+            if(host.valid() || !uniqueId.valid())
+                FAIL_LOG("Fastcgipp::Http::registerParameter() didn't refuse "\
+                        "a parameter with it's own member")
+
+            Fastcgipp::Http::Environment<wchar_t> environment;
+            {
+                static const unsigned char data[] =
+#include "urlencodedParam.hpp"
+                environment.fill(
+                        reinterpret_cast<const char*>(data),
+                        reinterpret_cast<const char*>(data+sizeof(data)));
+            }
+
+            if(
+                    environment.registered(uniqueId)
+                        != L"VusRVX8AAAEAAFSHD48AAAAF" ||
+                    environment.registered(connection) != L"keep-alive" ||
+                    !environment.registered(missing).empty() ||
+                    !environment.registered(host).empty() ||
+                    environment.others.count(L"UNIQUE_ID") ||
+                    environment.others.count(L"HTTP_CONNECTION") ||
+                    !environment.others.count(L"HTTP_DNT") ||
+                    environment.host != L"localhost" ||
+                    environment.remotePort != 49116)
+                FAIL_LOG("Fastcgipp::Http::Environment registered "\
+                        "parameters didn't decode properly")
+        }
     }
 
     // Testing Fastcgipp::Http::SessionId
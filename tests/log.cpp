@@ -0,0 +1,162 @@
+#include "fastcgi++/log.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+const unsigned int threads = 4;
+const unsigned int entries = 2000;
+
+//! Amount of times a string shows up in another
+size_t occurrences(const std::wstring& haystack, const std::wstring& needle)
+{
+    size_t count = 0;
+    for(size_t position = haystack.find(needle);
+            position != std::wstring::npos;
+            position = haystack.find(needle, position+needle.size()))
+        ++count;
+    return count;
+}
+
+//! What's been logged so far
+std::wstring logged(const std::wostringstream& output)
+{
+    std::lock_guard<std::mutex> lock(Fastcgipp::Logging::mutex);
+    return output.str();
+}
+
+int main()
+{
+    std::wostringstream output;
+    Fastcgipp::Logging::logstream = &output;
+    Fastcgipp::Logging::hostname = L"host";
+    Fastcgipp::Logging::program = L"program[1]";
+
+    // Plain text written right away
+    {
+        INFO_LOG("number " << std::hex << 255)
+        INFO_LOG("number " << 255)
+        const std::wstring text = output.str();
+        if(text.find(L" host program[1] [info]: number ff\n") == std::wstring::npos
+                || text.find(L"[info]: number 255\n") == std::wstring::npos)
+        {
+            std::cerr << "Log text is wrong" << std::endl;
+            return 1;
+        }
+        output.str(L"");
+    }
+
+    // Structured output
+    {
+        Fastcgipp::Logging::format = Fastcgipp::Logging::Format::JSON;
+        ERROR_LOG("a \"quoted\"\tline\\ \x01")
+        Fastcgipp::Logging::format = Fastcgipp::Logging::Format::TEXT;
+        const std::wstring text = output.str();
+        if(text.find(L"{\"time\":\"") != 0
+                || text.find(L"\",\"host\":\"host\",\"program\":\"program[1]\""
+                    L",\"level\":\"error\",\"message\":\"a \\\"quoted\\\"\\tline"
+                    L"\\\\ \\u0001\"}\n") == std::wstring::npos)
+        {
+            std::cerr << "Log JSON is wrong" << std::endl;
+            return 1;
+        }
+        output.str(L"");
+    }
+
+    // Many threads logging asynchronously
+    {
+        Fastcgipp::Logging::startAsync(entries);
+        std::vector<std::thread> loggers;
+        for(unsigned i=0; i<threads; ++i)
+            loggers.emplace_back([i] ()
+            {
+                for(unsigned j=0; j<entries; ++j)
+                    INFO_LOG("thread " << i << " entry " << j)
+            });
+        for(auto& logger: loggers)
+            logger.join();
+        Fastcgipp::Logging::stopAsync();
+
+        const std::wstring text = output.str();
+        if(occurrences(text, L"[info]: thread ")
+                + Fastcgipp::Logging::dropped() != threads*entries)
+        {
+            std::cerr << "Asynchronous log entries went missing" << std::endl;
+            return 1;
+        }
+        for(unsigned i=0; i<threads; ++i)
+        {
+            std::wostringstream last;
+            last << L"[info]: thread " << i << L" entry " << entries-1 << L'\n';
+            if(Fastcgipp::Logging::dropped() == 0
+                    && text.find(last.str()) == std::wstring::npos)
+            {
+                std::cerr << "Asynchronous log entry is wrong" << std::endl;
+                return 1;
+            }
+        }
+        output.str(L"");
+    }
+
+    // Stopping while threads are logging
+    for(unsigned round=0; round<20; ++round)
+    {
+        const unsigned long long dropped = Fastcgipp::Logging::dropped();
+        Fastcgipp::Logging::startAsync(entries);
+        std::vector<std::thread> loggers;
+        for(unsigned i=0; i<threads; ++i)
+            loggers.emplace_back([i] ()
+            {
+                for(unsigned j=0; j<entries/10; ++j)
+                    INFO_LOG("stopping " << i << " entry " << j)
+            });
+        Fastcgipp::Logging::stopAsync();
+        for(auto& logger: loggers)
+            logger.join();
+
+        if(occurrences(logged(output), L"[info]: stopping ")
+                + Fastcgipp::Logging::dropped()-dropped
+                != threads*(entries/10))
+        {
+            std::cerr << "Log entries went missing while stopping"
+                << std::endl;
+            return 1;
+        }
+        output.str(L"");
+    }
+
+    // Dropping entries when a ring is full
+    {
+        const unsigned long long dropped = Fastcgipp::Logging::dropped();
+        Fastcgipp::Logging::startAsync(2);
+        INFO_LOG("warmup")
+        while(logged(output).find(L"warmup") == std::wstring::npos)
+            std::this_thread::yield();
+
+        {
+            // The background thread can't write anything while we hold this
+            std::lock_guard<std::mutex> lock(Fastcgipp::Logging::mutex);
+            for(unsigned i=0; i<10; ++i)
+                INFO_LOG("full " << i)
+        }
+        if(Fastcgipp::Logging::dropped()-dropped != 8)
+        {
+            std::cerr << "Log entries weren't dropped" << std::endl;
+            return 1;
+        }
+        Fastcgipp::Logging::stopAsync();
+
+        const std::wstring text = output.str();
+        if(occurrences(text, L"[info]: full ") != 2
+                || text.find(L"[warning]: 8 log entries were dropped\n")
+                    == std::wstring::npos)
+        {
+            std::cerr << "Dropped log entries weren't reported" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
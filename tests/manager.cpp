@@ -0,0 +1,165 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/manager.hpp"
+#include "fastcgi++/request.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+const Fastcgipp::Protocol::FcgiId FCGIID = 1;
+const unsigned REQUESTS = 16;
+
+//! Finishes immediately but is slow to be removed from the request table
+class Reused: public Fastcgipp::Request<char>
+{
+    bool response()
+    {
+        out << "Content-Type: text/plain\r\n\r\nok";
+        return true;
+    }
+
+    std::unique_lock<std::mutex> handler()
+    {
+        auto lock = Fastcgipp::Request<char>::handler();
+
+        // END_REQUEST has been sent so give the client time to reuse our ID
+        // before the manager gets around to removing us
+        if(!lock)
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        return lock;
+    }
+};
+
+void appendRecord(
+        std::string& stream,
+        Fastcgipp::Protocol::RecordType type,
+        const std::string& content)
+{
+    const size_t recordSize
+        = Fastcgipp::Protocol::getRecordSize(content.size());
+
+    Fastcgipp::Protocol::Header header;
+    header.version = Fastcgipp::Protocol::version;
+    header.type = type;
+    header.fcgiId = FCGIID;
+    header.contentLength = content.size();
+    header.paddingLength = recordSize-content.size()-sizeof(header);
+    header.reserved = 0;
+
+    stream.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream += content;
+    stream.append(header.paddingLength, 0);
+}
+
+//! Reuse the same request ID as soon as every END_REQUEST arrives
+void client(const std::string& path)
+{
+    std::string request;
+    {
+        Fastcgipp::Protocol::BeginRequest begin;
+        std::memset(&begin, 0, sizeof(begin));
+        begin.role = Fastcgipp::Protocol::Role::RESPONDER;
+        begin.flags = Fastcgipp::Protocol::BeginRequest::keepConnBit;
+        appendRecord(
+                request,
+                Fastcgipp::Protocol::RecordType::BEGIN_REQUEST,
+                std::string(
+                    reinterpret_cast<const char*>(&begin),
+                    sizeof(begin)));
+        appendRecord(
+                request,
+                Fastcgipp::Protocol::RecordType::PARAMS,
+                std::string());
+        appendRecord(
+                request,
+                Fastcgipp::Protocol::RecordType::IN,
+                std::string());
+    }
+
+    Fastcgipp::SocketGroup group;
+    Fastcgipp::Socket socket = group.connect(path.c_str());
+    if(!socket.valid())
+        FAIL_LOG("Unable to connect to " << path.c_str())
+
+    std::vector<char> buffer;
+    for(unsigned i=0; i<REQUESTS; ++i)
+    {
+        if(socket.write(request.data(), request.size())
+                != ssize_t(request.size()))
+            FAIL_LOG("Unable to write request " << i)
+
+        std::string out;
+        bool ended = false;
+        while(!ended)
+        {
+            // Pull in complete records
+            size_t size = buffer.size();
+            buffer.resize(size+0x10000);
+            const ssize_t read = socket.read(buffer.data()+size, 0x10000);
+            if(read <= 0)
+                FAIL_LOG("Connection lost during request " << i)
+            buffer.resize(size+read);
+
+            size_t position = 0;
+            while(buffer.size()-position
+                    >= sizeof(Fastcgipp::Protocol::Header))
+            {
+                const auto& header
+                    = *reinterpret_cast<const Fastcgipp::Protocol::Header*>(
+                            buffer.data()+position);
+                const size_t recordSize = sizeof(header)
+                    + header.contentLength
+                    + header.paddingLength;
+                if(buffer.size()-position < recordSize)
+                    break;
+
+                if(header.fcgiId != FCGIID)
+                    FAIL_LOG("Got a record for the wrong request ID")
+
+                if(header.type == Fastcgipp::Protocol::RecordType::OUT)
+                    out.append(
+                            buffer.data()+position+sizeof(header),
+                            header.contentLength);
+                else if(header.type
+                        == Fastcgipp::Protocol::RecordType::END_REQUEST)
+                {
+                    ended = true;
+                    if(buffer.size()-position != recordSize)
+                        FAIL_LOG("Got records after END_REQUEST")
+                }
+                position += recordSize;
+            }
+            buffer.erase(buffer.begin(), buffer.begin()+position);
+        }
+
+        if(out != "Content-Type: text/plain\r\n\r\nok")
+            FAIL_LOG("Request " << i << " has a bad response")
+    }
+}
+
+int main()
+{
+    const std::string path = "/tmp/fastcgipp-manager-test-"
+        + std::to_string(getpid());
+
+    Fastcgipp::Manager<Reused> manager;
+    if(!manager.listen(path.c_str()))
+        FAIL_LOG("Unable to listen on " << path.c_str())
+    manager.start();
+
+    auto done = std::async(std::launch::async, client, path);
+    if(done.wait_for(std::chrono::seconds(10)) != std::future_status::ready)
+        FAIL_LOG("A request reusing it's ID right after END_REQUEST was lost")
+    done.get();
+
+    manager.terminate();
+    manager.join();
+    unlink(path.c_str());
+
+    return 0;
+}
@@ -0,0 +1,206 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/metrics.hpp"
+#include "fastcgi++/sockets.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+const unsigned int threads = 8;
+const unsigned int additions = 100000;
+const char socketName[] = "metricstest.sock";
+
+//! Ask the server for it's text
+std::string fetch(const char* request)
+{
+    // Keep our side of the connection out of the process wide registry
+    Fastcgipp::Metrics::Registry registry;
+    Fastcgipp::SocketGroup group(registry);
+    const Fastcgipp::Socket socket = group.connect(socketName);
+    if(!socket.valid())
+        FAIL_LOG("Unable to connect to the metrics server")
+    if(socket.write(request, std::strlen(request)) <= 0)
+        FAIL_LOG("Unable to write to the metrics server")
+
+    std::string text;
+    char buffer[256];
+    ssize_t count;
+    while((count = socket.read(buffer, sizeof(buffer))) > 0)
+        text.append(buffer, count);
+    return text;
+}
+
+int main()
+{
+    // Counters summed across threads
+    {
+        Fastcgipp::Metrics::Counter counter;
+        std::vector<std::thread> adders;
+        for(unsigned i=0; i<threads; ++i)
+            adders.emplace_back([&counter, i] ()
+            {
+                for(unsigned j=0; j<additions; ++j)
+                    counter.add(i+1);
+            });
+        for(auto& adder: adders)
+            adder.join();
+
+        if(counter.value() != additions*threads*(threads+1)/2)
+            FAIL_LOG("Counter lost some additions")
+    }
+
+    // Gauges and their high water mark
+    {
+        Fastcgipp::Metrics::Gauge gauge;
+        gauge.add(5);
+        gauge.sub(3);
+        gauge.add();
+        if(gauge.value() != 3 || gauge.max() != 5)
+            FAIL_LOG("Gauge has the wrong value or max")
+        gauge.set(10);
+        gauge.set(-2);
+        if(gauge.value() != -2 || gauge.max() != 10)
+            FAIL_LOG("Gauge has the wrong value or max after set()")
+    }
+
+    // Histogram buckets
+    {
+        typedef Fastcgipp::Metrics::Histogram Histogram;
+        unsigned previous = 0;
+        for(unsigned long long value=1; value < (1ULL<<41); value += value/7+1)
+        {
+            const unsigned bucket = Histogram::bucket(value);
+            if(bucket < previous || bucket >= Histogram::buckets)
+                FAIL_LOG("Histogram bucket out of order for " << value)
+            previous = bucket;
+            if(value <= Histogram::maxValue)
+            {
+                if(Histogram::lowest(bucket) > value
+                        || (bucket+1 < Histogram::buckets
+                            && Histogram::lowest(bucket+1) <= value))
+                    FAIL_LOG("Histogram bucket " << bucket \
+                            << " doesn't contain " << value)
+            }
+        }
+        for(unsigned bucket=0; bucket<Histogram::buckets; ++bucket)
+            if(Histogram::bucket(Histogram::lowest(bucket)) != bucket)
+                FAIL_LOG("Histogram lowest value of " << bucket << " is wrong")
+    }
+
+    // Histogram percentiles across threads
+    {
+        Fastcgipp::Metrics::Histogram histogram;
+        std::vector<std::thread> recorders;
+        for(unsigned i=0; i<threads; ++i)
+            recorders.emplace_back([&histogram, i] ()
+            {
+                for(unsigned j=i; j<additions; j+=threads)
+                    histogram.record(j+1);
+            });
+        for(auto& recorder: recorders)
+            recorder.join();
+
+        const auto snapshot = histogram.snapshot();
+        if(snapshot.count != additions)
+            FAIL_LOG("Histogram lost some values")
+        if(snapshot.sum != (unsigned long long)(additions)*(additions+1)/2)
+            FAIL_LOG("Histogram has the wrong sum")
+        if(snapshot.max != additions)
+            FAIL_LOG("Histogram has the wrong max")
+
+        for(const double fraction: {0.01, 0.5, 0.9, 0.99, 0.999, 1.0})
+        {
+            const double expected = fraction*additions;
+            const double actual = snapshot.percentile(fraction);
+            if(actual < expected*(1-1.0/16) || actual > expected*(1+1.0/16))
+                FAIL_LOG("Histogram percentile " << fraction << " is " \
+                        << actual << " instead of about " << expected)
+        }
+    }
+
+    // Registry and text output
+    Fastcgipp::Metrics::Registry registry;
+    {
+        auto& counter = registry.counter("test_total", "A counter");
+        if(&registry.counter("test_total", "A counter") != &counter)
+            FAIL_LOG("Registry created a second counter with the same name")
+        counter.add(7);
+        registry.gauge("test_gauge", "A gauge").add(3);
+        registry.histogram("test_latency", "A histogram").record(100);
+        long long sampled = 42;
+        registry.gauge("test_sampled", "A sampled gauge", [&sampled] ()
+        {
+            return sampled;
+        });
+
+        const auto samples = registry.snapshot();
+        if(samples.size() != 4)
+            FAIL_LOG("Registry snapshot has the wrong amount of samples")
+        if(samples[0].name != "test_gauge" || samples[0].value != 3)
+            FAIL_LOG("Registry snapshot has the wrong gauge")
+        if(samples[2].name != "test_sampled" || samples[2].value != 42)
+            FAIL_LOG("Registry snapshot has the wrong sampled gauge")
+
+        std::ostringstream text;
+        registry.write(text);
+        for(const char* line: {
+                "# TYPE test_total counter\ntest_total 7\n",
+                "# HELP test_gauge A gauge\n",
+                "test_gauge 3\n",
+                "test_gauge_max 3\n",
+                "test_sampled 42\n",
+                "# TYPE test_latency summary\n",
+                "test_latency{quantile=\"0.5\"} 100\n",
+                "test_latency_count 1\n"})
+            if(text.str().find(line) == std::string::npos)
+                FAIL_LOG("Registry text is missing " << line)
+
+        registry.remove("test_sampled");
+        if(registry.snapshot().size() != 3)
+            FAIL_LOG("Registry didn't remove the sampled gauge")
+    }
+
+    // The text served on a socket
+    {
+        std::remove(socketName);
+        Fastcgipp::Metrics::Server server(registry);
+        if(!server.listen(socketName))
+            FAIL_LOG("Unable to listen for metrics")
+        server.start();
+
+        const Fastcgipp::Metrics::Counter& incoming
+            = Fastcgipp::Metrics::registry().counter(
+                    "fastcgipp_socket_incoming_total",
+                    "Connections accepted");
+        const Fastcgipp::Metrics::Counter& received
+            = Fastcgipp::Metrics::registry().counter(
+                    "fastcgipp_socket_received_bytes_total",
+                    "Bytes read from sockets");
+        const unsigned long long incomingBefore = incoming.value();
+        const unsigned long long receivedBefore = received.value();
+
+        for(unsigned i=0; i<3; ++i)
+        {
+            const std::string text = fetch("\n");
+            if(text.find("test_total 7\n") != 0
+                    && text.find("\ntest_total 7\n") == std::string::npos)
+                FAIL_LOG("Metrics server sent the wrong text")
+        }
+
+        const std::string response = fetch("GET / HTTP/1.0\r\n\r\n");
+        if(response.find("HTTP/1.0 200 OK\r\n") != 0
+                || response.find("\ntest_total 7\n") == std::string::npos)
+            FAIL_LOG("Metrics server sent the wrong HTTP response")
+
+        if(incoming.value() != incomingBefore
+                || received.value() != receivedBefore)
+            FAIL_LOG("Metrics server counted it's own connections")
+
+        server.stop();
+    }
+
+    return 0;
+}
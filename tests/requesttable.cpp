@@ -0,0 +1,93 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/requesttable.hpp"
+#include "fastcgi++/sockets.hpp"
+
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+int main()
+{
+    const std::string path = "/tmp/fastcgipp-requesttable-test-"
+        + std::to_string(getpid());
+    Fastcgipp::SocketGroup group;
+    if(!group.listen(path.c_str()))
+        FAIL_LOG("Unable to listen on " << path.c_str())
+
+    std::vector<Fastcgipp::Socket> sockets;
+    for(unsigned i=0; i<32; ++i)
+    {
+        sockets.push_back(group.connect(path.c_str()));
+        if(!sockets.back().valid())
+            FAIL_LOG("Unable to connect to " << path.c_str())
+    }
+
+    // Shard counts are rounded up to powers of two
+    {
+        Fastcgipp::RequestTable<int> table(5);
+        if(table.shards() != 8)
+            FAIL_LOG("RequestTable didn't round it's shard count up")
+    }
+
+    // Basic insertion, lookup and removal
+    {
+        Fastcgipp::RequestTable<unsigned> table(4);
+        if(!table.empty())
+            FAIL_LOG("RequestTable isn't empty on construction")
+
+        for(unsigned i=0; i<sockets.size(); ++i)
+            for(Fastcgipp::Protocol::FcgiId id=1; id<=4; ++id)
+            {
+                const Fastcgipp::Protocol::RequestId requestId(
+                        id,
+                        sockets[i]);
+                auto& shard = table.shard(sockets[i]);
+                shard.emplace(requestId)->second = i*4+id;
+                if(shard.emplace(requestId)->second != i*4+id)
+                    FAIL_LOG("RequestTable emplace() overwrote a value")
+            }
+        if(table.size() != sockets.size()*4)
+            FAIL_LOG("RequestTable size is wrong after insertion")
+
+        for(unsigned i=0; i<sockets.size(); ++i)
+        {
+            auto& shard = table.shard(sockets[i]);
+            if(&shard != &table.shard(Fastcgipp::Socket(sockets[i])))
+                FAIL_LOG("Equal sockets land in different shards")
+
+            const auto request = shard.find(
+                    Fastcgipp::Protocol::RequestId(3, sockets[i]));
+            if(request == shard.end() || request->second != i*4+3)
+                FAIL_LOG("RequestTable find() didn't find the right request")
+
+            unsigned count = 0;
+            const auto range = shard.equal_range(sockets[i]);
+            for(auto request=range.first; request!=range.second; ++request)
+            {
+                if(!(request->first.m_socket == sockets[i]))
+                    FAIL_LOG("RequestTable equal_range() gave another socket")
+                ++count;
+            }
+            if(count != 4)
+                FAIL_LOG("RequestTable equal_range() gave the wrong count")
+        }
+
+        for(unsigned i=0; i<sockets.size(); i+=2)
+        {
+            auto& shard = table.shard(sockets[i]);
+            auto range = shard.equal_range(sockets[i]);
+            while(range.first != range.second)
+                range.first = shard.erase(range.first);
+        }
+        if(table.size() != sockets.size()*2)
+            FAIL_LOG("RequestTable size is wrong after removal")
+
+        auto& shard = table.shard(sockets[0]);
+        if(shard.find(Fastcgipp::Protocol::RequestId(1, sockets[0]))
+                != shard.end())
+            FAIL_LOG("RequestTable found a removed request")
+    }
+
+    return 0;
+}
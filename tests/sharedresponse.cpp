@@ -0,0 +1,86 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/sharedresponse.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+//! Transmit a response and put the payload back together from the records
+std::string transmit(
+        const Fastcgipp::SharedResponse& response,
+        Fastcgipp::Protocol::FcgiId id,
+        std::vector<const char*>& contents)
+{
+    std::vector<Fastcgipp::Block> blocks;
+    response.send(id, [&blocks] (Fastcgipp::Block&& block)
+    {
+        blocks.push_back(std::move(block));
+    });
+
+    if(blocks.size() != 2*response.records())
+        FAIL_LOG("SharedResponse sent the wrong amount of blocks")
+
+    std::string payload;
+    for(auto block = blocks.cbegin(); block != blocks.cend(); block += 2)
+    {
+        if(block->size() != sizeof(Fastcgipp::Protocol::Header))
+            FAIL_LOG("SharedResponse header block is the wrong size")
+        const Fastcgipp::Protocol::Header& header
+            = *reinterpret_cast<const Fastcgipp::Protocol::Header*>(
+                    block->begin());
+        const Fastcgipp::Block& content = *(block+1);
+
+        if(header.version != Fastcgipp::Protocol::version
+                || header.type != Fastcgipp::Protocol::RecordType::OUT
+                || header.fcgiId != id)
+            FAIL_LOG("SharedResponse header isn't right")
+        if(header.contentLength == 0 || header.contentLength > 0xffff)
+            FAIL_LOG("SharedResponse record has a bad content length")
+        if(sizeof(header)+content.size() != Fastcgipp::Protocol::getRecordSize(
+                    header.contentLength))
+            FAIL_LOG("SharedResponse record isn't padded properly")
+        if(!block->slice() || !content.slice())
+            FAIL_LOG("SharedResponse blocks aren't slices")
+
+        contents.push_back(content.begin());
+        payload.append(content.begin(), header.contentLength);
+    }
+    return payload;
+}
+
+int main()
+{
+    std::mt19937 random(2026);
+    std::uniform_int_distribution<int> byteDist(0, 255);
+
+    for(const size_t size: {
+            size_t(0),
+            size_t(1),
+            size_t(0xfffe),
+            size_t(0xffff),
+            size_t(0x10000),
+            size_t(2*0xffff),
+            size_t(300000)})
+    {
+        std::string payload(size, 0);
+        for(auto& byte: payload)
+            byte = static_cast<char>(byteDist(random));
+
+        const Fastcgipp::SharedResponse response(payload.data(), size);
+        if(response.size() != size)
+            FAIL_LOG("SharedResponse has the wrong size")
+        if(response.records() != (size+0xfffe)/0xffff)
+            FAIL_LOG("SharedResponse has the wrong amount of records")
+
+        std::vector<const char*> first;
+        std::vector<const char*> second;
+        if(transmit(response, 1, first) != payload)
+            FAIL_LOG("SharedResponse mangled a payload of size " << size)
+        if(transmit(response, 0xfedc, second) != payload)
+            FAIL_LOG("SharedResponse mangled a payload of size " << size)
+        if(first != second)
+            FAIL_LOG("SharedResponse copied the payload")
+    }
+
+    return 0;
+}
@@ -10,6 +10,7 @@
 #include <thread>
 #include <string>
 #include <condition_variable>
+#include <cstdio>
 
 const unsigned int chunkSize=1024;
 const unsigned int tranCount=768;
@@ -204,6 +205,7 @@ void client()
 
 std::condition_variable cv;
 std::mutex cvMutex;
+bool listening=false;
 
 void server()
 {
@@ -216,9 +218,11 @@ void server()
     };
 
     Fastcgipp::SocketGroup group;
+    group.pollBatchSize(16);
     serverGroup = &group;
     if(!group.listen("127.0.0.1", port.c_str()))
         FAIL_LOG("Unable to listen")
+    listening=true;
     cv.notify_all();
     cvLock.unlock();
     std::map<Fastcgipp::Socket, Buffer> buffers;
@@ -313,6 +317,8 @@ void server()
 
     if(group.size())
         FAIL_LOG("Server has active sockets when it shouldn't")
+    if(group.pollWakeups() == 0 || group.pollEvents() < group.pollWakeups())
+        FAIL_LOG("Server poll counters don't add up")
 }
 
 #include "fastcgi++/config.hpp"
@@ -356,10 +362,133 @@ unsigned int openfds()
 }
 #endif
 
+//! Send data as several chunks with a single gather write
+void gatherWrite()
+{
+    const char name[] = "socketsgather.sock";
+    std::remove(name);
+
+    Fastcgipp::SocketGroup group;
+    if(!group.listen(name))
+        FAIL_LOG("Unable to listen for the gather write")
+    const Fastcgipp::Socket client = group.connect(name);
+    if(!client.valid())
+        FAIL_LOG("Unable to connect for the gather write")
+
+    std::vector<char> data(chunkSize*3);
+    std::mt19937 rd(seed);
+    std::uniform_int_distribution<> dist(-128, 127);
+    for(auto& byte: data)
+        byte = dist(rd);
+
+    const size_t sizes[] = {1, chunkSize, data.size()-chunkSize-1};
+    iovec chunks[3];
+    size_t offset = 0;
+    for(unsigned i=0; i<3; ++i)
+    {
+        chunks[i].iov_base = data.data()+offset;
+        chunks[i].iov_len = sizes[i];
+        offset += sizes[i];
+    }
+    if(client.write(chunks, 3) != ssize_t(data.size()))
+        FAIL_LOG("Gather write didn't send everything")
+
+    std::vector<char> received(data.size());
+    size_t size = 0;
+    while(size < received.size())
+    {
+        const Fastcgipp::Socket server = group.poll(true);
+        if(!server.valid() || server == client)
+            continue;
+        const ssize_t count = server.read(
+                received.data()+size,
+                received.size()-size);
+        if(count < 0)
+            FAIL_LOG("Unable to read the gather write")
+        size += count;
+    }
+    if(received != data)
+        FAIL_LOG("Gather write sent the wrong data")
+}
+
+//! Check that a file segment makes it through a socket intact
+void fileSegment()
+{
+    std::vector<char> contents(300000);
+    {
+        std::mt19937 random(seed);
+        std::uniform_int_distribution<int> byteDist(0, 255);
+        for(auto& byte: contents)
+            byte = static_cast<char>(byteDist(random));
+    }
+
+    char filePath[] = "/tmp/fastcgipp-sockets-XXXXXX";
+    const int file = mkstemp(filePath);
+    if(file < 0)
+        FAIL_LOG("Unable to create a temporary file")
+    unlink(filePath);
+    if(write(file, contents.data(), contents.size())
+            != static_cast<ssize_t>(contents.size()))
+        FAIL_LOG("Unable to write the temporary file")
+
+    const std::string path = "/tmp/fastcgipp-sockets-"
+        + std::to_string(getpid());
+    Fastcgipp::SocketGroup server;
+    Fastcgipp::SocketGroup client;
+    if(!server.listen(path.c_str()))
+        FAIL_LOG("Unable to listen on " << path.c_str())
+    const Fastcgipp::Socket receiving = client.connect(path.c_str());
+    if(!receiving.valid())
+        FAIL_LOG("Unable to connect to " << path.c_str())
+
+    // Server side sockets are the non-blocking ones so we send from there
+    char buffer[4096];
+    if(receiving.write("x", 1) != 1)
+        FAIL_LOG("Unable to write to the server")
+    Fastcgipp::Socket sending;
+    while(!sending.valid())
+        sending = server.poll(true);
+    if(sending.read(buffer, sizeof(buffer)) != 1)
+        FAIL_LOG("Unable to read from the client")
+
+    const off_t offset = 12345;
+    Fastcgipp::FileSegment segment(
+            file,
+            offset,
+            contents.size()-offset-1000,
+            true);
+    const size_t size = segment.size;
+    std::vector<char> received;
+
+    while(received.size() < size)
+    {
+        if(segment.size != 0 && sending.write(segment) < 0)
+            FAIL_LOG("Unable to write a file segment into a socket")
+
+        if(client.poll(false).valid())
+        {
+            const ssize_t read = receiving.read(buffer, sizeof(buffer));
+            if(read < 0)
+                FAIL_LOG("Socket closed while receiving a file segment")
+            received.insert(received.end(), buffer, buffer+read);
+        }
+    }
+
+    if(segment.size != 0 || segment.offset != offset+off_t(size))
+        FAIL_LOG("File segment wasn't advanced properly")
+    if(!std::equal(
+                received.begin(),
+                received.end(),
+                contents.begin()+offset))
+        FAIL_LOG("Received file segment doesn't match the file")
+}
+
 int main()
 {
     const auto initialFds = openfds();
 
+    fileSegment();
+
     {
         std::random_device trueRand;
         std::uniform_int_distribution<> portDist(2048, 65534);
@@ -370,11 +499,13 @@ int main()
     std::thread serverThread(server);
     {
         std::unique_lock<std::mutex> cvLock(cvMutex);
-        cv.wait(cvLock);
+        cv.wait(cvLock, [] { return listening; });
     }
     client();
     serverThread.join();
 
+    gatherWrite();
+
     if(openfds() != initialFds)
         FAIL_LOG("There are leftover file descriptors after they should all "\
                 "have been closed");
@@ -0,0 +1,98 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/taskqueue.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+const unsigned int producers = 4;
+const unsigned int consumers = 4;
+const unsigned int items = 100000;
+
+int main()
+{
+    // Single threaded ordering and overflow
+    {
+        Fastcgipp::TaskQueue<unsigned> queue(8);
+        if(!queue.empty())
+            FAIL_LOG("TaskQueue isn't empty on construction")
+
+        for(unsigned i=0; i<20; ++i)
+            queue.push(i);
+        if(queue.size() != 20)
+            FAIL_LOG("TaskQueue has the wrong size after pushing")
+        if(queue.overflows() != 12)
+            FAIL_LOG("TaskQueue didn't overflow when it should have")
+
+        unsigned item;
+        for(unsigned i=0; i<20; ++i)
+            if(!queue.pop(item) || item != i)
+                FAIL_LOG("TaskQueue gave us the wrong item")
+        if(queue.pop(item) || !queue.empty())
+            FAIL_LOG("TaskQueue isn't empty after popping everything")
+    }
+
+    // Multiple producers and consumers with parking
+    {
+        Fastcgipp::TaskQueue<unsigned> queue(64);
+        Fastcgipp::EventCount idle;
+        std::atomic_bool done(false);
+        std::atomic_ullong sum(0);
+        std::atomic_uint count(0);
+        std::vector<std::thread> threads;
+
+        for(unsigned i=0; i<consumers; ++i)
+            threads.emplace_back([&] ()
+            {
+                unsigned item;
+                while(true)
+                {
+                    if(queue.pop(item))
+                    {
+                        sum += item;
+                        ++count;
+                        continue;
+                    }
+                    const int key = idle.prepare();
+                    if(!queue.empty())
+                    {
+                        idle.cancel();
+                        continue;
+                    }
+                    if(done)
+                    {
+                        idle.cancel();
+                        break;
+                    }
+                    idle.wait(key);
+                }
+            });
+
+        std::vector<std::thread> producerThreads;
+        for(unsigned i=0; i<producers; ++i)
+            producerThreads.emplace_back([&] ()
+            {
+                for(unsigned item=1; item<=items; ++item)
+                {
+                    queue.push(item);
+                    idle.notify();
+                }
+            });
+        for(auto& thread: producerThreads)
+            thread.join();
+
+        done = true;
+        idle.notify(true);
+        for(auto& thread: threads)
+            thread.join();
+
+        if(count != producers*items)
+            FAIL_LOG("TaskQueue lost or duplicated items: " << count)
+        if(sum != producers*(static_cast<unsigned long long>(items)*(items+1)/2))
+            FAIL_LOG("TaskQueue items don't add up")
+        if(!queue.empty())
+            FAIL_LOG("TaskQueue isn't empty after consuming everything")
+    }
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/trace.hpp"
+
+#include <cstring>
+#include <thread>
+
+int main()
+{
+    typedef Fastcgipp::Trace Trace;
+    typedef Trace::Phase Phase;
+
+    unsigned finished = 0;
+    long long total = -2;
+    bool written = true;
+    const auto hook = std::make_shared<const Trace::Hook>(
+            [&] (const Trace& trace)
+            {
+                ++finished;
+                total = trace.elapsed(Phase::BEGIN, Phase::END);
+                written = trace.reached(Phase::WRITTEN);
+            });
+
+    // Phases are only marked once and time between them is measured
+    {
+        const auto begin = Trace::Clock::now();
+        std::shared_ptr<Trace> trace(new Trace(
+                    Fastcgipp::Protocol::RequestId(),
+                    begin,
+                    hook));
+        if(trace->time(Phase::BEGIN) != begin)
+            FAIL_LOG("Trace has the wrong BEGIN time")
+        if(trace->reached(Phase::PARAMS) || trace->reached(Phase::END))
+            FAIL_LOG("Trace reached a phase it shouldn't have")
+        if(trace->elapsed(Phase::BEGIN, Phase::PARAMS) != -1)
+            FAIL_LOG("Trace measured time to a phase it didn't reach")
+
+        trace->mark(Phase::PARAMS, begin+std::chrono::microseconds(10));
+        trace->mark(Phase::PARAMS, begin+std::chrono::microseconds(20));
+        if(trace->elapsed(Phase::BEGIN, Phase::PARAMS) != 10)
+            FAIL_LOG("Trace phase was marked more than once")
+        trace->mark(Phase::END, begin+std::chrono::microseconds(250));
+
+        // Whoever lets go last hands the trace to the hook
+        std::shared_ptr<Trace> record(trace);
+        trace.reset();
+        if(finished != 0)
+            FAIL_LOG("Trace finished while still in use")
+        std::thread([&record] () { record.reset(); }).join();
+        if(finished != 1)
+            FAIL_LOG("Trace didn't finish when let go of")
+        if(total != 250 || written)
+            FAIL_LOG("Trace hook got the wrong phases")
+    }
+
+    // Phase names
+    if(std::strcmp(Trace::name(Phase::BEGIN), "begin") != 0
+            || std::strcmp(Trace::name(Phase::WRITTEN), "written") != 0)
+        FAIL_LOG("Trace phase names are wrong")
+
+    // Traces without a hook and hooks that throw
+    {
+        Trace quiet(
+                Fastcgipp::Protocol::RequestId(),
+                Trace::Clock::now(),
+                std::shared_ptr<const Trace::Hook>());
+        Trace throwing(
+                Fastcgipp::Protocol::RequestId(),
+                Trace::Clock::now(),
+                std::make_shared<const Trace::Hook>([] (const Trace&)
+                {
+                    throw 1;
+                }));
+    }
+
+    return 0;
+}
@@ -372,6 +372,9 @@ int main()
     std::uniform_int_distribution<> portDist(2048, 65534);
     port = std::to_string(portDist(trueRand));
 
+    transceiver.resizeReactors(3);
+    if(transceiver.reactors() != 3)
+        FAIL_LOG("Unable to resize the transceiver reactors")
     if(!transceiver.listen("127.0.0.1", port.c_str()))
         FAIL_LOG("Unable to listen")
     transceiver.start();
@@ -0,0 +1,204 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/utf8.hpp"
+
+#include <codecvt>
+#include <locale>
+#include <random>
+#include <string>
+
+//! The way encoding is supposed to come out
+std::string reference(const std::wstring& input)
+{
+    std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+    std::wstring valid(input);
+    for(auto& character: valid)
+        if(static_cast<uint32_t>(character) > 0x10ffff
+                || (character >= 0xd800 && character < 0xe000))
+            character = Fastcgipp::Utf8::replacement;
+    return converter.to_bytes(valid);
+}
+
+//! Encode into an output buffer of a certain size at a time
+std::string encode(const std::wstring& input, size_t chunkSize)
+{
+    std::string output;
+    std::string chunk(chunkSize, 0);
+    const wchar_t* from = input.data();
+    const wchar_t* const fromEnd = input.data()+input.size();
+
+    while(from != fromEnd)
+    {
+        char* to;
+        Fastcgipp::Utf8::encode(
+                from,
+                fromEnd,
+                from,
+                &chunk[0],
+                &chunk[0]+chunk.size(),
+                to);
+        if(to == &chunk[0])
+            FAIL_LOG("Fastcgipp::Utf8::encode() made no progress")
+        output.append(&chunk[0], to);
+    }
+    return output;
+}
+
+//! Decode all of it at once
+std::wstring decode(
+        const std::string& input,
+        wchar_t replacement=Fastcgipp::Utf8::replacement)
+{
+    std::wstring output(input.size(), 0);
+    output.resize(Fastcgipp::Utf8::decode(
+                input.data(),
+                input.data()+input.size(),
+                &output[0],
+                replacement) - output.data());
+    return output;
+}
+
+int main()
+{
+    // Encoding
+    {
+        std::mt19937 random(2026);
+        std::uniform_int_distribution<int> kindDist(0, 9);
+        std::uniform_int_distribution<int> asciiDist(0x01, 0x7f);
+        std::uniform_int_distribution<int> twoDist(0x80, 0x7ff);
+        std::uniform_int_distribution<int> threeDist(0x800, 0xffff);
+        std::uniform_int_distribution<int> fourDist(0x10000, 0x10ffff);
+        std::uniform_int_distribution<int> invalidDist(0xd800, 0xdfff);
+
+        for(int mix=0; mix<4; ++mix)
+        {
+            std::wstring input;
+            for(int i=0; i<5000; ++i)
+            {
+                const int kind = kindDist(random);
+                if(mix == 0 || kind < 10-mix*3)
+                    input.push_back(asciiDist(random));
+                else if(kind == 7)
+                    input.push_back(twoDist(random));
+                else if(kind == 8)
+                    input.push_back(threeDist(random));
+                else if(kind == 9)
+                    input.push_back(i%2 ? fourDist(random) : 0x110000+i);
+                else
+                    input.push_back(i%3 ? invalidDist(random) : 0x4f60);
+            }
+
+            const std::string expected = reference(input);
+            if(Fastcgipp::Utf8::length(
+                        input.data(),
+                        input.data()+input.size()) != expected.size())
+                FAIL_LOG("Fastcgipp::Utf8::length() is wrong with mix "\
+                        << mix)
+            for(const size_t chunkSize: {
+                    size_t(4),
+                    size_t(5),
+                    size_t(17),
+                    size_t(100),
+                    size_t(0x10000)})
+                if(encode(input, chunkSize) != expected)
+                    FAIL_LOG("Fastcgipp::Utf8::encode() is wrong with mix "\
+                            << mix << " and chunks of " << chunkSize)
+        }
+    }
+
+    // Decoding valid input
+    {
+        std::mt19937 random(2026);
+        std::uniform_int_distribution<int> kindDist(0, 9);
+        std::uniform_int_distribution<int> asciiDist(0x00, 0x7f);
+        std::uniform_int_distribution<int> twoDist(0x80, 0x7ff);
+        std::uniform_int_distribution<int> threeDist(0xe000, 0xffff);
+        std::uniform_int_distribution<int> fourDist(0x10000, 0x10ffff);
+
+        for(int mix=0; mix<4; ++mix)
+        {
+            std::wstring expected;
+            for(int i=0; i<5000; ++i)
+            {
+                const int kind = kindDist(random);
+                if(mix == 0 || kind < 10-mix*3)
+                    expected.push_back(asciiDist(random));
+                else if(kind == 7)
+                    expected.push_back(twoDist(random));
+                else if(kind == 8)
+                    expected.push_back(threeDist(random));
+                else
+                    expected.push_back(fourDist(random));
+            }
+
+            const std::string input = reference(expected);
+            for(size_t offset=0; offset<20; ++offset)
+            {
+                const std::string part(input, offset);
+                std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+                if(offset == 0 && decode(part) != expected)
+                    FAIL_LOG("Fastcgipp::Utf8::decode() is wrong with mix "\
+                            << mix)
+                if(offset != 0 && mix == 0
+                        && decode(part) != converter.from_bytes(part))
+                    FAIL_LOG("Fastcgipp::Utf8::decode() is wrong with mix "\
+                            << mix << " at offset " << offset)
+            }
+        }
+    }
+
+    // Decoding malformed input
+    {
+        const std::wstring r(1, Fastcgipp::Utf8::replacement);
+        const struct
+        {
+            std::string input;
+            std::wstring expected;
+        } cases[] =
+        {
+            {"\x80", r},
+            {"\xbf\x80", r+r},
+            {"\xc0\xaf", r+r},
+            {"\xc1\xbf", r+r},
+            {"\xe0\x80\xaf", r+r+r},
+            {"\xf0\x80\x80\xaf", r+r+r+r},
+            {"\xed\xa0\x80", r+r+r},
+            {"\xf4\x90\x80\x80", r+r+r+r},
+            {"\xf5\x80\x80\x80", r+r+r+r},
+            {"\xfe\xff", r+r},
+            {"\xe4\xbd", r},
+            {"a\xe4\xbd" "b", L"a"+r+L"b"},
+            {"\xf0\x9f\x98x", r+L"x"},
+            {"\xf0\x9f\x98\x80", std::wstring(1, 0x1f600)},
+            {"\xc3\xa9\xc3", L"\u00e9"+r},
+            {"\xed\x9f\xbf\xee\x80\x80", L"\ud7ff\ue000"},
+            {std::string(20, 'a')+"\x80"+std::string(20, 'b'),
+                std::wstring(20, 'a')+r+std::wstring(20, 'b')},
+        };
+
+        for(const auto& test: cases)
+        {
+            if(decode(test.input) != test.expected)
+                FAIL_LOG("Fastcgipp::Utf8::decode() is wrong with malformed "\
+                        "input of size " << test.input.size())
+
+            std::wstring dropped;
+            std::wstring questioned;
+            for(const wchar_t character: test.expected)
+            {
+                if(character != Fastcgipp::Utf8::replacement)
+                    dropped.push_back(character);
+                questioned.push_back(
+                        character == Fastcgipp::Utf8::replacement ?
+                            L'?' : character);
+            }
+            if(decode(test.input, 0) != dropped)
+                FAIL_LOG("Fastcgipp::Utf8::decode() doesn't drop malformed "\
+                        "input of size " << test.input.size())
+            if(decode(test.input, L'?') != questioned)
+                FAIL_LOG("Fastcgipp::Utf8::decode() doesn't replace "\
+                        "malformed input of size " << test.input.size())
+        }
+    }
+
+    return 0;
+}